@@ -209,6 +209,20 @@ extern const uint32_t CFG_UART_DEFAULT_BAUD;
 extern const uint32_t CFG_UART_AUTODETECT_MIN_BAUD;
 extern const uint32_t CFG_UART_AUTODETECT_MAX_BAUD;
 
+// Bulk dumps/verifies raise the U-Boot console to the fastest rate <= this
+// that passes an echo probe, then return to the original (0 = off)
+#ifndef CFG_UART_TURBO_BAUD
+  #define CFG_UART_TURBO_BAUD 1500000UL
+#endif
+// Target UART RX ring: ~50 ms of data at 1.5 Mbaud so WiFi stalls don't drop md lines
+#ifndef CFG_UART_RX_BUFFER_BYTES
+  #define CFG_UART_RX_BUFFER_BYTES 8192
+#endif
+// Target UART TX ring: a whole YMODEM-1K packet queues without blocking loop()
+#ifndef CFG_UART_TX_BUFFER_BYTES
+  #define CFG_UART_TX_BUFFER_BYTES 2048
+#endif
+
 #ifndef UART_AUTODETECT_SAMPLE_MS
   #define UART_AUTODETECT_SAMPLE_MS 700
 #endif
@@ -237,6 +251,9 @@ extern const char*  CFG_PATH_ENV_DIR;
 
 extern const char*  CFG_PATH_BACKUP_FILE;
 extern const char*  CFG_PATH_FW_FILE;
+extern const char*  CFG_PATH_SCAN_FILE;
+extern const char*  CFG_PATH_SCAN_PREV_FILE;
+extern const char*  CFG_PATH_BACKUP_CKPT_FILE;
 
 extern const size_t CFG_IO_CHUNK_BYTES;
 
@@ -244,6 +261,18 @@ extern const size_t CFG_IO_CHUNK_BYTES;
   #define CFG_SD_SPI_HZ 16000000UL
 #endif
 
+// Backup kept in flash when there is no SD card (data partition label in Custom.csv)
+#ifndef CFG_FLASH_BACKUP_PARTITION
+  #define CFG_FLASH_BACKUP_PARTITION "k2bak"
+#endif
+// host builds: file standing in for that partition, and its size
+#ifndef CFG_FLASH_BACKUP_HOST_IMAGE
+  #define CFG_FLASH_BACKUP_HOST_IMAGE "k2bak_partition.bin"
+#endif
+#ifndef CFG_FLASH_BACKUP_HOST_BYTES
+  #define CFG_FLASH_BACKUP_HOST_BYTES 0x180000UL
+#endif
+
 // ============================================================
 // 8B) SD Restore Bundle (K2_restore on SD card)
 // ============================================================
@@ -285,6 +314,38 @@ extern const char* CFG_RESTORE_PAYLOAD_DIR;
 #ifndef CFG_K2BAK_VERSION_V2
   #define CFG_K2BAK_VERSION_V2 2
 #endif
+#ifndef CFG_K2BAK_VERSION_V3
+  #define CFG_K2BAK_VERSION_V3 3
+#endif
+// v3 writer: largest payload chunk in the index (2 MiB -> 32 KiB of index per 2 GiB)
+#ifndef CFG_K2BAK_CHUNK_BLOCKS
+  #define CFG_K2BAK_CHUNK_BLOCKS 0x1000UL
+#endif
+// v3 writer: LZ4-compress payload chunks (those that don't shrink stay raw)
+#ifndef CFG_K2BAK_COMPRESS
+  #define CFG_K2BAK_COMPRESS 1
+#endif
+// compressed chunks are cut into independent frames of this many blocks
+// (16 KiB: writer needs ~40 KiB of heap, a reader ~32 KiB)
+#ifndef CFG_K2BAK_LZ_FRAME_BLOCKS
+  #define CFG_K2BAK_LZ_FRAME_BLOCKS 32UL
+#endif
+// whole-file CRC/SHA over an in-RAM file yield() after this many bytes
+#ifndef CFG_K2BAK_HASH_YIELD_BYTES
+  #define CFG_K2BAK_HASH_YIELD_BYTES (64UL * 1024UL)
+#endif
+// .k2bak read from SD (K2Bak::FileReader): LRU cache of aligned file blocks
+// for the small reads (frame headers, verify slices); larger reads bypass it
+#ifndef CFG_K2BAK_READ_CACHE_SLOTS
+  #define CFG_K2BAK_READ_CACHE_SLOTS 4
+#endif
+#ifndef CFG_K2BAK_READ_CACHE_BYTES
+  #define CFG_K2BAK_READ_CACHE_BYTES 4096UL
+#endif
+// Crc32::update(): 0 = slicing-by-8 tables, 1 = ESP32 ROM crc32_le
+#ifndef CFG_CRC32_USE_ROM
+  #define CFG_CRC32_USE_ROM 0
+#endif
 
 extern const uint32_t CFG_BACKUP_MAX_SECTIONS;
 extern const size_t   CFG_BACKUP_SECTION_NAME_MAX;
@@ -295,11 +356,144 @@ extern const size_t   CFG_BACKUP_SECTION_NAME_MAX;
 #ifndef CFG_BACKUP_DEFAULT_BLOCKS_PER_CHUNK
   #define CFG_BACKUP_DEFAULT_BLOCKS_PER_CHUNK 64UL
 #endif
+// UART dump: chunk (md slice) size adapts between these, aiming for about
+// CFG_BACKUP_SLICE_TARGET_MS of md output per chunk
+#ifndef CFG_BACKUP_MIN_BLOCKS_PER_CHUNK
+  #define CFG_BACKUP_MIN_BLOCKS_PER_CHUNK 8UL
+#endif
+#ifndef CFG_BACKUP_MAX_BLOCKS_PER_CHUNK
+  #define CFG_BACKUP_MAX_BLOCKS_PER_CHUNK 128UL
+#endif
+#ifndef CFG_BACKUP_SLICE_TARGET_MS
+  #define CFG_BACKUP_SLICE_TARGET_MS 1500UL
+#endif
+// UART dump: blocks staged at ${loadaddr} per mmc read. Capped by the room
+// bdinfo reports below U-Boot's stack; the fallback is used when it reports none.
+#ifndef CFG_BACKUP_WINDOW_MAX_BLOCKS
+  #define CFG_BACKUP_WINDOW_MAX_BLOCKS 0x8000UL
+#endif
+#ifndef CFG_BACKUP_WINDOW_FALLBACK_BLOCKS
+  #define CFG_BACKUP_WINDOW_FALLBACK_BLOCKS 0x2000UL
+#endif
+// Verify via U-Boot `crc32`: blocks per mmc read (must fit in RAM at ${loadaddr})
+#ifndef CFG_VERIFY_CRC_BLOCKS_PER_CHUNK
+  #define CFG_VERIFY_CRC_BLOCKS_PER_CHUNK 0x2000UL
+#endif
+// Streaming .k2bak: bytes re-read per tick() while computing CRC/SHA at the end
+#ifndef CFG_BACKUP_SEAL_BYTES_PER_TICK
+  #define CFG_BACKUP_SEAL_BYTES_PER_TICK (32UL * 1024UL)
+#endif
+// SD backup checkpoint (!backup resume): at most one per interval, taken
+// at the next chunk boundary
+#ifndef CFG_BACKUP_CHECKPOINT_MS
+  #define CFG_BACKUP_CHECKPOINT_MS 30000UL
+#endif
+// Pre-flight estimate before any dump has been measured: wire chars per
+// byte (x10) of md.b and of base64(gzip), and the fixed cost of a chunk
+// (prompts, mmc read, crc32). A job's rate model is only kept once it has
+// this many chunks.
+#ifndef CFG_JOB_RATE_WIRE_CHARS_X10
+  #define CFG_JOB_RATE_WIRE_CHARS_X10 36UL
+#endif
+#ifndef CFG_JOB_RATE_LINUX_CHARS_X10
+  #define CFG_JOB_RATE_LINUX_CHARS_X10 14UL
+#endif
+#ifndef CFG_JOB_RATE_CHUNK_OVERHEAD_MS
+  #define CFG_JOB_RATE_CHUNK_OVERHEAD_MS 250UL
+#endif
+#ifndef CFG_JOB_RATE_MIN_CHUNKS
+  #define CFG_JOB_RATE_MIN_CHUNKS 8UL
+#endif
+// Fingerprint scan (!backup scan): blocks per crc32. One .k2bak index
+// chunk, so a diff against a backup can mostly use the stored CRCs.
+#ifndef CFG_BACKUP_SCAN_CHUNK_BLOCKS
+  #define CFG_BACKUP_SCAN_CHUNK_BLOCKS CFG_K2BAK_CHUNK_BLOCKS
+#endif
+// Scan diff: backup bytes CRC'd per tick() where no stored CRC fits, and
+// changed spans listed in the report
+#ifndef CFG_BACKUP_SCAN_DIFF_BYTES_PER_TICK
+  #define CFG_BACKUP_SCAN_DIFF_BYTES_PER_TICK (64UL * 1024UL)
+#endif
+#ifndef CFG_BACKUP_SCAN_DIFF_SPANS
+  #define CFG_BACKUP_SCAN_DIFF_SPANS 8
+#endif
+// Restore from the SD .k2bak: bytes checked per tick() (file CRC/SHA, then chunk CRCs)
+#ifndef CFG_RESTORE_CHECK_BYTES_PER_TICK
+  #define CFG_RESTORE_CHECK_BYTES_PER_TICK (32UL * 1024UL)
+#endif
+// Restore write: blocks per `loady` + mmc write (must fit in RAM at ${loadaddr})
+#ifndef CFG_RESTORE_WRITE_BLOCKS_PER_CHUNK
+  #define CFG_RESTORE_WRITE_BLOCKS_PER_CHUNK 0x2000UL
+#endif
+// Restore write: tries per chunk (YMODEM abort, mmc write error, read-back crc32 mismatch)
+#ifndef CFG_RESTORE_WRITE_MAX_TRIES
+  #define CFG_RESTORE_WRITE_MAX_TRIES 3
+#endif
+// Restore write: fingerprint the device first (mmc read + crc32 per
+// CFG_RESTORE_DIFF_BLOCKS) and only send the units that differ from the file
+#ifndef CFG_RESTORE_WRITE_DIFF
+  #define CFG_RESTORE_WRITE_DIFF 1
+#endif
+#ifndef CFG_RESTORE_DIFF_BLOCKS
+  #define CFG_RESTORE_DIFF_BLOCKS 0x800UL
+#endif
+// YMODEM sender: payload bytes per staging read, two buffers (multiple of 1024)
+#ifndef CFG_YMODEM_STAGE_BYTES
+  #define CFG_YMODEM_STAGE_BYTES (8UL * 1024UL)
+#endif
+// Linux shell dump (!backup start linux): blocks per gzip member, and
+// members per shell command line
+#ifndef CFG_LINUX_DUMP_BLOCKS_PER_CHUNK
+  #define CFG_LINUX_DUMP_BLOCKS_PER_CHUNK 128UL
+#endif
+#ifndef CFG_LINUX_DUMP_CHUNKS_PER_BATCH
+  #define CFG_LINUX_DUMP_CHUNKS_PER_BATCH 16UL
+#endif
+// Linux shell dump: device for profile ranges, and where named partitions
+// live when no restore manifest gives target.by_name_base
+#ifndef CFG_LINUX_DUMP_DEVICE
+  #define CFG_LINUX_DUMP_DEVICE "/dev/mmcblk0"
+#endif
+#ifndef CFG_LINUX_BY_NAME_BASE
+  #define CFG_LINUX_BY_NAME_BASE "/dev/by-name/"
+#endif
+// UART dump: ask U-Boot for each chunk's crc32 first and record all-0x00 /
+// all-0xFF chunks as fill runs instead of md.b'ing them
+#ifndef CFG_BACKUP_SKIP_FILL_CHUNKS
+  #define CFG_BACKUP_SKIP_FILL_CHUNKS 1
+#endif
+// UART dump: re-reads allowed per chunk (short md.b, CRC mismatch, stall)
+#ifndef CFG_BACKUP_CHUNK_MAX_RETRIES
+  #define CFG_BACKUP_CHUNK_MAX_RETRIES 4
+#endif
+// UART dump: small md re-fetches of lost lines per chunk before a full re-read
+#ifndef CFG_BACKUP_CHUNK_MAX_REFETCH
+  #define CFG_BACKUP_CHUNK_MAX_REFETCH 8
+#endif
+// ZMODEM (!zm): bytes sent past the receiver's last ZACK
+#ifndef CFG_ZMODEM_WINDOW_BYTES
+  #define CFG_ZMODEM_WINDOW_BYTES (32UL * 1024UL)
+#endif
+// ZMODEM receive: largest data subpacket accepted (sz -8 sends 8K)
+#ifndef CFG_ZMODEM_MAX_SUBPACKET
+  #define CFG_ZMODEM_MAX_SUBPACKET (8UL * 1024UL)
+#endif
+// ZMODEM receive: SD directory for files from sz
+#ifndef CFG_ZMODEM_RX_DIR
+  #define CFG_ZMODEM_RX_DIR "/rx"
+#endif
+// ZMODEM: start receiving when sz starts in the console on its own
+#ifndef CFG_ZMODEM_AUTOSTART
+  #define CFG_ZMODEM_AUTOSTART 1
+#endif
 
 extern const char* CFG_PREF_NS_BACKUP;
 extern const char* CFG_PREF_KEY_PROFILE;
 extern const char* CFG_PREF_KEY_CSTART;
 extern const char* CFG_PREF_KEY_CCOUNT;
+extern const char* CFG_PREF_KEY_RATE_UBOOT;   // JobRate::Model of the last U-Boot dump
+extern const char* CFG_PREF_KEY_RATE_LINUX;   // ... of the last Linux shell dump
+extern const char* CFG_PREF_KEY_SKIP_PREFIX;  // + profile id: share not transferred
 
 // ============================================================
 // 10) Web UI / Pages
@@ -416,6 +610,15 @@ extern const size_t CFG_UBOOT_HEX_MAX_BYTES_PER_LINE;
   #define CFG_SG_BLOCK_RESTORE_VERIFY 1
 #endif
 
+// ---- ZMODEM ----
+// send writes files on the target; recv only reads them
+#ifndef CFG_SG_BLOCK_ZM_SEND
+  #define CFG_SG_BLOCK_ZM_SEND 1
+#endif
+#ifndef CFG_SG_BLOCK_ZM_RECV
+  #define CFG_SG_BLOCK_ZM_RECV 0
+#endif
+
 // ---- SD deletes ----
 #ifndef CFG_SG_BLOCK_SD_RM
   #define CFG_SG_BLOCK_SD_RM 1
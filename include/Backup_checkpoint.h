@@ -0,0 +1,56 @@
+#pragma once
+#include "Debug.h"
+#include <Arduino.h>
+#include <vector>
+
+#include "AppConfig.h"
+#include "K2bak.h"
+
+// Where an SD backup stood at its last checkpoint (!backup resume): the
+// planned ranges with their progress, the run's counters and the .k2bak
+// writer's state. Saved as CFG_PATH_BACKUP_CKPT_FILE, next to the temp
+// file, at a chunk boundary after the temp file has been flushed; written
+// to "<path>.tmp" first and renamed over the old one.
+//
+// The file ends with its own CRC-32. tailCrc covers the last TAIL_BYTES of
+// payload it vouches for, so a card that dropped writes is caught before
+// anything is appended behind them.
+namespace BackupCheckpoint {
+
+static constexpr size_t TAIL_BYTES = 4096;
+
+struct Range {
+  uint32_t lba_start = 0;
+  uint32_t lba_count = 0;
+  uint32_t done_blocks = 0;
+  String dev;                 // Linux mode: block device read
+  uint32_t dev_lba = 0;
+};
+
+struct Data {
+  bool linuxShell = false;    // dumped with dd | gzip | base64
+  bool incremental = false;   // the SD backup is the baseline
+  String boardId;
+  uint32_t rangeIdx = 0;
+  uint32_t blocksPerChunk = 0;
+  uint64_t plannedBytes = 0;
+  uint64_t skippedBytes = 0;
+  uint64_t reusedBytes = 0;
+  uint32_t tailCrc = 0;
+  std::vector<Range> ranges;
+  K2Bak::StreamState writer;
+};
+
+bool save(const Data& d, String* err);
+bool load(Data& d, String* err);
+bool exists();
+void remove();
+
+// CRC-32 of the last TAIL_BYTES (at most) of [payloadOff, size) as the
+// sink holds them.
+bool tailCrc(K2Bak::Sink& sink, uint64_t payloadOff, uint64_t size, uint32_t& out);
+
+// "lba 0x... of ..., N%" for status lines.
+String describe(const Data& d);
+
+} // namespace BackupCheckpoint
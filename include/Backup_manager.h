@@ -1,16 +1,68 @@
 #pragma once
 #include <Arduino.h>
 #include <Preferences.h>
+#include <memory>
 #include <vector>
 
 #include "AppConfig.h"
 #include "Debug.h"
 #include "Backup_profiles.h"
 #include "K2bak.h"
+#include "SdCache.h"
+#include "FlashBackup.h"
+#include "Uboot_baud.h"
+#include "Uboot_bdinfo.h"
+#include "Uboot_chain.h"
 #include "Uboot_hex_parser.h"
+#include "Uboot_md_probe.h"
+#include "Linux_dump_reply.h"
+#include "Gpt.h"
+#include "Scan_map.h"
+#include "Backup_checkpoint.h"
+#include "Job_rate.h"
 
-// Task D: UART raw block dump (U-Boot mmc read + md.b) into .k2bak payload.
-// NOTE: This remains RAM-backed; FULL profile is intentionally blocked.
+// Task D: UART raw block dump (U-Boot mmc read + md.b/w/l/q) into .k2bak payload.
+// With an SD card mounted the .k2bak is streamed chunk-by-chunk to SD (no
+// size cap, FULL allowed). Without SD it goes to the flash partition
+// (FlashBackup) when the table has one, else to a RAM file; both are capped
+// at CFG_BACKUP_MAX_BYTES, and FULL stays blocked.
+// Before each md.b the chunk's U-Boot crc32 is compared with that of an
+// all-0x00 / all-0xFF chunk; matches are recorded as fill runs, not dumped.
+// The same CRC checks the decoded md bytes. Lines lost from the md output
+// show up as address gaps and are re-fetched with a small md; a chunk that
+// still fails (CRC mismatch, stall, too many gaps) is dumped again, up to
+// CFG_BACKUP_CHUNK_MAX_RETRIES times.
+// mmc read, crc32 and (unless the previous chunk was a fill run) md go out
+// as one ';' line, so a data chunk costs a single prompt round-trip.
+// Once the numeric ${loadaddr} is known, one mmc read stages a window of up
+// to CFG_BACKUP_WINDOW_MAX_BLOCKS (bounded by bdinfo) and the chunks are
+// crc32/md slices of it. The chunk size follows the measured md rate and
+// halves after lost lines or re-reads.
+// Incremental mode takes the backup cached on SD as baseline: every chunk
+// is crc32'd first, and chunks whose CRC matches the baseline's bytes for
+// the same blocks are copied from the baseline instead of dumped. The
+// result is a complete .k2bak (SD keeps one backup, so a delta file would
+// outlive its baseline).
+// Raw dumps run with the console raised to CFG_UART_TURBO_BAUD (when the
+// target accepts it) and return to the original baud afterwards.
+// Linux mode (startLinux) runs when the target sits at a shell instead:
+// batches of `dd | gzip -1 | base64` are inflated on the ESP and checked
+// against the gzip trailer's CRC-32 before they are committed, so sparse
+// and text-heavy partitions cost a fraction of md's hex. Partitions can be
+// named; they are looked up under /dev/by-name and read through it.
+// GPT mode (startGpt) dumps LBA 0-33 first, parses the partition table from
+// it and then dumps the partitions picked by name; their ranges are merged
+// where they touch or overlap. LBA 0-33 stays in the backup.
+// Scan mode (startScan) sends only mmc read + crc32 per chunk and writes a
+// ScanMap to SD; startScanDiff compares that map with the SD backup or with
+// the scan before it.
+// An SD backup saves a BackupCheckpoint every CFG_BACKUP_CHECKPOINT_MS at a
+// chunk boundary. When it stops on an error or a cancel after that, the
+// temp file is kept, and startResume() picks it up again at the
+// checkpoint, also after an ESP reboot or a target power cycle.
+// Every job measures its own throughput (JobRate): the status line shows
+// rate, cost per chunk, re-reads and ETA, and a dump that gets far enough
+// leaves its figures in Preferences for the next pre-flight estimate.
 class BackupManager {
 public:
   void begin(HardwareSerial* target, Preferences* prefs);
@@ -23,6 +75,24 @@ public:
 
   // start/stop
   bool start(bool uartRawDump = true); // default raw dump; if false -> env+meta only
+  bool startIncremental();             // raw dump against the cached SD backup
+  // Raw dump from a Linux shell. parts: partition names (comma or space
+  // separated) under byNameBase, or empty for the profile's ranges of
+  // CFG_LINUX_DUMP_DEVICE.
+  bool startLinux(const String& parts, const String& byNameBase);
+  // Raw dump of GPT partitions by name (comma or space separated). Empty:
+  // only read the table for gptList(); nothing is stored.
+  bool startGpt(const String& parts);
+  // Fingerprint of the profile's ranges: crc32 per CFG_BACKUP_SCAN_CHUNK_BLOCKS
+  // into CFG_PATH_SCAN_FILE, no data transferred.
+  bool startScan();
+  // Last scan vs the SD backup (true) or vs the scan before it (false).
+  bool startScanDiff(bool againstBackup);
+  // Continues the interrupted SD backup from its checkpoint.
+  bool startResume();
+  // Drops the interrupted SD backup and its checkpoint. New SD dumps refuse
+  // to start while one is there.
+  bool discardPartial();
   bool running() const { return _running; }
   void cancel();
 
@@ -32,14 +102,25 @@ public:
 
   // status
   float progress() const { return _progress; }
-  String statusLine() const { return _status; }
+  String statusLine() const;
+  uint32_t retries() const { return _retries; }
 
   // output
-  bool getLastBackup(std::vector<uint8_t>& out) const;
+  bool getLastBackup(std::vector<uint8_t>& out) const; // RAM fallback only
+  bool lastBackupOnSd() const { return _lastOnSd; }
+  bool lastBackupInFlash() const { return _lastInFlash; }
 
   // estimates / limits
   uint64_t plannedBytes() const { return _plannedBytes; }
-  uint32_t plannedSecondsAt(uint32_t baud) const; // conservative estimate
+  uint64_t skippedBytes() const { return _skippedBytes; } // recorded as fill runs
+  uint64_t reusedBytes() const { return _reusedBytes; }   // copied from the baseline
+  uint32_t plannedSecondsAt(uint32_t baud) const; // planned ranges, from the learned rate
+  // Pre-flight estimate for a profile's ranges ("~12m30s at 921600 baud,
+  // from the last dump"), at the baud the last dump ran at.
+  String estimateText(const String& profileId, bool linuxShell = false) const;
+
+  // partition table from the last GPT read
+  const GptTable& gpt() const { return _gpt; }
 
 private:
   HardwareSerial* _t = nullptr;
@@ -56,6 +137,17 @@ private:
 
   // output
   std::vector<uint8_t> _lastBackup;
+  bool _lastOnSd = false;
+  bool _lastInFlash = false;
+
+  // streaming .k2bak output (SD file, else flash partition, else RAM vector)
+  bool _toSd = false;
+  bool _toFlash = false;
+  bool _flashOpened = false;   // this run overwrites the stored flash backup
+  File _outFile;
+  std::vector<uint8_t> _memFile;
+  std::unique_ptr<K2Bak::Sink> _sink;
+  K2Bak::StreamWriter _writer;
 
   // ---- UART sniff / prompt detect ----
   uint8_t _last1 = 0, _last2 = 0;
@@ -70,21 +162,103 @@ private:
     uint32_t lba_start = 0;
     uint32_t lba_count = 0;
     uint32_t done_blocks = 0;
-    std::vector<uint8_t> data; // holds full range data (within CFG_BACKUP_MAX_BYTES)
+    String dev;               // Linux mode: block device read; empty = CFG_LINUX_DUMP_DEVICE
+    uint32_t dev_lba = 0;     // its first lba (dd skip is relative to it)
   };
 
   std::vector<RangePlan> _ranges;
   uint32_t _rangeIdx = 0;
 
-  uint32_t _blocksPerChunk = CFG_BACKUP_DEFAULT_BLOCKS_PER_CHUNK;
+  uint32_t _blocksPerChunk = CFG_BACKUP_DEFAULT_BLOCKS_PER_CHUNK; // adaptive
   uint32_t _currentChunkBlocks = 0;
   size_t   _currentChunkBytes = 0;
   size_t   _currentChunkGot = 0;
+  std::vector<uint8_t> _chunkBuf; // one chunk; md output is decoded straight into it
+
+  // blocks staged in target RAM at ${loadaddr} by the last mmc read
+  UBootRamInfo _ram;
+  uint32_t _windowBlocks = 0;     // 0 = no staging, one mmc read per chunk
+  uint32_t _winLba = 0;
+  uint32_t _winCount = 0;
+  bool _winValid = false;
+  uint32_t _mdStartMs = 0;
+  uint32_t _chunkStartMs = 0;     // the chunk's first command (or its retry)
+  JobRate _jobRate;               // md rate, per-chunk overhead, re-reads
+  bool _rateKept = false;         // this run's model is in Preferences
+
+  UBootHexParser _hex;            // CRC of the decoded chunk is fused in
+  UBootMdProbe _mdProbe;        // picks md.b/w/l/q once per run
+  UBootBaudTurbo _turbo;
+  uint64_t _loadAddr = UBootHexParser::BASE_FROM_FIRST_LINE; // numeric ${loadaddr}
 
-  UBootHexParser _hex;
-  std::vector<uint8_t> _hexOut;
+  // per-chunk U-Boot crc32 (fill probe + md.b check)
+  UBootChainReply _chain;       // splits "mmc read; crc32; md" output
+  K2Bak::FillCrcCache _fillCrc;
+  bool _ubootCrc = true;        // cleared when U-Boot lacks the crc32 command
+  bool _haveChunkCrc = false;
+  uint32_t _chunkCrc = 0;
+  int16_t _chainFill = -1;      // fill byte decided from the chain's crc32, -1 = data
+  bool _lastChunkFill = false;  // fill runs cluster, so don't chain md after one
+  bool _rereadChunk = false;    // retry starts over at mmc read
+  uint32_t _cmdPromptMark = 0;
+  uint32_t _lastRxMs = 0;
+
+  // re-reads
+  uint8_t _chunkTries = 0;
+  uint8_t _refetches = 0;       // gap re-fetches for the current chunk
+  uint32_t _retries = 0;
+  uint32_t _refetchTotal = 0;
 
   uint64_t _plannedBytes = 0;
+  uint64_t _skippedBytes = 0;
+  uint64_t _reusedBytes = 0;
+
+  // incremental: previous backup on SD
+  bool _incremental = false;
+  File _baseFile;
+  K2Bak::FileReader _base;
+  bool _chainReuse = false;     // chunk matched the baseline; _chunkBuf holds its bytes
+
+  // Linux shell mode
+  bool _linux = false;
+  String _lxParts;              // partition names, space separated
+  String _lxByNameBase;
+  std::vector<RangePlan> _lxPartRanges;  // resolved partitions, by lba
+  LinuxDumpReply _lx;
+  uint32_t _lxTag = 0;          // numbers the K2DONE marker of each command
+  uint32_t _lxLeft = 0;         // members the running batch still owes
+  bool _lxDone = false;         // K2DONE of the running command seen
+
+  // GPT mode: range 0 is LBA 0-33, the named partitions follow once parsed
+  bool _gptWant = false;
+  bool _gptListOnly = false;
+  String _gptParts;             // partition names, as given
+  std::vector<uint8_t> _gptHead;
+  GptTable _gpt;
+
+  // scan mode: a crc32 per chunk goes to the map, nothing else is kept
+  bool _scan = false;
+  ScanMap::Writer _scanOut;
+  ScanMap::Summary _scanSum;
+
+  // scan diff: the last map against the baseline reader or the previous map
+  bool _diffBackup = false;
+  ScanMap::Reader _scanCur;
+  ScanMap::Reader _scanPrev;
+  ScanMap::Diff _diff;
+  ScanMap::Entry _diffEntry;    // chunk being compared
+  bool _diffHave = false;
+  uint32_t _diffDone = 0;       // its blocks CRC'd from the backup so far
+  uint32_t _diffCrc = 0;
+  ScanMap::Entry _prevEntry;
+  bool _prevHave = false;
+  bool _prevEof = false;
+
+  // checkpoints of an SD backup (!backup resume)
+  uint32_t _ckptMs = 0;           // last one saved, or the output opened
+  bool _ckptSaved = false;        // one on SD belongs to this file: keep it on error
+  bool _resume = false;           // PlanRanges restores _ckpt instead of planning
+  BackupCheckpoint::Data _ckpt;   // held from startResume() to PlanRanges
 
   enum class State : uint8_t {
     Idle,
@@ -92,13 +266,32 @@ private:
     SendBanner,
     SendPrintenv,
     WaitEnvDone,
+    TurboUp,
+    ProbeMdWidth,
+    SendBdinfo,
+    WaitBdinfo,
     PlanRanges,
     SendMmcRead,
-    WaitMmcReadPrompt,
+    WaitChain,
+    WaitChainEnd,
     SendMd,
     WaitMdData,
     WaitMdPrompt,
+    WaitRefetch,
+    RetryQuiet,
+    RetryResync,
+    LxSendEnv,
+    LxWaitEnv,
+    LxSendParts,
+    LxWaitParts,
+    LxSendBatch,
+    LxWaitBatch,
+    LxRetryQuiet,
+    LxRetrySync,
+    ScanDiff,
+    TurboDown,
     BuildK2Bak,
+    SealK2Bak,
     Done,
     Error
   };
@@ -110,13 +303,57 @@ private:
 
   void loadPrefs();
   void savePrefs();
+  JobRate::Model loadRateModel(bool linuxShell, const String& profileId, uint16_t* skipPermille,
+                               bool* learned = nullptr) const;
+  void keepRateModel();
+  uint32_t consoleBaud() const;
 
   void sendLine(const String& s);
   void advance(State s, uint32_t timeoutMs, const String& status);
 
+  bool startRun(bool uartRawDump);
+  bool partialParked();
   bool planRanges(String* err);
+  bool checkPlannedSize(String* err);
+  void gptCapture(const uint8_t* data, uint8_t fill);
+  bool gptResolve(String* err);
+  void scanCommit();
+  bool scanDiffStep(bool& done, String* err);
+  bool backupSpanCrc(size_t& budget, bool& ready, String* err);
   bool nextChunk(String* err);
 
+  bool openOutput(String* err);
+  bool openRange(String* err);
+  bool commitChunk(String* err);
+  bool commitFill(uint8_t fill, String* err);
+  bool rangeAdvanced(String* err);
+  void checkpointIfDue();
+  bool resumeOutput(String* err);
+  void parkOutput();
+  bool canRecordFill() const;
+  void retryChunk(const char* why, bool reread = false);
+  void sendCommand(const char* cmd, uint8_t chainParts);
+  bool commandDone() const;
+  uint64_t chunkAddr() const;
+  void chunkAddrArg(char* out, size_t outLen) const;
+  uint32_t mdTimeoutMs() const;
+  void adaptChunkSize(bool clean);
+  bool baselineCovers() const;
+  bool matchBaseline();
+  void closeBaseline();
+  void refetchOrFinish();
+  void finishChunk();
+  void transferDone();
+  void closeOutput(bool keep);
+  uint64_t doneBytes() const;
+
+  void lxCommand(const String& cmd);
+  void lxFeed(const uint8_t* data, size_t len);
+  void lxMemberDone();
+  void lxRetry(const char* why);
+  bool lxParseParts(String* err);
+  uint32_t lxChunkTimeoutMs() const;
+
   // best-effort: extract some kind of stable board identifier from printenv
   String inferBoardIdFromEnv(const String& env) const;
 };
\ No newline at end of file
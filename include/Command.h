@@ -94,6 +94,16 @@ public:
     // ---- actions: Backup / restore ----
     bool (*backupStartUart)() = nullptr;
     bool (*backupStartMeta)() = nullptr;
+    bool (*backupStartIncremental)() = nullptr;
+    bool (*backupStartLinux)(const String& parts) = nullptr;
+    bool (*backupStartGpt)(const String& parts) = nullptr;   // empty: read the table only
+    String (*backupGptList)() = nullptr;
+    bool (*backupResume)() = nullptr;   // continue the interrupted SD backup
+    bool (*backupDiscard)() = nullptr;  // drop it instead
+    bool (*backupStartScan)() = nullptr;
+    bool (*backupScanDiff)(bool againstBackup) = nullptr;
+    String (*backupScanShow)() = nullptr;
+    String (*backupEstimate)(const String& pid, bool linuxShell) = nullptr;   // empty pid: the selected one
     void (*backupSetProfileId)(const String& pid) = nullptr;
     void (*backupSetCustomRange)(uint32_t start, uint32_t count) = nullptr;
 
@@ -101,6 +111,19 @@ public:
     void   (*restoreDisarm)() = nullptr;
     String (*restoreApply)() = nullptr;
     String (*restoreVerify)() = nullptr;
+    // .k2bak restore source (SD file checked in the background, or the flash
+    // partition): load, drop, compare the target against it, progress
+    String (*restoreLoad)(const String& from) = nullptr;
+    void   (*restoreUnload)() = nullptr;
+    String (*restoreCheck)(const String& mode) = nullptr;
+    String (*restoreStatus)() = nullptr;
+
+    // ---- actions: ZMODEM file transfer with a Linux shell (lrzsz) ----
+    // path: [sd:|fs:]<path> on the bridge; remote: path on the target
+    String (*zmSend)(const String& path, bool resume) = nullptr;
+    String (*zmRecv)(const String& remote, bool resume) = nullptr;
+    String (*zmStatus)() = nullptr;
+    void   (*zmCancel)() = nullptr;
 
     // ---- SafeGuard hooks (optional) ----
     // Some builds wire these so UI / RPC layers can query or toggle unsafe mode.
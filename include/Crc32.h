@@ -0,0 +1,45 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-32 (IEEE 802.3, reflected poly 0xEDB88320) as used by zlib, U-Boot's
+// crc32 command and every .k2bak checksum.
+//
+// update() works on the raw register: start from INIT, feed any number of
+// spans, then XOR with INIT (or call finish()). The tables are built at
+// compile time, so there is no first-call init.
+//
+// Kernels:
+//   - slicing-by-8 (default): 8 KiB of tables, 8 bytes per step
+//   - ESP32 ROM crc32_le (CFG_CRC32_USE_ROM): byte table in mask ROM, no
+//     flash-cache pressure; whether it wins depends on the chip, so time
+//     both on the target (tools/bench_crc32.cpp covers the host side)
+// Plain C++ (no Arduino) so host tools can link it.
+namespace Crc32 {
+
+static constexpr uint32_t INIT = 0xFFFFFFFFu;
+
+// t[0] is the classic byte table; t[k][i] is the CRC of byte i followed
+// by k zero bytes, so eight lookups advance eight bytes.
+struct Tables { uint32_t t[8][256]; };
+extern const Tables TABLES;
+
+// One byte; for decoders that produce bytes one at a time.
+inline uint32_t step(uint32_t crc, uint8_t b) {
+  return TABLES.t[0][(crc ^ b) & 0xFFu] ^ (crc >> 8);
+}
+
+uint32_t update(uint32_t crc, const uint8_t* data, size_t len);
+inline uint32_t finish(uint32_t crc) { return crc ^ INIT; }
+
+// CRC of one buffer.
+inline uint32_t of(const uint8_t* data, size_t len) { return finish(update(INIT, data, len)); }
+
+// The individual kernels, for benchmarks and cross-checks.
+uint32_t updateBytewise(uint32_t crc, const uint8_t* data, size_t len);
+uint32_t updateSlice8(uint32_t crc, const uint8_t* data, size_t len);
+#ifdef ESP32
+uint32_t updateRom(uint32_t crc, const uint8_t* data, size_t len);
+#endif
+
+} // namespace Crc32
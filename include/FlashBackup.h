@@ -0,0 +1,59 @@
+#pragma once
+#include "Debug.h"
+
+#include <Arduino.h>
+#include "K2bak.h"
+
+// ============================================================
+// FlashBackup
+// - Keeps ONE .k2bak in the CFG_FLASH_BACKUP_PARTITION data partition
+//   (see Custom.csv), for boards without an SD card.
+// - Written through Sink (erases sectors just ahead of the data); read
+//   back through a memory-mapped view, so restore/verify parse it in
+//   place instead of copying it to heap.
+// - ESP32: esp_partition_* / esp_partition_mmap. Host builds: a plain
+//   file (CFG_FLASH_BACKUP_HOST_IMAGE) that is mmap()ed.
+// ============================================================
+
+namespace FlashBackup {
+
+// Call once at boot. Returns true if the partition exists.
+bool begin();
+
+bool available();
+uint64_t capacity();
+
+// True if the partition starts with a sealed .k2bak header.
+bool exists();
+
+// Length of the stored file (from its header), or 0.
+size_t sizeBytes();
+
+// Forget the stored file (erases its first sector).
+bool remove();
+
+// Read-only view of the stored file. Valid until unmap(); nothing may be
+// written to the partition while mapped (Sink::append fails).
+const uint8_t* map(size_t& len, String* err = nullptr);
+void unmap();
+bool mapped();
+
+// StreamWriter target. The previous backup is gone with the first append;
+// a file that never gets sealed reads as "no backup".
+class Sink : public K2Bak::Sink {
+public:
+  bool append(const uint8_t* data, size_t len) override;
+  bool patch(uint64_t off, const uint8_t* data, size_t len) override;
+  size_t read(uint64_t off, uint8_t* data, size_t len) override;
+  uint64_t size() const override { return _size; }
+
+private:
+  uint64_t _size = 0;
+  uint64_t _erasedTo = 0;   // sectors below this are erased or written by us
+  std::vector<uint8_t> _sector;
+};
+
+// JSON: {available, capacity, exists, size, mapped}
+String statusJson();
+
+} // namespace FlashBackup
@@ -0,0 +1,47 @@
+#pragma once
+#include "Debug.h"
+#include <Arduino.h>
+#include <vector>
+
+// GUID partition table, read from the first HEAD_BLOCKS blocks of a disk:
+// protective MBR at LBA 0, header at LBA 1, entry array from LBA 2.
+// Header and entry array are checked against their CRC-32s. Only the
+// primary copy is used; the backup one sits at the end of the disk.
+//
+// Names are the entries' UTF-16LE labels ("bootA", "rootfsA", "env"...);
+// anything outside ASCII reads as '?'.
+class GptTable {
+public:
+  static constexpr uint32_t HEAD_BLOCKS = 34;   // LBA 0..33: MBR, header, 128 x 128-byte entries
+
+  struct Part {
+    String name;
+    uint32_t lba_start;
+    uint32_t lba_count;
+  };
+
+  struct Range {
+    uint32_t lba_start;
+    uint32_t lba_count;
+  };
+
+  void clear();
+  // head: LBA 0.. of the disk, at least HEAD_BLOCKS * 512 bytes.
+  bool parse(const uint8_t* head, size_t len, String* err);
+
+  bool valid() const { return _valid; }
+  const std::vector<Part>& parts() const { return _parts; }
+  const Part* find(const String& name) const;   // case-insensitive
+
+  // Ranges of the named partitions (comma or space separated), sorted,
+  // with adjacent and overlapping ones merged.
+  bool select(const String& names, std::vector<Range>& out, String* err) const;
+  static void mergeRanges(std::vector<Range>& v);
+
+  // One "name start count (size)" line per partition, by lba.
+  String listText() const;
+
+private:
+  bool _valid = false;
+  std::vector<Part> _parts;
+};
@@ -0,0 +1,82 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming decoder for one gzip member (RFC 1952 around RFC 1951 DEFLATE),
+// as produced by `... | gzip` on the target.
+//
+// Output goes to one flat buffer owned by the caller: a member is expected
+// to expand to at most cap bytes (one dump chunk), so back-references are
+// resolved inside that buffer and no separate 32 KiB window is needed.
+// Input arrives in arbitrary pieces through feed(); each decode step
+// (header, block header with its code tables, one symbol, the trailer) is
+// retried from a saved position when the input runs out in the middle, so
+// the only input state is a small carry-over buffer.
+//
+// finish() checks the trailer: CRC-32 and length of the uncompressed data,
+// i.e. the checksum gzip computed on the target over what it read.
+// Canonical Huffman decoding follows zlib's puff (bit-serial, no tables
+// beyond the code counts): the UART is the bottleneck, not this.
+// Plain C++ (no Arduino) so host tools can link it.
+class GzipInflater {
+public:
+  static constexpr size_t IN_BYTES = 2048;
+
+  void begin(uint8_t* out, size_t cap);
+
+  // Decodes as far as the input allows. False once the stream is bad.
+  bool feed(const uint8_t* data, size_t len);
+
+  // No more input: the member must be complete and its trailer must match.
+  bool finish();
+
+  bool failed() const { return _st == St::Failed; }
+  const char* error() const { return _err; }
+  size_t produced() const { return _outLen; }
+  uint32_t trailerCrc() const { return _trailerCrc; }
+
+private:
+  enum class St : uint8_t { Idle, Header, BlockHeader, Stored, Codes, Trailer, Done, Failed };
+
+  struct Huffman {
+    uint16_t count[16];    // codes per length
+    uint16_t symbol[288];  // symbols ordered by code
+  };
+
+  St _st = St::Idle;
+  const char* _err = "";
+
+  uint8_t* _out = nullptr;
+  size_t _cap = 0;
+  size_t _outLen = 0;
+
+  uint8_t _in[IN_BYTES];
+  size_t _inLen = 0;
+  size_t _inPos = 0;
+  uint32_t _bitBuf = 0;
+  uint8_t _bitCnt = 0;
+  bool _short = false;     // the step in progress ran out of input
+
+  bool _lastBlock = false;
+  uint32_t _storedLeft = 0;
+  uint32_t _trailerCrc = 0;
+  uint32_t _trailerLen = 0;
+
+  Huffman _lit;
+  Huffman _dist;
+
+  void run(bool final);
+  void step();
+  void stepHeader();
+  void stepBlockHeader();
+  void stepStored();
+  void stepCodes();
+  void stepTrailer();
+  bool readDynamic();
+  void fail(const char* why);
+
+  uint32_t bits(uint8_t n);
+  void alignByte();
+  int decode(const Huffman& h);
+  static int build(Huffman& h, const uint8_t* lengths, int n);
+};
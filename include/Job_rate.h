@@ -0,0 +1,70 @@
+#pragma once
+#include "Debug.h"
+#include <Arduino.h>
+
+#include "AppConfig.h"
+
+// Measured throughput of a dump or verify job, chunk by chunk: bytes/s of
+// the chunks whose data crossed the UART, the fixed cost of every chunk
+// (prompt round-trips, mmc read, crc32) and how often one was read again.
+// Each sample weighs 1/4, so the ETA follows baud, md width and chunk size
+// as they change during the run.
+// A Model is what a finished job leaves behind; the next job starts its ETA
+// from it, and the pre-flight estimate scales it to the baud at hand.
+class JobRate {
+public:
+  struct Model {
+    uint32_t baud = 0;            // console baud it was measured at; 0 = nothing learned
+    uint32_t rate = 0;            // bytes/s while data moves
+    uint32_t overheadMs = 0;      // per chunk, on top of the transfer
+    uint32_t chunkBytes = 0;      // average chunk
+    uint16_t retryPermille = 0;   // re-reads per 1000 chunks
+  };
+
+  // skipPermille: share of the bytes expected not to move (fill runs,
+  // unchanged chunks) until the job has its own.
+  void begin(const Model& prior, uint16_t skipPermille = 0);
+
+  // One committed chunk. wallMs: from its first command to commit; xferMs:
+  // the part spent receiving data. moved = false for chunks that cost only
+  // commands (fill runs, baseline matches, crc32 only).
+  void chunk(size_t bytes, uint32_t wallMs, uint32_t xferMs, bool moved);
+  void retry();
+
+  uint32_t chunks() const { return _chunks; }
+  // Smoothed bytes/s of this job; 0 until a chunk has moved.
+  uint32_t liveRate() const { return _moved ? _rate : 0; }
+  uint16_t skipPermille() const;
+
+  // Seconds for bytesLeft in chunkBytes pieces; 0 = no idea yet.
+  uint32_t etaSeconds(uint64_t bytesLeft, size_t chunkBytes) const;
+  // "38.2 KiB/s, 140 ms/chunk, 2% re-read, ETA 1h02m"
+  String text(uint64_t bytesLeft, size_t chunkBytes) const;
+  // This job's figures, to be kept for the next one.
+  Model model(uint32_t baud) const;
+
+  // Stand-in before anything is measured: charsX10 tenths of a wire char
+  // per byte at baud, CFG_JOB_RATE_CHUNK_OVERHEAD_MS per chunk.
+  static Model wireModel(uint32_t baud, uint32_t charsX10, uint32_t chunkBytes);
+  // The stored model moved 3/4 of the way towards the latest job's (old is
+  // scaled to its baud first), so one odd run doesn't own the estimate.
+  static Model blend(const Model& old, const Model& latest);
+  // m scaled to baud (a wire-bound rate); baud 0 = m's own.
+  static uint32_t estimateSeconds(const Model& m, uint16_t skipPermille, uint64_t bytes, uint32_t baud);
+  static String fmtSeconds(uint32_t s);
+  static String fmtRate(uint32_t bytesPerSec);
+
+private:
+  Model _prior;
+  uint16_t _priorSkip = 0;
+  uint32_t _chunks = 0;
+  uint32_t _moved = 0;
+  uint32_t _retries = 0;
+  uint32_t _rate = 0;
+  uint32_t _overheadMs = 0;
+  uint64_t _bytes = 0;
+  uint64_t _movedBytes = 0;
+
+  static uint32_t seconds(uint32_t rate, uint32_t overheadMs, uint16_t retryPermille,
+                          uint16_t skipPermille, uint64_t bytes, size_t chunkBytes);
+};
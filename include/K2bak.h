@@ -2,14 +2,32 @@
 #include <Arduino.h>
 #include "AppConfig.h"
 #include "Debug.h"
+#include "Crc32.h"
+#include <FS.h>
 #include <vector>
+#include <mbedtls/sha256.h>
 
 // Container format versions (single-source in AppConfig.h)
 
 // ============================================================
 // K2BAK container (single-file backup)
 //
-// v2 (current):
+// v3 (current):
+//   HeaderV3 + board_id + profile_id + env + payload chunks
+//   + range table + chunk index + FooterV2
+//   - the tables follow the payload, so a writer streams without
+//     reserving slots; all offsets are 64-bit
+//   - one ChunkEntry (lba span, offset, length, CRC32, raw/fill/
+//     compressed flag) per payload chunk of at most CFG_K2BAK_CHUNK_BLOCKS,
+//     so any block can be located and checked without touching the rest
+//   - compressed chunks are a run of frames, each CFG_K2BAK_LZ_FRAME_BLOCKS
+//     of raw data (the chunk's last one may be shorter):
+//       u32 header (bit 31 = body stored as-is, bits 0..30 = body length)
+//       + body (LZ4 block format, see Lz4_block.h)
+//     so a reader only ever needs one frame in RAM
+//   - file_crc32 / footer.sha256 as in v2
+//
+// v2:
 //   HeaderV2 + board_id + profile_id + env + range table + payload blobs + FooterV2
 //   - file_crc32 validates integrity (fast)
 //   - footer.sha256 validates integrity (strong)
@@ -24,6 +42,10 @@ namespace K2Bak {
 // v2 magic (5 bytes) "K2BAK"
 static constexpr uint8_t  MAGIC5[5] = { 'K','2','B','A','K' };
 
+// fs::File seeks with 32-bit offsets (and FAT32 stops there too):
+// FileSink and FileReader refuse to touch bytes past this.
+static constexpr uint64_t FILE_MAX_BYTES = 0xFFFFFFFFULL;
+
 enum FileFlags : uint32_t {
   FLAG_NONE          = 0,
   FLAG_HAS_BOARD_ID  = 1u << 0,
@@ -34,7 +56,12 @@ enum FileFlags : uint32_t {
 
 enum RangeFlags : uint32_t {
   RANGE_RAW          = 1u << 0,
-  // future: RANGE_COMPRESSED = 1u << 1,
+  // v3 chunks only: data is LZ4 frames (see above), crc32 is over the raw bytes
+  RANGE_COMPRESSED   = 1u << 1,
+  // Fill runs: every byte of the lba range is 0x00 / 0xFF. No payload
+  // (data_len == 0, crc32 == 0); readers expand them.
+  RANGE_FILL_00      = 1u << 2,
+  RANGE_FILL_FF      = 1u << 3,
 };
 
 #pragma pack(push, 1)
@@ -89,6 +116,57 @@ struct RangeEntry {
   uint32_t flags;            // RangeFlags
 };
 
+// ---------------- v3 ----------------
+struct HeaderV3 {
+  uint8_t  magic[5];         // "K2BAK"
+  uint8_t  version;          // 3
+  uint8_t  reserved0[2];
+  uint32_t header_size;
+  uint32_t flags;
+  uint32_t reserved1;
+
+  uint64_t timestamp_unix;
+
+  uint32_t board_id_len;
+  uint32_t profile_id_len;
+  uint32_t env_len;
+  uint32_t range_count;
+  uint32_t chunk_count;
+  uint32_t reserved2;
+
+  uint64_t payload_off;
+  uint64_t range_table_off;  // RangeEntryV3[range_count]
+  uint64_t chunk_index_off;  // ChunkEntry[chunk_count]
+  uint64_t footer_off;
+
+  uint32_t file_crc32;       // as v2
+  uint32_t reserved3;
+};
+
+// A backed-up lba range; its content is chunks [first_chunk, first_chunk + chunk_count).
+// No chunks = metadata-only range.
+struct RangeEntryV3 {
+  uint32_t lba_start;
+  uint32_t lba_count;
+  uint32_t first_chunk;
+  uint32_t chunk_count;
+  uint32_t flags;            // RangeFlags
+  uint32_t reserved;
+};
+
+// One payload chunk (or fill run). flags uses RangeFlags; fill runs have
+// data_len == 0 and crc32 == 0. data_len of a compressed chunk counts its
+// frame headers.
+struct ChunkEntry {
+  uint32_t lba_start;
+  uint32_t lba_count;
+  uint64_t data_off;         // offset from file start
+  uint32_t data_len;         // stored bytes
+  uint32_t crc32;            // CRC32 of the lba_count * 512 raw bytes
+  uint32_t flags;
+  uint32_t reserved;
+};
+
 struct FooterV2 {
   uint8_t magic[5];          // "K2END"
   uint8_t reserved0[3];
@@ -103,11 +181,35 @@ struct Range {
   uint32_t flags = RANGE_RAW;
 };
 
-// -------- CRC32 / SHA256 --------
-uint32_t crc32(const uint8_t* data, size_t len, uint32_t seed = 0xFFFFFFFFu);
-uint32_t crc32_update(uint32_t crc, const uint8_t* data, size_t len);
+// -------- SHA256 (CRC32: Crc32.h) --------
 bool sha256(const uint8_t* data, size_t len, uint8_t out32[32]);
 
+// -------- Fill runs --------
+inline bool isFill(uint32_t flags) { return (flags & (RANGE_FILL_00 | RANGE_FILL_FF)) != 0; }
+inline uint8_t fillByte(uint32_t flags) { return (flags & RANGE_FILL_FF) ? 0xFF : 0x00; }
+inline bool isFill(const RangeEntry& e) { return isFill(e.flags); }
+inline uint8_t fillByte(const RangeEntry& e) { return fillByte(e.flags); }
+inline bool isFill(const ChunkEntry& c) { return isFill(c.flags); }
+inline uint8_t fillByte(const ChunkEntry& c) { return fillByte(c.flags); }
+
+// -------- Compressed chunks --------
+static constexpr uint32_t FRAME_STORED   = 0x80000000u;
+static constexpr uint32_t FRAME_LEN_MASK = 0x7FFFFFFFu;
+static constexpr size_t   FRAME_BYTES    = (size_t)CFG_K2BAK_LZ_FRAME_BLOCKS * 512u;
+inline bool isCompressed(const ChunkEntry& c) { return (c.flags & RANGE_COMPRESSED) != 0; }
+
+// CRC32 of len bytes of `fill` (what U-Boot's crc32 reports for an erased chunk).
+uint32_t fillCrc32(uint8_t fill, size_t len);
+
+// Chunk sizes repeat, so keep the last result per fill byte.
+class FillCrcCache {
+public:
+  uint32_t get(uint8_t fill, size_t len);
+private:
+  size_t _len[2] = { 0, 0 };
+  uint32_t _crc[2] = { 0, 0 };
+};
+
 // -------- Build / Parse --------
 // Build a v2 container.
 // NOTE: ranges[i].data may be empty (metadata-only) if the capture method isn't implemented yet.
@@ -122,7 +224,7 @@ bool buildV2(
 );
 
 struct Parsed {
-  // Normalized header info (supports both v1 and v2)
+  // Normalized header info (supports v1, v2 and v3)
   uint8_t version = 0;
   uint32_t flags = 0;
   uint64_t timestamp_unix = 0;
@@ -130,7 +232,12 @@ struct Parsed {
   String boardId;
   String profileId;
   String envText;
-  std::vector<RangeEntry> entries;
+  std::vector<RangeEntry> entries;   // v1/v2 range table (empty for v3)
+  std::vector<RangeEntryV3> ranges;  // v3 range table (empty for v1/v2)
+
+  // Every version: where each lba span's bytes are. A v1/v2 range entry
+  // becomes one chunk.
+  std::vector<ChunkEntry> chunks;
 
   // for reading payloads without copying everything first
   const uint8_t* fileBase = nullptr;
@@ -144,11 +251,52 @@ bool parse(
   String* err = nullptr
 );
 
+// Length of a v2/v3 file from its first bytes (footer_off + footer), or 0
+// if head isn't one. For stores that don't keep a file length (flash).
+uint64_t sealedLength(const uint8_t* head, size_t n);
+
+// Checks bounds and CRC of every chunk.
 bool validateRanges(
   const Parsed& p,
   String* err = nullptr
 );
 
+bool getChunkPayload(
+  const Parsed& p,
+  size_t index,
+  const uint8_t*& data,
+  size_t& len,
+  String* err = nullptr
+);
+
+// CRC32 of raw bytes [byteOff, byteOff + len) of a chunk, whatever its
+// encoding (raw, fill, compressed). Offsets need not be frame aligned;
+// compressed frames are expanded one at a time.
+bool chunkCrc(
+  const Parsed& p,
+  const ChunkEntry& c,
+  uint64_t byteOff,
+  uint64_t len,
+  uint32_t& out,
+  String* err = nullptr
+);
+
+// The same raw bytes copied to out (len bytes), for senders that stream a
+// chunk back to the device.
+bool chunkRead(
+  const Parsed& p,
+  const ChunkEntry& c,
+  uint64_t byteOff,
+  uint64_t len,
+  uint8_t* out,
+  String* err = nullptr
+);
+
+// Chunks with adjacent lba spans merged where the bytes are contiguous in
+// the file (raw) or the same fill, for walking a backup in large steps.
+// Merged raw entries carry crc32 = 0.
+std::vector<ChunkEntry> extents(const Parsed& p);
+
 // Convenience: fetch a range payload pointer/len
 bool getRangePayload(
   const Parsed& p,
@@ -158,4 +306,237 @@ bool getRangePayload(
   String* err = nullptr
 );
 
+// ============================================================
+// Streaming writer (v3)
+//
+// buildV2() needs every range in RAM. The streaming writer instead
+// appends payload to a Sink as it arrives, cuts it into index chunks of
+// up to CFG_K2BAK_CHUNK_BLOCKS with a running CRC32 each (LZ4-compressed
+// one frame at a time unless a chunk's first frame doesn't shrink), and appends the
+// range table + chunk index behind the payload in finish(). The header
+// is patched last, so file_crc32/sha256 can only be computed then:
+// seal() re-reads the sink in small steps so the caller can spread it
+// over several tick()s without a RAM copy of the file.
+// ============================================================
+
+// Append-mostly byte store (SD file or RAM vector).
+class Sink {
+public:
+  virtual ~Sink() {}
+  virtual bool append(const uint8_t* data, size_t len) = 0;
+  virtual bool patch(uint64_t off, const uint8_t* data, size_t len) = 0;
+  virtual size_t read(uint64_t off, uint8_t* data, size_t len) = 0;
+  virtual uint64_t size() const = 0;
+  virtual void flush() {}
+};
+
+// File must be opened read/write ("w+") so seal() can read it back.
+// size: bytes already in the file, for continuing one (StreamWriter::resume()).
+class FileSink : public Sink {
+public:
+  explicit FileSink(fs::File& f, uint64_t size = 0) : _f(f), _size(size), _atEnd(size == 0) {}
+  bool append(const uint8_t* data, size_t len) override;
+  bool patch(uint64_t off, const uint8_t* data, size_t len) override;
+  size_t read(uint64_t off, uint8_t* data, size_t len) override;
+  uint64_t size() const override { return _size; }
+  void flush() override { _f.flush(); }
+
+private:
+  fs::File& _f;
+  uint64_t _size = 0;
+  bool _atEnd = true;
+};
+
+class MemSink : public Sink {
+public:
+  explicit MemSink(std::vector<uint8_t>& v) : _v(v) {}
+  bool append(const uint8_t* data, size_t len) override;
+  bool patch(uint64_t off, const uint8_t* data, size_t len) override;
+  size_t read(uint64_t off, uint8_t* data, size_t len) override;
+  uint64_t size() const override { return _v.size(); }
+
+private:
+  std::vector<uint8_t>& _v;
+};
+
+// Where a StreamWriter stands between two chunks: enough to carry on
+// appending to the same sink after a restart (see StreamWriter::resume()).
+struct StreamState {
+  HeaderV3 h{};
+  std::vector<RangeEntryV3> ranges;
+  std::vector<ChunkEntry> chunks;
+  bool inRange = false;
+  uint32_t lba = 0;
+  bool compress = false;
+  uint64_t rawBytes = 0;
+  uint64_t storedBytes = 0;
+  uint64_t size = 0;          // sink bytes the state accounts for
+};
+
+class StreamWriter {
+public:
+  ~StreamWriter();
+
+  // Writes header placeholder, ids and env.
+  bool begin(
+    Sink* sink,
+    const String& boardId,
+    const String& profileId,
+    uint64_t timestampUnix,
+    const String& envText,
+    String* err = nullptr
+  );
+
+  bool beginRange(uint32_t lbaStart, uint32_t lbaCount, uint32_t flags = RANGE_RAW, String* err = nullptr);
+  // LZ4 payload chunks (default CFG_K2BAK_COMPRESS); applies from the next begin().
+  void setCompression(bool on) { _compress = on; }
+
+  // Whole blocks only; they continue at the range's current lba.
+  bool write(const uint8_t* data, size_t len, String* err = nullptr);
+  // Records lbaCount blocks of `fill` (0x00/0xFF) at lbaStart, which must be
+  // the range's current lba. Extends the previous chunk when it is the same fill.
+  bool addFill(uint32_t lbaStart, uint32_t lbaCount, uint8_t fill, String* err = nullptr);
+  // A range closed before lbaCount blocks were written shrinks to what it
+  // holds; one closed without any is metadata-only.
+  bool endRange(String* err = nullptr);
+
+  // Closes the growing chunk, so everything written so far is on the sink,
+  // and copies the writer's state. The next write() starts a new chunk.
+  bool snapshot(StreamState& out, String* err = nullptr);
+  // Continues a file from snapshot(); sink must hold its first st.size bytes.
+  bool resume(Sink* sink, const StreamState& st, String* err = nullptr);
+
+  // Appends range table, chunk index and footer and patches the header
+  // (CRC/SHA still zero).
+  bool finish(String* err = nullptr);
+
+  // Hashes up to budgetBytes of the finished file per call. When the whole
+  // file has been hashed, patches file_crc32 + sha256 and sets done=true.
+  bool sealStep(size_t budgetBytes, bool& done, String* err = nullptr);
+
+  bool active() const { return _sink != nullptr; }
+  bool inRange() const { return _inRange; }
+  uint64_t bytesWritten() const { return _sink ? _sink->size() : 0; }
+  size_t rangeCount() const { return _ranges.size(); }
+  size_t chunkCount() const { return _chunks.size(); }
+  uint64_t rawPayloadBytes() const { return _rawBytes; }       // written via write()
+  uint64_t storedPayloadBytes() const { return _storedBytes; } // what that took in the file
+  void abort();
+
+private:
+  Sink* _sink = nullptr;
+  HeaderV3 _h{};
+  std::vector<RangeEntryV3> _ranges;
+  std::vector<ChunkEntry> _chunks;
+
+  bool _inRange = false;
+  uint32_t _lba = 0;          // next lba of the open range
+  bool _chunkOpen = false;    // _chunks.back() is a payload chunk still growing
+  uint32_t _chunkCrc = 0;
+  bool _finished = false;
+  uint64_t _rawBytes = 0;
+  uint64_t _storedBytes = 0;
+
+  // compression: raw blocks are staged per frame, then compressed
+  bool _compress = CFG_K2BAK_COMPRESS != 0;
+  bool _lz = false;           // buffers allocated for this file
+  std::vector<uint8_t> _frame;
+  size_t _frameLen = 0;
+  std::vector<uint8_t> _lzOut;
+  std::vector<uint16_t> _lzTable;
+
+  bool flushFrame(String* err);
+  bool closeChunk(String* err);
+  void allocFrames();
+  void dropFrames();
+
+  // seal state
+  uint64_t _sealOff = 0;
+  uint32_t _sealCrc = 0;
+  bool _shaStarted = false;
+  mbedtls_sha256_context _sha;
+  std::vector<uint8_t> _io;
+};
+
+// ============================================================
+// Random access to a v2/v3 .k2bak on SD without loading it: header, ids,
+// env and tables are read eagerly into parsed() (fileBase stays null),
+// payload is read on demand through a small LRU cache of file blocks.
+// Serves as the baseline of an incremental backup and as the source of a
+// restore verify. open() only checks structure; checkStep() then streams
+// the whole-file CRC/SHA and every chunk CRC, a budget per call.
+// ============================================================
+class FileReader {
+public:
+  ~FileReader() { close(); }
+
+  bool open(fs::File& f, String* err = nullptr);
+  void close();
+  bool isOpen() const { return _f != nullptr; }
+
+  const String& boardId() const { return _meta.boardId; }
+  // Metadata only: use chunkCrc()/readBlocks() here for payload.
+  const Parsed& parsed() const { return _meta; }
+
+  // True when every block of the span is in the file (payload or fill).
+  bool covers(uint32_t lbaStart, uint32_t lbaCount) const;
+  bool readBlocks(uint32_t lbaStart, uint32_t lbaCount, uint8_t* out, String* err = nullptr);
+
+  // As K2Bak::chunkCrc(), for a chunk of parsed().
+  bool chunkCrc(const ChunkEntry& c, uint64_t byteOff, uint64_t len, uint32_t& out, String* err = nullptr);
+
+  // Integrity check in steps of about budgetBytes of file: whole-file
+  // CRC32 + SHA-256, then the CRC of every chunk (as validateRanges()).
+  // done=true once everything matched; false on the first mismatch.
+  bool checkStep(size_t budgetBytes, bool& done, String* err = nullptr);
+  uint64_t checkedBytes() const { return _chkBytes; }
+  uint64_t checkTotalBytes() const;
+
+private:
+  fs::File* _f = nullptr;
+  Parsed _meta;               // chunks in file order, unfiltered
+  mutable size_t _hint = 0;
+
+  // integrity fields, zeroed while hashing
+  uint64_t _crcOff = 0;
+  uint64_t _shaOff = 0;
+  uint32_t _fileCrc = 0;
+  uint8_t _fileSha[32] = { 0 };
+
+  // LRU block cache
+  struct Slot { uint64_t block = UINT64_MAX; uint32_t used = 0; };
+  Slot _slots[CFG_K2BAK_READ_CACHE_SLOTS];
+  std::vector<uint8_t> _cache;
+  uint32_t _useClock = 0;
+  bool readAt(uint64_t off, uint8_t* out, size_t len);
+
+  // compressed chunks: last expanded frame, and where the frame walk stopped
+  // (chunks keyed by data_off)
+  static constexpr uint64_t NO_KEY = UINT64_MAX;
+  std::vector<uint8_t> _frame;
+  std::vector<uint8_t> _zbuf;
+  uint64_t _frameKey = NO_KEY;
+  uint32_t _frameIdx = 0;
+  uint64_t _walkKey = NO_KEY;
+  uint32_t _walkIdx = 0;
+  uint64_t _walkOff = 0;
+
+  // checkStep() state
+  enum class Check : uint8_t { Digest, Chunks, Done };
+  Check _chk = Check::Digest;
+  uint64_t _chkOff = 0;       // Digest: file offset; Chunks: raw offset in chunk
+  size_t _chkIdx = 0;
+  uint32_t _chkCrc = 0;
+  uint64_t _chkBytes = 0;
+  bool _shaStarted = false;
+  mbedtls_sha256_context _sha;
+  std::vector<uint8_t> _io;
+
+  const ChunkEntry* find(uint32_t lba) const;
+  bool readable(const ChunkEntry& c) const;
+  bool loadFrame(const ChunkEntry& c, uint32_t idx, String* err);
+  bool crcUpdate(const ChunkEntry& c, uint64_t byteOff, uint64_t len, uint32_t& crc, String* err);
+  void resetCheck();
+};
+
 } // namespace K2Bak
@@ -0,0 +1,63 @@
+#pragma once
+#include "Debug.h"
+#include <Arduino.h>
+#include "Gzip_inflate.h"
+
+// Demultiplexes the shell output of one Linux-side dump batch
+//   i=0;while [ $i -lt 16 ];do dd if=/dev/mmcblk0 bs=512 skip=$((2048+i*128)) count=128 2>/dev/null|gzip -1|base64;echo K2END;i=$((i+1));done;echo K2DONE 7
+// Every chunk is one gzip member, printed as base64 lines and closed by a
+// "K2END" line; "K2DONE <tag>" ends the batch. Markers only count as whole
+// lines, so the shell's echo of the command (which contains them) is inert,
+// and the tag tells this batch's end from a late one of an interrupted batch.
+//
+// Before beginMember() the lines are plain text (fw_printenv, partition
+// lookups) and kept for the caller. Inside a member, base64 lines are
+// decoded and inflated into the chunk buffer as they arrive; other lines
+// (the echo, "gzip: not found", ...) are skipped, the last one is kept
+// for error messages.
+class LinuxDumpReply {
+public:
+  enum class Event : uint8_t { None, MemberEnd, Done };
+
+  // A new command line; its output ends with "K2DONE <tag>".
+  void begin(uint32_t tag);
+  // The next gzip member inflates into out (at most cap bytes).
+  void beginMember(uint8_t* out, size_t cap);
+  // Data lines are dropped until the batch ends (after a bad member).
+  void skipMembers();
+
+  // Consumes lines, stopping right after a marker line; returns how many
+  // bytes of data it used and sets event() for that marker.
+  size_t feed(const uint8_t* data, size_t len);
+  Event event() const { return _event; }
+
+  // After MemberEnd: completes the member and checks its gzip trailer
+  // (CRC-32 + length computed by gzip on the target).
+  bool memberOk(String* err);
+  size_t memberBytes() const { return _gz.produced(); }
+
+  const String& text() const { return _text; }
+  const String& lastText() const { return _lastText; }
+
+  // "QUJD" style line: base64 alphabet, whole quads, '=' only at the end.
+  static bool isBase64Line(const char* s, size_t n);
+
+private:
+  enum class Mode : uint8_t { Text, Member, Skip };
+
+  static constexpr size_t LINE_MAX = 160;
+  static constexpr size_t TEXT_MAX = 96 * 1024;
+  char _line[LINE_MAX];
+  size_t _len = 0;
+  bool _overlong = false;
+
+  Mode _mode = Mode::Text;
+  Event _event = Event::None;
+  char _doneLine[24];
+  String _text;
+  String _lastText;
+  GzipInflater _gz;
+
+  void onLine();
+  void decodeLine();
+};
@@ -0,0 +1,27 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// LZ4 block format (no frame/stream header), as used for compressed
+// .k2bak chunks. Blocks are at most 64 KiB, so match offsets always fit
+// the format's 16-bit field and the hash table holds 16-bit positions.
+//
+// Greedy single-probe compressor: the point is cheap shrinking of mostly
+// empty or repetitive partitions on the ESP32, not ratio. No heap; the
+// caller owns the table. Plain C++ (no Arduino) so host tools can link it.
+namespace Lz4Block {
+
+static constexpr size_t MAX_INPUT  = 0x10000;
+static constexpr unsigned HASH_BITS = 12;
+static constexpr size_t TABLE_ENTRIES = (size_t)1 << HASH_BITS;
+
+// Compresses n bytes (n <= MAX_INPUT) into dst. Returns the compressed
+// size, or 0 if it would not fit in cap bytes; pass cap = n - 1 to get 0
+// for anything that does not shrink. table needs TABLE_ENTRIES slots.
+size_t compress(const uint8_t* src, size_t n, uint8_t* dst, size_t cap, uint16_t* table);
+
+// Expands one block. Returns the number of bytes written to dst, or -1 on
+// malformed input or if the output would exceed cap.
+long decompress(const uint8_t* src, size_t n, uint8_t* dst, size_t cap);
+
+} // namespace Lz4Block
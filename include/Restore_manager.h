@@ -3,7 +3,13 @@
 #include <Arduino.h>
 #include <vector>
 #include "K2bak.h"
+#include "FlashBackup.h"
 #include "Uboot_hex_parser.h"
+#include "Uboot_baud.h"
+#include "Uboot_chain.h"
+#include "Uboot_md_probe.h"
+#include "Ymodem_sender.h"
+#include "Job_rate.h"
 
 class RestoreManager {
 public:
@@ -11,11 +17,22 @@ public:
 
   // File load
   bool loadBackupFile(const uint8_t* buf, size_t len); // parse .k2bak
+  // The cached SD backup, read in place (v2/v3): tables now, payload on
+  // demand. Its CRC/SHA and chunk CRCs are checked over the next tick()s;
+  // isLoaded() turns true once they all match.
+  bool loadBackupFromSd();
+  // The backup in the flash partition, parsed in place through a mapped
+  // view (no heap copy); stays mapped until unload().
+  bool loadBackupFromFlash();
+  void unload();
   bool hasLoaded() const { return _loaded; }
   bool isLoaded() const { return _loaded; }
+  bool checking() const { return _checking; }
+  float checkProgress() const;
+  String lastError() const { return _lastErr; }
 
-  String getBoardId() const { return _p.boardId; }
-  String getProfileId() const { return _p.profileId; }
+  String getBoardId() const { return meta().boardId; }
+  String getProfileId() const { return meta().profileId; }
   uint64_t getTotalRangeBytes() const;
   String getLayoutHintJson() const;
 
@@ -27,10 +44,28 @@ public:
   bool checkBoardIdMatches(const String& currentBoardId, String* whyNot = nullptr) const;
 
   // Task D: VERIFY engine (read device ranges over UART and compare CRC vs file)
-  bool startVerify();
+  // Crc32:  U-Boot computes `crc32` per chunk, only the result crosses UART.
+  // MdDump: md hex dump (widest md.b/w/l/q the target supports), CRC computed here.
+  // Auto:   Crc32, falling back to MdDump if U-Boot lacks CONFIG_CMD_CRC32.
+  enum class VerifyMode : uint8_t { Auto, Crc32, MdDump };
+  bool startVerify(VerifyMode mode = VerifyMode::Auto);
   bool verifying() const { return _verifying; }
   float verifyProgress() const { return _vProgress; }
-  String verifyStatus() const { return _vStatus; }
+  String verifyStatus() const;   // with rate and ETA while it runs
+
+  // Task E: WRITE engine. Per chunk of the loaded backup:
+  //   loady ${loadaddr}     <- YMODEM-1K from the file (fill runs: mw.b instead)
+  //   mmc write ${loadaddr} lba n; mmc read ${loadaddr} lba n; crc32 ${loadaddr} len
+  // The read-back CRC must match the file before the next chunk; a chunk
+  // that fails is sent again (CFG_RESTORE_WRITE_MAX_TRIES).
+  // Differential (CFG_RESTORE_WRITE_DIFF): the device is first fingerprinted
+  // with `mmc read; crc32` per CFG_RESTORE_DIFF_BLOCKS; units that already
+  // match the file are skipped, differing neighbours are written as one chunk.
+  // Overwrites the target: callers gate it behind arm + board id.
+  bool startWrite();
+  bool writing() const { return _writing; }
+  float writeProgress() const { return _wProgress; }
+  String writeStatus() const { return _wStatus; }
 
   void onTargetBytes(const uint8_t* data, size_t len);
   void tick();
@@ -40,16 +75,29 @@ private:
   bool _loaded = false;
 
   K2Bak::Parsed _p;
+  std::vector<K2Bak::ChunkEntry> _spans; // K2Bak::extents(meta()): what verify walks
   String _lastErr;
 
   // Keep reference to raw .k2bak file buffer (payload is at data_off/data_len)
   const uint8_t* _filePtr = nullptr;
   size_t _fileLen = 0;
 
+  // ...or the SD file, when loaded with loadBackupFromSd()
+  fs::File _file;
+  K2Bak::FileReader _reader;
+  bool _checking = false;
+  bool _flashMapped = false;
+  const K2Bak::Parsed& meta() const { return _reader.isOpen() ? _reader.parsed() : _p; }
+  bool adoptBuffer(const uint8_t* buf, size_t len);
+  void checkTick();
+
   // ---- verify state ----
   bool _verifying = false;
   float _vProgress = 0;
   String _vStatus = "idle";
+  JobRate _vRate;
+  uint32_t _vChunkMs = 0;   // chunk's mmc read sent
+  uint32_t _vXferMs = 0;    // md mode: its hex started
 
   uint8_t _last1 = 0, _last2 = 0;
   bool _promptSeen = false;
@@ -57,19 +105,65 @@ private:
   uint32_t _promptCount = 0;
   void sniffPrompt(uint8_t c);
 
-  UBootHexParser _hex;
-  std::vector<uint8_t> _hexOut;
+  UBootHexParser _hex;   // fused CRC of the md dump
+  UBootMdProbe _mdProbe;
+  bool _mdProbed = false;
+  UBootBaudTurbo _turbo;   // md mode only: the crc32 path moves too little to bother
+  bool _turboTried = false;
+  uint64_t _loadAddr = UBootHexParser::BASE_FROM_FIRST_LINE;
+  std::vector<uint8_t> _chunkBuf;  // md mode: decoded chunk, so lost lines can be re-fetched in place
+  uint8_t _refetches = 0;
+  uint32_t _lastRxMs = 0;
+
+  UBootChainReply _chain;  // "mmc read; crc32" / "mmc read; md" per chunk
+  K2Bak::FillCrcCache _fillCrc;
+  VerifyMode _vMode = VerifyMode::Auto;
+  bool _useCrc = true;
+  uint32_t _cmdPromptMark = 0; // _promptCount when the last command was sent
 
   size_t _rangeIdx = 0;
   uint32_t _doneBlocks = 0;
   uint32_t _chunkBlocks = 64;
   size_t _chunkBytes = 0;
   size_t _chunkGot = 0;
-  uint32_t _crc = 0;
 
   uint32_t _deadlineMs = 0;
-  enum class VState : uint8_t { Idle, WaitPrompt, SendMmcRead, WaitReadPrompt, SendMd, WaitMdData, WaitMdPrompt, Next, Done, Error };
+  enum class VState : uint8_t { Idle, WaitPrompt, TurboUp, ProbeMd, SendMmcRead, WaitChain, WaitCrc, WaitMdData, WaitMdPrompt, WaitRefetch, Next, TurboDown, Done, Error };
   VState _vs = VState::Idle;
 
-  static uint32_t crc32_update(uint32_t crc, const uint8_t* data, size_t len);
+  bool expectedChunkCrc(const K2Bak::ChunkEntry& R, uint32_t& out, String* err);
+  bool expectedCrc(const K2Bak::ChunkEntry& R, uint64_t byteOff, size_t len, uint32_t& out, String* err);
+  void chunkVerified(const K2Bak::ChunkEntry& R, uint32_t gotCrc);
+  void refetchOrFinish(const K2Bak::ChunkEntry& R);
+  void verifyFinished();
+  uint64_t verifyBytesLeft() const;
+  void sendCommand(const char* cmd, uint8_t chainParts);
+  bool commandDone() const;
+
+  // ---- write state (shares the cursor, chain and turbo with verify) ----
+  bool _writing = false;
+  float _wProgress = 0;
+  String _wStatus = "idle";
+  YmodemSender _ymodem;
+  uint8_t _wTries = 0;
+  bool _wLoaded = false;   // current chunk is in ${loadaddr}
+  bool _wDiff = true;
+  uint32_t _runBlocks = 0;    // differing blocks at _doneBlocks waiting to be written
+  uint32_t _probeBlocks = 0;  // size of the unit being fingerprinted
+  uint32_t _wSkipAfter = 0;   // matching unit right after the run, skipped once it's written
+  uint64_t _wWritten = 0;     // blocks written
+  uint64_t _wSkipped = 0;     // blocks found unchanged
+
+  enum class WState : uint8_t { Idle, WaitPrompt, TurboUp, NextChunk, SendProbe, WaitProbe, SendLoad, Ymodem, WaitLoadPrompt, SendWrite, WaitChain, WaitCrc, TurboDown, Error };
+  WState _ws = WState::Idle;
+
+  void writeTick();
+  void writeFeed(const uint8_t* data, size_t len);
+  void chunkWritten(const K2Bak::ChunkEntry& R, uint32_t gotCrc);
+  void probeDone(const K2Bak::ChunkEntry& R);
+  void advanceWrite(uint32_t blocks);
+  void retryChunk(const char* why);
+  void writeFinished();
+  void updateWriteProgress();
+  static bool readSlice(void* ctx, uint64_t off, uint8_t* out, size_t len);
 };
@@ -0,0 +1,111 @@
+#pragma once
+#include "Debug.h"
+#include <Arduino.h>
+#include <FS.h>
+
+#include "AppConfig.h"
+
+// Fingerprint of a disk (!backup scan): U-Boot's crc32 of every chunk of
+// the scanned ranges, no payload. Stored on SD as text, one chunk a line:
+//
+//   K2SCAN 1 <chunk blocks> <board id>
+//   <lba> <count> <crc32> <kind>          hex; kind 0 = all 0x00,
+//                                         F = all 0xFF, D = data
+//
+// Committing a new map keeps the one before as CFG_PATH_SCAN_PREV_FILE,
+// so two passes can be compared without a dump.
+namespace ScanMap {
+
+enum Kind : char { KIND_ZERO = '0', KIND_ERASED = 'F', KIND_DATA = 'D' };
+
+struct Entry {
+  uint32_t lba = 0;
+  uint32_t count = 0;
+  uint32_t crc = 0;
+  char kind = KIND_DATA;
+};
+
+// Blocks per kind, for "what is on the disk" at a glance.
+struct Summary {
+  uint32_t chunks = 0;
+  uint64_t zeroBlocks = 0;
+  uint64_t erasedBlocks = 0;
+  uint64_t dataBlocks = 0;
+
+  void add(const Entry& e);
+  String text() const;
+};
+
+class Writer {
+public:
+  bool begin(const String& boardId, uint32_t chunkBlocks, String* err);
+  bool add(const Entry& e, String* err);
+  // Replaces the current map; it becomes the previous one.
+  bool commit(String* err);
+  void discard();
+  bool active() const { return _open; }
+
+private:
+  File _f;
+  bool _open = false;
+};
+
+class Reader {
+public:
+  bool open(const char* path, String* err);
+  void close();
+  bool isOpen() const { return _open; }
+
+  // Next chunk; false at the end of the map or on a bad line (failed()).
+  bool next(Entry& e);
+  bool failed() const { return _bad; }
+
+  const String& boardId() const { return _boardId; }
+  uint32_t chunkBlocks() const { return _chunkBlocks; }
+  float progress() const;   // share of the file read
+
+private:
+  File _f;
+  bool _open = false;
+  bool _bad = false;
+  String _boardId;
+  uint32_t _chunkBlocks = 0;
+  uint64_t _read = 0;
+
+  char _buf[256];
+  size_t _len = 0;
+  size_t _pos = 0;
+  bool readLine(char* out, size_t outLen);
+};
+
+// Tally of a comparison chunk by chunk; the first changed spans are kept
+// (adjacent ones merged) for the report.
+class Diff {
+public:
+  void reset();
+  void same(const Entry& e);
+  void changed(const Entry& e);
+  void missing(const Entry& e);   // chunk has no counterpart on the other side
+
+  uint32_t changedChunks() const { return _changed; }
+  String summary(const char* against) const;
+
+private:
+  struct Span { uint32_t lba; uint32_t count; };
+  uint32_t _chunks = 0;
+  uint32_t _changed = 0;
+  uint32_t _missing = 0;
+  uint64_t _changedBlocks = 0;
+  uint64_t _missingBlocks = 0;
+  Span _spans[CFG_BACKUP_SCAN_DIFF_SPANS];
+  size_t _spanCount = 0;
+  bool _moreSpans = false;
+};
+
+Kind kindOf(uint32_t crc, uint32_t zeroCrc, uint32_t erasedCrc);
+
+// The map at path as runs of the same kind, one "<lba> +<count> <kind>
+// (<size>)" line each, at most maxLines.
+String runsText(const char* path, size_t maxLines);
+
+} // namespace ScanMap
@@ -41,6 +41,23 @@ inline bool saveFirmware(const uint8_t* data, size_t len) { return writeFileAtom
 // Caller must close.
 File openRead(SdItem item);
 
+// Streaming save for items too large for RAM (UART backups).
+// openTemp() opens "<path>.tmp" read/write (truncated); commitTemp() replaces
+// the cached item with it (on failure both files stay as they were),
+// discardTemp() throws it away. Caller closes the File before commit/discard.
+File openTemp(SdItem item);
+bool commitTemp(SdItem item);
+void discardTemp(SdItem item);
+// Reopens the temp file of an interrupted save read/write, cut back to size
+// bytes. Empty File if it is missing or shorter than that.
+File reopenTemp(SdItem item, uint64_t size);
+
+// Free space on the card in bytes (0 if not mounted).
+uint64_t freeBytes();
+
+// Path of the cached item (for status lines / logs).
+const char* path(SdItem item);
+
 // JSON: {mounted, backup_exists, backup_size, firmware_exists, firmware_size}
 String statusJson();
 
@@ -0,0 +1,62 @@
+#pragma once
+#include "Debug.h"
+#include <Arduino.h>
+
+// Temporarily raises the U-Boot console baud for bulk transfers:
+//   setenv baudrate N   -> "## Switch baudrate to N bps and press ENTER ..."
+//   switch our UART to N, send CR, then `echo K2_TURBO_OK` must come back.
+// Candidates are tried fastest first; a failed one is undone (both sides
+// back to the original baud, confirmed by echo) before the next is tried.
+// Nothing is saved (no saveenv), so a target reset also undoes it.
+class UBootBaudTurbo {
+public:
+  // Raise to the fastest candidate <= maxBaud that passes the echo probe.
+  void beginUp(HardwareSerial* target, uint32_t maxBaud);
+  // Return to the baud seen at beginUp().
+  void beginDown();
+
+  void feed(const uint8_t* data, size_t len);
+  // Drives the current phase; returns true once it finished.
+  bool tick();
+  bool running() const { return _st != St::Idle && _st != St::Done; }
+
+  bool raised() const { return _cur != _orig; }
+  uint32_t baud() const { return _cur; }
+  // Both sides may disagree (revert could not be confirmed).
+  bool lost() const { return _lost; }
+
+  // Blocking (~200 ms) best-effort return to the original baud, for cancel
+  // and error paths that can't wait for tick().
+  void revertNow();
+
+private:
+  enum class St : uint8_t { Idle, SendSetenv, WaitSwitch, Switch, SendEcho, WaitEcho, Done };
+  St _st = St::Idle;
+
+  HardwareSerial* _t = nullptr;
+  uint32_t _orig = 0;
+  uint32_t _cur = 0;
+  uint32_t _maxBaud = 0;
+  size_t _candIdx = 0;
+  uint32_t _want = 0;      // baud being switched to
+  bool _down = false;      // current switch returns to _orig
+  bool _searching = false; // beginUp(): a confirmed revert tries the next candidate
+  bool _lost = false;
+  uint8_t _echoTries = 0;
+
+  uint32_t _deadlineMs = 0;
+  uint32_t _switchMs = 0;
+
+  static constexpr size_t LINE_MAX = 96;
+  char _line[LINE_MAX];
+  size_t _len = 0;
+  bool _switchSeen = false;
+  bool _unsupported = false;
+  bool _echoSeen = false;
+
+  void parseLine();
+  bool nextCandidate();
+  void startSwitch(uint32_t baud, bool down);
+  void switchDone(bool ok);
+  void finish();
+};
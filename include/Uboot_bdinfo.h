@@ -0,0 +1,40 @@
+#pragma once
+#include "Debug.h"
+#include <Arduino.h>
+
+// Collects the memory layout from U-Boot's `bdinfo`:
+//   DRAM bank   = 0x00000000
+//   -> start    = 0x40000000
+//   -> size     = 0x80000000
+//   relocaddr   = 0xbff6e000
+//   sp start    = 0xbdf2beb0
+// (some architectures print memstart / memsize instead of banks).
+// Used to size how much of the disk can be staged at ${loadaddr} in one
+// mmc read without running into U-Boot's stack, heap or code.
+class UBootRamInfo {
+public:
+  void reset();
+  void feed(const uint8_t* data, size_t len);
+
+  // Bytes usable from addr upwards; 0 when bdinfo gave nothing to go on.
+  uint64_t roomAbove(uint64_t addr) const;
+
+private:
+  static constexpr size_t LINE_MAX = 96;
+  static constexpr size_t MAX_BANKS = 4;
+  // stack grows down from "sp start"; leave it room
+  static constexpr uint64_t STACK_MARGIN = 1024ULL * 1024ULL;
+
+  char _line[LINE_MAX];
+  size_t _len = 0;
+
+  struct Bank { uint64_t start; uint64_t size; };
+  Bank _banks[MAX_BANKS];
+  size_t _bankCount = 0;
+  bool _bankOpen = false;   // "-> start" seen, waiting for "-> size"
+
+  uint64_t _relocAddr = 0;
+  uint64_t _spStart = 0;
+
+  void parseLine();
+};
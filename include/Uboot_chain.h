@@ -0,0 +1,54 @@
+#pragma once
+#include "Debug.h"
+#include <Arduino.h>
+#include "Uboot_crc.h"
+
+// Demultiplexes the console output of one compound command line
+//   mmc read ${loadaddr} 0x800 0x40; crc32 ${loadaddr} 0x8000; md.l ${loadaddr} 0x2000
+//   mmc write ${loadaddr} 0x800 0x40; mmc read ${loadaddr} 0x800 0x40; crc32 ...
+// Sending the parts on one line saves a prompt round-trip per command.
+//
+// The header parts (mmc read status, crc32 result) are scanned line by
+// line; once they are all in, the rest of the stream is md output and is
+// handed back untouched so the hex decoder keeps its batch path.
+// U-Boot runs every part of a ';' chain even when one fails, so a failed
+// mmc read still dumps whatever ${loadaddr} held; check mmcOk().
+class UBootChainReply {
+public:
+  enum Part : uint8_t {
+    PART_MMC = 1u << 0,
+    PART_CRC = 1u << 1,
+    PART_MD  = 1u << 2,
+    PART_MMC_WRITE = 1u << 3,
+  };
+
+  void begin(uint8_t parts);
+
+  // Consumes header lines; returns how many bytes of data it used. When
+  // inMd(), the remaining data + n .. data + len belongs to md.
+  size_t feed(const uint8_t* data, size_t len);
+
+  uint8_t parts() const { return _parts; }
+  bool headerDone() const;
+  bool inMd() const { return (_parts & PART_MD) && headerDone(); }
+
+  bool mmcOk() const { return _mmcDone && _mmcOk; }
+  bool mmcFailed() const { return _mmcDone && !_mmcOk; }
+  bool mmcWriteOk() const { return _mmcWriteDone && _mmcWriteOk; }
+  bool mmcWriteFailed() const { return _mmcWriteDone && !_mmcWriteOk; }
+  const UBootCrcReply& crc() const { return _crc; }
+
+private:
+  static constexpr size_t LINE_MAX = 128;
+  char _line[LINE_MAX];
+  size_t _len = 0;
+
+  uint8_t _parts = 0;
+  bool _mmcDone = false;
+  bool _mmcOk = false;
+  bool _mmcWriteDone = false;
+  bool _mmcWriteOk = false;
+  UBootCrcReply _crc;
+
+  void parseLine();
+};
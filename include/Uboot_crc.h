@@ -0,0 +1,30 @@
+#pragma once
+#include "Debug.h"
+#include <Arduino.h>
+
+// Watches U-Boot console output for the result of a `crc32` command:
+// CRC32 for 42000000 ... 42007fff ==> 1a2b3c4d
+//
+// Only the 8 hex digits after "==>" are kept, so a whole chunk can be
+// checked with ~60 bytes on the wire instead of a full md.b dump.
+// Also flags "Unknown command" (U-Boot built without CONFIG_CMD_CRC32).
+class UBootCrcReply {
+public:
+  void reset();
+  void feed(const uint8_t* data, size_t len);
+
+  bool haveResult() const { return _have; }
+  uint32_t result() const { return _crc; }
+  bool unsupported() const { return _unsupported; }
+
+private:
+  static constexpr size_t LINE_MAX = 96;
+  char _line[LINE_MAX];
+  size_t _len = 0;
+
+  bool _have = false;
+  uint32_t _crc = 0;
+  bool _unsupported = false;
+
+  void parseLine();
+};
@@ -1,22 +1,104 @@
 #pragma once
-#include "Debug.h"
-#include <Arduino.h>
-#include <vector>
-#include "Appconfig.h"
+#include <stddef.h>
+#include <stdint.h>
 
-// Parses U-Boot md.b style lines like:
+// Streaming decoder for U-Boot md.b / md.w / md.l / md.q output:
 // 40010000: 01 02 03 04 05 06 07 08  ....
+// 40010000: 04030201 08070605 0c0b0a09 100f0e0d    ................
 //
-// Accepts CR/LF stream, returns extracted bytes.
+// Words are printed as native integers, so they are split back into bytes
+// in target memory order (little-endian unless told otherwise).
+//
+// Fed in batches straight from the UART; no line buffer, no heap. Decoded
+// bytes go to a caller-supplied span, optionally with CRC32 folded into the
+// same pass. Plain C++ (no Arduino) so tools/bench_hex_decode.cpp can run it
+// on the host.
+//
+// With a window set, each line's "ADDR:" is checked against the next
+// expected address: lost lines become exact gaps (re-fetch them with a
+// small md) and lines outside the window are ignored.
 class UBootHexParser {
 public:
+  // Clears line state (word width, endianness and CRC mode are kept).
   void reset();
-  void feed(const uint8_t* data, size_t len);
-  bool popBytes(std::vector<uint8_t>& out); // returns any newly parsed bytes
+
+  // Decodes [data, data+len). Up to outCap bytes are written to out (out may
+  // be nullptr to only count/CRC them); anything beyond is dropped.
+  // Returns the number of bytes decoded into the span.
+  // In window mode out/outCap describe the window: bytes land at
+  // out[addr - base] no matter in which order lines arrive.
+  size_t feed(const uint8_t* data, size_t len, uint8_t* out, size_t outCap);
+
+  // ---- address-checked window ----
+  static constexpr uint64_t BASE_FROM_FIRST_LINE = ~0ULL;
+  struct Gap { uint64_t addr; uint32_t len; };
+  static constexpr size_t MAX_GAPS = 8;
+
+  // Expect one md of [base, base+len). Clears gaps.
+  void beginWindow(uint64_t base, size_t len);
+  // Expect an md of [addr, addr+len) inside the window (re-fetch of a gap).
+  void expectRange(uint64_t addr, size_t len);
+  void endWindow() { _windowed = false; }
+
+  // The expected range has been seen up to its end (gaps may remain).
+  bool streamDone() const { return _baseKnown && _next >= _end; }
+  // The md finished: whatever is still expected becomes a gap.
+  void closeStream();
+
+  size_t gapCount() const { return _gapCount; }
+  bool gapsOverflowed() const { return _gapOverflow; }
+  bool takeGap(Gap& g); // removes and returns the first gap
+
+  uint64_t windowBase() const { return _base; }
+  uint64_t lastLineAddr() const { return _lastLineAddr; }
+
+  // width: 1 (md.b), 2 (md.w), 4 (md.l) or 8 (md.q)
+  void setWordWidth(uint8_t width, bool bigEndian = false);
+  uint8_t wordWidth() const { return _width; }
+
+  // md suffix for a width: 'b', 'w', 'l', 'q'
+  static char mdSuffix(uint8_t width);
+
+  // Fused CRC32 (0xEDB88320) over every byte written by feed().
+  void crcBegin(uint32_t seed = 0xFFFFFFFFu) { _crcOn = true; _crc = seed; _inOrder = true; }
+  void crcOff() { _crcOn = false; }
+  uint32_t crcValue() const { return _crc ^ 0xFFFFFFFFu; }
+  // False once a window saw a gap or a re-fetch: the fused CRC then no
+  // longer matches the window and must be recomputed over the buffer.
+  bool crcInOrder() const { return _inOrder; }
 
 private:
-  String _lineBuf;
-  std::vector<uint8_t> _pending;
+  enum class St : uint8_t { Addr, Sep, Digit, AfterWord, Skip };
+  St _st = St::Addr;
+
+  uint8_t _width = 1;
+  bool _bigEndian = false;
+
+  uint8_t _word[8];
+  uint8_t _nibbles = 0;     // hex digits of the current word seen so far
+
+  // current line
+  uint64_t _lineAddr = 0;
+  uint32_t _lineBytes = 0;
+  bool _lineLead = false;   // line is at/after _next (not a fill-in)
+  uint64_t _lastLineAddr = 0;
+
+  // window
+  bool _windowed = false;
+  bool _baseKnown = false;
+  uint64_t _base = 0;
+  size_t _winLen = 0;
+  uint64_t _next = 0;
+  uint64_t _end = 0;
+  Gap _gaps[MAX_GAPS];
+  size_t _gapCount = 0;
+  bool _gapOverflow = false;
+
+  bool _crcOn = false;
+  bool _inOrder = true;
+  uint32_t _crc = 0xFFFFFFFFu;
 
-  bool parseLine(const String& line);
+  bool lineStart();
+  void addGap(uint64_t addr, uint64_t end);
+  size_t emitWord(uint8_t* out, size_t outCap, size_t seqPos);
 };
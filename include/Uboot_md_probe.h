@@ -0,0 +1,56 @@
+#pragma once
+#include "Debug.h"
+#include <Arduino.h>
+#include "Uboot_hex_parser.h"
+
+// Finds the widest md variant the target prints correctly:
+//   mw.l ${loadaddr} 0x04030201 4   -> 16 known bytes
+//   md.b ${loadaddr} 0x10           -> memory order (endianness), numeric address
+//   mw.l <addr+4> 0x08070605 1      -> the two halves of the first md.q word differ
+//   md.b ${loadaddr} 0x10           -> reference bytes
+//   md.q / md.l / md.w              -> first one that decodes to the same bytes
+// Wider words need fewer characters per byte on the wire (md.b ~4.9,
+// md.l ~4.2, md.q ~4.1 incl. address + ASCII column).
+// The md.b reply also yields the numeric ${loadaddr} (for re-fetching gaps).
+// Clobbers 16 bytes at ${loadaddr}; run it before the first mmc read.
+class UBootMdProbe {
+public:
+  void start(HardwareSerial* target);
+  void feed(const uint8_t* data, size_t len);
+
+  // Drives the probe; returns true once finished (width() is valid then).
+  bool tick();
+  bool running() const { return _st != St::Idle && _st != St::Done; }
+
+  uint8_t width() const { return _width; }
+  bool bigEndian() const { return _bigEndian; }
+  bool hasLoadAddr() const { return _haveLoadAddr; }
+  uint64_t loadAddr() const { return _loadAddr; }
+
+private:
+  enum class St : uint8_t { Idle, SendMw, WaitMw, SendMdB, WaitMdB, SendMwHi, WaitMwHi, SendMdW, WaitMdW, Done };
+  St _st = St::Idle;
+
+  HardwareSerial* _t = nullptr;
+  uint8_t _last1 = 0, _last2 = 0;
+  uint32_t _promptCount = 0;
+  uint32_t _cmdPromptMark = 0;
+  uint32_t _deadlineMs = 0;
+
+  static constexpr size_t PROBE_BYTES = 16;
+
+  UBootHexParser _hex;
+  uint8_t _got[PROBE_BYTES];
+  size_t _gotLen = 0;
+  uint8_t _ref[PROBE_BYTES];  // md.b bytes
+
+  uint8_t _width = 1;
+  bool _bigEndian = false;
+  bool _haveLoadAddr = false;
+  uint64_t _loadAddr = 0;
+  size_t _tryIdx = 0;
+  bool _hiWritten = false;    // the long at +4 holds 0x08070605
+
+  void send(const char* cmd, St next);
+  void finish(uint8_t width);
+};
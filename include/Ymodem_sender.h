@@ -0,0 +1,80 @@
+#pragma once
+#include "Debug.h"
+#include <Arduino.h>
+#include <vector>
+
+// YMODEM-1K sender for U-Boot's `loady`:
+//   'C'              <- receiver asks for CRC-16 mode
+//   SOH 00 FF "name\0size\0" ... CRC16  -> ACK, then 'C' again
+//   STX nn ~nn <1024 bytes> CRC16       -> ACK (NAK: resend), CAN CAN aborts
+//   EOT                                 -> ACK (a NAK is answered with EOT again)
+//   'C', SOH 00 FF <zeros> CRC16        -> end of batch
+// The payload is pulled through read() into two staging buffers: while a
+// packet waits for its ACK, tick() refills the buffer the transfer has
+// already left, so SD / flash / LZ4 reads overlap with the UART.
+// The tail of the last packet is padded with 0x1A; `loady` keeps the size
+// from block 0, so ${filesize} is exact.
+class YmodemSender {
+public:
+  // Copies len payload bytes starting at off into out; false aborts.
+  typedef bool (*ReadFn)(void* ctx, uint64_t off, uint8_t* out, size_t len);
+
+  void begin(HardwareSerial* target, const char* name, uint64_t size, ReadFn read, void* ctx);
+  void feed(const uint8_t* data, size_t len);
+
+  // Drives the transfer; returns true once it finished (ok() or not).
+  bool tick();
+  bool running() const { return _st != St::Idle && _st != St::Done && _st != St::Failed; }
+  bool ok() const { return _st == St::Done; }
+  // The receiver answered at least once (loady is running on the target).
+  bool started() const { return _started; }
+  String error() const { return _err; }
+
+  uint64_t size() const { return _size; }
+  uint64_t ackedBytes() const { return _acked; }
+
+  // Stops the receiver (CAN CAN) and fails the transfer.
+  void cancel(const char* why = "cancelled");
+
+  // CRC-16/XMODEM (poly 0x1021, init 0), as carried by every packet.
+  // crc continues a running value (ZMODEM subpackets).
+  static uint16_t crc16(const uint8_t* data, size_t len, uint16_t crc = 0);
+
+private:
+  enum class St : uint8_t { Idle, WaitC, WaitHdrAck, WaitDataC, WaitDataAck, WaitEotAck, WaitEndC, WaitEndAck, Done, Failed };
+  St _st = St::Idle;
+
+  HardwareSerial* _t = nullptr;
+  ReadFn _read = nullptr;
+  void* _ctx = nullptr;
+  String _name;
+  uint64_t _size = 0;
+  uint64_t _acked = 0;     // payload bytes the receiver confirmed
+  uint8_t _seq = 0;        // sequence number of the packet in flight
+  uint8_t _tries = 0;      // sends of the packet in flight
+  bool _started = false;
+  String _err;
+  uint32_t _deadlineMs = 0;
+  uint8_t _prev = 0;       // previous receiver byte (tells 'C' from text)
+
+  static constexpr size_t BLOCK = 1024;
+  uint8_t _pkt[3 + BLOCK + 2];
+  size_t _pktLen = 0;
+
+  // Double buffer: slot s holds payload [_stageOff[s], _stageOff[s] + _stageLen[s])
+  std::vector<uint8_t> _stage[2];
+  uint64_t _stageOff[2] = { 0, 0 };
+  size_t _stageLen[2] = { 0, 0 };
+  uint64_t _nextFill = 0;  // payload offset the next refill starts at
+
+  void onByte(uint8_t c);
+  bool fillSlot(int s);
+  void prefetch();
+  const uint8_t* payloadAt(uint64_t off);
+  void sendHeader(bool last);
+  bool sendData();
+  void sendEot();
+  void resend();
+  void expect(St st, uint32_t ms);
+  void fail(const String& why);
+};
@@ -0,0 +1,184 @@
+#pragma once
+#include "Debug.h"
+#include <Arduino.h>
+#include <vector>
+
+// ZMODEM (lrzsz `sz` / `rz` on a Linux target), one session at a time.
+//
+//   receive (target runs sz):             send (target runs rz):
+//   <- ZRQINIT                            -> ZRQINIT
+//   -> ZRINIT                             <- ZRINIT (flags, buffer size)
+//   <- ZFILE + "name\0size ..."           -> ZFILE + "name\0size mtime mode"
+//   -> ZRPOS(n)   n > 0 resumes            <- ZRPOS(n)
+//   <- ZDATA(n) + subpackets ... ZEOF      -> ZDATA(n) + subpackets ... ZEOF
+//   -> ZRINIT, <- ZFIN, -> ZFIN, <- "OO"   <- ZRINIT, -> ZFIN, <- ZFIN, -> "OO"
+//
+// Headers and data subpackets carry CRC-32 (CRC-16 when the peer lacks
+// CANFC32), updated as the bytes stream through. The receiver answers hex
+// headers only, like rz. A bad subpacket or a stall is answered with ZRPOS
+// at the last good byte; the sender rewinds there.
+//
+// Sender: subpackets go out back to back (ZCRCG); every quarter window
+// one asks for a ZACK (ZCRCQ), and nothing is sent more than
+// CFG_ZMODEM_WINDOW_BYTES past the last ZACK. A receiver with a buffer
+// size in its ZRINIT gets a ZCRCW (wait for ZACK) before it would
+// overflow; one that can't overlap I/O (no CANOVIO) gets one per
+// subpacket.
+// Crash recovery: a resumed send sets ZCRESUM so rz keeps what it already
+// has; on receive, open() reports the bytes already held when the sender
+// sets ZCRESUM (sz -r), and ZRPOS asks for the rest.
+// Output is queued and written as the UART TX ring has room, so tick()
+// never blocks on the line.
+class Zmodem {
+public:
+  // Sender: copies len bytes at off into out; false aborts.
+  typedef bool (*ReadFn)(void* ctx, uint64_t off, uint8_t* out, size_t len);
+  // Receiver: a file is offered. False skips it; resumeAt = bytes already
+  // held (only asked for when the sender allows recovery).
+  typedef bool (*OpenFn)(void* ctx, const char* name, uint64_t size, bool resume, uint64_t& resumeAt);
+  typedef bool (*WriteFn)(void* ctx, uint64_t off, const uint8_t* data, size_t len);
+  typedef void (*CloseFn)(void* ctx, bool complete);
+
+  // ZRPOS / ZDATA carry 32-bit offsets
+  static constexpr uint64_t MAX_FILE_BYTES = 0xFFFFFFFFULL;
+
+  void beginSend(HardwareSerial* target, const char* name, uint64_t size, uint32_t mtime,
+                 bool resume, ReadFn read, void* ctx);
+  // waitForSender: don't offer ZRINIT before the sender's ZRQINIT (sz
+  // still being started on the shell)
+  void beginReceive(HardwareSerial* target, bool waitForSender,
+                    OpenFn open, WriteFn write, CloseFn close, void* ctx);
+
+  void feed(const uint8_t* data, size_t len);
+  // Drives the session; returns true once it finished (ok() or not).
+  bool tick();
+
+  bool running() const { return _st != St::Idle && _st != St::Done && _st != St::Failed; }
+  bool ok() const { return _st == St::Done; }
+  bool sending() const { return _send; }
+  String error() const { return _err; }
+
+  const String& fileName() const { return _name; }
+  uint64_t size() const { return _size; }
+  uint64_t bytes() const { return _send ? _ackPos : _pos; }   // confirmed by / written at the receiver
+  uint64_t resumedAt() const { return _resumedAt; }
+  uint32_t files() const { return _files; }
+  uint32_t errors() const { return _errors; }
+
+  // Stops the peer (CAN x8) and fails the session.
+  void cancel(const char* why = "cancelled");
+
+  // Spots sz / rz announcing themselves (hex ZRQINIT / ZRINIT) in console
+  // output, for auto-start.
+  class Detector {
+  public:
+    enum class Seen : uint8_t { None, Sender, Receiver };
+    Seen feed(uint8_t c);
+  private:
+    uint8_t _matched = 0;
+  };
+
+private:
+  enum class St : uint8_t {
+    Idle,
+    // sender
+    SWaitRinit, SWaitRpos, SData, SWaitAck, SWaitEof, SWaitFin,
+    // receiver
+    RWaitFile, RData, RWaitOO,
+    Done, Failed
+  };
+  enum class Rx : uint8_t { Hunt, Pad, Format, HexHdr, BinHdr, Data, DataCrc };
+
+  St _st = St::Idle;
+  bool _send = false;
+  HardwareSerial* _t = nullptr;
+  void* _ctx = nullptr;
+  ReadFn _read = nullptr;
+  OpenFn _open = nullptr;
+  WriteFn _write = nullptr;
+  CloseFn _close = nullptr;
+  String _err;
+  uint32_t _deadlineMs = 0;
+  uint8_t _tries = 0;
+  uint32_t _errors = 0;
+
+  String _name;
+  uint64_t _size = 0;
+  uint32_t _mtime = 0;
+  bool _resume = false;
+  uint64_t _resumedAt = 0;
+  uint32_t _files = 0;
+
+  // sender
+  uint64_t _txPos = 0;       // next file byte to send
+  uint64_t _ackPos = 0;      // last ZACK / ZRPOS
+  uint64_t _lastQ = 0;       // where the last ZCRCQ / ZCRCW went out
+  bool _inFrame = false;     // a ZDATA frame is open
+  bool _peerCrc32 = false;
+  bool _peerEscCtl = false;
+  bool _ovio = true;         // receiver takes data while writing (CANFDX + CANOVIO)
+  uint32_t _rxBuf = 0;       // receiver's buffer size, 0 = unlimited
+  uint32_t _window = 0;      // bytes in flight past the last ZACK
+  size_t _subMax = 0;        // bytes per subpacket
+  bool _closing = false;     // "OO" queued, done once it's out
+
+  // receiver
+  uint64_t _pos = 0;         // bytes written
+  uint8_t _subFor = 0;       // header the expected subpacket belongs to
+  uint8_t _subFlags = 0;     // and that header's ZF0
+  bool _waitSender = false;
+  bool _fileOpen = false;
+  uint8_t _oo = 0;           // 'O's after our ZFIN
+
+  // incoming frame parser
+  Rx _rx = Rx::Hunt;
+  bool _rxCrc32 = false;
+  bool _esc = false;
+  uint8_t _can = 0;
+  uint8_t _hdr[9];
+  uint8_t _hdrLen = 0;
+  uint8_t _hex[14];
+  uint8_t _hexLen = 0;
+  std::vector<uint8_t> _sub;
+  size_t _subLen = 0;
+  uint8_t _subEnd = 0;
+  uint8_t _crcBytes[4];
+  uint8_t _crcLen = 0;
+
+  // outgoing queue
+  std::vector<uint8_t> _tx;
+  size_t _txSent = 0;
+  std::vector<uint8_t> _io;  // one subpacket of file data
+  uint8_t _lastOut = 0;
+
+  void reset(HardwareSerial* target, void* ctx);
+  void expect(St st, uint32_t ms);
+  void fail(const String& why);
+  bool timedOut() const;
+  bool retry(const char* what);
+
+  // parser
+  void onByte(uint8_t c);
+  int unescape(uint8_t c, bool& frameEnd);
+  void onHeader(uint8_t type, const uint8_t p[4]);
+  void onSubpacket(bool good);
+  void expectSubpacket(uint8_t forType);
+
+  void onSenderHeader(uint8_t type, uint32_t pos, const uint8_t p[4]);
+  void onReceiverHeader(uint8_t type, uint32_t pos, const uint8_t p[4]);
+
+  // output
+  void pump();
+  bool txIdle() const { return _txSent >= _tx.size(); }
+  void put(uint8_t c);
+  void putEscaped(uint8_t c);
+  void sendHexHeader(uint8_t type, uint32_t arg);
+  void sendHexHeader(uint8_t type, const uint8_t p[4]);
+  void sendBinHeader(uint8_t type, uint32_t arg);
+  void sendBinHeader(uint8_t type, const uint8_t p[4]);
+  void sendZrinit();
+  void sendSubpacket(const uint8_t* data, size_t len, uint8_t end);
+  void sendZfile();
+  bool sendData();
+  void sendCrcReply(uint32_t len);
+};
@@ -0,0 +1,62 @@
+#pragma once
+#include "Debug.h"
+#include <Arduino.h>
+#include <FS.h>
+#include "Zmodem.h"
+
+// File transfer with a Linux shell on the target over the console UART
+// (lrzsz), stored on the bridge's SD card or LittleFS.
+//
+//   !zm send [-r] [sd:|fs:]<path>   types "rz", then sends the file
+//   !zm recv [-r] <remote path>     types "sz <path>", file lands in
+//                                   CFG_ZMODEM_RX_DIR on SD
+//
+// Received files are written as "<name>.part" and renamed once complete.
+// An interrupted one keeps its .part: "recv -r" runs "sz -r" and carries on
+// from its length; "send -r" runs "rz -r", which keeps what the target
+// already has.
+// With CFG_ZMODEM_AUTOSTART, an sz started by hand in the console (its
+// ZRQINIT in the RX stream) is received without a command; an rz started by
+// hand waits for "!zm send".
+// While a session runs it owns the UART: target bytes go to the engine
+// only and console input is dropped.
+class ZmodemTransfer {
+public:
+  void begin(HardwareSerial* target);
+
+  bool startSend(const String& path, bool resume, String* err);
+  bool startReceive(const String& remote, bool resume, String* err);
+
+  // Every target byte. True: the bytes belonged to a session and must not
+  // be echoed to the consoles. allowAutostart: nothing else is using the
+  // UART.
+  bool onTargetBytes(const uint8_t* data, size_t len, bool allowAutostart);
+  void tick();
+
+  bool running() const { return _zm.running(); }
+  void cancel();
+  String statusLine() const;
+
+private:
+  HardwareSerial* _t = nullptr;
+  Zmodem _zm;
+  Zmodem::Detector _detect;
+  uint32_t _rzSeenMs = 0;      // rz announced itself (ZRINIT) without us
+  bool _active = false;        // a session ran and its result isn't in yet
+
+  fs::File _file;
+  String _path;                // send: source; receive: final name on SD
+  String _partPath;
+  uint64_t _rxAt = 0;          // receive: bytes in the .part file
+  String _last = "zm: idle";
+
+  static bool readCb(void* ctx, uint64_t off, uint8_t* out, size_t len);
+  static bool openCb(void* ctx, const char* name, uint64_t size, bool resume, uint64_t& resumeAt);
+  static bool writeCb(void* ctx, uint64_t off, const uint8_t* data, size_t len);
+  static void closeCb(void* ctx, bool complete);
+
+  bool openRx(const char* name, uint64_t size, bool resume, uint64_t& resumeAt);
+  void closeRx(bool complete);
+  void finish();
+  void beginReceive(bool waitForSender);
+};
@@ -33,6 +33,9 @@ const char* CFG_PATH_ENV_DIR     = "/env";
 
 const char* CFG_PATH_BACKUP_FILE = "/backup.k2bak";
 const char* CFG_PATH_FW_FILE     = "/firmware.bin";
+const char* CFG_PATH_SCAN_FILE      = "/scan.k2scan";
+const char* CFG_PATH_SCAN_PREV_FILE = "/scan.prev.k2scan";
+const char* CFG_PATH_BACKUP_CKPT_FILE = "/backup.k2bak.ckpt";
 
 const size_t CFG_IO_CHUNK_BYTES  = 4096;
 
@@ -50,6 +53,9 @@ const char* CFG_PREF_NS_BACKUP   = "bridge";
 const char* CFG_PREF_KEY_PROFILE = "bk_profile";
 const char* CFG_PREF_KEY_CSTART  = "bk_cstart";
 const char* CFG_PREF_KEY_CCOUNT  = "bk_ccount";
+const char* CFG_PREF_KEY_RATE_UBOOT  = "bk_rate_ub";
+const char* CFG_PREF_KEY_RATE_LINUX  = "bk_rate_lx";
+const char* CFG_PREF_KEY_SKIP_PREFIX = "bk_sk_";
 
 // -------------------- Web UI --------------------
 const char* CFG_WEBUI_TITLE     = APP_NAME;
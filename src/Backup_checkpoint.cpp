@@ -0,0 +1,235 @@
+#include "Backup_checkpoint.h"
+#include "Crc32.h"
+#include "Debug.h"
+#include <SD.h>
+#include <cstring>
+
+DBG_REGISTER_MODULE(__FILE__);
+
+namespace BackupCheckpoint {
+
+static const uint8_t MAGIC[6] = { 'K','2','C','K','P','T' };
+static constexpr uint8_t VERSION = 1;
+
+static String tempPath() {
+  return String(CFG_PATH_BACKUP_CKPT_FILE) + ".tmp";
+}
+
+// ------------------------------------------------------------
+// Encoding: little-endian fields as the .k2bak tables, strings as
+// u32 length + bytes
+// ------------------------------------------------------------
+
+static void put(std::vector<uint8_t>& v, const void* p, size_t n) {
+  const uint8_t* b = (const uint8_t*)p;
+  v.insert(v.end(), b, b + n);
+}
+
+static void put32(std::vector<uint8_t>& v, uint32_t x) { put(v, &x, sizeof(x)); }
+static void put64(std::vector<uint8_t>& v, uint64_t x) { put(v, &x, sizeof(x)); }
+
+static void putStr(std::vector<uint8_t>& v, const String& s) {
+  put32(v, (uint32_t)s.length());
+  put(v, s.c_str(), s.length());
+}
+
+class In {
+public:
+  In(const uint8_t* p, size_t n) : _p(p), _n(n) {}
+
+  bool get(void* out, size_t n) {
+    if (!_ok || n > _n - _off) return _ok = false;
+    memcpy(out, _p + _off, n);
+    _off += n;
+    return true;
+  }
+  uint32_t u32() { uint32_t x = 0; get(&x, sizeof(x)); return x; }
+  uint64_t u64() { uint64_t x = 0; get(&x, sizeof(x)); return x; }
+  String str() {
+    const uint32_t n = u32();
+    if (!_ok || n > _n - _off) { _ok = false; return String(); }
+    String s;
+    s.reserve(n);
+    for (uint32_t i = 0; i < n; i++) s += (char)_p[_off + i];
+    _off += n;
+    return s;
+  }
+  bool ok() const { return _ok; }
+  bool atEnd() const { return _off == _n; }
+
+private:
+  const uint8_t* _p;
+  size_t _n;
+  size_t _off = 0;
+  bool _ok = true;
+};
+
+// ------------------------------------------------------------
+// Save / load
+// ------------------------------------------------------------
+
+bool save(const Data& d, String* err) {
+  std::vector<uint8_t> v;
+  v.reserve(256 + d.ranges.size() * 32 + d.writer.ranges.size() * sizeof(K2Bak::RangeEntryV3) +
+            d.writer.chunks.size() * sizeof(K2Bak::ChunkEntry));
+  put(v, MAGIC, sizeof(MAGIC));
+  v.push_back(VERSION);
+  v.push_back((uint8_t)((d.linuxShell ? 1u : 0u) | (d.incremental ? 2u : 0u)));
+  putStr(v, d.boardId);
+  put32(v, d.rangeIdx);
+  put32(v, d.blocksPerChunk);
+  put64(v, d.plannedBytes);
+  put64(v, d.skippedBytes);
+  put64(v, d.reusedBytes);
+  put32(v, d.tailCrc);
+
+  put32(v, (uint32_t)d.ranges.size());
+  for (const Range& r : d.ranges) {
+    put32(v, r.lba_start);
+    put32(v, r.lba_count);
+    put32(v, r.done_blocks);
+    putStr(v, r.dev);
+    put32(v, r.dev_lba);
+  }
+
+  const K2Bak::StreamState& w = d.writer;
+  put(v, &w.h, sizeof(w.h));
+  v.push_back((uint8_t)((w.inRange ? 1u : 0u) | (w.compress ? 2u : 0u)));
+  put32(v, w.lba);
+  put64(v, w.rawBytes);
+  put64(v, w.storedBytes);
+  put64(v, w.size);
+  put32(v, (uint32_t)w.ranges.size());
+  put(v, w.ranges.data(), w.ranges.size() * sizeof(K2Bak::RangeEntryV3));
+  put32(v, (uint32_t)w.chunks.size());
+  put(v, w.chunks.data(), w.chunks.size() * sizeof(K2Bak::ChunkEntry));
+  put32(v, Crc32::of(v.data(), v.size()));
+
+  const String tmp = tempPath();
+  File f = SD.open(tmp.c_str(), FILE_WRITE);
+  if (!f) {
+    if (err) *err = String("cannot create ") + tmp;
+    return false;
+  }
+  const size_t n = f.write(v.data(), v.size());
+  f.flush();
+  f.close();
+  if (n != v.size()) {
+    SD.remove(tmp.c_str());
+    if (err) *err = "SD write failed (checkpoint)";
+    return false;
+  }
+  if (SD.exists(CFG_PATH_BACKUP_CKPT_FILE)) SD.remove(CFG_PATH_BACKUP_CKPT_FILE);
+  if (!SD.rename(tmp.c_str(), CFG_PATH_BACKUP_CKPT_FILE)) {
+    if (err) *err = String("cannot rename checkpoint to ") + CFG_PATH_BACKUP_CKPT_FILE;
+    return false;
+  }
+  return true;
+}
+
+static bool decode(const std::vector<uint8_t>& v, Data& d) {
+  if (v.size() < sizeof(MAGIC) + 2 + 4 || memcmp(v.data(), MAGIC, sizeof(MAGIC)) != 0 ||
+      v[sizeof(MAGIC)] != VERSION) {
+    return false;
+  }
+  uint32_t crc = 0;
+  memcpy(&crc, v.data() + v.size() - 4, 4);
+  if (Crc32::of(v.data(), v.size() - 4) != crc) return false;
+
+  In in(v.data() + sizeof(MAGIC) + 2, v.size() - sizeof(MAGIC) - 2 - 4);
+  const uint8_t flags = v[sizeof(MAGIC) + 1];
+  d = Data();
+  d.linuxShell = (flags & 1u) != 0;
+  d.incremental = (flags & 2u) != 0;
+  d.boardId = in.str();
+  d.rangeIdx = in.u32();
+  d.blocksPerChunk = in.u32();
+  d.plannedBytes = in.u64();
+  d.skippedBytes = in.u64();
+  d.reusedBytes = in.u64();
+  d.tailCrc = in.u32();
+
+  const uint32_t nr = in.u32();
+  for (uint32_t i = 0; in.ok() && i < nr; i++) {
+    Range r;
+    r.lba_start = in.u32();
+    r.lba_count = in.u32();
+    r.done_blocks = in.u32();
+    r.dev = in.str();
+    r.dev_lba = in.u32();
+    d.ranges.push_back(r);
+  }
+
+  K2Bak::StreamState& w = d.writer;
+  uint8_t wflags = 0;
+  in.get(&w.h, sizeof(w.h));
+  in.get(&wflags, 1);
+  w.inRange = (wflags & 1u) != 0;
+  w.compress = (wflags & 2u) != 0;
+  w.lba = in.u32();
+  w.rawBytes = in.u64();
+  w.storedBytes = in.u64();
+  w.size = in.u64();
+  const uint32_t wr = in.u32();
+  if (!in.ok() || wr > v.size() / sizeof(K2Bak::RangeEntryV3)) return false;
+  w.ranges.resize(wr);
+  in.get(w.ranges.data(), wr * sizeof(K2Bak::RangeEntryV3));
+  const uint32_t wc = in.u32();
+  if (!in.ok() || wc > v.size() / sizeof(K2Bak::ChunkEntry)) return false;
+  w.chunks.resize(wc);
+  in.get(w.chunks.data(), wc * sizeof(K2Bak::ChunkEntry));
+
+  return in.ok() && in.atEnd() && w.h.header_size == sizeof(K2Bak::HeaderV3) &&
+         d.rangeIdx <= d.ranges.size();
+}
+
+static bool loadFrom(const char* path, Data& d) {
+  File f = SD.open(path, FILE_READ);
+  if (!f) return false;
+  std::vector<uint8_t> v((size_t)f.size());
+  const size_t n = v.empty() ? 0 : f.read(v.data(), v.size());
+  f.close();
+  return n == v.size() && decode(v, d);
+}
+
+bool load(Data& d, String* err) {
+  // a crash between remove and rename leaves only the new one, as .tmp
+  if (loadFrom(CFG_PATH_BACKUP_CKPT_FILE, d)) return true;
+  if (loadFrom(tempPath().c_str(), d)) return true;
+  if (err) *err = exists() ? "checkpoint is damaged" : "no interrupted backup on SD";
+  return false;
+}
+
+bool exists() {
+  return SD.exists(CFG_PATH_BACKUP_CKPT_FILE) || SD.exists(tempPath().c_str());
+}
+
+void remove() {
+  if (SD.exists(CFG_PATH_BACKUP_CKPT_FILE)) SD.remove(CFG_PATH_BACKUP_CKPT_FILE);
+  const String tmp = tempPath();
+  if (SD.exists(tmp.c_str())) SD.remove(tmp.c_str());
+}
+
+bool tailCrc(K2Bak::Sink& sink, uint64_t payloadOff, uint64_t size, uint32_t& out) {
+  uint64_t off = size > payloadOff + TAIL_BYTES ? size - TAIL_BYTES : payloadOff;
+  uint8_t buf[512];
+  uint32_t crc = Crc32::INIT;
+  while (off < size) {
+    const size_t want = size - off > sizeof(buf) ? sizeof(buf) : (size_t)(size - off);
+    if (sink.read(off, buf, want) != want) return false;
+    crc = Crc32::update(crc, buf, want);
+    off += want;
+  }
+  out = Crc32::finish(crc);
+  return true;
+}
+
+String describe(const Data& d) {
+  uint64_t done = 0;
+  for (const Range& r : d.ranges) done += (uint64_t)r.done_blocks * 512ULL;
+  const unsigned pct = d.plannedBytes ? (unsigned)(done * 100ULL / d.plannedBytes) : 0;
+  return String((unsigned long)(done / 1024ULL / 1024ULL)) + " of " +
+         String((unsigned long)(d.plannedBytes / 1024ULL / 1024ULL)) + " MiB (" + String(pct) + "%)";
+}
+
+} // namespace BackupCheckpoint
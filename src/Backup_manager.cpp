@@ -1,11 +1,16 @@
 #include "Backup_manager.h"
 #include <Arduino.h>
 #include "Debug.h"
+#include "BlueprintRuntime.h"
+#include <algorithm>
 #include <cstdarg>
 #include <cstdio>
 
 DBG_REGISTER_MODULE(__FILE__);
 
+static_assert(CFG_LINUX_DUMP_BLOCKS_PER_CHUNK <= CFG_BACKUP_MAX_BLOCKS_PER_CHUNK,
+              "Linux dump chunks are inflated into the md chunk buffer");
+
 // -----------------------------------------------------------------------------
 // Backup debug logger (no local config macros; controlled by DEBUG_BACKUP)
 // Works on HWCDC (USB CDC) where Serial.vprintf() is not available.
@@ -63,6 +68,15 @@ static bool appendProfileRanges(const String& profileId,
   return true;
 }
 
+static uint64_t profileBytes(const String& profileId, uint32_t customCount) {
+  std::vector<ProfileRange> planned;
+  if (profileId.equalsIgnoreCase("CUSTOM")) return (uint64_t)customCount * 512ULL;
+  if (!appendProfileRanges(profileId, planned, nullptr)) return 0;
+  uint64_t bytes = 0;
+  for (const ProfileRange& r : planned) bytes += (uint64_t)r.count * 512ULL;
+  return bytes;
+}
+
 // -----------------------------------------------------------------------------
 // BackupManager
 // -----------------------------------------------------------------------------
@@ -121,19 +135,106 @@ bool BackupManager::getLastBackup(std::vector<uint8_t>& out) const {
   return true;
 }
 
+uint32_t BackupManager::consoleBaud() const {
+  return (_t && _t->baudRate()) ? _t->baudRate() : 115200;
+}
+
+// The last dumps' figures in this mode, blended (keepRateModel); the wire
+// stand-in at the console baud when there are none.
+JobRate::Model BackupManager::loadRateModel(bool linuxShell, const String& profileId,
+                                            uint16_t* skipPermille, bool* learned) const {
+  JobRate::Model m;
+  uint32_t skip = 0;
+  if (_prefs) {
+    const char* key = linuxShell ? CFG_PREF_KEY_RATE_LINUX : CFG_PREF_KEY_RATE_UBOOT;
+    _prefs->begin(CFG_PREF_NS_BACKUP, true);
+    if (_prefs->getBytesLength(key) == sizeof(m)) _prefs->getBytes(key, &m, sizeof(m));
+    if (!linuxShell) skip = _prefs->getUInt((String(CFG_PREF_KEY_SKIP_PREFIX) + profileId).c_str(), 0);
+    _prefs->end();
+  }
+  if (skipPermille) *skipPermille = (uint16_t)(skip > 1000 ? 1000 : skip);
+  if (learned) *learned = m.baud && m.rate;
+  if (m.baud && m.rate) return m;
+  if (linuxShell) {
+    return JobRate::wireModel(consoleBaud(), CFG_JOB_RATE_LINUX_CHARS_X10, CFG_LINUX_DUMP_BLOCKS_PER_CHUNK * 512UL);
+  }
+  return JobRate::wireModel(consoleBaud(), CFG_JOB_RATE_WIRE_CHARS_X10, CFG_BACKUP_DEFAULT_BLOCKS_PER_CHUNK * 512UL);
+}
+
+// Leaves this dump's figures for the next estimate. Scans, table reads and
+// short runs say little about a dump; the fill share is the profile's own
+// (an incremental run's would count unchanged chunks too).
+void BackupManager::keepRateModel() {
+  if (_rateKept || !_prefs || !_uartRawDump || _scan || _gptListOnly) return;
+  if (_jobRate.chunks() < CFG_JOB_RATE_MIN_CHUNKS) return;
+  const JobRate::Model latest = _jobRate.model(consoleBaud());
+  if (!latest.baud) return;   // nothing moved: only fill runs
+  _rateKept = true;
+
+  const char* key = _linux ? CFG_PREF_KEY_RATE_LINUX : CFG_PREF_KEY_RATE_UBOOT;
+  const JobRate::Model m = JobRate::blend(loadRateModel(_linux, _profileId, nullptr), latest);
+  _prefs->begin(CFG_PREF_NS_BACKUP, false);
+  _prefs->putBytes(key, &m, sizeof(m));
+  if (!_linux && !_incremental && !_gptWant && _lxPartRanges.empty()) {
+    _prefs->putUInt((String(CFG_PREF_KEY_SKIP_PREFIX) + _profileId).c_str(), _jobRate.skipPermille());
+  }
+  _prefs->end();
+  backup_logf("[BACKUP] rate model: %lu B/s at %lu baud, %lu ms/chunk, %u/1000 re-read\n",
+              (unsigned long)m.rate, (unsigned long)m.baud, (unsigned long)m.overheadMs,
+              (unsigned)m.retryPermille);
+}
+
 uint32_t BackupManager::plannedSecondsAt(uint32_t baud) const {
-  // Conservative estimate (wire overhead + prompt delays)
-  double bytesOnWire = (double)_plannedBytes * 3.6;
-  double bps = (double)baud / 10.0;
-  double sec = bytesOnWire / (bps > 1 ? bps : 1);
-  sec += 5.0 * (double)_ranges.size();
-  return (uint32_t)(sec + 0.5);
+  uint16_t skip = 0;
+  const JobRate::Model m = loadRateModel(_linux, _profileId, &skip);
+  return JobRate::estimateSeconds(m, skip, _plannedBytes, baud);
+}
+
+String BackupManager::estimateText(const String& profileId, bool linuxShell) const {
+  const uint64_t bytes = profileBytes(profileId, _customCount);
+  if (!bytes) return String("profile ") + profileId + " has no ranges";
+
+  uint16_t skip = 0;
+  bool learned = false;
+  const JobRate::Model m = loadRateModel(linuxShell, profileId, &skip, &learned);
+  String s = "~" + JobRate::fmtSeconds(JobRate::estimateSeconds(m, skip, bytes, 0)) + " for " +
+             String((unsigned long)(bytes / 1024ULL / 1024ULL)) + " MiB at " +
+             String((unsigned long)m.baud) + " baud";
+  if (!learned) return s + " (nothing measured yet: wire estimate)";
+  s += " (" + JobRate::fmtRate(m.rate) + ", " + String((unsigned long)m.overheadMs) + " ms/chunk";
+  if (skip) s += ", " + String((unsigned)(skip / 10)) + "% fill last time";
+  return s + ")";
+}
+
+String BackupManager::statusLine() const {
+  String s = _status;
+  if (_retries || _refetchTotal) {
+    s += " [retries: " + String((unsigned long)_retries) +
+         ", re-fetched: " + String((unsigned long)_refetchTotal) + "]";
+  }
+  if (_incremental) s += " [unchanged: " + String((unsigned long)(_reusedBytes / 1024ULL)) + " KiB]";
+  if (_running && _jobRate.chunks()) {
+    const uint64_t done = doneBytes();
+    const uint64_t left = _plannedBytes > done ? _plannedBytes - done : 0;
+    s += " [" + _jobRate.text(left, (size_t)_blocksPerChunk * 512u) + "]";
+  }
+  return s;
 }
 
 void BackupManager::cancel() {
   if (!_running) return;
+  if (_linux && _t) _t->write((uint8_t)0x03);  // stop a running batch
+  keepRateModel();
+  _turbo.revertNow();
+  closeBaseline();
+  if (_ckptSaved) {
+    parkOutput();
+    _status = "cancelled (partial backup kept: !backup resume)";
+  } else {
+    closeOutput(false);
+    _status = "cancelled";
+  }
   _running = false;
-  _status = "cancelled";
   _st = State::Idle;
 }
 
@@ -143,24 +244,40 @@ void BackupManager::sendLine(const String& s) {
   _t->print("\n");
 }
 
+// Every target command goes through here so the prompt mark and the reply
+// demux agree on what is outstanding.
+void BackupManager::sendCommand(const char* cmd, uint8_t chainParts) {
+  _chain.begin(chainParts);
+  _cmdPromptMark = _promptCount;
+  sendLine(cmd);
+}
+
+// The prompt that ends the last command, not the one before it.
+bool BackupManager::commandDone() const {
+  return _promptCount != _cmdPromptMark;
+}
+
 void BackupManager::advance(State s, uint32_t timeoutMs, const String& status) {
   _st = s;
   _deadlineMs = millis() + timeoutMs;
   _status = status;
 }
 
+// The prompt starts a line: an "=>" in md's ASCII column or crc32's
+// " ==> " is not one.
 void BackupManager::sniffPrompt(uint8_t c) {
-  _last2 = _last1;
-  _last1 = c;
-  if (_last2 == '=' && _last1 == '>') {
+  if (c == '>' && _last1 == '=' && (_last2 == '\n' || _last2 == '\r')) {
     _promptSeen = true;
     _promptLastMs = millis();
     _promptCount++;
   }
+  _last2 = _last1;
+  _last1 = c;
 }
 
 void BackupManager::onTargetBytes(const uint8_t* data, size_t len) {
   if (!_running) return;
+  if (len) _lastRxMs = millis();
 
   for (size_t i = 0; i < len; i++) {
     uint8_t c = data[i];
@@ -172,28 +289,243 @@ void BackupManager::onTargetBytes(const uint8_t* data, size_t len) {
         _envText.remove(0, _envText.length() - 96 * 1024);
       }
     }
+  }
 
-    if (_st == State::WaitMdData || _st == State::WaitMdPrompt) {
-      _hex.feed(&c, 1);
-      if (_hex.popBytes(_hexOut)) {
-        size_t take = _hexOut.size();
-        if (_currentChunkGot + take > _currentChunkBytes) {
-          take = (_currentChunkBytes > _currentChunkGot) ? (_currentChunkBytes - _currentChunkGot) : 0;
-        }
-        if (take) {
-          auto& rp = _ranges[_rangeIdx];
-          rp.data.insert(rp.data.end(), _hexOut.begin(), _hexOut.begin() + take);
-          _currentChunkGot += take;
-        }
-        _hexOut.clear();
-      }
+  // tick() is what changes _st, so the whole batch belongs to one state
+  if (_st == State::WaitChain || _st == State::WaitChainEnd || _st == State::WaitMdData ||
+      _st == State::WaitMdPrompt || _st == State::WaitRefetch) {
+    const size_t n = _chain.feed(data, len);
+    if (_chain.inMd() && n < len) {
+      // decode straight into the chunk buffer, placed by line address
+      _currentChunkGot += _hex.feed(data + n, len - n, _chunkBuf.data(), _currentChunkBytes);
+    }
+  } else if (_st == State::ProbeMdWidth) {
+    _mdProbe.feed(data, len);
+  } else if (_st == State::WaitBdinfo) {
+    _ram.feed(data, len);
+  } else if (_st == State::TurboUp || _st == State::TurboDown) {
+    _turbo.feed(data, len);
+  } else if (_st == State::LxWaitEnv || _st == State::LxWaitParts ||
+             _st == State::LxWaitBatch || _st == State::LxRetrySync) {
+    lxFeed(data, len);
+  }
+}
+
+bool BackupManager::startIncremental() {
+  if (_running) return false;
+  if (!SdCache::mounted() || !SdCache::exists(SdItem::Backup)) {
+    _status = "incremental backup needs a previous backup on SD";
+    return false;
+  }
+  if (partialParked() || !startRun(true)) return false;
+
+  String err;
+  _baseFile = SdCache::openRead(SdItem::Backup);
+  if (!_baseFile || !_base.open(_baseFile, &err)) {
+    closeBaseline();
+    cancel();
+    _status = String("incremental backup: baseline unusable: ") + (err.length() ? err : String("cannot open"));
+    return false;
+  }
+  _incremental = true;
+  return true;
+}
+
+bool BackupManager::startLinux(const String& parts, const String& byNameBase) {
+  if (_running) return false;
+  if (BlueprintRuntime::mode() != BlueprintRuntime::Mode::LinuxShell) {
+    _status = "Linux dump needs the target at a shell prompt";
+    return false;
+  }
+  String names = parts;
+  names.replace(',', ' ');
+  names.trim();
+  // the names end up on a shell command line
+  for (size_t i = 0; i < (size_t)names.length(); i++) {
+    const char c = names[i];
+    if (!isalnum((unsigned char)c) && c != '_' && c != '-' && c != '.' && c != ' ') {
+      _status = String("bad partition name: ") + names;
+      return false;
+    }
+  }
+  if (partialParked() || !startRun(true)) return false;
+
+  _linux = true;
+  _lxParts = names;
+  _lxByNameBase = byNameBase.length() ? byNameBase : String(CFG_LINUX_BY_NAME_BASE);
+  _blocksPerChunk = CFG_LINUX_DUMP_BLOCKS_PER_CHUNK;
+  advance(State::LxSendEnv, 1000, "reading the environment (fw_printenv)");
+  return true;
+}
+
+bool BackupManager::startGpt(const String& parts) {
+  if (_running) return false;
+  String want = parts;
+  want.trim();
+  if (want.length() && partialParked()) return false;
+  if (!startRun(true)) return false;
+
+  _gptWant = true;
+  _gptParts = want;
+  _gptListOnly = !_gptParts.length();
+  if (_gptListOnly) {
+    // a table read keeps nothing: leave the stored backup alone
+    _toSd = false;
+    _toFlash = false;
+  }
+  _gpt.clear();
+  _gptHead.assign((size_t)GptTable::HEAD_BLOCKS * 512u, 0);
+  return true;
+}
+
+bool BackupManager::startScan() {
+  if (_running) return false;
+  if (!SdCache::mounted()) {
+    _status = "scan needs an SD card for its map";
+    return false;
+  }
+  if (!startRun(true)) return false;
+
+  _scan = true;
+  // no .k2bak: the map is the only output
+  _toSd = false;
+  _toFlash = false;
+  _blocksPerChunk = CFG_BACKUP_SCAN_CHUNK_BLOCKS;
+  _scanSum = ScanMap::Summary();
+  return true;
+}
+
+bool BackupManager::startScanDiff(bool againstBackup) {
+  if (_running) return false;
+  if (!SdCache::mounted()) {
+    _status = "scan diff needs the SD card";
+    return false;
+  }
+  String err;
+  if (!_scanCur.open(CFG_PATH_SCAN_FILE, &err)) {
+    _status = String("scan diff: ") + err;
+    return false;
+  }
+  if (againstBackup) {
+    _baseFile = SdCache::openRead(SdItem::Backup);
+    if (!_baseFile || !_base.open(_baseFile, &err)) {
+      closeBaseline();
+      _status = String("scan diff: SD backup unusable: ") + (err.length() ? err : String("cannot open"));
+      return false;
+    }
+    if (_base.boardId() != _scanCur.boardId()) {
+      backup_logf("[BACKUP] scan is from board '%s', backup from '%s'\n",
+                  _scanCur.boardId().c_str(), _base.boardId().c_str());
     }
+  } else if (!_scanPrev.open(CFG_PATH_SCAN_PREV_FILE, &err)) {
+    closeBaseline();
+    _status = String("scan diff: ") + err;
+    return false;
   }
+
+  _diffBackup = againstBackup;
+  _diff.reset();
+  _diffHave = false;
+  _prevHave = false;
+  _prevEof = false;
+  _scan = false;
+  _gptWant = false;
+  _linux = false;
+  _toSd = false;
+  _toFlash = false;
+  _chunkBuf.resize((size_t)CFG_BACKUP_MAX_BLOCKS_PER_CHUNK * 512u);
+
+  _running = true;
+  _progress = 0;
+  advance(State::ScanDiff, 5000, againstBackup ? "comparing scan with the SD backup"
+                                               : "comparing scan with the previous one");
+  return true;
+}
+
+bool BackupManager::startResume() {
+  if (_running) return false;
+  if (!SdCache::mounted()) {
+    _status = "resume needs the SD card";
+    return false;
+  }
+  BackupCheckpoint::Data ck;
+  String err;
+  if (!BackupCheckpoint::load(ck, &err)) {
+    _status = String("resume: ") + err;
+    return false;
+  }
+  if (ck.linuxShell && BlueprintRuntime::mode() != BlueprintRuntime::Mode::LinuxShell) {
+    _status = "resume: that backup reads from a Linux shell, the target is not at one";
+    return false;
+  }
+  if (!startRun(true)) return false;
+
+  _resume = true;
+  _ckpt = std::move(ck);
+  if (_ckpt.incremental) {
+    _baseFile = SdCache::openRead(SdItem::Backup);
+    if (_baseFile && _base.open(_baseFile, &err)) {
+      _incremental = true;
+    } else {
+      backup_logf("[BACKUP] resume: baseline unusable (%s), dumping the rest in full\n", err.c_str());
+      closeBaseline();
+    }
+  }
+  if (_ckpt.linuxShell) {
+    _linux = true;
+    _blocksPerChunk = CFG_LINUX_DUMP_BLOCKS_PER_CHUNK;
+    advance(State::LxSendEnv, 1000, "reading the environment (fw_printenv)");
+  }
+  backup_logf("[BACKUP] resuming at %s\n", BackupCheckpoint::describe(_ckpt).c_str());
+  return true;
+}
+
+bool BackupManager::discardPartial() {
+  if (_running) return false;
+  if (!SdCache::mounted() || !BackupCheckpoint::exists()) {
+    _status = "no interrupted backup on SD";
+    return false;
+  }
+  BackupCheckpoint::remove();
+  SdCache::discardTemp(SdItem::Backup);
+  _status = "interrupted backup discarded";
+  backup_logf("[BACKUP] interrupted backup discarded\n");
+  return true;
+}
+
+// A new SD dump would overwrite the partial file that !backup resume needs.
+bool BackupManager::partialParked() {
+  if (!SdCache::mounted() || !BackupCheckpoint::exists()) return false;
+  _status = "an interrupted backup is on SD: !backup resume, or !backup discard to drop it";
+  return true;
 }
 
 bool BackupManager::start(bool uartRawDump) {
   if (_running) return false;
+  if (uartRawDump && partialParked()) return false;
+  return startRun(uartRawDump);
+}
+
+bool BackupManager::startRun(bool uartRawDump) {
+  if (_running) return false;
+  if (uartRawDump && !SdCache::mounted() && FlashBackup::available() && FlashBackup::mapped()) {
+    _status = "flash backup is loaded for restore (!restore unload first)";
+    return false;
+  }
   _uartRawDump = uartRawDump;
+  _incremental = false;
+  _linux = false;
+  _lxParts = "";
+  _lxPartRanges.clear();
+  _gptWant = false;
+  _gptListOnly = false;
+  _gptParts = "";
+  _gptHead.clear();
+  _scan = false;
+  _reusedBytes = 0;
+  _resume = false;
+  _ckpt = BackupCheckpoint::Data();
+  _ckptSaved = false;
 
   _running = true;
   _progress = 0;
@@ -202,21 +534,48 @@ bool BackupManager::start(bool uartRawDump) {
 
   _envText = "";
   _lastBackup.clear();
+  _lastOnSd = false;
+  _lastInFlash = false;
+  // the last run's targets are not this one's to clean up
+  _toSd = false;
+  _toFlash = false;
+  closeOutput(false);
+  _toSd = uartRawDump && SdCache::mounted();
+  _toFlash = uartRawDump && !_toSd && FlashBackup::available();
 
   _ranges.clear();
   _rangeIdx = 0;
   _plannedBytes = 0;
+  _skippedBytes = 0;
+
+  _chain.begin(0);
+  _ubootCrc = true;
+  _lastChunkFill = false;
+  _rereadChunk = false;
+  _haveChunkCrc = false;
+  _chunkTries = 0;
+  _retries = 0;
+  _refetchTotal = 0;
+  _loadAddr = UBootHexParser::BASE_FROM_FIRST_LINE;
 
   _promptSeen = false;
   _promptLastMs = 0;
   _promptCount = 0;
-  _last1 = _last2 = 0;
+  _last1 = '\n';   // the stream starts at a line start
+  _last2 = 0;
 
-  _hex.reset();
-  _hexOut.clear();
+  _hex.setWordWidth(1);
+  _hex.crcOff();
   _currentChunkBlocks = 0;
   _currentChunkBytes = 0;
   _currentChunkGot = 0;
+  _blocksPerChunk = CFG_BACKUP_DEFAULT_BLOCKS_PER_CHUNK;
+  _chunkBuf.resize((size_t)CFG_BACKUP_MAX_BLOCKS_PER_CHUNK * 512u);
+  _ram.reset();
+  _windowBlocks = 0;
+  _winValid = false;
+  _jobRate.begin(JobRate::Model());
+  _rateKept = false;
 
   advance(State::WaitPrompt, 7000, "waiting for U-Boot prompt (=>)");
   return true;
@@ -225,7 +584,12 @@ bool BackupManager::start(bool uartRawDump) {
 bool BackupManager::planRanges(String* err) {
   std::vector<ProfileRange> planned;
 
-  if (_profileId == "CUSTOM") {
+  if (_gptWant) {
+    // the partition table; named partitions are queued once it is parsed
+    addRange(planned, 0, GptTable::HEAD_BLOCKS);
+  } else if (!_lxPartRanges.empty()) {
+    // named partitions, resolved on the target (lxParseParts)
+  } else if (_profileId == "CUSTOM") {
     if (_customCount == 0) { if (err) *err = "CUSTOM range count is 0"; return false; }
     addRange(planned, _customStart, _customCount);
   } else {
@@ -240,13 +604,13 @@ bool BackupManager::planRanges(String* err) {
     }
   }
 
-  // Block FULL for raw dumps
-  if (_uartRawDump && _profileId == "FULL") {
-    if (err) *err = "FULL profile is blocked for UART raw dump";
+  // Without SD the whole file lives in RAM or flash: block FULL for raw dumps
+  if (_uartRawDump && !_toSd && _lxPartRanges.empty() && !_gptWant && !_scan && _profileId == "FULL") {
+    if (err) *err = "FULL profile needs an SD card for UART raw dump";
     return false;
   }
 
-  _ranges.clear();
+  _ranges = _lxPartRanges;
   _plannedBytes = 0;
 
   for (size_t i = 0; i < planned.size(); i++) {
@@ -254,21 +618,476 @@ bool BackupManager::planRanges(String* err) {
     rp.lba_start   = planned[i].start;
     rp.lba_count   = planned[i].count;
     rp.done_blocks = 0;
-    uint64_t bytes = (uint64_t)rp.lba_count * 512ULL;
-    _plannedBytes += bytes;
     _ranges.push_back(std::move(rp));
   }
+  for (size_t i = 0; i < _ranges.size(); i++) _plannedBytes += (uint64_t)_ranges[i].lba_count * 512ULL;
+  return checkPlannedSize(err);
+}
+
+// Whether _plannedBytes fits where the .k2bak goes.
+bool BackupManager::checkPlannedSize(String* err) {
+  if (_scan) return true;   // only the map is stored
+
+  if (_uartRawDump && _toFlash && _plannedBytes > FlashBackup::capacity()) {
+    // only fits if it compresses; the sink fails cleanly if it doesn't
+    backup_logf("[BACKUP] planned %lu KiB > flash partition %lu KiB, relying on compression\n",
+                (unsigned long)(_plannedBytes / 1024ULL), (unsigned long)(FlashBackup::capacity() / 1024ULL));
+  }
 
-  if (_uartRawDump && _plannedBytes > CFG_BACKUP_MAX_BYTES) {
-    if (err) *err = String("Planned backup too large for RAM: ") +
+  if (_uartRawDump && !_toSd && _plannedBytes > CFG_BACKUP_MAX_BYTES) {
+    if (err) *err = String("Planned backup too large without SD card: ") +
                     (unsigned)(_plannedBytes / 1024 / 1024) +
                     " MiB (cap 8 MiB)";
     return false;
   }
 
+  if (_uartRawDump && _toSd) {
+    // payload + env/header slack
+    const uint64_t need = _plannedBytes + (uint64_t)_envText.length() + 64ULL * 1024ULL;
+    if (need > K2Bak::FILE_MAX_BYTES) {
+      if (err) *err = String("Planned backup too large for one SD file: ") +
+                      (unsigned)(need / 1024 / 1024) + " MiB (cap 4 GiB)";
+      return false;
+    }
+    const uint64_t have = SdCache::freeBytes();
+    if (have < need) {
+      if (err) *err = String("Not enough free space on SD: need ") +
+                      (unsigned)(need / 1024 / 1024) + " MiB, have " +
+                      (unsigned)(have / 1024 / 1024) + " MiB";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool BackupManager::openOutput(String* err) {
+  closeOutput(false);
+
+  if (_toSd) {
+    if (BackupCheckpoint::exists()) {
+      // start() refuses this already; the checkpoint may have come since
+      if (err) *err = "an interrupted backup is on SD: !backup resume, or !backup discard to drop it";
+      return false;
+    }
+    _outFile = SdCache::openTemp(SdItem::Backup);
+    if (!_outFile) {
+      if (err) *err = "Cannot open backup file on SD";
+      return false;
+    }
+    _sink.reset(new K2Bak::FileSink(_outFile));
+  } else if (_toFlash) {
+    _sink.reset(new FlashBackup::Sink());
+    _flashOpened = true;
+  } else {
+    _memFile.clear();
+    // one allocation up front: a growing vector would briefly need 2x
+    if (_uartRawDump) _memFile.reserve((size_t)_plannedBytes + _envText.length() + 4096u);
+    _sink.reset(new K2Bak::MemSink(_memFile));
+  }
+
+  const String boardId = inferBoardIdFromEnv(_envText);
+  const uint64_t ts = (uint64_t)(millis() / 1000ULL);
+  if (!_writer.begin(_sink.get(), boardId, _gptWant ? String("GPT") : _profileId, ts, _envText, err)) {
+    closeOutput(false);
+    return false;
+  }
+  _ckptMs = millis();
   return true;
 }
 
+// Puts the plan and the writer back where the checkpoint left them and
+// reopens the temp file at the size it vouches for.
+bool BackupManager::resumeOutput(String* err) {
+  const String board = inferBoardIdFromEnv(_envText);
+  if (board != _ckpt.boardId && !board.startsWith("unknown_") && !_ckpt.boardId.startsWith("unknown_")) {
+    if (err) *err = String("target is ") + board + ", the interrupted backup is of " + _ckpt.boardId;
+    return false;
+  }
+
+  _ranges.clear();
+  for (const BackupCheckpoint::Range& r : _ckpt.ranges) {
+    RangePlan rp;
+    rp.lba_start = r.lba_start;
+    rp.lba_count = r.lba_count;
+    rp.done_blocks = r.done_blocks;
+    rp.dev = r.dev;
+    rp.dev_lba = r.dev_lba;
+    _ranges.push_back(rp);
+  }
+  _rangeIdx = _ckpt.rangeIdx;
+  _plannedBytes = _ckpt.plannedBytes;
+  _skippedBytes = _ckpt.skippedBytes;
+  _reusedBytes = _ckpt.reusedBytes;
+  if (!_linux && _ckpt.blocksPerChunk >= CFG_BACKUP_MIN_BLOCKS_PER_CHUNK &&
+      _ckpt.blocksPerChunk <= CFG_BACKUP_MAX_BLOCKS_PER_CHUNK) {
+    _blocksPerChunk = _ckpt.blocksPerChunk;
+  }
+
+  const uint64_t done = doneBytes();
+  const uint64_t need = (_plannedBytes > done ? _plannedBytes - done : 0) + 64ULL * 1024ULL;
+  if (SdCache::freeBytes() < need) {
+    if (err) *err = String("Not enough free space on SD: need ") + (unsigned)(need / 1024 / 1024) + " MiB more";
+    return false;
+  }
+
+  _outFile = SdCache::reopenTemp(SdItem::Backup, _ckpt.writer.size);
+  if (!_outFile) {
+    if (err) *err = "partial backup file is missing or cannot be cut back to the checkpoint";
+    return false;
+  }
+  _ckptSaved = true;
+  _sink.reset(new K2Bak::FileSink(_outFile, _ckpt.writer.size));
+
+  uint32_t tail = 0;
+  if (!BackupCheckpoint::tailCrc(*_sink, _ckpt.writer.h.payload_off, _ckpt.writer.size, tail) ||
+      tail != _ckpt.tailCrc) {
+    if (err) *err = "partial backup file does not match its checkpoint (start over)";
+    return false;
+  }
+  if (!_writer.resume(_sink.get(), _ckpt.writer, err)) return false;
+
+  backup_logf("[BACKUP] resumed at %s, file %lu bytes\n", BackupCheckpoint::describe(_ckpt).c_str(),
+              (unsigned long)_ckpt.writer.size);
+  _ckpt = BackupCheckpoint::Data();
+  _ckptMs = millis();
+  _progress = (_plannedBytes > 0) ? (float)((double)done / (double)_plannedBytes) : 0.0f;
+  return true;
+}
+
+// Saves where the SD backup stands, at most every CFG_BACKUP_CHECKPOINT_MS.
+// Runs between chunks; a failed save only costs the resume point.
+void BackupManager::checkpointIfDue() {
+  if (!_toSd || !_uartRawDump || _scan || !_sink) return;
+  if (_gptWant && _ranges[0].done_blocks < _ranges[0].lba_count) return;   // table not parsed yet
+  if ((uint32_t)(millis() - _ckptMs) < CFG_BACKUP_CHECKPOINT_MS) return;
+  _ckptMs = millis();
+
+  BackupCheckpoint::Data d;
+  String err;
+  if (!_writer.snapshot(d.writer, &err)) {
+    backup_logf("[BACKUP] checkpoint skipped: %s\n", err.c_str());
+    return;
+  }
+  // the checkpoint may only vouch for bytes that are on the card
+  _sink->flush();
+  if (!BackupCheckpoint::tailCrc(*_sink, d.writer.h.payload_off, d.writer.size, d.tailCrc)) {
+    backup_logf("[BACKUP] checkpoint skipped: SD read back failed\n");
+    return;
+  }
+  d.linuxShell = _linux;
+  d.incremental = _base.isOpen();
+  d.boardId = inferBoardIdFromEnv(_envText);
+  d.rangeIdx = _rangeIdx;
+  d.blocksPerChunk = _blocksPerChunk;
+  d.plannedBytes = _plannedBytes;
+  d.skippedBytes = _skippedBytes;
+  d.reusedBytes = _reusedBytes;
+  for (const RangePlan& rp : _ranges) {
+    BackupCheckpoint::Range r;
+    r.lba_start = rp.lba_start;
+    r.lba_count = rp.lba_count;
+    r.done_blocks = rp.done_blocks;
+    r.dev = rp.dev;
+    r.dev_lba = rp.dev_lba;
+    d.ranges.push_back(r);
+  }
+  if (!BackupCheckpoint::save(d, &err)) {
+    backup_logf("[BACKUP] checkpoint failed: %s\n", err.c_str());
+    return;
+  }
+  _ckptSaved = true;
+  backup_logf("[BACKUP] checkpoint at %s\n", BackupCheckpoint::describe(d).c_str());
+}
+
+// The profile range is opened on its first chunk; payload and fill chunks
+// both advance it.
+bool BackupManager::openRange(String* err) {
+  const auto& rp = _ranges[_rangeIdx];
+  return _writer.inRange() ||
+         _writer.beginRange(rp.lba_start + rp.done_blocks, rp.lba_count - rp.done_blocks, K2Bak::RANGE_RAW, err);
+}
+
+// Appends the completed chunk to the output and advances the range cursor.
+bool BackupManager::commitChunk(String* err) {
+  auto& rp = _ranges[_rangeIdx];
+  if (!openRange(err)) return false;
+  if (!_writer.write(_chunkBuf.data(), _currentChunkBytes, err)) return false;
+  if (_gptWant && _rangeIdx == 0) gptCapture(_chunkBuf.data(), 0);
+
+  rp.done_blocks += _currentChunkBlocks;
+  _lastChunkFill = false;
+  return rangeAdvanced(err);
+}
+
+bool BackupManager::commitFill(uint8_t fill, String* err) {
+  auto& rp = _ranges[_rangeIdx];
+  if (!openRange(err)) return false;
+  if (!_writer.addFill(rp.lba_start + rp.done_blocks, _currentChunkBlocks, fill, err)) return false;
+  if (_gptWant && _rangeIdx == 0) gptCapture(nullptr, fill);
+
+  rp.done_blocks += _currentChunkBlocks;
+  _skippedBytes += _currentChunkBytes;
+  _lastChunkFill = true;
+  return rangeAdvanced(err);
+}
+
+// After a chunk: closes the range once it is complete (for LBA 0-33 of a
+// GPT run, parses the table), then checkpoints if one is due.
+bool BackupManager::rangeAdvanced(String* err) {
+  const auto& rp = _ranges[_rangeIdx];
+  if (rp.done_blocks >= rp.lba_count) {
+    if (!_writer.endRange(err)) return false;
+    if (_gptWant && _rangeIdx == 0 && !gptResolve(err)) return false;
+  }
+  checkpointIfDue();
+  return true;
+}
+
+// Keeps a copy of the current chunk of LBA 0-33 (data, or a fill run when
+// data is null) for the GPT parser.
+void BackupManager::gptCapture(const uint8_t* data, uint8_t fill) {
+  const size_t off = (size_t)_ranges[0].done_blocks * 512u;
+  if (off + _currentChunkBytes > _gptHead.size()) return;
+  if (data) memcpy(_gptHead.data() + off, data, _currentChunkBytes);
+  else memset(_gptHead.data() + off, fill, _currentChunkBytes);
+}
+
+// LBA 0-33 is in: parse the table and queue the named partitions behind it.
+bool BackupManager::gptResolve(String* err) {
+  const bool parsed = _gpt.parse(_gptHead.data(), _gptHead.size(), err);
+  _gptHead.clear();
+  _gptHead.shrink_to_fit();
+  if (!parsed || _gptListOnly) return parsed;
+
+  std::vector<GptTable::Range> sel;
+  if (!_gpt.select(_gptParts, sel, err)) return false;
+  for (const GptTable::Range& r : sel) {
+    uint32_t start = r.lba_start;
+    uint32_t count = r.lba_count;
+    if (start < GptTable::HEAD_BLOCKS) {
+      // LBA 0-33 is in the backup already
+      const uint32_t cut = GptTable::HEAD_BLOCKS - start;
+      if (count <= cut) continue;
+      start += cut;
+      count -= cut;
+    }
+    RangePlan rp;
+    rp.lba_start = start;
+    rp.lba_count = count;
+    _ranges.push_back(rp);
+    _plannedBytes += (uint64_t)count * 512ULL;
+    backup_logf("[BACKUP] GPT range lba 0x%lX +0x%lX\n", (unsigned long)start, (unsigned long)count);
+  }
+  if (!checkPlannedSize(err)) return false;
+  if (!_toSd && !_toFlash) _memFile.reserve((size_t)_plannedBytes + _envText.length() + 4096u);
+  return true;
+}
+
+// The v3 chunk index grows with the file, so any fill run can be recorded.
+bool BackupManager::canRecordFill() const {
+  return CFG_BACKUP_SKIP_FILL_CHUNKS != 0;
+}
+
+// Re-dumps the next missing range reported by the decoder; once none are
+// left the chunk is checked and committed.
+void BackupManager::refetchOrFinish() {
+  UBootHexParser::Gap g;
+  if (_hex.gapsOverflowed()) { retryChunk("too many gaps"); return; }
+  if (!_hex.takeGap(g)) {
+    if (!_hex.streamDone()) retryChunk("short md dump"); // no line at all
+    else finishChunk();
+    return;
+  }
+  if (++_refetches > CFG_BACKUP_CHUNK_MAX_REFETCH) { retryChunk("too many gaps"); return; }
+  _refetchTotal++;
+
+  _hex.expectRange(g.addr, g.len);
+  const uint8_t w = _hex.wordWidth();
+  char cmd[128];
+  snprintf(cmd, sizeof(cmd), "md.%c 0x%llX 0x%lX", UBootHexParser::mdSuffix(w),
+           (unsigned long long)g.addr, (unsigned long)(g.len / w));
+  sendCommand(cmd, UBootChainReply::PART_MD);
+  advance(State::WaitRefetch, 5000, String("re-fetching ") + String((unsigned long)g.len) + " bytes");
+}
+
+// Where the current chunk sits in target RAM (BASE_FROM_FIRST_LINE when
+// ${loadaddr} is not known numerically).
+uint64_t BackupManager::chunkAddr() const {
+  if (_loadAddr == UBootHexParser::BASE_FROM_FIRST_LINE) return _loadAddr;
+  const auto& rp = _ranges[_rangeIdx];
+  return _loadAddr + (uint64_t)(rp.lba_start + rp.done_blocks - _winLba) * 512ULL;
+}
+
+// chunkAddr() as an md/crc32 argument.
+void BackupManager::chunkAddrArg(char* out, size_t outLen) const {
+  if (_windowBlocks == 0 || _loadAddr == UBootHexParser::BASE_FROM_FIRST_LINE) {
+    snprintf(out, outLen, "${loadaddr}");
+    return;
+  }
+  snprintf(out, outLen, "0x%llX", (unsigned long long)chunkAddr());
+}
+
+// md of the current chunk at the measured rate, with plenty of slack.
+uint32_t BackupManager::mdTimeoutMs() const {
+  const uint32_t rate = _jobRate.liveRate();
+  if (!rate) return 12000;
+  const uint64_t ms = (uint64_t)_currentChunkBytes * 3000ULL / rate;
+  return ms > 12000 ? (uint32_t)ms : 12000;
+}
+
+// Grows the chunk towards CFG_BACKUP_SLICE_TARGET_MS of md output while the
+// link is clean; halves it after lost lines or a re-read, since each of
+// those costs time proportional to the chunk.
+void BackupManager::adaptChunkSize(bool clean) {
+  if (_scan) return;   // crc32 output doesn't grow with the chunk
+  uint32_t next = _blocksPerChunk;
+  if (!clean) {
+    next /= 2;
+  } else if (_jobRate.liveRate()) {
+    const uint64_t target = (uint64_t)_jobRate.liveRate() * CFG_BACKUP_SLICE_TARGET_MS / 1000ULL / 512ULL;
+    if (target >= (uint64_t)next * 2) next *= 2;
+    else if (target < next / 2) next /= 2;
+  }
+  if (next < CFG_BACKUP_MIN_BLOCKS_PER_CHUNK) next = CFG_BACKUP_MIN_BLOCKS_PER_CHUNK;
+  if (next > CFG_BACKUP_MAX_BLOCKS_PER_CHUNK) next = CFG_BACKUP_MAX_BLOCKS_PER_CHUNK;
+  _blocksPerChunk = next;
+}
+
+bool BackupManager::baselineCovers() const {
+  if (!_base.isOpen()) return false;
+  const auto& rp = _ranges[_rangeIdx];
+  return _base.covers(rp.lba_start + rp.done_blocks, _currentChunkBlocks);
+}
+
+// Loads the baseline's bytes for the current chunk into _chunkBuf and checks
+// them against the target's crc32.
+bool BackupManager::matchBaseline() {
+  if (!_haveChunkCrc || !baselineCovers()) return false;
+  const auto& rp = _ranges[_rangeIdx];
+  String err;
+  if (!_base.readBlocks(rp.lba_start + rp.done_blocks, _currentChunkBlocks, _chunkBuf.data(), &err)) {
+    backup_logf("[BACKUP] baseline: %s, continuing without it\n", err.c_str());
+    closeBaseline();
+    return false;
+  }
+  return Crc32::of(_chunkBuf.data(), _currentChunkBytes) == _chunkCrc;
+}
+
+void BackupManager::finishChunk() {
+  if (_haveChunkCrc) {
+    const uint32_t got = _hex.crcInOrder() ? _hex.crcValue()
+                                           : Crc32::of(_chunkBuf.data(), _currentChunkBytes);
+    if (got != _chunkCrc) {
+      retryChunk("crc mismatch");
+      return;
+    }
+  }
+
+  const uint32_t now = millis();
+  _jobRate.chunk(_currentChunkBytes, now - _chunkStartMs, now - _mdStartMs, true);
+  const bool clean = (_refetches == 0 && _chunkTries == 0);
+
+  String err;
+  if (!commitChunk(&err)) {
+    _status = String("backup failed: ") + err;
+    _st = State::Error;
+    return;
+  }
+  adaptChunkSize(clean);
+
+  if (nextChunk(nullptr)) {
+    advance(State::SendMmcRead, 2500, "reading blocks (mmc read)");
+  } else {
+    transferDone();
+  }
+}
+
+// Last chunk is in: drop back to the console baud, then seal the file.
+void BackupManager::transferDone() {
+  closeBaseline();  // done with it; committing the new file replaces it
+  keepRateModel();  // at the baud the chunks moved at
+  if (_turbo.raised()) {
+    _turbo.beginDown();
+    advance(State::TurboDown, 10000, "restoring console baud");
+  } else {
+    advance(State::BuildK2Bak, 5000, "building .k2bak");
+  }
+}
+
+// The chunk is still at ${loadaddr}: wait for the line to go quiet, get a
+// fresh prompt, then dump it again.
+void BackupManager::retryChunk(const char* why, bool reread) {
+  const auto& rp = _ranges[_rangeIdx];
+  if (++_chunkTries > CFG_BACKUP_CHUNK_MAX_RETRIES) {
+    char buf[128];
+    snprintf(buf, sizeof(buf), "backup failed: chunk @lba 0x%lX %s (%u tries)",
+             (unsigned long)(rp.lba_start + rp.done_blocks), why, (unsigned)_chunkTries);
+    _status = buf;
+    _st = State::Error;
+    return;
+  }
+  _retries++;
+  _jobRate.retry();
+  _chunkStartMs = millis();   // the lost attempt shows up as the re-read share
+  backup_logf("[BACKUP] chunk @lba 0x%lX %s, re-reading (try %u)\n",
+              (unsigned long)(rp.lba_start + rp.done_blocks), why, (unsigned)_chunkTries);
+
+  _hex.reset();
+  _currentChunkGot = 0;
+  _rereadChunk = _rereadChunk || reread;
+  if (_rereadChunk) _winValid = false;
+  adaptChunkSize(false);
+  advance(State::RetryQuiet, 15000, String("re-reading chunk: ") + why);
+}
+
+void BackupManager::closeBaseline() {
+  _base.close();
+  if (_baseFile) _baseFile.close();
+  _scanCur.close();
+  _scanPrev.close();
+}
+
+void BackupManager::closeOutput(bool keep) {
+  _writer.abort();
+  _sink.reset();
+  _scanOut.discard();
+
+  const bool opened = (bool)_outFile;
+  if (_outFile) _outFile.close();
+  if (_toSd) {
+    // a temp file this run did not open may be a parked one
+    if (keep) _lastOnSd = SdCache::commitTemp(SdItem::Backup);
+    else if (opened) SdCache::discardTemp(SdItem::Backup);
+    // a sealed file that failed to commit stays resumable
+    if (keep ? _lastOnSd : opened) BackupCheckpoint::remove();
+  } else if (_toFlash) {
+    // the stored backup stays unless this run started writing over it
+    if (keep) _lastInFlash = FlashBackup::exists();
+    else if (_flashOpened) FlashBackup::remove();
+  } else if (keep) {
+    _lastBackup = std::move(_memFile);
+  }
+  _flashOpened = false;
+  _memFile.clear();
+  _memFile.shrink_to_fit();
+}
+
+// Leaves the temp file and its checkpoint on SD for startResume().
+void BackupManager::parkOutput() {
+  _writer.abort();
+  _sink.reset();
+  if (_outFile) _outFile.close();
+  _memFile.clear();
+  _memFile.shrink_to_fit();
+}
+
+uint64_t BackupManager::doneBytes() const {
+  uint64_t done = 0;
+  for (size_t i = 0; i < _ranges.size(); i++) done += (uint64_t)_ranges[i].done_blocks * 512ULL;
+  return done + (_currentChunkGot < _currentChunkBytes ? _currentChunkGot : _currentChunkBytes);
+}
+
 bool BackupManager::nextChunk(String* err) {
   (void)err;
   if (_rangeIdx >= _ranges.size()) return false;
@@ -281,19 +1100,302 @@ bool BackupManager::nextChunk(String* err) {
   }
 
   uint32_t remaining = rp.lba_count - rp.done_blocks;
+  // stay inside the staged window rather than re-reading what it already holds
+  const uint32_t lba = rp.lba_start + rp.done_blocks;
+  if (_winValid && lba >= _winLba && lba - _winLba < _winCount) {
+    const uint32_t inWin = _winCount - (lba - _winLba);
+    if (remaining > inWin) remaining = inWin;
+  }
   _currentChunkBlocks = remaining > _blocksPerChunk ? _blocksPerChunk : remaining;
   _currentChunkBytes  = (size_t)_currentChunkBlocks * 512u;
   _currentChunkGot    = 0;
   _hex.reset();
+  _haveChunkCrc = false;
+  _chunkTries = 0;
+  _rereadChunk = false;
+  _chunkStartMs = millis();
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+// Linux shell mode
+// -----------------------------------------------------------------------------
+static bool allBytes(const uint8_t* p, size_t n, uint8_t v) {
+  for (size_t i = 0; i < n; i++) {
+    if (p[i] != v) return false;
+  }
+  return true;
+}
+
+// Sends a shell command line whose output ends with this command's K2DONE.
+void BackupManager::lxCommand(const String& cmd) {
+  _lx.begin(++_lxTag);
+  _lxDone = false;
+  sendLine(cmd + ";echo K2DONE " + String((unsigned long)_lxTag));
+}
+
+void BackupManager::lxFeed(const uint8_t* data, size_t len) {
+  while (len) {
+    const size_t n = _lx.feed(data, len);
+    data += n;
+    len -= n;
+    if (_lx.event() == LinuxDumpReply::Event::MemberEnd) {
+      if (_st == State::LxWaitBatch) lxMemberDone();
+    } else if (_lx.event() == LinuxDumpReply::Event::Done) {
+      _lxDone = true;
+    }
+  }
+}
+
+// One chunk's gzip member is complete: check it, commit it, and point the
+// reply at the next one of the batch.
+void BackupManager::lxMemberDone() {
+  String err;
+  if (!_lx.memberOk(&err)) {
+    lxRetry(err.c_str());
+    return;
+  }
+  if (_lx.memberBytes() != _currentChunkBytes) {
+    char why[64];
+    snprintf(why, sizeof(why), "short read (%lu of %lu bytes)",
+             (unsigned long)_lx.memberBytes(), (unsigned long)_currentChunkBytes);
+    lxRetry(why);
+    return;
+  }
+
+  const uint8_t* p = _chunkBuf.data();
+  bool ok;
+  if (canRecordFill() && allBytes(p, _currentChunkBytes, 0x00)) ok = commitFill(0x00, &err);
+  else if (canRecordFill() && allBytes(p, _currentChunkBytes, 0xFF)) ok = commitFill(0xFF, &err);
+  else ok = commitChunk(&err);
+  if (!ok) {
+    _status = String("backup failed: ") + err;
+    _st = State::Error;
+    return;
+  }
+  _chunkTries = 0;
+  _progress = (_plannedBytes > 0) ? (float)((double)doneBytes() / (double)_plannedBytes) : 0.0f;
+  // the batch streams back to back: the whole gap between members is transfer
+  const uint32_t now = millis();
+  _jobRate.chunk(_currentChunkBytes, now - _chunkStartMs, now - _chunkStartMs, true);
+  _chunkStartMs = now;
+
+  if (--_lxLeft) {
+    _lx.beginMember(_chunkBuf.data(), _currentChunkBytes);
+    _deadlineMs = millis() + lxChunkTimeoutMs();
+  }
+}
+
+// Interrupts the batch (Ctrl-C), then starts over at the chunk that failed.
+void BackupManager::lxRetry(const char* why) {
+  const auto& rp = _ranges[_rangeIdx];
+  if (++_chunkTries > CFG_BACKUP_CHUNK_MAX_RETRIES) {
+    char buf[160];
+    snprintf(buf, sizeof(buf), "backup failed: chunk @lba 0x%lX %s (%u tries)",
+             (unsigned long)(rp.lba_start + rp.done_blocks), why, (unsigned)_chunkTries);
+    _status = buf;
+    _st = State::Error;
+    return;
+  }
+  _retries++;
+  _jobRate.retry();
+  _chunkStartMs = millis();   // the lost attempt shows up as the re-read share
+  backup_logf("[BACKUP] chunk @lba 0x%lX %s, re-reading (try %u)\n",
+              (unsigned long)(rp.lba_start + rp.done_blocks), why, (unsigned)_chunkTries);
+
+  _lx.skipMembers();
+  if (_t) _t->write((uint8_t)0x03);
+  advance(State::LxRetryQuiet, 15000, String("re-reading chunk: ") + why);
+}
+
+// "K2PART <name> <start> <size>" per partition; a name that did not resolve
+// prints no numbers.
+bool BackupManager::lxParseParts(String* err) {
+  _lxPartRanges.clear();
+  const String& t = _lx.text();
+  String names = _lxParts + " ";
+  int from = 0;
+  while (from < (int)names.length()) {
+    const int sp = names.indexOf(' ', from);
+    const String name = names.substring(from, sp);
+    from = sp + 1;
+    if (!name.length()) continue;
+
+    const String key = String("K2PART ") + name + " ";
+    int at = 0;
+    bool found = false;
+    while ((at = t.indexOf(key, at)) >= 0) {
+      // a whole line, not the shell's echo of the command
+      if (at == 0 || t[at - 1] == '\n') {
+        const int eol = t.indexOf('\n', at);
+        const String nums = t.substring(at + key.length(), eol < 0 ? t.length() : eol);
+        char* end = nullptr;
+        const unsigned long long start = strtoull(nums.c_str(), &end, 10);
+        char* end2 = nullptr;
+        const unsigned long long count = strtoull(end, &end2, 10);
+        if (end != nums.c_str() && end2 != end && *end2 == 0 && count &&
+            start + count <= 0xFFFFFFFFULL) {
+          RangePlan rp;
+          rp.lba_start = (uint32_t)start;
+          rp.lba_count = (uint32_t)count;
+          rp.dev = _lxByNameBase + name;
+          rp.dev_lba = (uint32_t)start;
+          _lxPartRanges.push_back(rp);
+          found = true;
+          break;
+        }
+      }
+      at += key.length();
+    }
+    if (!found) {
+      if (err) *err = String("partition '") + name + "' not found under " + _lxByNameBase;
+      _lxPartRanges.clear();
+      return false;
+    }
+  }
+
+  std::sort(_lxPartRanges.begin(), _lxPartRanges.end(),
+            [](const RangePlan& a, const RangePlan& b) { return a.lba_start < b.lba_start; });
+  for (size_t i = 1; i < _lxPartRanges.size(); i++) {
+    const RangePlan& a = _lxPartRanges[i - 1];
+    if (a.lba_start + a.lba_count > _lxPartRanges[i].lba_start) {
+      if (err) *err = "partitions overlap (named twice?)";
+      _lxPartRanges.clear();
+      return false;
+    }
+  }
+  return !_lxPartRanges.empty();
+}
+
+// -----------------------------------------------------------------------------
+// Fingerprint scan
+// -----------------------------------------------------------------------------
+
+// Scan mode: the chunk's crc32 is all that is kept of it.
+void BackupManager::scanCommit() {
+  auto& rp = _ranges[_rangeIdx];
+  ScanMap::Entry e;
+  e.lba = rp.lba_start + rp.done_blocks;
+  e.count = _currentChunkBlocks;
+  e.crc = _chunkCrc;
+  e.kind = ScanMap::kindOf(_chunkCrc, _fillCrc.get(0x00, _currentChunkBytes),
+                           _fillCrc.get(0xFF, _currentChunkBytes));
+  String err;
+  if (!_scanOut.add(e, &err)) {
+    _status = String("scan failed: ") + err;
+    _st = State::Error;
+    return;
+  }
+  _scanSum.add(e);
+  _jobRate.chunk(_currentChunkBytes, millis() - _chunkStartMs, 0, false);
+  rp.done_blocks += _currentChunkBlocks;
+  _progress = (_plannedBytes > 0) ? (float)((double)doneBytes() / (double)_plannedBytes) : 0.0f;
+
+  if (nextChunk(nullptr)) advance(State::SendMmcRead, 2500, "scanning (mmc read + crc32)");
+  else transferDone();
+}
+
+// Compares map chunks until this tick's read budget is spent.
+bool BackupManager::scanDiffStep(bool& done, String* err) {
+  done = false;
+  size_t budget = CFG_BACKUP_SCAN_DIFF_BYTES_PER_TICK;
+  for (uint32_t n = 0; n < 64; n++) {
+    if (!_diffHave) {
+      if (!_scanCur.next(_diffEntry)) {
+        if (_scanCur.failed()) {
+          if (err) *err = "scan map is damaged";
+          return false;
+        }
+        done = true;
+        return true;
+      }
+      _diffHave = true;
+      _diffDone = 0;
+      _diffCrc = Crc32::INIT;
+    }
+
+    const ScanMap::Entry& e = _diffEntry;
+    if (_diffBackup) {
+      if (!_base.covers(e.lba, e.count)) {
+        _diff.missing(e);
+      } else {
+        bool ready = false;
+        if (!backupSpanCrc(budget, ready, err)) return false;
+        if (!ready) return true;
+        if (_diffCrc == e.crc) _diff.same(e);
+        else _diff.changed(e);
+      }
+    } else {
+      // both maps are in lba order
+      while (!_prevEof && (!_prevHave || _prevEntry.lba < e.lba)) {
+        _prevHave = _scanPrev.next(_prevEntry);
+        if (!_prevHave) _prevEof = true;
+      }
+      if (_prevHave && _prevEntry.lba == e.lba && _prevEntry.count == e.count) {
+        if (_prevEntry.crc == e.crc) _diff.same(e);
+        else _diff.changed(e);
+      } else {
+        _diff.missing(e);
+      }
+    }
+    _diffHave = false;
+  }
+  return true;
+}
+
+// CRC of the current map chunk's blocks in the backup: the stored CRC when
+// a backup chunk spans exactly those blocks, else the blocks read back and
+// hashed, as far as budget allows. ready=false: call again next tick.
+bool BackupManager::backupSpanCrc(size_t& budget, bool& ready, String* err) {
+  const ScanMap::Entry& e = _diffEntry;
+  ready = false;
+  if (_diffDone == 0) {
+    const auto& chunks = _base.parsed().chunks;
+    const auto it = std::lower_bound(chunks.begin(), chunks.end(), e.lba,
+                                     [](const K2Bak::ChunkEntry& c, uint32_t lba) { return c.lba_start < lba; });
+    if (it != chunks.end() && it->lba_start == e.lba && it->lba_count == e.count) {
+      _diffCrc = K2Bak::isFill(*it) ? _fillCrc.get(K2Bak::fillByte(*it), (size_t)e.count * 512u) : it->crc32;
+      ready = true;
+      return true;
+    }
+  }
+  while (_diffDone < e.count) {
+    if (!budget) return true;
+    uint32_t n = e.count - _diffDone;
+    if (n > CFG_BACKUP_MAX_BLOCKS_PER_CHUNK) n = CFG_BACKUP_MAX_BLOCKS_PER_CHUNK;
+    if (!_base.readBlocks(e.lba + _diffDone, n, _chunkBuf.data(), err)) return false;
+    _diffCrc = Crc32::update(_diffCrc, _chunkBuf.data(), (size_t)n * 512u);
+    _diffDone += n;
+    budget = budget > (size_t)n * 512u ? budget - (size_t)n * 512u : 0;
+  }
+  _diffCrc = Crc32::finish(_diffCrc);
+  ready = true;
   return true;
 }
 
+// One chunk as base64 of an incompressible gzip member, with slack.
+uint32_t BackupManager::lxChunkTimeoutMs() const {
+  const uint32_t baud = consoleBaud();
+  // ~1.37 chars per byte, 10 bits per char
+  const uint64_t ms = (uint64_t)_currentChunkBytes * 14ULL * 1000ULL / baud;
+  return 5000 + (uint32_t)(ms * 2);
+}
+
 void BackupManager::tick() {
   if (!_running) return;
 
   if ((int32_t)(millis() - _deadlineMs) > 0) {
-    _status = "timeout: " + _status;
-    _st = State::Error;
+    if (_st == State::WaitChain || _st == State::WaitChainEnd) {
+      retryChunk("stalled", true);
+    } else if (_st == State::WaitMdData || _st == State::WaitMdPrompt ||
+        _st == State::WaitRefetch || _st == State::RetryResync) {
+      retryChunk("stalled");
+    } else if (_st == State::LxWaitBatch) {
+      lxRetry("stalled");
+    } else {
+      _status = "timeout: " + _status;
+      _st = State::Error;
+    }
   }
 
   switch (_st) {
@@ -317,24 +1419,106 @@ void BackupManager::tick() {
     case State::WaitEnvDone: {
       if (_promptCount >= 2 ||
           (_promptSeen && (millis() - _promptLastMs) < 1500 && _envText.length() > 64)) {
-        advance(State::PlanRanges, 1500, "planning ranges");
+        if (_uartRawDump && !_gptListOnly && !_scan) {
+          _turbo.beginUp(_t, CFG_UART_TURBO_BAUD);
+          advance(State::TurboUp, 30000, "raising console baud");
+        } else if (_scan) {
+          // crc32 replies are tiny: no turbo, but the probe finds ${loadaddr} for staging
+          _mdProbe.start(_t);
+          advance(State::ProbeMdWidth, 15000, "probing md widths");
+        } else {
+          advance(State::PlanRanges, 1500, "planning ranges");
+        }
+      }
+    } break;
+
+    case State::TurboUp: {
+      if (_turbo.tick()) {
+        if (_turbo.lost()) {
+          _status = "backup failed: lost the console while changing baud";
+          _st = State::Error;
+          break;
+        }
+        backup_logf("[BACKUP] link at %lu baud\n", (unsigned long)_turbo.baud());
+        _mdProbe.start(_t);
+        advance(State::ProbeMdWidth, 15000, "probing md widths");
       }
     } break;
 
+    case State::ProbeMdWidth: {
+      if (_mdProbe.tick()) {
+        _hex.setWordWidth(_mdProbe.width(), _mdProbe.bigEndian());
+        if (_mdProbe.hasLoadAddr()) _loadAddr = _mdProbe.loadAddr();
+        backup_logf("[BACKUP] dumping with md.%c\n", UBootHexParser::mdSuffix(_mdProbe.width()));
+        if (_loadAddr != UBootHexParser::BASE_FROM_FIRST_LINE) {
+          advance(State::SendBdinfo, 1500, "checking target RAM (bdinfo)");
+        } else {
+          // slices need numeric addresses: stay at one mmc read per chunk
+          advance(State::PlanRanges, 1500, "planning ranges");
+        }
+      }
+    } break;
+
+    case State::SendBdinfo: {
+      _ram.reset();
+      sendCommand("bdinfo", 0);
+      advance(State::WaitBdinfo, 5000, "checking target RAM (bdinfo)");
+    } break;
+
+    case State::WaitBdinfo: {
+      if (!commandDone() || (millis() - _lastRxMs) < 100) break;
+      const uint64_t room = _ram.roomAbove(_loadAddr) / 512ULL;
+      uint64_t win = room ? room : CFG_BACKUP_WINDOW_FALLBACK_BLOCKS;
+      if (win > CFG_BACKUP_WINDOW_MAX_BLOCKS) win = CFG_BACKUP_WINDOW_MAX_BLOCKS;
+      _windowBlocks = win < CFG_BACKUP_MAX_BLOCKS_PER_CHUNK ? 0 : (uint32_t)win;
+      backup_logf("[BACKUP] staging window: %lu blocks%s\n", (unsigned long)_windowBlocks,
+                  room ? "" : " (bdinfo: no RAM layout, fallback)");
+      advance(State::PlanRanges, 1500, "planning ranges");
+    } break;
+
     case State::PlanRanges: {
       String err;
-      if (!planRanges(&err)) {
-        _status = String("backup failed: ") + err;
+      if (_resume ? !resumeOutput(&err) : !planRanges(&err)) {
+        _status = String(_resume ? "resume failed: " : "backup failed: ") + err;
+        _st = State::Error;
+        break;
+      }
+      if (!_resume) _rangeIdx = 0;
+      if (_scan) {
+        _jobRate.begin(JobRate::Model(), 1000);   // crc32 only: every chunk is overhead
+      } else {
+        uint16_t skip = 0;
+        const JobRate::Model prior = loadRateModel(_linux, _profileId, &skip);
+        _jobRate.begin(prior, _incremental ? 0 : skip);
+      }
+
+      if (_base.isOpen()) {
+        const String board = inferBoardIdFromEnv(_envText);
+        if (_base.boardId().length() && board.length() && _base.boardId() != board) {
+          backup_logf("[BACKUP] baseline is from board '%s', not '%s': full dump\n",
+                      _base.boardId().c_str(), board.c_str());
+          closeBaseline();
+        }
+      }
+
+      if (_scan && _windowBlocks && _blocksPerChunk > _windowBlocks) _blocksPerChunk = _windowBlocks;
+      bool opened = true;   // a resumed run has its output back already
+      if (_scan) opened = _scanOut.begin(inferBoardIdFromEnv(_envText), _blocksPerChunk, &err);
+      else if (!_resume) opened = openOutput(&err);
+      if (!opened) {
+        _status = String(_scan ? "scan failed: " : "backup failed: ") + err;
         _st = State::Error;
         break;
       }
-      _rangeIdx = 0;
 
       if (!_uartRawDump) {
         advance(State::BuildK2Bak, 3000, "building .k2bak (env+meta)");
+      } else if (_linux) {
+        if (!nextChunk(nullptr)) transferDone();
+        else advance(State::LxSendBatch, 2500, "reading blocks (dd | gzip | base64)");
       } else {
         if (!nextChunk(nullptr)) {
-          advance(State::BuildK2Bak, 3000, "building .k2bak");
+          transferDone();
         } else {
           advance(State::SendMmcRead, 2500, "reading blocks (mmc read)");
         }
@@ -348,70 +1532,327 @@ void BackupManager::tick() {
       }
       auto& rp = _ranges[_rangeIdx];
       uint32_t lba = rp.lba_start + rp.done_blocks;
-      char cmd[128];
-      snprintf(cmd, sizeof(cmd), "mmc read ${loadaddr} 0x%lX 0x%lX",
-               (unsigned long)lba, (unsigned long)_currentChunkBlocks);
-      sendLine(cmd);
-      advance(State::WaitMmcReadPrompt, 7000, "waiting mmc read to finish");
+
+      // a chunk after a fill run is likely fill too, and one the baseline holds
+      // is likely unchanged: let crc32 decide before dumping those
+      uint8_t parts = 0;
+      if (_ubootCrc) parts |= UBootChainReply::PART_CRC;
+      const bool crcFirst = _ubootCrc && ((_lastChunkFill && canRecordFill()) || baselineCovers());
+      if (!crcFirst && !_scan) parts |= UBootChainReply::PART_MD;
+
+      char cmd[192];
+      int n = 0;
+      uint32_t readMs = 0;
+      const bool staged = _winValid && lba >= _winLba &&
+                          lba + _currentChunkBlocks <= _winLba + _winCount;
+      if (!staged) {
+        _winLba = lba;
+        _winCount = _currentChunkBlocks;
+        if (_windowBlocks) {
+          const uint32_t left = rp.lba_count - rp.done_blocks;
+          _winCount = left > _windowBlocks ? _windowBlocks : left;
+        }
+        _winValid = _windowBlocks != 0;
+        parts |= UBootChainReply::PART_MMC;
+        n = snprintf(cmd, sizeof(cmd), "mmc read ${loadaddr} 0x%lX 0x%lX; ",
+                     (unsigned long)lba, (unsigned long)_winCount);
+        readMs = _winCount / 2;   // ~1 MB/s worst case
+      }
+
+      char addr[24];
+      chunkAddrArg(addr, sizeof(addr));
+      if (parts & UBootChainReply::PART_CRC) {
+        n += snprintf(cmd + n, sizeof(cmd) - n, "crc32 %s 0x%lX; ",
+                      addr, (unsigned long)_currentChunkBytes);
+      }
+      if (parts & UBootChainReply::PART_MD) {
+        const uint8_t w = _hex.wordWidth();
+        n += snprintf(cmd + n, sizeof(cmd) - n, "md.%c %s 0x%lX; ",
+                      UBootHexParser::mdSuffix(w), addr, (unsigned long)(_currentChunkBytes / w));
+        _hex.beginWindow(chunkAddr(), _currentChunkBytes);
+        _hex.crcBegin();
+        _currentChunkGot = 0;
+        _refetches = 0;
+      }
+      if (n >= 2) cmd[n - 2] = 0; // drop the trailing "; "
+
+      _haveChunkCrc = false;
+      _chainFill = -1;
+      _chainReuse = false;
+      sendCommand(cmd, parts);
+      advance(State::WaitChain, 7000 + readMs, staged ? "checking chunk" : "reading blocks (mmc read)");
     } break;
 
-    case State::WaitMmcReadPrompt: {
-      if (_promptSeen && (millis() - _promptLastMs) < 1500) {
-        advance(State::SendMd, 2000, "dumping memory (md.b)");
+    case State::WaitChain: {
+      if (!_chain.headerDone()) break;
+      if (_chain.mmcFailed()) {
+        retryChunk("mmc read error", true);
+        break;
+      }
+
+      const bool withMd = (_chain.parts() & UBootChainReply::PART_MD) != 0;
+      if (_chain.crc().unsupported()) {
+        backup_logf("[BACKUP] crc32 unsupported: no fill skip, no chunk check\n");
+        _ubootCrc = false;
+      } else if (_chain.crc().haveResult()) {
+        _chunkCrc = _chain.crc().result();
+        _haveChunkCrc = true;
+        if (canRecordFill()) {
+          if (_chunkCrc == _fillCrc.get(0x00, _currentChunkBytes)) _chainFill = 0x00;
+          else if (_chunkCrc == _fillCrc.get(0xFF, _currentChunkBytes)) _chainFill = 0xFF;
+        }
+        if (_chainFill < 0 && !withMd) _chainReuse = matchBaseline();
+      }
+
+      if (_scan) {
+        if (!_ubootCrc) {
+          _status = "scan failed: U-Boot has no crc32 command";
+          _st = State::Error;
+          break;
+        }
+        advance(State::WaitChainEnd, 2000, "scanning (crc32)");
+        break;
+      }
+
+      if (_chainReuse) {
+        advance(State::WaitChainEnd, 2000, "unchanged since baseline");
+      } else if (_chainFill >= 0) {
+        // a chained md still has to print before the next command
+        advance(State::WaitChainEnd, withMd ? 12000 : 2000, "skipping fill chunk");
+      } else if (withMd) {
+        _mdStartMs = millis();
+        advance(State::WaitMdData, mdTimeoutMs(), "parsing md hex");
+      } else {
+        advance(State::WaitChainEnd, 2000, "checking chunk (crc32)");
+      }
+    } break;
+
+    case State::WaitChainEnd: {
+      if (!commandDone()) break;
+      if (_scan) {
+        if (_haveChunkCrc) scanCommit();
+        else retryChunk("no crc32 result", true);
+        break;
+      }
+      if (_chainFill < 0 && !_chainReuse) {
+        advance(State::SendMd, 2000, "dumping memory (md)");
+        break;
+      }
+
+      String err;
+      const bool ok = _chainReuse ? commitChunk(&err) : commitFill((uint8_t)_chainFill, &err);
+      if (_chainReuse) _reusedBytes += _currentChunkBytes;
+      if (!ok) {
+        _status = String("backup failed: ") + err;
+        _st = State::Error;
+        break;
+      }
+      _jobRate.chunk(_currentChunkBytes, millis() - _chunkStartMs, 0, false);
+      _progress = (_plannedBytes > 0) ? (float)((double)doneBytes() / (double)_plannedBytes) : 0.0f;
+
+      if (nextChunk(nullptr)) {
+        advance(State::SendMmcRead, 2500, "reading blocks (mmc read)");
+      } else {
+        transferDone();
       }
     } break;
 
     case State::SendMd: {
-      _hex.reset();
+      _hex.beginWindow(chunkAddr(), _currentChunkBytes);
+      _hex.crcBegin();
       _currentChunkGot = 0;
+      _refetches = 0;
+      const uint8_t w = _hex.wordWidth();
+      char addr[24];
+      chunkAddrArg(addr, sizeof(addr));
       char cmd[128];
-      snprintf(cmd, sizeof(cmd), "md.b ${loadaddr} 0x%lX",
-               (unsigned long)_currentChunkBytes);
-      sendLine(cmd);
-      advance(State::WaitMdData, 12000, "parsing md.b hex");
+      snprintf(cmd, sizeof(cmd), "md.%c %s 0x%lX",
+               UBootHexParser::mdSuffix(w), addr, (unsigned long)(_currentChunkBytes / w));
+      sendCommand(cmd, UBootChainReply::PART_MD);
+      _mdStartMs = millis();
+      advance(State::WaitMdData, mdTimeoutMs(), "parsing md hex");
     } break;
 
     case State::WaitMdData: {
-      if (_currentChunkGot >= _currentChunkBytes) {
-        advance(State::WaitMdPrompt, 7000, "waiting md.b prompt");
+      if (_hex.streamDone() && !_hex.gapCount()) {
+        advance(State::WaitMdPrompt, 7000, "waiting md prompt");
+      } else if (commandDone() && (millis() - _lastRxMs) > 300) {
+        // md finished (prompt + quiet line) with lines missing
+        _hex.closeStream();
+        refetchOrFinish();
       } else {
-        uint64_t done = 0;
-        for (size_t i = 0; i < _ranges.size(); i++) done += (uint64_t)_ranges[i].data.size();
-        _progress = (_plannedBytes > 0) ? (float)((double)done / (double)_plannedBytes) : 0.0f;
+        _progress = (_plannedBytes > 0) ? (float)((double)doneBytes() / (double)_plannedBytes) : 0.0f;
       }
     } break;
 
     case State::WaitMdPrompt: {
-      if (_promptSeen && (millis() - _promptLastMs) < 1500) {
-        auto& rp = _ranges[_rangeIdx];
-        rp.done_blocks += _currentChunkBlocks;
+      if (commandDone()) {
+        finishChunk();
+      }
+    } break;
 
-        if (nextChunk(nullptr)) {
-          advance(State::SendMmcRead, 2500, "reading blocks (mmc read)");
+    case State::WaitRefetch: {
+      if (commandDone() && (millis() - _lastRxMs) > 300) {
+        _hex.closeStream();
+        refetchOrFinish();
+      }
+    } break;
+
+    case State::RetryQuiet: {
+      // typing while md.b still prints would be eaten by its ctrlc() polling
+      if ((millis() - _lastRxMs) > 300) {
+        sendCommand("echo K2_UART_BRIDGE_RESYNC", 0);
+        advance(State::RetryResync, 3000, _status);
+      }
+    } break;
+
+    case State::RetryResync: {
+      if (commandDone()) {
+        if (_rereadChunk) {
+          _rereadChunk = false;
+          advance(State::SendMmcRead, 2500, "reading blocks (mmc read, retry)");
         } else {
-          advance(State::BuildK2Bak, 5000, "building .k2bak");
+          advance(State::SendMd, 2000, "dumping memory (md, retry)");
         }
       }
     } break;
 
-    case State::BuildK2Bak: {
-      std::vector<K2Bak::Range> ranges;
-      ranges.reserve(_ranges.size());
-      for (size_t i = 0; i < _ranges.size(); i++) {
-        K2Bak::Range r;
-        r.lba_start = _ranges[i].lba_start;
-        r.lba_count = _ranges[i].lba_count;
-        r.flags     = K2Bak::RANGE_RAW;
-        if (_uartRawDump) r.data = std::move(_ranges[i].data);
-        ranges.push_back(std::move(r));
+    case State::LxSendEnv: {
+      lxCommand("fw_printenv 2>/dev/null");
+      advance(State::LxWaitEnv, 5000, "reading the environment (fw_printenv)");
+    } break;
+
+    case State::LxWaitEnv: {
+      if (!_lxDone) break;
+      _envText = _lx.text();
+      if (_lxParts.length()) advance(State::LxSendParts, 1500, "looking up partitions");
+      else advance(State::PlanRanges, 1500, "planning ranges");
+    } break;
+
+    case State::LxSendParts: {
+      lxCommand(String("for p in ") + _lxParts + ";do d=$(readlink -f " + _lxByNameBase +
+                "$p);b=${d##*/};echo K2PART $p $(cat /sys/class/block/$b/start /sys/class/block/$b/size 2>/dev/null);done");
+      advance(State::LxWaitParts, 5000, "looking up partitions");
+    } break;
+
+    case State::LxWaitParts: {
+      if (!_lxDone) break;
+      String err;
+      if (!lxParseParts(&err)) {
+        _status = String("backup failed: ") + err;
+        _st = State::Error;
+        break;
+      }
+      advance(State::PlanRanges, 1500, "planning ranges");
+    } break;
+
+    case State::LxSendBatch: {
+      // whole chunks of the current range; a short tail goes alone
+      const auto& rp = _ranges[_rangeIdx];
+      const uint32_t lba = rp.lba_start + rp.done_blocks;
+      uint32_t n = (rp.lba_count - rp.done_blocks) / _currentChunkBlocks;
+      if (n > CFG_LINUX_DUMP_CHUNKS_PER_BATCH) n = CFG_LINUX_DUMP_CHUNKS_PER_BATCH;
+      if (!n) n = 1;
+      const String dev = rp.dev.length() ? rp.dev : String(CFG_LINUX_DUMP_DEVICE);
+
+      char cmd[320];
+      snprintf(cmd, sizeof(cmd),
+               "i=0;while [ $i -lt %lu ];do dd if=%s bs=512 skip=$((%lu+i*%lu)) count=%lu 2>/dev/null"
+               "|gzip -1|base64;echo K2END;i=$((i+1));done",
+               (unsigned long)n, dev.c_str(), (unsigned long)(lba - rp.dev_lba),
+               (unsigned long)_currentChunkBlocks, (unsigned long)_currentChunkBlocks);
+      _lxLeft = n;
+      lxCommand(cmd);
+      _lx.beginMember(_chunkBuf.data(), _currentChunkBytes);
+      advance(State::LxWaitBatch, lxChunkTimeoutMs(), "reading blocks (dd | gzip | base64)");
+    } break;
+
+    case State::LxWaitBatch: {
+      if (!_lxDone) break;
+      if (_lxLeft) {
+        lxRetry(_lx.lastText().length() ? _lx.lastText().c_str() : "batch ended early");
+      } else if (nextChunk(nullptr)) {
+        advance(State::LxSendBatch, 2500, "reading blocks (dd | gzip | base64)");
+      } else {
+        transferDone();
       }
+    } break;
 
-      const String boardId = inferBoardIdFromEnv(_envText);
-      const uint64_t ts = (uint64_t)(millis() / 1000ULL);
+    case State::LxRetryQuiet: {
+      // let the interrupted pipeline drain before asking for a fresh marker
+      if ((millis() - _lastRxMs) > 300) {
+        lxCommand("true");
+        advance(State::LxRetrySync, 5000, _status);
+      }
+    } break;
 
-      std::vector<uint8_t> out;
+    case State::LxRetrySync: {
+      if (_lxDone) advance(State::LxSendBatch, 2500, "reading blocks (dd | gzip | base64, retry)");
+    } break;
+
+    case State::ScanDiff: {
+      bool done = false;
+      String err;
+      if (!scanDiffStep(done, &err)) {
+        _status = String("scan diff failed: ") + err;
+        _st = State::Error;
+        break;
+      }
+      _deadlineMs = millis() + 5000;
+      _progress = _scanCur.progress();
+      if (!done) break;
+      _status = _diff.summary(_diffBackup ? "backup" : "previous scan");
+      backup_logf("[BACKUP] %s\n", _status.c_str());
+      closeBaseline();
+      _progress = 1.0f;
+      _st = State::Done;
+      _running = false;
+    } break;
+
+    case State::TurboDown: {
+      if (_turbo.tick()) {
+        // the dump itself is complete; a failed revert only affects the console
+        if (_turbo.lost()) backup_logf("[BACKUP] could not confirm console baud restore\n");
+        advance(State::BuildK2Bak, 5000, "building .k2bak");
+      }
+    } break;
+
+    case State::BuildK2Bak: {
+      if (_scan) {
+        String err;
+        if (!_scanOut.commit(&err)) {
+          _status = String("scan failed: ") + err;
+          _st = State::Error;
+          break;
+        }
+        _progress = 1.0f;
+        _status = String("scan done: ") + _scanSum.text() + " (" + CFG_PATH_SCAN_FILE + ")";
+        backup_logf("[BACKUP] %s\n", _status.c_str());
+        _st = State::Done;
+        _running = false;
+        break;
+      }
+      if (_gptListOnly) {
+        // table read only: the RAM copy of LBA 0-33 is dropped
+        closeOutput(false);
+        _progress = 1.0f;
+        _status = String("GPT read: ") + String((unsigned long)_gpt.parts().size()) +
+                  " partitions (!backup gpt list)";
+        _st = State::Done;
+        _running = false;
+        break;
+      }
       String err;
-      bool ok = K2Bak::buildV2(out, boardId, _profileId, ts, _envText, ranges, &err);
+      bool ok = true;
+
+      // env+meta mode: ranges are recorded without payload
+      if (!_uartRawDump) {
+        for (size_t i = 0; ok && i < _ranges.size(); i++) {
+          ok = _writer.beginRange(_ranges[i].lba_start, _ranges[i].lba_count, K2Bak::RANGE_RAW, &err) &&
+               _writer.endRange(&err);
+        }
+      }
+      if (ok) ok = _writer.finish(&err);
 
       if (!ok) {
         _status = String("backup failed: ") + err;
@@ -419,11 +1860,46 @@ void BackupManager::tick() {
         _st = State::Error;
         break;
       }
+      advance(State::SealK2Bak, 5000, "sealing .k2bak (crc32 + sha256)");
+    } break;
+
+    case State::SealK2Bak: {
+      String err;
+      bool done = false;
+      if (!_writer.sealStep(CFG_BACKUP_SEAL_BYTES_PER_TICK, done, &err)) {
+        _status = String("backup failed: ") + err;
+        backup_logf("[BACKUP] %s\n", _status.c_str());
+        _st = State::Error;
+        break;
+      }
+      if (!done) {
+        _deadlineMs = millis() + 5000;
+        break;
+      }
+
+      const uint64_t size = _writer.bytesWritten();
+      const uint64_t rawPayload = _writer.rawPayloadBytes();
+      const uint64_t storedPayload = _writer.storedPayloadBytes();
+      closeOutput(true);
+      if (_toSd && !_lastOnSd) {
+        _status = String("backup failed: could not commit backup file on SD (kept as ") +
+                  SdCache::path(SdItem::Backup) + ".tmp)";
+        _st = State::Error;
+        break;
+      }
+      if (_toFlash && !_lastInFlash) {
+        _status = "backup failed: backup in flash is unreadable";
+        _st = State::Error;
+        break;
+      }
 
-      _lastBackup = std::move(out);
       _progress = 1.0f;
-      _status = _uartRawDump ? "backup ready (.k2bak with payload)" : "backup ready (.k2bak / env+meta only)";
-      backup_logf("[BACKUP] done size=%u bytes\n", (unsigned)_lastBackup.size());
+      if (_toSd) _status = String("backup ready on SD (") + SdCache::path(SdItem::Backup) + ")";
+      else if (_toFlash) _status = "backup ready in flash (partition " CFG_FLASH_BACKUP_PARTITION ")";
+      else _status = _uartRawDump ? "backup ready (.k2bak with payload)" : "backup ready (.k2bak / env+meta only)";
+      backup_logf("[BACKUP] done size=%lu bytes (payload %lu -> %lu, fill skipped=%lu, unchanged=%lu)\n",
+                  (unsigned long)size, (unsigned long)rawPayload, (unsigned long)storedPayload,
+                  (unsigned long)_skippedBytes, (unsigned long)_reusedBytes);
       _st = State::Done;
       _running = false;
     } break;
@@ -434,6 +1910,16 @@ void BackupManager::tick() {
 
     case State::Error: {
       backup_logf("[BACKUP] ERROR: %s\n", _status.c_str());
+      if (_linux && _t) _t->write((uint8_t)0x03);
+      keepRateModel();
+      _turbo.revertNow();
+      closeBaseline();
+      if (_ckptSaved) {
+        parkOutput();
+        _status += " (partial backup kept: !backup resume)";
+      } else {
+        closeOutput(false);
+      }
       _running = false;
       _st = State::Idle;
     } break;
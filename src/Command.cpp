@@ -237,9 +237,14 @@ void Command::showHelp(Source src) {
     "  !bp prompt <name>\n"
     "  !bp gcode [group] [name]\n"
     "\n"
-    "  !backup start uart|meta\n"
+    "  !backup start uart|meta|incr|linux [part,...]\n"
+    "  !backup resume\n"
+    "  !backup discard\n"
+    "  !backup gpt [list]\n"
+    "  !backup scan [diff [backup|prev]|show]\n"
     "  !backup status\n"
     "  !backup profile <A|B|C|FULL>\n"
+    "  !backup estimate [profile] [linux]\n"
     "  !backup custom <start> <count>\n"
     "\n"
     "  !restore plan\n"
@@ -247,6 +252,15 @@ void Command::showHelp(Source src) {
     "  !restore disarm\n"
     "  !restore apply\n"
     "  !restore verify\n"
+    "  !restore load [sd|flash]\n"
+    "  !restore unload\n"
+    "  !restore check [auto|crc|md]\n"
+    "  !restore status\n"
+    "\n"
+    "  !zm send [-r] [sd:|fs:]<path>\n"
+    "  !zm recv [-r] <remote path>\n"
+    "  !zm status\n"
+    "  !zm cancel\n"
     "\n"
     "  !sd status\n"
     "  !sd rm backup|fw|all\n"
@@ -745,7 +759,53 @@ bool Command::handleLine(Source src, const String& line) {
         sayLn(src, ok ? "Backup started (meta)." : "Backup start failed/busy.");
         return true;
       }
-      sayLn(src, "Usage: !backup start uart|meta");
+      if (arg.equalsIgnoreCase("incr")) {
+        if (!gCtx->backupStartIncremental) { sayLn(src, "(not wired) backup start incr"); return true; }
+        bool ok = gCtx->backupStartIncremental();
+        if (ok) sayLn(src, "Backup started (incremental, baseline = SD backup).");
+        else if (gCtx->backupStatusLine) sayLn(src, String("Backup start failed: ") + gCtx->backupStatusLine());
+        else sayLn(src, "Backup start failed/busy.");
+        return true;
+      }
+      String mode, parts;
+      splitFirst(arg, mode, parts);
+      if (mode.equalsIgnoreCase("uart")) {
+        // partitions by GPT name
+        if (!gCtx->backupStartGpt) { sayLn(src, "(not wired) backup start uart <part,...>"); return true; }
+        bool ok = gCtx->backupStartGpt(parts);
+        if (ok) sayLn(src, String("Backup started (uart, GPT partitions: ") + parts + ").");
+        else if (gCtx->backupStatusLine) sayLn(src, String("Backup start failed: ") + gCtx->backupStatusLine());
+        else sayLn(src, "Backup start failed/busy.");
+        return true;
+      }
+      if (mode.equalsIgnoreCase("linux")) {
+        if (!gCtx->backupStartLinux) { sayLn(src, "(not wired) backup start linux"); return true; }
+        bool ok = gCtx->backupStartLinux(parts);
+        if (ok) sayLn(src, parts.length() ? String("Backup started (linux shell, partitions: ") + parts + ")."
+                                          : String("Backup started (linux shell, profile ranges)."));
+        else if (gCtx->backupStatusLine) sayLn(src, String("Backup start failed: ") + gCtx->backupStatusLine());
+        else sayLn(src, "Backup start failed/busy.");
+        return true;
+      }
+      sayLn(src, "Usage: !backup start uart|meta|incr|linux [part,...]");
+      return true;
+    }
+
+    if (sub.equalsIgnoreCase("resume")) {
+      if (!gCtx->backupResume) { sayLn(src, "(not wired) backup resume"); return true; }
+      bool ok = gCtx->backupResume();
+      if (ok) sayLn(src, "Backup resuming from its SD checkpoint; see !backup status.");
+      else if (gCtx->backupStatusLine) sayLn(src, String("Resume failed: ") + gCtx->backupStatusLine());
+      else sayLn(src, "Resume failed/busy.");
+      return true;
+    }
+
+    if (sub.equalsIgnoreCase("discard")) {
+      if (!gCtx->backupDiscard) { sayLn(src, "(not wired) backup discard"); return true; }
+      bool ok = gCtx->backupDiscard();
+      if (ok) sayLn(src, "Interrupted backup and its checkpoint removed from SD.");
+      else if (gCtx->backupStatusLine) sayLn(src, String("Discard failed: ") + gCtx->backupStatusLine());
+      else sayLn(src, "Discard failed/busy.");
       return true;
     }
 
@@ -755,10 +815,73 @@ bool Command::handleLine(Source src, const String& line) {
       return true;
     }
 
+    if (sub.equalsIgnoreCase("scan")) {
+      String what, against;
+      splitFirst(arg, what, against);
+      if (!what.length()) {
+        if (!gCtx->backupStartScan) { sayLn(src, "(not wired) backup scan"); return true; }
+        bool ok = gCtx->backupStartScan();
+        if (ok) sayLn(src, "Scan started (crc32 per chunk of the profile's ranges, no data).");
+        else if (gCtx->backupStatusLine) sayLn(src, String("Scan start failed: ") + gCtx->backupStatusLine());
+        else sayLn(src, "Scan start failed/busy.");
+        return true;
+      }
+      if (what.equalsIgnoreCase("diff")) {
+        const bool prev = against.equalsIgnoreCase("prev");
+        if (!prev && against.length() && !against.equalsIgnoreCase("backup")) {
+          sayLn(src, "Usage: !backup scan diff [backup|prev]");
+          return true;
+        }
+        if (!gCtx->backupScanDiff) { sayLn(src, "(not wired) backup scan diff"); return true; }
+        bool ok = gCtx->backupScanDiff(!prev);
+        if (ok) sayLn(src, prev ? "Comparing with the previous scan; see !backup status."
+                                : "Comparing with the SD backup; see !backup status.");
+        else if (gCtx->backupStatusLine) sayLn(src, String("Scan diff failed: ") + gCtx->backupStatusLine());
+        else sayLn(src, "Scan diff failed/busy.");
+        return true;
+      }
+      if (what.equalsIgnoreCase("show")) {
+        if (gCtx->backupScanShow) sayLn(src, gCtx->backupScanShow());
+        else sayLn(src, "(not wired) backup scan show");
+        return true;
+      }
+      sayLn(src, "Usage: !backup scan [diff [backup|prev]|show]");
+      return true;
+    }
+
+    if (sub.equalsIgnoreCase("gpt")) {
+      if (arg.equalsIgnoreCase("list")) {
+        if (gCtx->backupGptList) sayLn(src, gCtx->backupGptList());
+        else sayLn(src, "(not wired) backup gpt list");
+        return true;
+      }
+      if (arg.length()) { sayLn(src, "Usage: !backup gpt [list]"); return true; }
+      if (!gCtx->backupStartGpt) { sayLn(src, "(not wired) backup gpt"); return true; }
+      bool ok = gCtx->backupStartGpt(String());
+      if (ok) sayLn(src, "Reading the GPT (LBA 0-33); !backup gpt list when done.");
+      else if (gCtx->backupStatusLine) sayLn(src, String("GPT read failed: ") + gCtx->backupStatusLine());
+      else sayLn(src, "GPT read failed/busy.");
+      return true;
+    }
+
     if (sub.equalsIgnoreCase("profile")) {
       if (!arg.length()) { sayLn(src, "Usage: !backup profile <A|B|C|FULL>"); return true; }
       if (gCtx->backupSetProfileId) gCtx->backupSetProfileId(arg);
-      sayLn(src, String("Backup profile set to ") + arg);
+      if (gCtx->backupEstimate) sayLn(src, String("Backup profile set to ") + arg + ": " + gCtx->backupEstimate(arg, false));
+      else sayLn(src, String("Backup profile set to ") + arg);
+      return true;
+    }
+
+    if (sub.equalsIgnoreCase("estimate")) {
+      String pid, mode;
+      splitFirst(arg, pid, mode);
+      if (pid.equalsIgnoreCase("linux")) { mode = pid; pid = ""; }
+      if (mode.length() && !mode.equalsIgnoreCase("linux")) {
+        sayLn(src, "Usage: !backup estimate [profile] [linux]");
+        return true;
+      }
+      if (gCtx->backupEstimate) sayLn(src, gCtx->backupEstimate(pid, mode.length() > 0));
+      else sayLn(src, "(not wired) backup estimate");
       return true;
     }
 
@@ -772,7 +895,7 @@ bool Command::handleLine(Source src, const String& line) {
       return true;
     }
 
-    sayLn(src, "Usage: !backup start uart|meta | !backup status | !backup profile <A|B|C|FULL> | !backup custom <start> <count>");
+    sayLn(src, "Usage: !backup start uart|meta|incr|linux [part,...] | !backup resume | !backup discard | !backup gpt [list] | !backup scan [diff|show] | !backup status | !backup profile <A|B|C|FULL> | !backup estimate [profile] [linux] | !backup custom <start> <count>");
     return true;
   }
 
@@ -823,7 +946,73 @@ bool Command::handleLine(Source src, const String& line) {
       return true;
     }
 
-    sayLn(src, "Usage: !restore plan | !restore arm [token] [override] | !restore disarm | !restore apply | !restore verify");
+    if (sub.equalsIgnoreCase("load")) {
+      if (!gCtx->restoreLoad) { sayLn(src, "(not wired) restore load"); return true; }
+      String from = arg; from.trim();
+      sayLn(src, gCtx->restoreLoad(from));
+      return true;
+    }
+
+    if (sub.equalsIgnoreCase("unload")) {
+      if (gCtx->restoreUnload) gCtx->restoreUnload();
+      sayLn(src, "Restore file unloaded.");
+      return true;
+    }
+
+    if (sub.equalsIgnoreCase("check")) {
+      if (!gCtx->restoreCheck) { sayLn(src, "(not wired) restore check"); return true; }
+      String mode = arg; mode.trim();
+      sayLn(src, gCtx->restoreCheck(mode));
+      return true;
+    }
+
+    if (sub.equalsIgnoreCase("status")) {
+      if (!gCtx->restoreStatus) { sayLn(src, "(not wired) restore status"); return true; }
+      sayLn(src, gCtx->restoreStatus());
+      return true;
+    }
+
+    sayLn(src, "Usage: !restore plan | !restore arm [token] [override] | !restore disarm | !restore apply | !restore verify | "
+               "!restore load [sd|flash] | !restore unload | !restore check [auto|crc|md] | !restore status");
+    return true;
+  }
+
+  // ==========================================================
+  // zm ... (ZMODEM with a Linux shell)
+  // ==========================================================
+  if (head.equalsIgnoreCase("zm")) {
+    String sub, arg;
+    splitFirst(tail, sub, arg);
+
+    if (sub.equalsIgnoreCase("send") || sub.equalsIgnoreCase("recv")) {
+      const bool send = sub.equalsIgnoreCase("send");
+      String opt, rest;
+      splitFirst(arg, opt, rest);
+      const bool resume = opt.equalsIgnoreCase("-r");
+      String path = resume ? rest : arg;
+      path.trim();
+      if (!path.length()) {
+        sayLn(src, send ? "Usage: !zm send [-r] [sd:|fs:]<path>" : "Usage: !zm recv [-r] <remote path>");
+        return true;
+      }
+      if (send ? !gCtx->zmSend : !gCtx->zmRecv) { sayLn(src, String("(not wired) zm ") + sub); return true; }
+      sayLn(src, send ? gCtx->zmSend(path, resume) : gCtx->zmRecv(path, resume));
+      return true;
+    }
+
+    if (sub.equalsIgnoreCase("status")) {
+      if (!gCtx->zmStatus) { sayLn(src, "(not wired) zm status"); return true; }
+      sayLn(src, gCtx->zmStatus());
+      return true;
+    }
+
+    if (sub.equalsIgnoreCase("cancel")) {
+      if (gCtx->zmCancel) gCtx->zmCancel();
+      sayLn(src, "ZMODEM transfer cancelled.");
+      return true;
+    }
+
+    sayLn(src, "Usage: !zm send [-r] [sd:|fs:]<path> | !zm recv [-r] <remote path> | !zm status | !zm cancel");
     return true;
   }
 
@@ -0,0 +1,78 @@
+#include "Crc32.h"
+
+#include <string.h>
+
+#ifdef ARDUINO
+#include "AppConfig.h"
+#include "Debug.h"
+DBG_REGISTER_MODULE(__FILE__);
+#endif
+
+#ifndef CFG_CRC32_USE_ROM
+  #define CFG_CRC32_USE_ROM 0
+#endif
+
+#ifdef ESP32
+#include "esp_rom_crc.h"
+#endif
+
+namespace Crc32 {
+
+static constexpr Tables makeTables() {
+  Tables r{};
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t c = i;
+    for (int k = 0; k < 8; k++) c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+    r.t[0][i] = c;
+  }
+  for (uint32_t i = 0; i < 256; i++) {
+    for (int k = 1; k < 8; k++) r.t[k][i] = (r.t[k - 1][i] >> 8) ^ r.t[0][r.t[k - 1][i] & 0xFFu];
+  }
+  return r;
+}
+
+constexpr Tables TABLES = makeTables();
+
+uint32_t updateBytewise(uint32_t crc, const uint8_t* data, size_t len) {
+  for (size_t i = 0; i < len; i++) crc = step(crc, data[i]);
+  return crc;
+}
+
+uint32_t updateSlice8(uint32_t crc, const uint8_t* data, size_t len) {
+  // align so the 8-byte loads below are word loads
+  while (len && ((uintptr_t)data & 3u)) {
+    crc = step(crc, *data++);
+    len--;
+  }
+  while (len >= 8) {
+    uint32_t lo, hi;
+    memcpy(&lo, data, 4);
+    memcpy(&hi, data + 4, 4);
+    lo ^= crc;  // little-endian: byte 0 is the low byte (ESP32 and x86 alike)
+    const auto& t = TABLES.t;
+    crc = t[7][lo & 0xFFu] ^ t[6][(lo >> 8) & 0xFFu] ^ t[5][(lo >> 16) & 0xFFu] ^ t[4][lo >> 24] ^
+          t[3][hi & 0xFFu] ^ t[2][(hi >> 8) & 0xFFu] ^ t[1][(hi >> 16) & 0xFFu] ^ t[0][hi >> 24];
+    data += 8;
+    len -= 8;
+  }
+  while (len--) crc = step(crc, *data++);
+  return crc;
+}
+
+#ifdef ESP32
+// The ROM routine takes and returns the finished (inverted) value.
+uint32_t updateRom(uint32_t crc, const uint8_t* data, size_t len) {
+  return ~esp_rom_crc32_le(~crc, data, (uint32_t)len);
+}
+#endif
+
+uint32_t update(uint32_t crc, const uint8_t* data, size_t len) {
+  if (!data || !len) return crc;
+#if defined(ESP32) && CFG_CRC32_USE_ROM
+  return updateRom(crc, data, len);
+#else
+  return updateSlice8(crc, data, len);
+#endif
+}
+
+} // namespace Crc32
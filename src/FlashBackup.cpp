@@ -0,0 +1,251 @@
+#include "FlashBackup.h"
+#include "Debug.h"
+#include "AppConfig.h"
+#include <ArduinoJson.h>
+
+#ifdef ESP32
+#include "esp_partition.h"
+#include "esp_idf_version.h"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+DBG_REGISTER_MODULE(__FILE__);
+
+static constexpr uint64_t SECTOR = 4096;
+
+// ------------------------------------------------------------
+// Backend: raw partition access
+// ------------------------------------------------------------
+
+static uint64_t g_capacity = 0;
+static const void* g_map = nullptr;
+static size_t g_mapLen = 0;
+
+#ifdef ESP32
+
+static const esp_partition_t* g_part = nullptr;
+#if ESP_IDF_VERSION_MAJOR >= 5
+static esp_partition_mmap_handle_t g_mapHandle;
+#else
+static spi_flash_mmap_handle_t g_mapHandle;
+#endif
+
+static bool rawOpen() {
+  g_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                    CFG_FLASH_BACKUP_PARTITION);
+  g_capacity = g_part ? g_part->size : 0;
+  return g_part != nullptr;
+}
+
+static bool rawRead(uint64_t off, void* dst, size_t n) {
+  return esp_partition_read(g_part, (size_t)off, dst, n) == ESP_OK;
+}
+
+static bool rawWrite(uint64_t off, const void* src, size_t n) {
+  return esp_partition_write(g_part, (size_t)off, src, n) == ESP_OK;
+}
+
+static bool rawErase(uint64_t off, uint64_t n) {
+  return esp_partition_erase_range(g_part, (size_t)off, (size_t)n) == ESP_OK;
+}
+
+static const void* rawMap(size_t n) {
+  const void* p = nullptr;
+#if ESP_IDF_VERSION_MAJOR >= 5
+  if (esp_partition_mmap(g_part, 0, n, ESP_PARTITION_MMAP_DATA, &p, &g_mapHandle) != ESP_OK) return nullptr;
+#else
+  if (esp_partition_mmap(g_part, 0, n, SPI_FLASH_MMAP_DATA, &p, &g_mapHandle) != ESP_OK) return nullptr;
+#endif
+  return p;
+}
+
+static void rawUnmap() {
+#if ESP_IDF_VERSION_MAJOR >= 5
+  esp_partition_munmap(g_mapHandle);
+#else
+  spi_flash_munmap(g_mapHandle);
+#endif
+}
+
+#else  // host: a file stands in for the partition
+
+static int g_fd = -1;
+
+static bool rawOpen() {
+  if (g_fd < 0) g_fd = ::open(CFG_FLASH_BACKUP_HOST_IMAGE, O_RDWR | O_CREAT, 0644);
+  struct stat st{};
+  if (g_fd < 0 || fstat(g_fd, &st) != 0) return false;
+  if ((uint64_t)st.st_size < CFG_FLASH_BACKUP_HOST_BYTES) {
+    // new image: erased flash reads 0xFF
+    std::vector<uint8_t> ff(SECTOR, 0xFF);
+    for (uint64_t off = (uint64_t)st.st_size & ~(SECTOR - 1); off < CFG_FLASH_BACKUP_HOST_BYTES; off += SECTOR) {
+      if (pwrite(g_fd, ff.data(), SECTOR, (off_t)off) != (ssize_t)SECTOR) return false;
+    }
+    st.st_size = CFG_FLASH_BACKUP_HOST_BYTES;
+  }
+  g_capacity = (uint64_t)st.st_size & ~(SECTOR - 1);
+  return true;
+}
+
+static bool rawRead(uint64_t off, void* dst, size_t n) {
+  return pread(g_fd, dst, n, (off_t)off) == (ssize_t)n;
+}
+
+// NOR semantics: programming only clears bits.
+static bool rawWrite(uint64_t off, const void* src, size_t n) {
+  std::vector<uint8_t> cur(n);
+  if (!rawRead(off, cur.data(), n)) return false;
+  const uint8_t* s = (const uint8_t*)src;
+  for (size_t i = 0; i < n; i++) cur[i] &= s[i];
+  return pwrite(g_fd, cur.data(), n, (off_t)off) == (ssize_t)n;
+}
+
+static bool rawErase(uint64_t off, uint64_t n) {
+  std::vector<uint8_t> ff(SECTOR, 0xFF);
+  for (uint64_t o = off; o < off + n; o += SECTOR) {
+    if (pwrite(g_fd, ff.data(), SECTOR, (off_t)o) != (ssize_t)SECTOR) return false;
+  }
+  return true;
+}
+
+static const void* rawMap(size_t n) {
+  void* p = mmap(nullptr, n, PROT_READ, MAP_SHARED, g_fd, 0);
+  return p == MAP_FAILED ? nullptr : p;
+}
+
+static void rawUnmap() {
+  munmap(const_cast<void*>(g_map), g_mapLen);
+}
+
+#endif
+
+// ------------------------------------------------------------
+// API
+// ------------------------------------------------------------
+
+bool FlashBackup::begin() {
+  if (!rawOpen()) {
+    g_capacity = 0;
+    DBG_PRINTF("[FLASH] no '%s' partition\n", CFG_FLASH_BACKUP_PARTITION);
+    return false;
+  }
+  DBG_PRINTF("[FLASH] partition '%s' %lu KiB, backup %lu bytes\n", CFG_FLASH_BACKUP_PARTITION,
+             (unsigned long)(g_capacity / 1024), (unsigned long)sizeBytes());
+  return true;
+}
+
+bool FlashBackup::available() {
+  return g_capacity != 0;
+}
+
+uint64_t FlashBackup::capacity() {
+  return g_capacity;
+}
+
+size_t FlashBackup::sizeBytes() {
+  if (!g_capacity) return 0;
+  uint8_t head[sizeof(K2Bak::HeaderV3)];
+  if (!rawRead(0, head, sizeof(head))) return 0;
+  const uint64_t len = K2Bak::sealedLength(head, sizeof(head));
+  return len <= g_capacity ? (size_t)len : 0;
+}
+
+bool FlashBackup::exists() {
+  return sizeBytes() != 0;
+}
+
+bool FlashBackup::remove() {
+  if (!g_capacity || g_map) return false;
+  return rawErase(0, SECTOR);
+}
+
+const uint8_t* FlashBackup::map(size_t& len, String* err) {
+  len = 0;
+  if (g_map) {
+    if (err) *err = "Flash backup already mapped";
+    return nullptr;
+  }
+  const size_t n = sizeBytes();
+  if (!n) {
+    if (err) *err = "No backup in flash";
+    return nullptr;
+  }
+  g_map = rawMap(n);
+  if (!g_map) {
+    if (err) *err = "Cannot map flash backup";
+    return nullptr;
+  }
+  g_mapLen = n;
+  len = n;
+  return (const uint8_t*)g_map;
+}
+
+void FlashBackup::unmap() {
+  if (!g_map) return;
+  rawUnmap();
+  g_map = nullptr;
+  g_mapLen = 0;
+}
+
+bool FlashBackup::mapped() {
+  return g_map != nullptr;
+}
+
+String FlashBackup::statusJson() {
+  JsonDocument d;
+  d["available"] = available();
+  d["capacity"] = (uint64_t)capacity();
+  d["size"] = (uint32_t)sizeBytes();
+  d["exists"] = d["size"].as<uint32_t>() != 0;
+  d["mapped"] = mapped();
+  String out;
+  serializeJson(d, out);
+  return out;
+}
+
+// ------------------------------------------------------------
+// Sink
+// ------------------------------------------------------------
+
+bool FlashBackup::Sink::append(const uint8_t* data, size_t len) {
+  if (!len) return true;
+  if (!g_capacity || g_map || _size + len > g_capacity) return false;
+  const uint64_t end = _size + len;
+  if (end > _erasedTo) {
+    const uint64_t to = (end + SECTOR - 1) & ~(SECTOR - 1);
+    if (!rawErase(_erasedTo, to - _erasedTo)) return false;
+    _erasedTo = to;
+  }
+  if (!rawWrite(_size, data, len)) return false;
+  _size = end;
+  return true;
+}
+
+// Flash can't be rewritten in place: each touched sector is read, patched,
+// erased and written back.
+bool FlashBackup::Sink::patch(uint64_t off, const uint8_t* data, size_t len) {
+  if (g_map || off > _size || len > _size - off) return false;
+  _sector.resize(SECTOR);
+  while (len) {
+    const uint64_t base = off & ~(SECTOR - 1);
+    const size_t in = (size_t)(off - base);
+    const size_t take = len < SECTOR - in ? len : (size_t)(SECTOR - in);
+    if (!rawRead(base, _sector.data(), SECTOR)) return false;
+    memcpy(_sector.data() + in, data, take);
+    if (!rawErase(base, SECTOR) || !rawWrite(base, _sector.data(), SECTOR)) return false;
+    off += take;
+    data += take;
+    len -= take;
+  }
+  return true;
+}
+
+size_t FlashBackup::Sink::read(uint64_t off, uint8_t* data, size_t len) {
+  if (off >= _size) return 0;
+  if (len > _size - off) len = (size_t)(_size - off);
+  return rawRead(off, data, len) ? len : 0;
+}
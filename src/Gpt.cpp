@@ -0,0 +1,190 @@
+#include "Gpt.h"
+#include "Crc32.h"
+#include "Debug.h"
+#include <algorithm>
+#include <cstring>
+
+DBG_REGISTER_MODULE(__FILE__);
+
+static constexpr size_t BLOCK = 512;
+static constexpr size_t HDR_MIN = 92;
+static constexpr size_t ENTRY_NAME_OFF = 56;
+static constexpr size_t ENTRY_NAME_CHARS = 36;
+
+static uint32_t le32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t le64(const uint8_t* p) {
+  return (uint64_t)le32(p) | ((uint64_t)le32(p + 4) << 32);
+}
+
+static bool allZero(const uint8_t* p, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    if (p[i]) return false;
+  }
+  return true;
+}
+
+// Partition type 0xEE in one of the four MBR slots.
+static bool protectiveMbr(const uint8_t* mbr) {
+  if (mbr[510] != 0x55 || mbr[511] != 0xAA) return false;
+  for (size_t i = 0; i < 4; i++) {
+    if (mbr[446 + i * 16 + 4] == 0xEE) return true;
+  }
+  return false;
+}
+
+static String fmtSize(uint64_t blocks) {
+  const uint64_t kib = blocks / 2ULL;
+  if (kib >= 10ULL * 1024ULL) return String((unsigned long)(kib / 1024ULL)) + " MiB";
+  return String((unsigned long)kib) + " KiB";
+}
+
+void GptTable::clear() {
+  _valid = false;
+  _parts.clear();
+}
+
+bool GptTable::parse(const uint8_t* head, size_t len, String* err) {
+  clear();
+  if (!head || len < (size_t)HEAD_BLOCKS * BLOCK) {
+    if (err) *err = "GPT: short read of LBA 0-33";
+    return false;
+  }
+
+  const uint8_t* h = head + BLOCK;
+  if (memcmp(h, "EFI PART", 8) != 0) {
+    if (err) *err = (head[510] == 0x55 && head[511] == 0xAA) ? "no GPT on the disk (MBR partitioned?)"
+                                                               : "no GPT on the disk";
+    return false;
+  }
+  if (!protectiveMbr(head)) DBG_PRINTF("[GPT] no protective MBR entry, using the GPT header anyway\n");
+
+  const uint32_t hdrSize = le32(h + 12);
+  if (hdrSize < HDR_MIN || hdrSize > BLOCK) {
+    if (err) *err = "GPT: bad header size";
+    return false;
+  }
+  uint8_t hdr[BLOCK];
+  memcpy(hdr, h, hdrSize);
+  memset(hdr + 16, 0, 4);   // CRC field counts as zero
+  if (Crc32::of(hdr, hdrSize) != le32(h + 16)) {
+    if (err) *err = "GPT: header CRC mismatch";
+    return false;
+  }
+
+  const uint64_t entriesLba = le64(h + 72);
+  const uint32_t count = le32(h + 80);
+  const uint32_t entrySize = le32(h + 84);
+  if (entrySize < 128 || (entrySize & 7) || count == 0) {
+    if (err) *err = "GPT: bad entry layout";
+    return false;
+  }
+  const uint64_t arrayBytes = (uint64_t)count * entrySize;
+  if (entriesLba < 2 || entriesLba * BLOCK + arrayBytes > (uint64_t)HEAD_BLOCKS * BLOCK) {
+    if (err) *err = "GPT: entry array beyond LBA 33";
+    return false;
+  }
+  const uint8_t* entries = head + entriesLba * BLOCK;
+  if (Crc32::of(entries, (size_t)arrayBytes) != le32(h + 88)) {
+    if (err) *err = "GPT: entry array CRC mismatch";
+    return false;
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    const uint8_t* e = entries + (size_t)i * entrySize;
+    if (allZero(e, 16)) continue;   // unused slot
+    const uint64_t first = le64(e + 32);
+    const uint64_t last = le64(e + 40);
+    if (last < first || last > 0xFFFFFFFFULL) {
+      DBG_PRINTF("[GPT] entry %u: lba %llu..%llu out of reach, skipped\n", (unsigned)i,
+                 (unsigned long long)first, (unsigned long long)last);
+      continue;
+    }
+
+    Part p;
+    for (size_t c = 0; c < ENTRY_NAME_CHARS; c++) {
+      const uint16_t u = (uint16_t)(e[ENTRY_NAME_OFF + c * 2] | (e[ENTRY_NAME_OFF + c * 2 + 1] << 8));
+      if (!u) break;
+      p.name += (u >= 0x20 && u < 0x7F) ? (char)u : '?';
+    }
+    if (!p.name.length()) p.name = String("part") + (i + 1);
+    p.lba_start = (uint32_t)first;
+    p.lba_count = (uint32_t)(last - first + 1);
+    _parts.push_back(p);
+  }
+
+  std::sort(_parts.begin(), _parts.end(),
+            [](const Part& a, const Part& b) { return a.lba_start < b.lba_start; });
+  _valid = true;
+  DBG_PRINTF("[GPT] %u partitions\n", (unsigned)_parts.size());
+  return true;
+}
+
+const GptTable::Part* GptTable::find(const String& name) const {
+  for (const Part& p : _parts) {
+    if (p.name.equalsIgnoreCase(name)) return &p;
+  }
+  return nullptr;
+}
+
+bool GptTable::select(const String& names, std::vector<Range>& out, String* err) const {
+  out.clear();
+  String list = names;
+  list.replace(',', ' ');
+  list += " ";
+  int from = 0;
+  while (from < (int)list.length()) {
+    const int sp = list.indexOf(' ', from);
+    String name = list.substring(from, sp);
+    from = sp + 1;
+    name.trim();
+    if (!name.length()) continue;
+
+    const Part* p = find(name);
+    if (!p) {
+      if (err) *err = String("partition '") + name + "' not in the GPT";
+      out.clear();
+      return false;
+    }
+    out.push_back(Range{p->lba_start, p->lba_count});
+  }
+  if (out.empty()) {
+    if (err) *err = "no partitions named";
+    return false;
+  }
+  mergeRanges(out);
+  return true;
+}
+
+void GptTable::mergeRanges(std::vector<Range>& v) {
+  std::sort(v.begin(), v.end(), [](const Range& a, const Range& b) { return a.lba_start < b.lba_start; });
+  size_t w = 0;
+  for (size_t i = 0; i < v.size(); i++) {
+    if (!v[i].lba_count) continue;
+    if (w) {
+      Range& prev = v[w - 1];
+      const uint64_t prevEnd = (uint64_t)prev.lba_start + prev.lba_count;
+      if ((uint64_t)v[i].lba_start <= prevEnd) {
+        const uint64_t end = (uint64_t)v[i].lba_start + v[i].lba_count;
+        if (end > prevEnd) prev.lba_count = (uint32_t)(end - prev.lba_start);
+        continue;
+      }
+    }
+    v[w++] = v[i];
+  }
+  v.resize(w);
+}
+
+String GptTable::listText() const {
+  if (!_valid) return "GPT not read yet (!backup gpt)";
+  String s;
+  for (const Part& p : _parts) {
+    s += p.name + " " + String((unsigned long)p.lba_start) + " " + String((unsigned long)p.lba_count) +
+         " (" + fmtSize(p.lba_count) + ")\n";
+  }
+  if (!s.length()) return "GPT has no partitions";
+  s.remove(s.length() - 1);
+  return s;
+}
@@ -0,0 +1,375 @@
+#include "Gzip_inflate.h"
+#include "Crc32.h"
+
+#include <string.h>
+
+#ifdef ARDUINO
+#include "Debug.h"
+DBG_REGISTER_MODULE(__FILE__);
+#endif
+
+// gzip header flags
+static constexpr uint8_t FHCRC    = 0x02;
+static constexpr uint8_t FEXTRA   = 0x04;
+static constexpr uint8_t FNAME    = 0x08;
+static constexpr uint8_t FCOMMENT = 0x10;
+
+static constexpr uint16_t LEN_BASE[29] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static constexpr uint8_t LEN_EXTRA[29] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static constexpr uint16_t DIST_BASE[30] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+  257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static constexpr uint8_t DIST_EXTRA[30] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+  7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+// order in which the code-length code lengths are sent
+static constexpr uint8_t CL_ORDER[19] = {
+  16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+void GzipInflater::begin(uint8_t* out, size_t cap) {
+  _out = out;
+  _cap = cap;
+  _outLen = 0;
+  _inLen = _inPos = 0;
+  _bitBuf = 0;
+  _bitCnt = 0;
+  _short = false;
+  _lastBlock = false;
+  _storedLeft = 0;
+  _trailerCrc = _trailerLen = 0;
+  _err = "";
+  _st = St::Header;
+}
+
+void GzipInflater::fail(const char* why) {
+  if (_st == St::Failed) return;
+  _err = why;
+  _st = St::Failed;
+}
+
+bool GzipInflater::feed(const uint8_t* data, size_t len) {
+  if (_st == St::Idle) fail("not started");
+  if (_st == St::Done && len) fail("data after the gzip trailer");
+  while (len && _st != St::Failed && _st != St::Done) {
+    if (_inPos == _inLen) {
+      _inPos = _inLen = 0;
+    } else if (_inLen == IN_BYTES) {
+      memmove(_in, _in + _inPos, _inLen - _inPos);
+      _inLen -= _inPos;
+      _inPos = 0;
+    }
+    const size_t n = len < IN_BYTES - _inLen ? len : IN_BYTES - _inLen;
+    if (!n) {
+      fail("decode step larger than the input buffer");
+      break;
+    }
+    memcpy(_in + _inLen, data, n);
+    _inLen += n;
+    data += n;
+    len -= n;
+    run(false);
+  }
+  if (_st == St::Done && len) fail("data after the gzip trailer");
+  return _st != St::Failed;
+}
+
+bool GzipInflater::finish() {
+  run(true);
+  if (_st == St::Failed) return false;
+  if (_st != St::Done) {
+    fail("truncated gzip stream");
+    return false;
+  }
+  if (_inPos < _inLen) {
+    fail("data after the gzip trailer");
+    return false;
+  }
+  if (_trailerLen != (uint32_t)_outLen) {
+    fail("length mismatch (short read on the target?)");
+    return false;
+  }
+  if (Crc32::of(_out, _outLen) != _trailerCrc) {
+    fail("crc mismatch");
+    return false;
+  }
+  return true;
+}
+
+// Steps until the input runs out; an interrupted step is rewound so it can
+// start over once more bytes are in (or fails, if none will come).
+void GzipInflater::run(bool final) {
+  while (_st != St::Failed && _st != St::Done && _st != St::Idle) {
+    const size_t pos = _inPos;
+    const uint32_t buf = _bitBuf;
+    const uint8_t cnt = _bitCnt;
+    _short = false;
+    step();
+    if (_short) {
+      _inPos = pos;
+      _bitBuf = buf;
+      _bitCnt = cnt;
+      if (final) fail("truncated gzip stream");
+      return;
+    }
+  }
+}
+
+void GzipInflater::step() {
+  switch (_st) {
+    case St::Header:      stepHeader(); break;
+    case St::BlockHeader: stepBlockHeader(); break;
+    case St::Stored:      stepStored(); break;
+    case St::Codes:       stepCodes(); break;
+    case St::Trailer:     stepTrailer(); break;
+    default: break;
+  }
+}
+
+// ------------------------------------------------------------
+// Bit input (LSB first)
+// ------------------------------------------------------------
+
+uint32_t GzipInflater::bits(uint8_t n) {
+  while (_bitCnt < n) {
+    if (_inPos >= _inLen) {
+      _short = true;
+      return 0;
+    }
+    _bitBuf |= (uint32_t)_in[_inPos++] << _bitCnt;
+    _bitCnt += 8;
+  }
+  const uint32_t v = _bitBuf & ((1u << n) - 1u);
+  _bitBuf >>= n;
+  _bitCnt -= n;
+  return v;
+}
+
+void GzipInflater::alignByte() {
+  const uint8_t drop = _bitCnt & 7u;
+  _bitBuf >>= drop;
+  _bitCnt -= drop;
+}
+
+// -1: out of input, -2: no such code.
+int GzipInflater::decode(const Huffman& h) {
+  int code = 0, first = 0, index = 0;
+  for (int len = 1; len < 16; len++) {
+    code |= (int)bits(1);
+    if (_short) return -1;
+    const int count = h.count[len];
+    if (code - count < first) return h.symbol[index + (code - first)];
+    index += count;
+    first += count;
+    first <<= 1;
+    code <<= 1;
+  }
+  return -2;
+}
+
+// 0: complete code, > 0: incomplete, < 0: over-subscribed.
+int GzipInflater::build(Huffman& h, const uint8_t* lengths, int n) {
+  memset(h.count, 0, sizeof(h.count));
+  for (int s = 0; s < n; s++) h.count[lengths[s]]++;
+  if (h.count[0] == n) return 0;
+
+  int left = 1;
+  for (int len = 1; len < 16; len++) {
+    left <<= 1;
+    left -= h.count[len];
+    if (left < 0) return left;
+  }
+
+  uint16_t offs[16];
+  offs[1] = 0;
+  for (int len = 1; len < 15; len++) offs[len + 1] = (uint16_t)(offs[len] + h.count[len]);
+  for (int s = 0; s < n; s++) {
+    if (lengths[s]) h.symbol[offs[lengths[s]]++] = (uint16_t)s;
+  }
+  return left;
+}
+
+// ------------------------------------------------------------
+// Steps
+// ------------------------------------------------------------
+
+void GzipInflater::stepHeader() {
+  const uint32_t id = bits(16);
+  const uint32_t cm = bits(8);
+  const uint32_t flg = bits(8);
+  bits(16); bits(16);   // mtime
+  bits(16);             // xfl, os
+  if (_short) return;
+  if (id != 0x8B1Fu) { fail("not gzip data"); return; }
+  if (cm != 8) { fail("unknown gzip method"); return; }
+
+  if (flg & FEXTRA) {
+    uint32_t xlen = bits(16);
+    while (xlen-- && !_short) bits(8);
+  }
+  if (flg & FNAME) {
+    while (!_short && bits(8) != 0) {}
+  }
+  if (flg & FCOMMENT) {
+    while (!_short && bits(8) != 0) {}
+  }
+  if (flg & FHCRC) bits(16);
+  if (_short) return;
+  _st = St::BlockHeader;
+}
+
+void GzipInflater::stepBlockHeader() {
+  const bool last = bits(1) != 0;
+  const uint32_t type = bits(2);
+  if (_short) return;
+
+  if (type == 0) {
+    alignByte();
+    const uint32_t len = bits(16);
+    const uint32_t nlen = bits(16);
+    if (_short) return;
+    if ((len ^ 0xFFFFu) != nlen) { fail("bad stored block length"); return; }
+    _storedLeft = len;
+    _lastBlock = last;
+    _st = St::Stored;
+  } else if (type == 1) {
+    uint8_t lengths[288 + 30];
+    int s = 0;
+    for (; s < 144; s++) lengths[s] = 8;
+    for (; s < 256; s++) lengths[s] = 9;
+    for (; s < 280; s++) lengths[s] = 7;
+    for (; s < 288; s++) lengths[s] = 8;
+    build(_lit, lengths, 288);
+    for (s = 0; s < 30; s++) lengths[s] = 5;
+    build(_dist, lengths, 30);
+    _lastBlock = last;
+    _st = St::Codes;
+  } else if (type == 2) {
+    if (!readDynamic() || _short) return;
+    _lastBlock = last;
+    _st = St::Codes;
+  } else {
+    fail("bad block type");
+  }
+}
+
+// Code lengths of a dynamic block, themselves Huffman-coded; _dist holds the
+// code-length code until the real distance code replaces it.
+bool GzipInflater::readDynamic() {
+  const int nlen = (int)bits(5) + 257;
+  const int ndist = (int)bits(5) + 1;
+  const int ncode = (int)bits(4) + 4;
+  if (_short) return false;
+  if (nlen > 286 || ndist > 30) { fail("bad code counts"); return false; }
+
+  uint8_t lengths[286 + 30];
+  int i = 0;
+  for (; i < ncode; i++) lengths[CL_ORDER[i]] = (uint8_t)bits(3);
+  for (; i < 19; i++) lengths[CL_ORDER[i]] = 0;
+  if (_short) return false;
+  if (build(_dist, lengths, 19) != 0) { fail("incomplete code-length code"); return false; }
+
+  int index = 0;
+  while (index < nlen + ndist) {
+    int sym = decode(_dist);
+    if (_short) return false;
+    if (sym < 0) { fail("bad code-length code"); return false; }
+    if (sym < 16) {
+      lengths[index++] = (uint8_t)sym;
+      continue;
+    }
+    uint8_t len = 0;
+    if (sym == 16) {
+      if (index == 0) { fail("repeat with no previous length"); return false; }
+      len = lengths[index - 1];
+      sym = 3 + (int)bits(2);
+    } else if (sym == 17) {
+      sym = 3 + (int)bits(3);
+    } else {
+      sym = 11 + (int)bits(7);
+    }
+    if (_short) return false;
+    if (index + sym > nlen + ndist) { fail("too many code lengths"); return false; }
+    while (sym--) lengths[index++] = len;
+  }
+  if (lengths[256] == 0) { fail("no end-of-block code"); return false; }
+
+  // a single code may be incomplete; anything else must be complete
+  int err = build(_lit, lengths, nlen);
+  if (err < 0 || (err > 0 && nlen - _lit.count[0] != 1)) { fail("bad literal/length code"); return false; }
+  err = build(_dist, lengths + nlen, ndist);
+  if (err < 0 || (err > 0 && ndist - _dist.count[0] != 1)) { fail("bad distance code"); return false; }
+  return true;
+}
+
+// Copies what has arrived; never rewound, so it only reports running out
+// when it could not take a single byte.
+void GzipInflater::stepStored() {
+  if (!_storedLeft) {
+    _st = _lastBlock ? St::Trailer : St::BlockHeader;
+    return;
+  }
+  if (_bitCnt < 8 && _inPos >= _inLen) {
+    _short = true;
+    return;
+  }
+  if (_outLen + _storedLeft > _cap) { fail("output larger than the chunk"); return; }
+  while (_storedLeft && _bitCnt >= 8) {
+    _out[_outLen++] = (uint8_t)bits(8);
+    _storedLeft--;
+  }
+  size_t n = _inLen - _inPos;
+  if (n > _storedLeft) n = _storedLeft;
+  memcpy(_out + _outLen, _in + _inPos, n);
+  _outLen += n;
+  _inPos += n;
+  _storedLeft -= (uint32_t)n;
+}
+
+void GzipInflater::stepCodes() {
+  const int sym = decode(_lit);
+  if (_short) return;
+  if (sym < 0) { fail("bad literal/length code"); return; }
+
+  if (sym < 256) {
+    if (_outLen >= _cap) { fail("output larger than the chunk"); return; }
+    _out[_outLen++] = (uint8_t)sym;
+    return;
+  }
+  if (sym == 256) {
+    _st = _lastBlock ? St::Trailer : St::BlockHeader;
+    return;
+  }
+
+  const int li = sym - 257;
+  if (li >= 29) { fail("bad length symbol"); return; }
+  const size_t len = LEN_BASE[li] + bits(LEN_EXTRA[li]);
+  const int di = decode(_dist);
+  if (_short) return;
+  if (di < 0 || di >= 30) { fail("bad distance symbol"); return; }
+  const size_t dist = DIST_BASE[di] + bits(DIST_EXTRA[di]);
+  if (_short) return;
+
+  if (dist > _outLen) { fail("distance before the start of the chunk"); return; }
+  if (len > _cap - _outLen) { fail("output larger than the chunk"); return; }
+  // overlapping copies repeat the last dist bytes, so go byte by byte
+  uint8_t* dst = _out + _outLen;
+  const uint8_t* src = dst - dist;
+  for (size_t i = 0; i < len; i++) dst[i] = src[i];
+  _outLen += len;
+}
+
+void GzipInflater::stepTrailer() {
+  alignByte();
+  const uint32_t crcLo = bits(16);
+  const uint32_t crcHi = bits(16);
+  const uint32_t lenLo = bits(16);
+  const uint32_t lenHi = bits(16);
+  if (_short) return;
+  _trailerCrc = crcLo | (crcHi << 16);
+  _trailerLen = lenLo | (lenHi << 16);
+  _st = St::Done;
+}
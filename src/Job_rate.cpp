@@ -0,0 +1,132 @@
+#include "Job_rate.h"
+#include "Debug.h"
+#include <cstdio>
+
+DBG_REGISTER_MODULE(__FILE__);
+
+static uint32_t smooth(uint32_t avg, uint32_t sample, bool first) {
+  return first ? sample : (uint32_t)(((uint64_t)avg * 3ULL + sample) / 4ULL);
+}
+
+void JobRate::begin(const Model& prior, uint16_t skipPermille) {
+  *this = JobRate();
+  _prior = prior;
+  _priorSkip = skipPermille > 1000 ? 1000 : skipPermille;
+}
+
+void JobRate::chunk(size_t bytes, uint32_t wallMs, uint32_t xferMs, bool moved) {
+  if (!moved) xferMs = 0;
+  if (xferMs > wallMs) xferMs = wallMs;
+  _overheadMs = smooth(_overheadMs, wallMs - xferMs, _chunks == 0);
+  _chunks++;
+  _bytes += bytes;
+  if (!moved) return;
+
+  _movedBytes += bytes;
+  if (xferMs) {
+    _rate = smooth(_rate, (uint32_t)((uint64_t)bytes * 1000ULL / xferMs), _moved == 0);
+    _moved++;
+  }
+}
+
+void JobRate::retry() {
+  _retries++;
+}
+
+uint16_t JobRate::skipPermille() const {
+  if (!_bytes) return _priorSkip;
+  return (uint16_t)((_bytes - _movedBytes) * 1000ULL / _bytes);
+}
+
+uint32_t JobRate::seconds(uint32_t rate, uint32_t overheadMs, uint16_t retryPermille,
+                          uint16_t skipPermille, uint64_t bytes, size_t chunkBytes) {
+  if (!bytes) return 0;
+  if (!chunkBytes) chunkBytes = 512;
+  const uint64_t moveBytes = bytes * (1000ULL - (skipPermille > 1000 ? 1000 : skipPermille)) / 1000ULL;
+  if (moveBytes && !rate) return 0;
+  const uint64_t chunks = (bytes + chunkBytes - 1) / chunkBytes;
+  uint64_t ms = (moveBytes ? moveBytes * 1000ULL / rate : 0) + chunks * overheadMs;
+  ms = ms * (1000ULL + retryPermille) / 1000ULL;
+  return (uint32_t)((ms + 999ULL) / 1000ULL);
+}
+
+uint32_t JobRate::etaSeconds(uint64_t bytesLeft, size_t chunkBytes) const {
+  // the prior stands in for what this job has not measured yet
+  const uint32_t rate = _moved ? _rate : _prior.rate;
+  const uint32_t overhead = _chunks ? _overheadMs : _prior.overheadMs;
+  const uint16_t retries = _chunks ? (uint16_t)((uint64_t)_retries * 1000ULL / _chunks) : _prior.retryPermille;
+  return seconds(rate, overhead, retries, skipPermille(), bytesLeft, chunkBytes);
+}
+
+String JobRate::text(uint64_t bytesLeft, size_t chunkBytes) const {
+  String s;
+  if (_moved) s += fmtRate(_rate) + ", ";
+  if (_chunks) s += String((unsigned long)_overheadMs) + " ms/chunk, ";
+  if (_retries && _chunks) {
+    s += String((unsigned long)((uint64_t)_retries * 100ULL / _chunks)) + "% re-read, ";
+  }
+  const uint32_t eta = etaSeconds(bytesLeft, chunkBytes);
+  if (eta) s += "ETA " + fmtSeconds(eta);
+  else if (s.length()) s.remove(s.length() - 2);
+  else s = "measuring";
+  return s;
+}
+
+JobRate::Model JobRate::model(uint32_t baud) const {
+  Model m;
+  if (!_moved || !_chunks) return m;
+  m.baud = baud;
+  m.rate = _rate;
+  m.overheadMs = _overheadMs;
+  m.chunkBytes = (uint32_t)(_bytes / _chunks);
+  const uint64_t r = (uint64_t)_retries * 1000ULL / _chunks;
+  m.retryPermille = (uint16_t)(r > 0xFFFFULL ? 0xFFFFULL : r);
+  return m;
+}
+
+JobRate::Model JobRate::wireModel(uint32_t baud, uint32_t charsX10, uint32_t chunkBytes) {
+  Model m;
+  m.baud = baud;
+  // baud / 10 chars a second, charsX10 / 10 chars a byte
+  m.rate = charsX10 ? baud / charsX10 : 0;
+  m.overheadMs = CFG_JOB_RATE_CHUNK_OVERHEAD_MS;
+  m.chunkBytes = chunkBytes;
+  return m;
+}
+
+JobRate::Model JobRate::blend(const Model& old, const Model& latest) {
+  if (!old.baud || !old.rate || !latest.baud) return latest;
+  Model m = latest;
+  const uint32_t oldRate = (uint32_t)((uint64_t)old.rate * latest.baud / old.baud);
+  m.rate = (uint32_t)(((uint64_t)oldRate + 3ULL * latest.rate) / 4ULL);
+  m.overheadMs = (uint32_t)(((uint64_t)old.overheadMs + 3ULL * latest.overheadMs) / 4ULL);
+  m.chunkBytes = (uint32_t)(((uint64_t)old.chunkBytes + 3ULL * latest.chunkBytes) / 4ULL);
+  m.retryPermille = (uint16_t)(((uint32_t)old.retryPermille + 3u * latest.retryPermille) / 4u);
+  return m;
+}
+
+uint32_t JobRate::estimateSeconds(const Model& m, uint16_t skipPermille, uint64_t bytes, uint32_t baud) {
+  if (!m.baud) return 0;
+  if (!baud) baud = m.baud;
+  const uint32_t rate = (uint32_t)((uint64_t)m.rate * baud / m.baud);
+  return seconds(rate, m.overheadMs, m.retryPermille, skipPermille, bytes, m.chunkBytes);
+}
+
+String JobRate::fmtSeconds(uint32_t s) {
+  char buf[24];
+  if (s >= 3600) snprintf(buf, sizeof(buf), "%luh%02lum", (unsigned long)(s / 3600), (unsigned long)(s / 60 % 60));
+  else if (s >= 60) snprintf(buf, sizeof(buf), "%lum%02lus", (unsigned long)(s / 60), (unsigned long)(s % 60));
+  else snprintf(buf, sizeof(buf), "%lus", (unsigned long)s);
+  return String(buf);
+}
+
+String JobRate::fmtRate(uint32_t bytesPerSec) {
+  char buf[24];
+  if (bytesPerSec >= 1024) {
+    snprintf(buf, sizeof(buf), "%lu.%lu KiB/s", (unsigned long)(bytesPerSec / 1024),
+             (unsigned long)(bytesPerSec % 1024 * 10 / 1024));
+  } else {
+    snprintf(buf, sizeof(buf), "%lu B/s", (unsigned long)bytesPerSec);
+  }
+  return String(buf);
+}
@@ -1,6 +1,9 @@
 #include "K2bak.h"
+#include "Lz4_block.h"
+#include "Crc32.h"
 
 #include <mbedtls/sha256.h>
+#include <stddef.h>
 #include "Debug.h"
 
 DBG_REGISTER_MODULE(__FILE__);
@@ -8,36 +11,28 @@ DBG_REGISTER_MODULE(__FILE__);
 namespace K2Bak {
 
 // ============================================================
-// CRC32 (standard polynomial 0xEDB88320)
+// CRC32 (see Crc32.h)
 // ============================================================
 
-static uint32_t crc_table[256];
-static bool crc_init = false;
-
-static void init_crc() {
-  if (crc_init) return;
-  for (uint32_t i = 0; i < 256; i++) {
-    uint32_t c = i;
-    for (int k = 0; k < 8; k++) {
-      c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
-    }
-    crc_table[i] = c;
+uint32_t fillCrc32(uint8_t fill, size_t len) {
+  uint8_t blk[512];
+  memset(blk, fill, sizeof(blk));
+  uint32_t c = Crc32::INIT;
+  while (len) {
+    size_t n = len < sizeof(blk) ? len : sizeof(blk);
+    c = Crc32::update(c, blk, n);
+    len -= n;
   }
-  crc_init = true;
+  return Crc32::finish(c);
 }
 
-uint32_t crc32_update(uint32_t crc, const uint8_t* data, size_t len) {
-  init_crc();
-  uint32_t c = crc;
-  for (size_t i = 0; i < len; i++) {
-    c = crc_table[(c ^ data[i]) & 0xFFu] ^ (c >> 8);
+uint32_t FillCrcCache::get(uint8_t fill, size_t len) {
+  const int i = fill ? 1 : 0;
+  if (_len[i] != len) {
+    _crc[i] = fillCrc32(fill, len);
+    _len[i] = len;
   }
-  return c;
-}
-
-uint32_t crc32(const uint8_t* data, size_t len, uint32_t seed) {
-  uint32_t c = crc32_update(seed, data, len);
-  return c ^ 0xFFFFFFFFu;
+  return _crc[i];
 }
 
 bool sha256(const uint8_t* data, size_t len, uint8_t out32[32]) {
@@ -77,11 +72,70 @@ static bool in_bounds(size_t off, size_t len, size_t fileLen) {
   return true;
 }
 
+static bool in_bounds64(uint64_t off, uint64_t len, uint64_t fileLen) {
+  return off <= fileLen && len <= fileLen - off;
+}
+
+// A length-counted text field: not NUL-terminated in the file, so only its
+// own bytes are read (up to a NUL inside it, as before).
+static String field_text(const uint8_t* p, size_t len) {
+  const void* nul = memchr(p, 0, len);
+  if (nul) len = (size_t)((const uint8_t*)nul - p);
+  String s;
+  s.concat((const char*)p, (unsigned int)len);
+  return s;
+}
+
+// [off, off + len) lies where File::seek() can reach.
+static bool seekable(uint64_t off, uint64_t len) {
+  return in_bounds64(off, len, FILE_MAX_BYTES);
+}
+
 static void memzero(uint8_t* p, size_t n) {
   if (!p || !n) return;
   for (size_t i = 0; i < n; i++) p[i] = 0;
 }
 
+// CRC32 (+ SHA-256 if shaOut) of the file as stored before sealing: the
+// 4 bytes at crcOff and the 32 at shaOff read as zero. Hashes in place
+// rather than patching a copy, yielding every CFG_K2BAK_HASH_YIELD_BYTES.
+static bool digest_sealed(const uint8_t* file, size_t len, size_t crcOff, size_t shaOff,
+                          uint32_t& crcOut, uint8_t* shaOut) {
+  static const uint8_t zeros[32] = { 0 };
+  struct Seg { const uint8_t* p; size_t n; };
+  Seg segs[5] = {
+    { file, crcOff },
+    { zeros, 4 },
+    { file + crcOff + 4, len - (crcOff + 4) },
+    { nullptr, 0 },
+    { nullptr, 0 },
+  };
+  if (shaOut) {
+    segs[2].n = shaOff - (crcOff + 4);
+    segs[3] = { zeros, 32 };
+    segs[4] = { file + shaOff + 32, len - (shaOff + 32) };
+  }
+
+  mbedtls_sha256_context ctx;
+  mbedtls_sha256_init(&ctx);
+  bool ok = !shaOut || mbedtls_sha256_starts_ret(&ctx, 0) == 0;
+  uint32_t c = 0xFFFFFFFFu;
+  for (const Seg& sg : segs) {
+    for (size_t off = 0; ok && off < sg.n; ) {
+      size_t n = sg.n - off;
+      if (n > CFG_K2BAK_HASH_YIELD_BYTES) n = CFG_K2BAK_HASH_YIELD_BYTES;
+      c = Crc32::update(c, sg.p + off, n);
+      if (shaOut) ok = mbedtls_sha256_update_ret(&ctx, sg.p + off, n) == 0;
+      off += n;
+      if (off < sg.n) yield();
+    }
+  }
+  if (ok && shaOut) ok = mbedtls_sha256_finish_ret(&ctx, shaOut) == 0;
+  mbedtls_sha256_free(&ctx);
+  crcOut = c ^ 0xFFFFFFFFu;
+  return ok;
+}
+
 // ============================================================
 // Build (v2)
 // ============================================================
@@ -152,7 +206,7 @@ bool buildV2(
     e.data_len  = (uint32_t)ranges[i].data.size();
 
     if (!ranges[i].data.empty()) {
-      e.crc32 = crc32(ranges[i].data.data(), ranges[i].data.size());
+      e.crc32 = Crc32::of(ranges[i].data.data(), ranges[i].data.size());
       write_bytes(outFile, ranges[i].data.data(), ranges[i].data.size());
     } else {
       e.crc32 = 0;
@@ -177,21 +231,10 @@ bool buildV2(
   // 9) compute integrity
   // CRC32 of entire file with header.file_crc32 treated as 0.
   // SHA256 of entire file with header.file_crc32=0 and footer.sha256=0.
-  std::vector<uint8_t> tmp(outFile);
-  HeaderV2 hz = h;
-  hz.file_crc32 = 0;
-  memcpy(tmp.data(), &hz, sizeof(hz));
-  // zero sha in temp
-  if (h.footer_off + sizeof(FooterV2) <= tmp.size()) {
-    FooterV2 fz{};
-    memcpy(&fz, tmp.data() + h.footer_off, sizeof(FooterV2));
-    memzero(fz.sha256, sizeof(fz.sha256));
-    memcpy(tmp.data() + h.footer_off, &fz, sizeof(FooterV2));
-  }
-
-  const uint32_t fileCrc = crc32(tmp.data(), tmp.size());
+  uint32_t fileCrc = 0;
   uint8_t fileSha[32];
-  if (!sha256(tmp.data(), tmp.size(), fileSha)) {
+  if (!digest_sealed(outFile.data(), outFile.size(), offsetof(HeaderV2, file_crc32),
+                     h.footer_off + offsetof(FooterV2, sha256), fileCrc, fileSha)) {
     if (err) *err = "SHA256 failed";
     return false;
   }
@@ -237,23 +280,26 @@ static bool parse_v2(Parsed& out, const uint8_t* fileData, size_t fileLen, Strin
 
   // bounds sanity
   if (!in_bounds(0, sizeof(HeaderV2), fileLen)) { if (err) *err = "Header out of bounds"; return false; }
-  if (!in_bounds(h.footer_off, sizeof(FooterV2), fileLen)) { if (err) *err = "Footer out of bounds"; return false; }
+  if (h.footer_off < sizeof(HeaderV2) || !in_bounds(h.footer_off, sizeof(FooterV2), fileLen)) {
+    if (err) *err = "Footer out of bounds";
+    return false;
+  }
 
   // read variable fields
   size_t off = sizeof(HeaderV2);
   if (h.board_id_len) {
     if (!in_bounds(off, h.board_id_len, fileLen)) { if (err) *err = "board_id out of bounds"; return false; }
-    out.boardId = String((const char*)(fileData + off)).substring(0, h.board_id_len);
+    out.boardId = field_text(fileData + off, h.board_id_len);
     off += h.board_id_len;
   }
   if (h.profile_id_len) {
     if (!in_bounds(off, h.profile_id_len, fileLen)) { if (err) *err = "profile_id out of bounds"; return false; }
-    out.profileId = String((const char*)(fileData + off)).substring(0, h.profile_id_len);
+    out.profileId = field_text(fileData + off, h.profile_id_len);
     off += h.profile_id_len;
   }
   if (h.env_len) {
     if (!in_bounds(off, h.env_len, fileLen)) { if (err) *err = "env out of bounds"; return false; }
-    out.envText = String((const char*)(fileData + off)).substring(0, h.env_len);
+    out.envText = field_text(fileData + off, h.env_len);
     off += h.env_len;
   }
 
@@ -274,27 +320,18 @@ static bool parse_v2(Parsed& out, const uint8_t* fileData, size_t fileLen, Strin
     return false;
   }
 
-  // Prepare temp with crc+sha zeroed and compute
-  std::vector<uint8_t> tmp(fileData, fileData + fileLen);
-  HeaderV2 hz = h;
-  hz.file_crc32 = 0;
-  memcpy(tmp.data(), &hz, sizeof(hz));
-  FooterV2 fz = f;
-  memzero(fz.sha256, sizeof(fz.sha256));
-  memcpy(tmp.data() + h.footer_off, &fz, sizeof(fz));
-
-  const uint32_t wantCrc = h.file_crc32;
-  const uint32_t gotCrc  = crc32(tmp.data(), tmp.size());
-  if (wantCrc != gotCrc) {
-    if (err) *err = "File CRC mismatch (corrupt backup file)";
-    return false;
-  }
-
+  // digests are defined with file_crc32 and footer.sha256 zeroed
+  uint32_t gotCrc = 0;
   uint8_t gotSha[32];
-  if (!sha256(tmp.data(), tmp.size(), gotSha)) {
+  if (!digest_sealed(fileData, fileLen, offsetof(HeaderV2, file_crc32),
+                     h.footer_off + offsetof(FooterV2, sha256), gotCrc, gotSha)) {
     if (err) *err = "SHA256 failed";
     return false;
   }
+  if (h.file_crc32 != gotCrc) {
+    if (err) *err = "File CRC mismatch (corrupt backup file)";
+    return false;
+  }
   if (memcmp(gotSha, f.sha256, 32) != 0) {
     if (err) *err = "File SHA256 mismatch (corrupt backup file)";
     return false;
@@ -337,12 +374,12 @@ static bool parse_v1(Parsed& out, const uint8_t* fileData, size_t fileLen, Strin
   size_t off = sizeof(HeaderV1);
   if (h.board_id_len) {
     if (!in_bounds(off, h.board_id_len, fileLen)) { if (err) *err="board_id out of bounds"; return false; }
-    out.boardId = String((const char*)(fileData + off)).substring(0, h.board_id_len);
+    out.boardId = field_text(fileData + off, h.board_id_len);
     off += h.board_id_len;
   }
   if (h.env_len) {
     if (!in_bounds(off, h.env_len, fileLen)) { if (err) *err="env out of bounds"; return false; }
-    out.envText = String((const char*)(fileData + off)).substring(0, h.env_len);
+    out.envText = field_text(fileData + off, h.env_len);
     off += h.env_len;
   }
 
@@ -354,14 +391,9 @@ static bool parse_v1(Parsed& out, const uint8_t* fileData, size_t fileLen, Strin
   }
 
   // CRC check (treat header.file_crc32 as 0)
-  std::vector<uint8_t> tmp(fileData, fileData + fileLen);
-  HeaderV1 hz = h;
-  hz.file_crc32 = 0;
-  memcpy(tmp.data(), &hz, sizeof(hz));
-
-  const uint32_t want = h.file_crc32;
-  const uint32_t got  = crc32(tmp.data(), tmp.size());
-  if (want != got) {
+  uint32_t got = 0;
+  digest_sealed(fileData, fileLen, offsetof(HeaderV1, file_crc32), 0, got, nullptr);
+  if (h.file_crc32 != got) {
     if (err) *err = "File CRC mismatch (corrupt backup file)";
     return false;
   }
@@ -375,6 +407,97 @@ static bool parse_v1(Parsed& out, const uint8_t* fileData, size_t fileLen, Strin
   return true;
 }
 
+static bool parse_v3(Parsed& out, const uint8_t* fileData, size_t fileLen, String* err) {
+  if (!fileData || fileLen < sizeof(HeaderV3) + sizeof(FooterV2)) {
+    if (err) *err = "File too small";
+    return false;
+  }
+
+  HeaderV3 h{};
+  memcpy(&h, fileData, sizeof(h));
+  if (h.header_size != sizeof(HeaderV3)) {
+    if (err) *err = "Header size mismatch";
+    return false;
+  }
+
+  const uint64_t rangeBytes = (uint64_t)h.range_count * sizeof(RangeEntryV3);
+  const uint64_t chunkBytes = (uint64_t)h.chunk_count * sizeof(ChunkEntry);
+  if (!in_bounds64(h.footer_off, sizeof(FooterV2), fileLen) ||
+      h.footer_off + sizeof(FooterV2) != fileLen) { if (err) *err = "Footer out of bounds"; return false; }
+  if (!in_bounds64(h.range_table_off, rangeBytes, h.footer_off)) { if (err) *err = "range_table out of bounds"; return false; }
+  if (!in_bounds64(h.chunk_index_off, chunkBytes, h.footer_off)) { if (err) *err = "chunk_index out of bounds"; return false; }
+
+  // board_id, profile_id, env follow the header back to back; each length
+  // is checked on its own so a huge one cannot wrap a 32-bit sum
+  uint64_t off = sizeof(HeaderV3);
+  const uint32_t lens[3] = { h.board_id_len, h.profile_id_len, h.env_len };
+  String* fields[3] = { &out.boardId, &out.profileId, &out.envText };
+  for (int k = 0; k < 3; k++) {
+    if (!in_bounds64(off, lens[k], h.footer_off)) { if (err) *err = "ids/env out of bounds"; return false; }
+    *fields[k] = field_text(fileData + (size_t)off, lens[k]);
+    off += lens[k];
+  }
+
+  out.ranges.resize(h.range_count);
+  if (rangeBytes) memcpy(out.ranges.data(), fileData + h.range_table_off, (size_t)rangeBytes);
+  out.chunks.resize(h.chunk_count);
+  if (chunkBytes) memcpy(out.chunks.data(), fileData + h.chunk_index_off, (size_t)chunkBytes);
+
+  for (size_t i = 0; i < out.ranges.size(); i++) {
+    const RangeEntryV3& r = out.ranges[i];
+    if ((uint64_t)r.first_chunk + r.chunk_count > h.chunk_count) {
+      if (err) *err = String("Range chunk list out of bounds at index ") + i;
+      return false;
+    }
+  }
+
+  FooterV2 f{};
+  memcpy(&f, fileData + h.footer_off, sizeof(f));
+  const uint8_t endMagic[5] = { 'K','2','E','N','D' };
+  if (memcmp(f.magic, endMagic, sizeof(endMagic)) != 0) {
+    if (err) *err = "Bad footer magic";
+    return false;
+  }
+
+  uint32_t gotCrc = 0;
+  uint8_t gotSha[32];
+  if (!digest_sealed(fileData, fileLen, offsetof(HeaderV3, file_crc32),
+                     (size_t)h.footer_off + offsetof(FooterV2, sha256), gotCrc, gotSha)) {
+    if (err) *err = "SHA256 failed";
+    return false;
+  }
+  if (gotCrc != h.file_crc32) {
+    if (err) *err = "File CRC mismatch (corrupt backup file)";
+    return false;
+  }
+  if (memcmp(gotSha, f.sha256, 32) != 0) {
+    if (err) *err = "File SHA256 mismatch (corrupt backup file)";
+    return false;
+  }
+
+  out.version = CFG_K2BAK_VERSION_V3;
+  out.flags = h.flags;
+  out.timestamp_unix = h.timestamp_unix;
+  return true;
+}
+
+// v1/v2 range entries as chunks; metadata-only entries have no bytes to point at.
+static void chunks_from_entries(Parsed& p) {
+  p.chunks.clear();
+  p.chunks.reserve(p.entries.size());
+  for (const RangeEntry& e : p.entries) {
+    if (!e.data_len && !isFill(e)) continue;
+    ChunkEntry c{};
+    c.lba_start = e.lba_start;
+    c.lba_count = e.lba_count;
+    c.data_off  = e.data_off;
+    c.data_len  = e.data_len;
+    c.crc32     = e.crc32;
+    c.flags     = e.flags;
+    p.chunks.push_back(c);
+  }
+}
+
 bool parse(Parsed& out, const uint8_t* fileData, size_t fileLen, String* err) {
   out = Parsed{};
   out.fileBase = fileData;
@@ -383,33 +506,226 @@ bool parse(Parsed& out, const uint8_t* fileData, size_t fileLen, String* err) {
     if (err) *err = "File too small";
     return false;
   }
-  // Detect v2 by leading "K2BAK" and version byte
-  if (fileLen >= sizeof(HeaderV2) &&
-      memcmp(fileData, MAGIC5, sizeof(MAGIC5)) == 0 &&
-      fileData[5] == CFG_K2BAK_VERSION_V2) {
-    return parse_v2(out, fileData, fileLen, err);
+  // Detect v2/v3 by leading "K2BAK" and version byte
+  bool ok;
+  if (memcmp(fileData, MAGIC5, sizeof(MAGIC5)) == 0 && fileData[5] == CFG_K2BAK_VERSION_V3) {
+    return parse_v3(out, fileData, fileLen, err);
+  } else if (fileLen >= sizeof(HeaderV2) &&
+             memcmp(fileData, MAGIC5, sizeof(MAGIC5)) == 0 &&
+             fileData[5] == CFG_K2BAK_VERSION_V2) {
+    ok = parse_v2(out, fileData, fileLen, err);
+  } else {
+    ok = parse_v1(out, fileData, fileLen, err);
   }
-  return parse_v1(out, fileData, fileLen, err);
+  if (ok) chunks_from_entries(out);
+  return ok;
 }
 
-bool validateRanges(const Parsed& p, String* err) {
-  for (size_t i = 0; i < p.entries.size(); i++) {
-    const RangeEntry& e = p.entries[i];
-    if (e.data_len == 0) continue; // metadata-only ok
-    if (!in_bounds(e.data_off, e.data_len, p.fileLen)) {
-      if (err) *err = String("Range payload out of bounds at index ") + i;
+uint64_t sealedLength(const uint8_t* head, size_t n) {
+  if (!head || n < sizeof(HeaderV2) || memcmp(head, MAGIC5, sizeof(MAGIC5)) != 0) return 0;
+  if (head[5] == CFG_K2BAK_VERSION_V3 && n >= sizeof(HeaderV3)) {
+    HeaderV3 h{};
+    memcpy(&h, head, sizeof(h));
+    return h.footer_off ? h.footer_off + sizeof(FooterV2) : 0;
+  }
+  if (head[5] == CFG_K2BAK_VERSION_V2) {
+    HeaderV2 h{};
+    memcpy(&h, head, sizeof(h));
+    return h.footer_off ? (uint64_t)h.footer_off + sizeof(FooterV2) : 0;
+  }
+  return 0;
+}
+
+// Hands the raw bytes [off, off + len) of a compressed chunk to fn in
+// frame-sized slices. Stored frames are passed straight from the file;
+// the others are expanded into scratch.
+template <typename Fn>
+static bool walk_frames(const Parsed& p, const ChunkEntry& c, uint64_t off, uint64_t len,
+                        std::vector<uint8_t>& scratch, Fn&& fn, String* err) {
+  const uint64_t total = (uint64_t)c.lba_count * 512ULL;
+  if (!in_bounds64(c.data_off, c.data_len, p.fileLen)) {
+    if (err) *err = "Chunk payload out of bounds";
+    return false;
+  }
+  const uint8_t* in = p.fileBase + (size_t)c.data_off;
+  const uint64_t end = off + len;
+  uint64_t pos = 0, raw = 0;
+
+  while (raw < end) {
+    uint32_t hdr;
+    if (c.data_len - pos < sizeof(hdr)) { if (err) *err = "Compressed chunk truncated"; return false; }
+    memcpy(&hdr, in + pos, sizeof(hdr));
+    pos += sizeof(hdr);
+    const uint32_t bodyLen = hdr & FRAME_LEN_MASK;
+    if (c.data_len - pos < bodyLen) { if (err) *err = "Compressed chunk truncated"; return false; }
+    const size_t rawLen = (size_t)(total - raw < FRAME_BYTES ? total - raw : FRAME_BYTES);
+
+    if (raw + rawLen > off) {
+      const uint8_t* frame = in + pos;
+      if (hdr & FRAME_STORED) {
+        if (bodyLen != rawLen) { if (err) *err = "Stored frame length mismatch"; return false; }
+      } else {
+        scratch.resize(FRAME_BYTES);
+        if (Lz4Block::decompress(frame, bodyLen, scratch.data(), rawLen) != (long)rawLen) {
+          if (err) *err = "Corrupt compressed frame";
+          return false;
+        }
+        frame = scratch.data();
+      }
+      const size_t from = off > raw ? (size_t)(off - raw) : 0;
+      const size_t to = end < raw + rawLen ? (size_t)(end - raw) : rawLen;
+      fn(frame + from, to - from);
+    }
+    pos += bodyLen;
+    raw += rawLen;
+  }
+  if (end == total && pos != c.data_len) {
+    if (err) *err = "Trailing bytes in compressed chunk";
+    return false;
+  }
+  return true;
+}
+
+bool chunkCrc(const Parsed& p, const ChunkEntry& c, uint64_t byteOff, uint64_t len, uint32_t& out, String* err) {
+  if (byteOff + len > (uint64_t)c.lba_count * 512ULL) {
+    if (err) *err = "Slice beyond chunk";
+    return false;
+  }
+  if (isFill(c)) {
+    out = fillCrc32(fillByte(c), (size_t)len);
+    return true;
+  }
+  if (isCompressed(c)) {
+    std::vector<uint8_t> scratch;
+    uint32_t crc = 0xFFFFFFFFu;
+    const bool ok = walk_frames(p, c, byteOff, len, scratch,
+                                [&](const uint8_t* d, size_t n) { crc = Crc32::update(crc, d, n); }, err);
+    out = crc ^ 0xFFFFFFFFu;
+    return ok;
+  }
+  if (byteOff + len > c.data_len || !in_bounds64(c.data_off + byteOff, len, p.fileLen)) {
+    if (err) *err = "Chunk payload out of bounds";
+    return false;
+  }
+  out = Crc32::of(p.fileBase + (size_t)(c.data_off + byteOff), (size_t)len);
+  return true;
+}
+
+bool chunkRead(const Parsed& p, const ChunkEntry& c, uint64_t byteOff, uint64_t len, uint8_t* out, String* err) {
+  if (byteOff + len > (uint64_t)c.lba_count * 512ULL) {
+    if (err) *err = "Slice beyond chunk";
+    return false;
+  }
+  if (isFill(c)) {
+    memset(out, fillByte(c), (size_t)len);
+    return true;
+  }
+  if (isCompressed(c)) {
+    std::vector<uint8_t> scratch;
+    return walk_frames(p, c, byteOff, len, scratch,
+                       [&](const uint8_t* d, size_t n) { memcpy(out, d, n); out += n; }, err);
+  }
+  if (byteOff + len > c.data_len || !in_bounds64(c.data_off + byteOff, len, p.fileLen)) {
+    if (err) *err = "Chunk payload out of bounds";
+    return false;
+  }
+  memcpy(out, p.fileBase + (size_t)(c.data_off + byteOff), (size_t)len);
+  return true;
+}
+
+// Structure of one chunk: known encoding, sane fill, payload inside the file.
+static bool check_chunk_shape(const ChunkEntry& c, uint8_t version, uint64_t fileLen, size_t i, String* err) {
+  if (isFill(c)) {
+    if (c.data_len != 0 || ((c.flags & RANGE_FILL_00) && (c.flags & RANGE_FILL_FF))) {
+      if (err) *err = String("Malformed fill chunk at index ") + i;
       return false;
     }
-    const uint8_t* data = p.fileBase + e.data_off;
-    uint32_t got = crc32(data, e.data_len);
-    if (got != e.crc32) {
-      if (err) *err = String("Range CRC mismatch at index ") + i;
+    return true;
+  }
+  const bool compressed = isCompressed(c) && version >= CFG_K2BAK_VERSION_V3;
+  if (!(c.flags & RANGE_RAW) && !compressed) {
+    if (err) *err = String("Unsupported chunk encoding at index ") + i;
+    return false;
+  }
+  if (version >= CFG_K2BAK_VERSION_V3 && !compressed &&
+      (uint64_t)c.data_len != (uint64_t)c.lba_count * 512ULL) {
+    if (err) *err = String("Chunk length mismatch at index ") + i;
+    return false;
+  }
+  if (!in_bounds64(c.data_off, c.data_len, fileLen)) {
+    if (err) *err = String("Chunk payload out of bounds at index ") + i;
+    return false;
+  }
+  return true;
+}
+
+bool validateRanges(const Parsed& p, String* err) {
+  for (size_t i = 0; i < p.chunks.size(); i++) {
+    const ChunkEntry& c = p.chunks[i];
+    if (i) yield();  // up to a few MiB of CRC per chunk
+    if (!check_chunk_shape(c, p.version, p.fileLen, i, err)) return false;
+    if (isFill(c)) continue;
+
+    uint32_t got = 0;
+    if (isCompressed(c) && p.version >= CFG_K2BAK_VERSION_V3) {
+      String why;
+      if (!chunkCrc(p, c, 0, (uint64_t)c.lba_count * 512ULL, got, &why)) {
+        if (err) *err = why + " at index " + i;
+        return false;
+      }
+    } else {
+      got = Crc32::of(p.fileBase + (size_t)c.data_off, c.data_len);
+    }
+    if (got != c.crc32) {
+      if (err) *err = String("Chunk CRC mismatch at index ") + i;
       return false;
     }
   }
   return true;
 }
 
+bool getChunkPayload(const Parsed& p, size_t index, const uint8_t*& data, size_t& len, String* err) {
+  data = nullptr;
+  len = 0;
+  if (index >= p.chunks.size()) {
+    if (err) *err = "Index out of range";
+    return false;
+  }
+  const ChunkEntry& c = p.chunks[index];
+  if (!in_bounds64(c.data_off, c.data_len, p.fileLen)) {
+    if (err) *err = "Payload out of bounds";
+    return false;
+  }
+  data = p.fileBase + (size_t)c.data_off;
+  len  = c.data_len;
+  return true;
+}
+
+std::vector<ChunkEntry> extents(const Parsed& p) {
+  std::vector<ChunkEntry> out;
+  out.reserve(p.chunks.size());
+  for (const ChunkEntry& c : p.chunks) {
+    if (!out.empty()) {
+      ChunkEntry& last = out.back();
+      const bool adjacent = last.lba_start + last.lba_count == c.lba_start;
+      const bool sameFill = isFill(c) && last.flags == c.flags;
+      const bool contiguousRaw = c.flags == RANGE_RAW && last.flags == RANGE_RAW &&
+                                 (uint64_t)last.data_len == (uint64_t)last.lba_count * 512ULL &&
+                                 (uint64_t)c.data_len == (uint64_t)c.lba_count * 512ULL &&
+                                 last.data_off + last.data_len == c.data_off &&
+                                 last.data_len <= 0xFFFFFFFFu - c.data_len;
+      if (adjacent && (sameFill || contiguousRaw)) {
+        last.lba_count += c.lba_count;
+        last.data_len += c.data_len;
+        last.crc32 = 0;
+        continue;
+      }
+    }
+    out.push_back(c);
+  }
+  return out;
+}
+
 bool getRangePayload(const Parsed& p, size_t index, const uint8_t*& data, size_t& len, String* err) {
   data = nullptr;
   len = 0;
@@ -427,4 +743,930 @@ bool getRangePayload(const Parsed& p, size_t index, const uint8_t*& data, size_t
   return true;
 }
 
-} // namespace K2Bak
+// ============================================================
+// Streaming writer (v3)
+// ============================================================
+
+bool FileSink::append(const uint8_t* data, size_t len) {
+  if (!len) return true;
+  if (!seekable(_size, len)) return false;
+  if (!_atEnd) {
+    if (!_f.seek((uint32_t)_size, SeekSet)) return false;
+    _atEnd = true;
+  }
+  if (_f.write(data, len) != len) return false;
+  _size += len;
+  return true;
+}
+
+bool FileSink::patch(uint64_t off, const uint8_t* data, size_t len) {
+  if (off + len > _size || !seekable(off, len)) return false;
+  _atEnd = false;
+  if (!_f.seek((uint32_t)off, SeekSet)) return false;
+  return _f.write(data, len) == len;
+}
+
+size_t FileSink::read(uint64_t off, uint8_t* data, size_t len) {
+  if (off >= _size) return 0;
+  if (off + len > _size) len = (size_t)(_size - off);
+  if (!seekable(off, len)) return 0;
+  _atEnd = false;
+  if (!_f.seek((uint32_t)off, SeekSet)) return 0;
+  return _f.read(data, len);
+}
+
+bool MemSink::append(const uint8_t* data, size_t len) {
+  write_bytes(_v, data, len);
+  return true;
+}
+
+bool MemSink::patch(uint64_t off, const uint8_t* data, size_t len) {
+  if (!in_bounds((size_t)off, len, _v.size())) return false;
+  memcpy(_v.data() + off, data, len);
+  return true;
+}
+
+size_t MemSink::read(uint64_t off, uint8_t* data, size_t len) {
+  if (off >= _v.size()) return 0;
+  if (off + len > _v.size()) len = _v.size() - (size_t)off;
+  memcpy(data, _v.data() + off, len);
+  return len;
+}
+
+StreamWriter::~StreamWriter() {
+  abort();
+}
+
+void StreamWriter::abort() {
+  if (_shaStarted) {
+    mbedtls_sha256_free(&_sha);
+    _shaStarted = false;
+  }
+  _sink = nullptr;
+  _inRange = false;
+  _chunkOpen = false;
+  _finished = false;
+  _ranges.clear();
+  _chunks.clear();
+  _chunks.shrink_to_fit();
+  _io.clear();
+  _io.shrink_to_fit();
+  dropFrames();
+}
+
+// ~40 KiB, held until finish()/abort()
+void StreamWriter::allocFrames() {
+  _lz = _compress && FRAME_BYTES <= Lz4Block::MAX_INPUT;
+  if (_lz) {
+    _frame.resize(FRAME_BYTES);
+    _lzOut.resize(FRAME_BYTES);
+    _lzTable.resize(Lz4Block::TABLE_ENTRIES);
+  }
+}
+
+void StreamWriter::dropFrames() {
+  _lz = false;
+  _frameLen = 0;
+  _frame.clear();
+  _frame.shrink_to_fit();
+  _lzOut.clear();
+  _lzOut.shrink_to_fit();
+  _lzTable.clear();
+  _lzTable.shrink_to_fit();
+}
+
+bool StreamWriter::begin(
+  Sink* sink,
+  const String& boardId,
+  const String& profileId,
+  uint64_t timestampUnix,
+  const String& envText,
+  String* err
+) {
+  abort();
+  if (!sink || sink->size() != 0) {
+    if (err) *err = "Sink must be empty";
+    return false;
+  }
+
+  _sink = sink;
+  _rawBytes = 0;
+  _storedBytes = 0;
+
+  allocFrames();
+
+  _h = HeaderV3{};
+  memcpy(_h.magic, MAGIC5, sizeof(MAGIC5));
+  _h.version        = CFG_K2BAK_VERSION_V3;
+  _h.header_size    = (uint32_t)sizeof(HeaderV3);
+  _h.flags          = FLAG_NONE;
+  if (boardId.length())   _h.flags |= FLAG_HAS_BOARD_ID;
+  if (profileId.length()) _h.flags |= FLAG_HAS_PROFILE_ID;
+  if (envText.length())   _h.flags |= FLAG_HAS_ENV_TEXT;
+  _h.timestamp_unix = timestampUnix;
+  _h.board_id_len   = (uint32_t)boardId.length();
+  _h.profile_id_len = (uint32_t)profileId.length();
+  _h.env_len        = (uint32_t)envText.length();
+
+  bool ok = sink->append((const uint8_t*)&_h, sizeof(_h));
+  if (ok && boardId.length())   ok = sink->append((const uint8_t*)boardId.c_str(), boardId.length());
+  if (ok && profileId.length()) ok = sink->append((const uint8_t*)profileId.c_str(), profileId.length());
+  if (ok && envText.length())   ok = sink->append((const uint8_t*)envText.c_str(), envText.length());
+  _h.payload_off = sink->size();
+
+  if (!ok) {
+    if (err) *err = "Sink write failed (header)";
+    abort();
+    return false;
+  }
+  return true;
+}
+
+bool StreamWriter::beginRange(uint32_t lbaStart, uint32_t lbaCount, uint32_t flags, String* err) {
+  if (!_sink || _finished || _inRange) {
+    if (err) *err = "Writer not ready for a new range";
+    return false;
+  }
+  RangeEntryV3 r{};
+  r.lba_start   = lbaStart;
+  r.lba_count   = lbaCount;
+  r.first_chunk = (uint32_t)_chunks.size();
+  r.flags       = flags;
+  _ranges.push_back(r);
+  _lba = lbaStart;
+  _inRange = true;
+  return true;
+}
+
+// Writes the staged frame. The chunk's first frame decides its encoding:
+// if it doesn't shrink, the whole chunk is stored raw. Later frames that
+// don't shrink are stored as-is inside the compressed chunk.
+bool StreamWriter::flushFrame(String* err) {
+  const size_t n = _frameLen;
+  if (!n) return true;
+  _frameLen = 0;
+  ChunkEntry& c = _chunks.back();
+
+  bool ok;
+  size_t stored = n;
+  if (c.flags == RANGE_RAW) {
+    ok = _sink->append(_frame.data(), n);
+  } else {
+    // worth it only if header + body beat the raw frame
+    const size_t z = Lz4Block::compress(_frame.data(), n, _lzOut.data(), n - sizeof(uint32_t) - 1u,
+                                        _lzTable.data());
+    if (!z && c.data_len == 0) {
+      c.flags = RANGE_RAW;
+      ok = _sink->append(_frame.data(), n);
+    } else {
+      const uint32_t hdr = z ? (uint32_t)z : (FRAME_STORED | (uint32_t)n);
+      const uint8_t* body = z ? _lzOut.data() : _frame.data();
+      stored = sizeof(hdr) + (z ? z : n);
+      ok = _sink->append((const uint8_t*)&hdr, sizeof(hdr)) && _sink->append(body, stored - sizeof(hdr));
+    }
+  }
+  if (!ok) {
+    if (err) *err = "Sink write failed (payload)";
+    return false;
+  }
+  c.data_len += (uint32_t)stored;
+  _storedBytes += stored;
+  return true;
+}
+
+bool StreamWriter::closeChunk(String* err) {
+  if (!_chunkOpen) return true;
+  if (_lz && !flushFrame(err)) return false;
+  _chunks.back().crc32 = _chunkCrc ^ 0xFFFFFFFFu;
+  _chunkOpen = false;
+  return true;
+}
+
+bool StreamWriter::write(const uint8_t* data, size_t len, String* err) {
+  if (!_inRange) {
+    if (err) *err = "write() outside of a range";
+    return false;
+  }
+  if (len % 512u) {
+    if (err) *err = "write() takes whole blocks";
+    return false;
+  }
+
+  while (len) {
+    if (_chunkOpen && _chunks.back().lba_count >= CFG_K2BAK_CHUNK_BLOCKS && !closeChunk(err)) return false;
+    if (!_chunkOpen) {
+      ChunkEntry c{};
+      c.lba_start = _lba;
+      c.data_off  = _sink->size();
+      c.flags     = _lz ? RANGE_COMPRESSED : RANGE_RAW;
+      _chunks.push_back(c);
+      _chunkCrc = 0xFFFFFFFFu;
+      _chunkOpen = true;
+    }
+    ChunkEntry& c = _chunks.back();
+    uint32_t blocks = (uint32_t)(len / 512u);
+    if (blocks > CFG_K2BAK_CHUNK_BLOCKS - c.lba_count) blocks = CFG_K2BAK_CHUNK_BLOCKS - c.lba_count;
+    if (_lz && blocks > (FRAME_BYTES - _frameLen) / 512u) blocks = (uint32_t)((FRAME_BYTES - _frameLen) / 512u);
+    const size_t n = (size_t)blocks * 512u;
+
+    if (_lz) {
+      memcpy(_frame.data() + _frameLen, data, n);
+      _frameLen += n;
+      if (_frameLen == FRAME_BYTES && !flushFrame(err)) return false;
+    } else {
+      if (!_sink->append(data, n)) {
+        if (err) *err = "Sink write failed (payload)";
+        return false;
+      }
+      c.data_len += (uint32_t)n;
+      _storedBytes += n;
+    }
+    _chunkCrc = Crc32::update(_chunkCrc, data, n);
+    _chunks.back().lba_count += blocks;
+    _rawBytes += n;
+    _lba += blocks;
+    data += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool StreamWriter::addFill(uint32_t lbaStart, uint32_t lbaCount, uint8_t fill, String* err) {
+  if (!_inRange || lbaStart != _lba) {
+    if (err) *err = "Fill run outside the current range position";
+    return false;
+  }
+  if (fill != 0x00 && fill != 0xFF) {
+    if (err) *err = "Fill byte must be 0x00 or 0xFF";
+    return false;
+  }
+  if (!closeChunk(err)) return false;
+  const uint32_t flags = fill ? RANGE_FILL_FF : RANGE_FILL_00;
+  _lba += lbaCount;
+
+  if (_chunks.size() > _ranges.back().first_chunk) {
+    ChunkEntry& last = _chunks.back();
+    if (last.flags == flags && last.lba_start + last.lba_count == lbaStart) {
+      last.lba_count += lbaCount;
+      return true;
+    }
+  }
+  ChunkEntry c{};
+  c.lba_start = lbaStart;
+  c.lba_count = lbaCount;
+  c.data_off  = _sink->size();
+  c.flags     = flags;
+  _chunks.push_back(c);
+  return true;
+}
+
+bool StreamWriter::endRange(String* err) {
+  if (!_inRange) {
+    if (err) *err = "endRange() without beginRange()";
+    return false;
+  }
+  if (!closeChunk(err)) return false;
+  RangeEntryV3& r = _ranges.back();
+  r.chunk_count = (uint32_t)_chunks.size() - r.first_chunk;
+  const uint32_t written = _lba - r.lba_start;
+  if (r.chunk_count && written < r.lba_count) r.lba_count = written;
+  _inRange = false;
+  return true;
+}
+
+bool StreamWriter::snapshot(StreamState& out, String* err) {
+  if (!_sink || _finished) {
+    if (err) *err = "Writer not active";
+    return false;
+  }
+  if (!closeChunk(err)) return false;
+  out.h           = _h;
+  out.ranges      = _ranges;
+  out.chunks      = _chunks;
+  out.inRange     = _inRange;
+  out.lba         = _lba;
+  out.compress    = _lz;
+  out.rawBytes    = _rawBytes;
+  out.storedBytes = _storedBytes;
+  out.size        = _sink->size();
+  return true;
+}
+
+bool StreamWriter::resume(Sink* sink, const StreamState& st, String* err) {
+  abort();
+  if (!sink || sink->size() != st.size || st.size < st.h.payload_off) {
+    if (err) *err = "Sink does not match the saved writer state";
+    return false;
+  }
+  if (st.inRange && st.ranges.empty()) {
+    if (err) *err = "Saved writer state has no open range";
+    return false;
+  }
+  for (const ChunkEntry& c : st.chunks) {
+    if (c.data_off + c.data_len > st.size) {
+      if (err) *err = "Saved chunk index points past the file";
+      return false;
+    }
+  }
+
+  _sink = sink;
+  _h = st.h;
+  _ranges = st.ranges;
+  _chunks = st.chunks;
+  _inRange = st.inRange;
+  _lba = st.lba;
+  _rawBytes = st.rawBytes;
+  _storedBytes = st.storedBytes;
+  _compress = st.compress;
+  allocFrames();
+  return true;
+}
+
+bool StreamWriter::finish(String* err) {
+  if (!_sink || _finished) {
+    if (err) *err = "Writer not active";
+    return false;
+  }
+  if (_inRange && !endRange(err)) return false;
+
+  _h.range_count = (uint32_t)_ranges.size();
+  _h.chunk_count = (uint32_t)_chunks.size();
+  if (!_ranges.empty()) _h.flags |= FLAG_HAS_RANGES;
+  _h.file_crc32 = 0;
+
+  FooterV2 f{};
+  const uint8_t endMagic[5] = { 'K','2','E','N','D' };
+  memcpy(f.magic, endMagic, sizeof(endMagic));
+
+  _h.range_table_off = _sink->size();
+  bool ok = _ranges.empty() ||
+            _sink->append((const uint8_t*)_ranges.data(), _ranges.size() * sizeof(RangeEntryV3));
+  _h.chunk_index_off = _sink->size();
+  if (ok && !_chunks.empty()) {
+    ok = _sink->append((const uint8_t*)_chunks.data(), _chunks.size() * sizeof(ChunkEntry));
+  }
+  _h.footer_off = _sink->size();
+  if (ok) ok = _sink->append((const uint8_t*)&f, sizeof(f));
+  if (ok) ok = _sink->patch(0, (const uint8_t*)&_h, sizeof(_h));
+  if (!ok) {
+    if (err) *err = "Sink write failed (footer/table)";
+    return false;
+  }
+  _sink->flush();
+
+  _finished = true;
+  _sealOff = 0;
+  _sealCrc = 0xFFFFFFFFu;
+  mbedtls_sha256_init(&_sha);
+  _shaStarted = true;
+  if (mbedtls_sha256_starts_ret(&_sha, 0) != 0) {
+    if (err) *err = "SHA256 failed";
+    return false;
+  }
+  dropFrames();
+  _io.resize(CFG_IO_CHUNK_BYTES);
+  return true;
+}
+
+bool StreamWriter::sealStep(size_t budgetBytes, bool& done, String* err) {
+  done = false;
+  if (!_finished || !_shaStarted) {
+    if (err) *err = "seal before finish()";
+    return false;
+  }
+
+  const uint64_t total = _sink->size();
+  size_t budget = budgetBytes ? budgetBytes : _io.size();
+
+  // The stored file still has file_crc32 == 0 and sha256 == 0, which is
+  // exactly the state both digests are defined over.
+  while (_sealOff < total && budget > 0) {
+    size_t want = _io.size();
+    if (want > budget) want = budget;
+    if ((uint64_t)want > total - _sealOff) want = (size_t)(total - _sealOff);
+
+    size_t got = _sink->read(_sealOff, _io.data(), want);
+    if (got != want) {
+      if (err) *err = "Sink read failed (seal)";
+      return false;
+    }
+    _sealCrc = Crc32::update(_sealCrc, _io.data(), got);
+    if (mbedtls_sha256_update_ret(&_sha, _io.data(), got) != 0) {
+      if (err) *err = "SHA256 failed";
+      return false;
+    }
+    _sealOff += got;
+    budget -= got;
+  }
+  if (_sealOff < total) return true;
+
+  uint8_t sha[32];
+  const int rc = mbedtls_sha256_finish_ret(&_sha, sha);
+  mbedtls_sha256_free(&_sha);
+  _shaStarted = false;
+  if (rc != 0) {
+    if (err) *err = "SHA256 failed";
+    return false;
+  }
+
+  _h.file_crc32 = _sealCrc ^ 0xFFFFFFFFu;
+  bool ok = _sink->patch(0, (const uint8_t*)&_h, sizeof(_h));
+  if (ok) ok = _sink->patch(_h.footer_off + offsetof(FooterV2, sha256), sha, sizeof(sha));
+  if (!ok) {
+    if (err) *err = "Sink write failed (seal)";
+    return false;
+  }
+  _sink->flush();
+
+  _io.clear();
+  _io.shrink_to_fit();
+  done = true;
+  return true;
+}
+
+// ============================================================
+// FileReader
+// ============================================================
+
+bool FileReader::open(fs::File& f, String* err) {
+  close();
+
+  uint8_t head[sizeof(HeaderV3)];
+  const uint64_t fileLen = f ? f.size() : 0;
+  const size_t headLen = fileLen < sizeof(head) ? (size_t)fileLen : sizeof(head);
+  if (!f || !f.seek(0) || headLen < sizeof(HeaderV2) || f.read(head, headLen) != headLen ||
+      memcmp(head, MAGIC5, sizeof(MAGIC5)) != 0) {
+    if (err) *err = "Not a .k2bak file";
+    return false;
+  }
+
+  _f = &f;
+  _meta.fileLen = (size_t)fileLen;
+  auto fail = [&](const String& why) {
+    close();
+    if (err) *err = why;
+    return false;
+  };
+  auto readTable = [&](uint64_t off, void* out, uint64_t len) {
+    return !len || (seekable(off, len) && _f->seek((uint32_t)off) &&
+                    _f->read((uint8_t*)out, (size_t)len) == len);
+  };
+
+  uint32_t lens[3] = { 0, 0, 0 };   // board_id, profile_id, env
+  uint64_t idOff = 0, footerOff = 0;
+  if (head[5] == CFG_K2BAK_VERSION_V3 && headLen == sizeof(HeaderV3)) {
+    HeaderV3 h{};
+    memcpy(&h, head, sizeof(h));
+    const uint64_t rangeBytes = (uint64_t)h.range_count * sizeof(RangeEntryV3);
+    const uint64_t chunkBytes = (uint64_t)h.chunk_count * sizeof(ChunkEntry);
+    if (h.header_size != sizeof(HeaderV3)) return fail("Header size mismatch");
+    if (h.footer_off < sizeof(HeaderV3) || !in_bounds64(h.footer_off, sizeof(FooterV2), fileLen) ||
+        h.footer_off + sizeof(FooterV2) != fileLen) return fail("Footer out of bounds");
+    if (!in_bounds64(h.range_table_off, rangeBytes, h.footer_off)) return fail("range_table out of bounds");
+    if (!in_bounds64(h.chunk_index_off, chunkBytes, h.footer_off)) return fail("chunk_index out of bounds");
+
+    _meta.ranges.resize(h.range_count);
+    if (!readTable(h.range_table_off, _meta.ranges.data(), rangeBytes)) return fail("Cannot read range table");
+    _meta.chunks.resize(h.chunk_count);
+    if (!readTable(h.chunk_index_off, _meta.chunks.data(), chunkBytes)) return fail("Cannot read chunk index");
+    for (size_t i = 0; i < _meta.ranges.size(); i++) {
+      const RangeEntryV3& r = _meta.ranges[i];
+      if ((uint64_t)r.first_chunk + r.chunk_count > h.chunk_count) {
+        return fail(String("Range chunk list out of bounds at index ") + i);
+      }
+    }
+
+    _meta.version = CFG_K2BAK_VERSION_V3;
+    _meta.flags = h.flags;
+    _meta.timestamp_unix = h.timestamp_unix;
+    lens[0] = h.board_id_len; lens[1] = h.profile_id_len; lens[2] = h.env_len;
+    idOff = sizeof(HeaderV3);
+    footerOff = h.footer_off;
+    _crcOff = offsetof(HeaderV3, file_crc32);
+    _fileCrc = h.file_crc32;
+  } else if (head[5] == CFG_K2BAK_VERSION_V2) {
+    HeaderV2 h{};
+    memcpy(&h, head, sizeof(h));
+    const uint64_t tableBytes = (uint64_t)h.range_count * sizeof(RangeEntry);
+    if (h.header_size != sizeof(HeaderV2)) return fail("Header size mismatch");
+    if (h.footer_off < sizeof(HeaderV2) || !in_bounds64(h.footer_off, sizeof(FooterV2), fileLen)) {
+      return fail("Footer out of bounds");
+    }
+    if (!in_bounds64(h.range_table_off, tableBytes, fileLen)) return fail("range_table out of bounds");
+
+    _meta.entries.resize(h.range_count);
+    if (!readTable(h.range_table_off, _meta.entries.data(), tableBytes)) return fail("Cannot read range table");
+    chunks_from_entries(_meta);
+
+    _meta.version = CFG_K2BAK_VERSION_V2;
+    _meta.flags = h.flags;
+    _meta.timestamp_unix = h.timestamp_unix;
+    lens[0] = h.board_id_len; lens[1] = h.profile_id_len; lens[2] = h.env_len;
+    idOff = sizeof(HeaderV2);
+    footerOff = h.footer_off;
+    _crcOff = offsetof(HeaderV2, file_crc32);
+    _fileCrc = h.file_crc32;
+  } else {
+    return fail(String("Unsupported .k2bak version: ") + head[5]);
+  }
+
+  // board_id, profile_id, env follow the header back to back
+  String* fields[3] = { &_meta.boardId, &_meta.profileId, &_meta.envText };
+  for (int k = 0; k < 3; k++) {
+    if (!in_bounds64(idOff, lens[k], fileLen)) return fail("ids/env out of bounds");
+    std::vector<char> text(lens[k] + 1u, 0);
+    if (!readTable(idOff, text.data(), lens[k])) return fail("Cannot read ids/env");
+    *fields[k] = String(text.data());
+    idOff += lens[k];
+  }
+
+  FooterV2 foot{};
+  if (!readTable(footerOff, &foot, sizeof(foot))) return fail("Cannot read footer");
+  const uint8_t endMagic[5] = { 'K','2','E','N','D' };
+  if (memcmp(foot.magic, endMagic, sizeof(endMagic)) != 0) return fail("Bad footer magic");
+  memcpy(_fileSha, foot.sha256, sizeof(_fileSha));
+  _shaOff = footerOff + offsetof(FooterV2, sha256);
+
+  _hint = 0;
+  return true;
+}
+
+void FileReader::close() {
+  resetCheck();
+  _f = nullptr;
+  _meta = Parsed{};
+  _hint = 0;
+  for (Slot& s : _slots) s = Slot{};
+  _cache.clear();
+  _cache.shrink_to_fit();
+  _frame.clear();
+  _frame.shrink_to_fit();
+  _zbuf.clear();
+  _zbuf.shrink_to_fit();
+  _frameKey = NO_KEY;
+  _walkKey = NO_KEY;
+}
+
+// Small reads go through CFG_K2BAK_READ_CACHE_SLOTS aligned blocks of
+// CFG_K2BAK_READ_CACHE_BYTES (least recently used one is replaced); a
+// read of a whole block or more goes straight to the file.
+bool FileReader::readAt(uint64_t off, uint8_t* out, size_t len) {
+  const uint64_t fileLen = _meta.fileLen;
+  if (!_f || !in_bounds64(off, len, fileLen) || !seekable(off, len)) return false;
+  const size_t B = CFG_K2BAK_READ_CACHE_BYTES;
+  if (len >= B) return _f->seek((uint32_t)off) && _f->read(out, len) == len;
+
+  if (_cache.size() != B * CFG_K2BAK_READ_CACHE_SLOTS) _cache.resize(B * CFG_K2BAK_READ_CACHE_SLOTS);
+  while (len) {
+    const uint64_t block = off / B;
+    Slot* hit = nullptr;
+    Slot* victim = &_slots[0];
+    for (Slot& s : _slots) {
+      if (s.block == block) { hit = &s; break; }
+      if (s.used < victim->used) victim = &s;
+    }
+    uint8_t* data = _cache.data() + (size_t)((hit ? hit : victim) - _slots) * B;
+    if (!hit) {
+      const uint64_t start = block * B;
+      const size_t n = (size_t)(fileLen - start < B ? fileLen - start : B);
+      victim->block = UINT64_MAX;
+      if (!seekable(start, n) || !_f->seek((uint32_t)start) || _f->read(data, n) != n) return false;
+      victim->block = block;
+      hit = victim;
+    }
+    hit->used = ++_useClock;
+
+    const size_t in = (size_t)(off % B);
+    const size_t take = len < B - in ? len : B - in;
+    memcpy(out, data + in, take);
+    out += take;
+    off += take;
+    len -= take;
+  }
+  return true;
+}
+
+bool FileReader::readable(const ChunkEntry& c) const {
+  if (!c.lba_count) return false;
+  if (isFill(c)) return true;
+  const bool raw = c.flags == RANGE_RAW && (uint64_t)c.data_len == (uint64_t)c.lba_count * 512ULL;
+  const bool lz = c.flags == RANGE_COMPRESSED && _meta.version >= CFG_K2BAK_VERSION_V3;
+  return (raw || lz) && in_bounds64(c.data_off, c.data_len, _meta.fileLen);
+}
+
+// Expands frame idx of a compressed chunk into _frame. Frame offsets are
+// only known by walking the headers, so the walk resumes where the last
+// one stopped when reading forward. Chunks are told apart by data_off.
+bool FileReader::loadFrame(const ChunkEntry& c, uint32_t idx, String* err) {
+  if (_frameKey == c.data_off && _frameIdx == idx) return true;
+  _frameKey = NO_KEY;
+  if (_walkKey != c.data_off || _walkIdx > idx) {
+    _walkKey = c.data_off;
+    _walkIdx = 0;
+    _walkOff = c.data_off;
+  }
+  const uint64_t end = c.data_off + c.data_len;
+  const uint64_t total = (uint64_t)c.lba_count * 512ULL;
+
+  for (;;) {
+    uint32_t hdr;
+    if (end - _walkOff < sizeof(hdr) || !readAt(_walkOff, (uint8_t*)&hdr, sizeof(hdr))) {
+      _walkKey = NO_KEY;
+      if (err) *err = "Compressed chunk truncated";
+      return false;
+    }
+    const uint32_t bodyLen = hdr & FRAME_LEN_MASK;
+    const uint64_t rawOff = (uint64_t)_walkIdx * FRAME_BYTES;
+    if (end - _walkOff - sizeof(hdr) < bodyLen || rawOff >= total) {
+      _walkKey = NO_KEY;
+      if (err) *err = "Compressed chunk truncated";
+      return false;
+    }
+    if (_walkIdx < idx) {
+      _walkOff += sizeof(hdr) + bodyLen;
+      _walkIdx++;
+      continue;
+    }
+
+    const uint64_t body = _walkOff + sizeof(hdr);
+    const size_t rawLen = (size_t)(total - rawOff < FRAME_BYTES ? total - rawOff : FRAME_BYTES);
+    _frame.resize(FRAME_BYTES);
+    bool ok;
+    if (hdr & FRAME_STORED) {
+      ok = bodyLen == rawLen && readAt(body, _frame.data(), rawLen);
+    } else {
+      _zbuf.resize(FRAME_BYTES);
+      ok = bodyLen <= _zbuf.size() && readAt(body, _zbuf.data(), bodyLen) &&
+           Lz4Block::decompress(_zbuf.data(), bodyLen, _frame.data(), rawLen) == (long)rawLen;
+    }
+    _walkOff += sizeof(hdr) + bodyLen;
+    _walkIdx++;
+    if (!ok) {
+      if (err) *err = "Corrupt compressed frame";
+      return false;
+    }
+    _frameKey = c.data_off;
+    _frameIdx = idx;
+    return true;
+  }
+}
+
+const ChunkEntry* FileReader::find(uint32_t lba) const {
+  const std::vector<ChunkEntry>& t = _meta.chunks;
+  auto hit = [&](size_t i) {
+    _hint = i;
+    return readable(t[i]) ? &t[i] : nullptr;
+  };
+  // reads are mostly sequential: try the last hit and its successor first
+  for (size_t k = 0; k < 2 && _hint + k < t.size(); k++) {
+    const ChunkEntry& c = t[_hint + k];
+    if (lba >= c.lba_start && lba - c.lba_start < c.lba_count) return hit(_hint + k);
+  }
+  for (size_t i = 0; i < t.size(); i++) {
+    const ChunkEntry& c = t[i];
+    if (lba >= c.lba_start && lba - c.lba_start < c.lba_count) return hit(i);
+  }
+  return nullptr;
+}
+
+bool FileReader::covers(uint32_t lbaStart, uint32_t lbaCount) const {
+  uint32_t lba = lbaStart;
+  const uint32_t end = lbaStart + lbaCount;
+  while (lba < end) {
+    const ChunkEntry* e = find(lba);
+    if (!e) return false;
+    lba = e->lba_start + e->lba_count;
+  }
+  return true;
+}
+
+bool FileReader::readBlocks(uint32_t lbaStart, uint32_t lbaCount, uint8_t* out, String* err) {
+  if (!_f) { if (err) *err = "Backup file not open"; return false; }
+
+  uint32_t lba = lbaStart;
+  const uint32_t end = lbaStart + lbaCount;
+  while (lba < end) {
+    const ChunkEntry* e = find(lba);
+    if (!e) { if (err) *err = "Backup file does not cover lba"; return false; }
+
+    uint32_t n = e->lba_start + e->lba_count - lba;
+    if (n > end - lba) n = end - lba;
+    const size_t bytes = (size_t)n * 512u;
+
+    if (isFill(*e)) {
+      memset(out, fillByte(*e), bytes);
+    } else if (isCompressed(*e)) {
+      // frame by frame; a read may start or end mid-frame
+      uint64_t rawOff = (uint64_t)(lba - e->lba_start) * 512ULL;
+      uint8_t* dst = out;
+      size_t left = bytes;
+      while (left) {
+        const uint32_t idx = (uint32_t)(rawOff / FRAME_BYTES);
+        if (!loadFrame(*e, idx, err)) return false;
+        const size_t in = (size_t)(rawOff % FRAME_BYTES);
+        size_t take = FRAME_BYTES - in;
+        if (take > left) take = left;
+        memcpy(dst, _frame.data() + in, take);
+        dst += take;
+        rawOff += take;
+        left -= take;
+      }
+    } else {
+      const uint64_t off = e->data_off + (uint64_t)(lba - e->lba_start) * 512ULL;
+      if (!readAt(off, out, bytes)) {
+        if (err) *err = "Backup file read failed";
+        return false;
+      }
+    }
+    out += bytes;
+    lba += n;
+  }
+  return true;
+}
+
+// Feeds raw bytes [byteOff, byteOff + len) of a payload chunk into crc.
+bool FileReader::crcUpdate(const ChunkEntry& c, uint64_t byteOff, uint64_t len, uint32_t& crc, String* err) {
+  if (isCompressed(c) && _meta.version >= CFG_K2BAK_VERSION_V3) {
+    while (len) {
+      if (!loadFrame(c, (uint32_t)(byteOff / FRAME_BYTES), err)) return false;
+      const size_t in = (size_t)(byteOff % FRAME_BYTES);
+      const size_t take = len < FRAME_BYTES - in ? (size_t)len : FRAME_BYTES - in;
+      crc = Crc32::update(crc, _frame.data() + in, take);
+      byteOff += take;
+      len -= take;
+    }
+    return true;
+  }
+
+  if (byteOff + len > c.data_len || !in_bounds64(c.data_off + byteOff, len, _meta.fileLen)) {
+    if (err) *err = "Chunk payload out of bounds";
+    return false;
+  }
+  _io.resize(CFG_K2BAK_READ_CACHE_BYTES);
+  while (len) {
+    const size_t n = len < _io.size() ? (size_t)len : _io.size();
+    if (!readAt(c.data_off + byteOff, _io.data(), n)) {
+      if (err) *err = "Backup file read failed";
+      return false;
+    }
+    crc = Crc32::update(crc, _io.data(), n);
+    byteOff += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool FileReader::chunkCrc(const ChunkEntry& c, uint64_t byteOff, uint64_t len, uint32_t& out, String* err) {
+  if (!_f) { if (err) *err = "Backup file not open"; return false; }
+  if (byteOff + len > (uint64_t)c.lba_count * 512ULL) {
+    if (err) *err = "Slice beyond chunk";
+    return false;
+  }
+  if (isFill(c)) {
+    out = fillCrc32(fillByte(c), (size_t)len);
+    return true;
+  }
+  uint32_t crc = Crc32::INIT;
+  if (!crcUpdate(c, byteOff, len, crc, err)) return false;
+  out = Crc32::finish(crc);
+  return true;
+}
+
+uint64_t FileReader::checkTotalBytes() const {
+  uint64_t total = _meta.fileLen;
+  for (const ChunkEntry& c : _meta.chunks) {
+    if (isFill(c)) continue;
+    total += isCompressed(c) ? (uint64_t)c.lba_count * 512ULL : c.data_len;
+  }
+  return total;
+}
+
+void FileReader::resetCheck() {
+  if (_shaStarted) mbedtls_sha256_free(&_sha);
+  _shaStarted = false;
+  _chk = Check::Digest;
+  _chkOff = 0;
+  _chkIdx = 0;
+  _chkCrc = Crc32::INIT;
+  _chkBytes = 0;
+  _io.clear();
+  _io.shrink_to_fit();
+}
+
+// Zeroes the part of buf (file bytes [off, off + n)) that overlaps the
+// field [fieldOff, fieldOff + fieldLen).
+static void zero_field(uint8_t* buf, uint64_t off, size_t n, uint64_t fieldOff, size_t fieldLen) {
+  const uint64_t from = off > fieldOff ? off : fieldOff;
+  const uint64_t to = (off + n < fieldOff + fieldLen) ? off + n : fieldOff + fieldLen;
+  if (from < to) memzero(buf + (size_t)(from - off), (size_t)(to - from));
+}
+
+bool FileReader::checkStep(size_t budgetBytes, bool& done, String* err) {
+  done = false;
+  if (!_f) { if (err) *err = "Backup file not open"; return false; }
+  if (budgetBytes < 512) budgetBytes = 512;
+  size_t spent = 0;
+
+  if (_chk == Check::Digest) {
+    if (!_shaStarted) {
+      mbedtls_sha256_init(&_sha);
+      _shaStarted = true;
+      if (mbedtls_sha256_starts_ret(&_sha, 0) != 0) {
+        resetCheck();
+        if (err) *err = "SHA256 failed";
+        return false;
+      }
+    }
+    _io.resize(CFG_K2BAK_READ_CACHE_BYTES);
+    const uint64_t fileLen = _meta.fileLen;
+    while (spent < budgetBytes && _chkOff < fileLen) {
+      const size_t n = (size_t)(fileLen - _chkOff < _io.size() ? fileLen - _chkOff : _io.size());
+      if (!readAt(_chkOff, _io.data(), n)) {
+        resetCheck();
+        if (err) *err = "Backup file read failed";
+        return false;
+      }
+      // digests are defined with file_crc32 and footer.sha256 zeroed
+      zero_field(_io.data(), _chkOff, n, _crcOff, 4);
+      zero_field(_io.data(), _chkOff, n, _shaOff, 32);
+      _chkCrc = Crc32::update(_chkCrc, _io.data(), n);
+      if (mbedtls_sha256_update_ret(&_sha, _io.data(), n) != 0) {
+        resetCheck();
+        if (err) *err = "SHA256 failed";
+        return false;
+      }
+      _chkOff += n;
+      _chkBytes += n;
+      spent += n;
+    }
+    if (_chkOff < fileLen) return true;
+
+    uint8_t got[32];
+    const bool shaOk = mbedtls_sha256_finish_ret(&_sha, got) == 0;
+    mbedtls_sha256_free(&_sha);
+    _shaStarted = false;
+    const char* why = nullptr;
+    if (!shaOk) why = "SHA256 failed";
+    else if (Crc32::finish(_chkCrc) != _fileCrc) why = "File CRC mismatch (corrupt backup file)";
+    else if (memcmp(got, _fileSha, sizeof(got)) != 0) why = "File SHA256 mismatch (corrupt backup file)";
+    if (why) {
+      resetCheck();
+      if (err) *err = why;
+      return false;
+    }
+    _chk = Check::Chunks;
+    _chkOff = 0;
+    _chkIdx = 0;
+  }
+
+  const std::vector<ChunkEntry>& t = _meta.chunks;
+  while (_chk == Check::Chunks && spent < budgetBytes && _chkIdx < t.size()) {
+    const ChunkEntry& c = t[_chkIdx];
+    if (_chkOff == 0) {
+      if (!check_chunk_shape(c, _meta.version, _meta.fileLen, _chkIdx, err)) { resetCheck(); return false; }
+      _chkCrc = Crc32::INIT;
+    }
+    if (isFill(c)) {
+      _chkIdx++;
+      continue;
+    }
+    const bool lz = isCompressed(c) && _meta.version >= CFG_K2BAK_VERSION_V3;
+    const uint64_t total = lz ? (uint64_t)c.lba_count * 512ULL : c.data_len;
+    uint64_t n = total - _chkOff;
+    if (n > budgetBytes - spent) n = budgetBytes - spent;
+
+    String why;
+    if (!crcUpdate(c, _chkOff, n, _chkCrc, &why)) {
+      resetCheck();
+      if (err) *err = why + " at index " + _chkIdx;
+      return false;
+    }
+    _chkOff += n;
+    _chkBytes += n;
+    spent += (size_t)n;
+    if (_chkOff < total) break;
+
+    if (lz && total && (_walkKey != c.data_off || _walkOff != c.data_off + c.data_len)) {
+      resetCheck();
+      if (err) *err = String("Trailing bytes in compressed chunk at index ") + _chkIdx;
+      return false;
+    }
+    if (Crc32::finish(_chkCrc) != c.crc32) {
+      resetCheck();
+      if (err) *err = String("Chunk CRC mismatch at index ") + _chkIdx;
+      return false;
+    }
+    _chkIdx++;
+    _chkOff = 0;
+  }
+
+  if (_chk == Check::Chunks && _chkIdx >= t.size()) {
+    _chk = Check::Done;
+    _io.clear();
+    _io.shrink_to_fit();
+  }
+  done = _chk == Check::Done;
+  return true;
+}
+
+} // namespace K2Bak
\ No newline at end of file
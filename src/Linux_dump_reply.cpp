@@ -0,0 +1,120 @@
+#include "Linux_dump_reply.h"
+#include "Debug.h"
+
+DBG_REGISTER_MODULE(__FILE__);
+
+static int8_t b64Value(char c){
+  if (c >= 'A' && c <= 'Z') return (int8_t)(c - 'A');
+  if (c >= 'a' && c <= 'z') return (int8_t)(c - 'a' + 26);
+  if (c >= '0' && c <= '9') return (int8_t)(c - '0' + 52);
+  if (c == '+') return 62;
+  if (c == '/') return 63;
+  return -1;
+}
+
+bool LinuxDumpReply::isBase64Line(const char* s, size_t n){
+  if (!n || (n & 3u)) return false;
+  size_t pad = 0;
+  if (s[n - 1] == '=') pad++;
+  if (pad && s[n - 2] == '=') pad++;
+  for (size_t i = 0; i < n - pad; i++) {
+    if (b64Value(s[i]) < 0) return false;
+  }
+  return true;
+}
+
+void LinuxDumpReply::begin(uint32_t tag){
+  _len = 0;
+  _overlong = false;
+  _mode = Mode::Text;
+  _event = Event::None;
+  snprintf(_doneLine, sizeof(_doneLine), "K2DONE %lu", (unsigned long)tag);
+  _text = "";
+  _lastText = "";
+}
+
+void LinuxDumpReply::beginMember(uint8_t* out, size_t cap){
+  _gz.begin(out, cap);
+  _mode = Mode::Member;
+}
+
+void LinuxDumpReply::skipMembers(){
+  _mode = Mode::Skip;
+}
+
+size_t LinuxDumpReply::feed(const uint8_t* data, size_t len){
+  _event = Event::None;
+  for (size_t i = 0; i < len; i++) {
+    const char c = (char)data[i];
+    if (c == '\r') continue;
+    if (c != '\n') {
+      if (_len < LINE_MAX - 1) _line[_len++] = c;
+      else _overlong = true;
+      continue;
+    }
+    _line[_len] = 0;
+    onLine();
+    _len = 0;
+    _overlong = false;
+    if (_event != Event::None) return i + 1;
+  }
+  return len;
+}
+
+void LinuxDumpReply::onLine(){
+  size_t n = _len;
+  while (n && _line[n - 1] == ' ') n--;
+  _line[n] = 0;
+  _len = n;
+
+  if (!_overlong && strcmp(_line, _doneLine) == 0) {
+    _event = Event::Done;
+    return;
+  }
+  if (!_overlong && strcmp(_line, "K2END") == 0 && _mode != Mode::Text) {
+    // the member is complete; anything before the next beginMember() is dropped
+    if (_mode == Mode::Member) _event = Event::MemberEnd;
+    _mode = Mode::Skip;
+    return;
+  }
+
+  if (_mode == Mode::Text) {
+    if (_text.length() + n + 1 <= TEXT_MAX) {
+      _text += _line;
+      _text += '\n';
+    }
+    return;
+  }
+  if (!_overlong && isBase64Line(_line, n)) {
+    if (_mode == Mode::Member) decodeLine();
+    return;
+  }
+  // the shell's echo of the command line is not worth reporting
+  if (n && !strstr(_line, "K2DONE")) _lastText = _line;
+}
+
+void LinuxDumpReply::decodeLine(){
+  uint8_t bin[LINE_MAX / 4 * 3];
+  size_t out = 0;
+  for (size_t i = 0; i + 4 <= _len; i += 4) {
+    const int8_t a = b64Value(_line[i]);
+    const int8_t b = b64Value(_line[i + 1]);
+    const int8_t c = b64Value(_line[i + 2]);
+    const int8_t d = b64Value(_line[i + 3]);
+    bin[out++] = (uint8_t)((a << 2) | (b >> 4));
+    if (c < 0) break;
+    bin[out++] = (uint8_t)((b << 4) | (c >> 2));
+    if (d < 0) break;
+    bin[out++] = (uint8_t)((c << 6) | d);
+  }
+  _gz.feed(bin, out);
+}
+
+bool LinuxDumpReply::memberOk(String* err){
+  if (_gz.finish()) return true;
+  if (err) {
+    *err = _gz.error();
+    if (!_gz.produced() && _lastText.length()) *err += String(" (") + _lastText + ")";
+  }
+  return false;
+}
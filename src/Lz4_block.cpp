@@ -0,0 +1,148 @@
+#include "Lz4_block.h"
+
+#include <string.h>
+
+#ifdef ARDUINO
+#include "Debug.h"
+DBG_REGISTER_MODULE(__FILE__);
+#endif
+
+namespace Lz4Block {
+
+// Format constants: a match is at least 4 bytes, the last 5 bytes are
+// always literals and no match may start in the last 12.
+static constexpr size_t MIN_MATCH     = 4;
+static constexpr size_t LAST_LITERALS = 5;
+static constexpr size_t MF_LIMIT      = 12;
+
+static inline uint32_t read32(const uint8_t* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint32_t hashAt(const uint8_t* p) {
+  return (read32(p) * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// 255-run length continuation after a saturated token nibble.
+static inline bool putLength(uint8_t*& op, const uint8_t* end, size_t len) {
+  while (len >= 255) {
+    if (op >= end) return false;
+    *op++ = 255;
+    len -= 255;
+  }
+  if (op >= end) return false;
+  *op++ = (uint8_t)len;
+  return true;
+}
+
+static bool putSequence(uint8_t*& op, const uint8_t* end,
+                        const uint8_t* lit, size_t litLen,
+                        size_t offset, size_t matchLen) {
+  if (op >= end) return false;
+  uint8_t* token = op++;
+  uint8_t t = (uint8_t)((litLen < 15 ? litLen : 15) << 4);
+  if (litLen >= 15 && !putLength(op, end, litLen - 15)) return false;
+  if ((size_t)(end - op) < litLen) return false;
+  memcpy(op, lit, litLen);
+  op += litLen;
+
+  if (matchLen) {
+    if (end - op < 2) return false;
+    *op++ = (uint8_t)offset;
+    *op++ = (uint8_t)(offset >> 8);
+    const size_t ml = matchLen - MIN_MATCH;
+    t |= (uint8_t)(ml < 15 ? ml : 15);
+    if (ml >= 15 && !putLength(op, end, ml - 15)) return false;
+  }
+  *token = t;
+  return true;
+}
+
+size_t compress(const uint8_t* src, size_t n, uint8_t* dst, size_t cap, uint16_t* table) {
+  if (!src || !dst || !table || n > MAX_INPUT) return 0;
+  uint8_t* op = dst;
+  const uint8_t* const end = dst + cap;
+  size_t anchor = 0;
+
+  if (n > MF_LIMIT) {
+    memset(table, 0, TABLE_ENTRIES * sizeof(uint16_t));
+    const size_t mfLimit = n - MF_LIMIT;
+    const size_t matchLimit = n - LAST_LITERALS;
+    size_t ip = 1;
+
+    while (ip <= mfLimit) {
+      const uint32_t h = hashAt(src + ip);
+      size_t ref = table[h];
+      table[h] = (uint16_t)ip;
+
+      if (read32(src + ref) != read32(src + ip)) {
+        // step faster through data that keeps missing
+        ip += 1 + ((ip - anchor) >> 6);
+        continue;
+      }
+
+      while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) { ip--; ref--; }
+      size_t len = MIN_MATCH;
+      while (ip + len < matchLimit && src[ref + len] == src[ip + len]) len++;
+
+      if (!putSequence(op, end, src + anchor, ip - anchor, ip - ref, len)) return 0;
+      ip += len;
+      anchor = ip;
+      if (ip <= mfLimit) table[hashAt(src + ip - 2)] = (uint16_t)(ip - 2);
+    }
+  }
+
+  if (!putSequence(op, end, src + anchor, n - anchor, 0, 0)) return 0;
+  return (size_t)(op - dst);
+}
+
+long decompress(const uint8_t* src, size_t n, uint8_t* dst, size_t cap) {
+  if (!src || !dst) return -1;
+  size_t ip = 0, op = 0;
+
+  while (ip < n) {
+    const uint8_t token = src[ip++];
+
+    size_t lit = token >> 4;
+    if (lit == 15) {
+      uint8_t b;
+      do {
+        if (ip >= n) return -1;
+        b = src[ip++];
+        lit += b;
+      } while (b == 255);
+    }
+    if (lit > n - ip || lit > cap - op) return -1;
+    memcpy(dst + op, src + ip, lit);
+    ip += lit;
+    op += lit;
+    if (ip == n) break;  // last sequence has no match
+
+    if (n - ip < 2) return -1;
+    const size_t offset = (size_t)src[ip] | ((size_t)src[ip + 1] << 8);
+    ip += 2;
+    if (offset == 0 || offset > op) return -1;
+
+    size_t ml = token & 15;
+    if (ml == 15) {
+      uint8_t b;
+      do {
+        if (ip >= n) return -1;
+        b = src[ip++];
+        ml += b;
+      } while (b == 255);
+    }
+    ml += MIN_MATCH;
+    if (ml > cap - op) return -1;
+
+    // may overlap (offset < ml), so byte by byte
+    const uint8_t* from = dst + op - offset;
+    for (size_t i = 0; i < ml; i++) dst[op + i] = from[i];
+    op += ml;
+  }
+  return (long)op;
+}
+
+} // namespace Lz4Block
@@ -47,7 +47,9 @@ DBG_REGISTER_MODULE(__FILE__);
 #include "Backup_profiles.h"
 #include "SafeGuard.h"
 #include "SdCache.h"
+#include "FlashBackup.h"
 #include "OTA.h"
+#include "Zmodem_transfer.h"
 
 // NEW: Restore Plan manifest loader (Linux-mode restore plan JSON)
 #include "RestorePlan.h"
@@ -115,6 +117,14 @@ static std::vector<uint8_t> restoreFileBuf;
 // NEW: manifest-based restore plan
 static RestorePlan gRestore;
 
+// ZMODEM file transfer with a Linux shell (!zm)
+static ZmodemTransfer zmodem;
+
+// Something is driving the target console (dump, verify, write, transfer).
+static bool targetUartBusy() {
+  return backupMgr.running() || restoreMgr.verifying() || restoreMgr.writing() || zmodem.running();
+}
+
 // ===== autobaud scheduling state =====
 static volatile bool autoBaudRequested = false;
 static volatile bool autoBaudRunning   = false;
@@ -145,6 +155,8 @@ static String   lastEnvLayoutJson;
 static bool     restoreArmed = false;
 static String   restoreAckToken;
 static bool     restoreBoardOverride = false;
+static uint32_t restoreArmedAtMs = 0;
+static constexpr uint32_t RESTORE_ARM_TIMEOUT_MS = 5UL * 60UL * 1000UL; // as RestorePlan
 
 // ============================================================
 // Command system context
@@ -178,12 +190,6 @@ static inline String makeAckToken() {
   return String(t);
 }
 
-static inline uint32_t estimateSecondsFromBytes(uint64_t bytes, uint32_t baud) {
-  double bytesPerSec = (double)baud / 10.0 * 0.60; // 10 bits/byte + 60% efficiency
-  if (bytesPerSec < 1.0) bytesPerSec = 1.0;
-  return (uint32_t)ceil((double)bytes / bytesPerSec);
-}
-
 static inline bool ubootPromptFresh(uint32_t maxAgeMs = 2500) {
   return ubootPromptSeen && ((millis() - ubootPromptLastMs) <= maxAgeMs);
 }
@@ -500,6 +506,9 @@ static void ingestFromClient(Command::Source src, const uint8_t* data, size_t le
         continue;
       }
 
+      // typing into a ZMODEM stream would corrupt it
+      if (zmodem.running()) continue;
+
       TargetSerial.print(line);
       TargetSerial.print("\n");
       continue;
@@ -551,6 +560,7 @@ static void setupCommandContext() {
     d["backup_size"] = (uint32_t)SdCache::sizeBytes(SdItem::Backup);
     d["firmware_exists"] = SdCache::exists(SdItem::Firmware);
     d["firmware_size"] = (uint32_t)SdCache::sizeBytes(SdItem::Firmware);
+    d["flash_backup_size"] = (uint32_t)FlashBackup::sizeBytes();
     String out;
     serializeJson(d, out);
     return out;
@@ -561,15 +571,40 @@ static void setupCommandContext() {
   gCmdCtx.envLastText      = []() -> String { return lastEnvText; };
   gCmdCtx.envLastBoardId   = []() -> String { return lastEnvBoardId; };
   gCmdCtx.envLastLayoutJson= []() -> String { return lastEnvLayoutJson; };
-
+  // backup wiring
   // minimal backup/restore read-only wiring
-  gCmdCtx.backupStatusLine = []() -> String { return backupMgr.running() ? backupMgr.statusLine() : String("idle"); };
+  gCmdCtx.backupStatusLine = []() -> String { return backupMgr.statusLine(); };
   gCmdCtx.backupProgress01 = []() -> float { return backupMgr.running() ? backupMgr.progress() : 0.0f; };
   gCmdCtx.backupGetProfileId = []() -> String { return backupMgr.getProfileId(); };
   gCmdCtx.backupGetCustomRange = [](uint32_t& start, uint32_t& count) {
     backupMgr.getCustomRange(start, count);
   };
 
+  gCmdCtx.backupStartUart = []() -> bool { return backupMgr.start(true); };
+  gCmdCtx.backupStartMeta = []() -> bool { return backupMgr.start(false); };
+  gCmdCtx.backupStartIncremental = []() -> bool { return backupMgr.startIncremental(); };
+  gCmdCtx.backupStartLinux = [](const String& parts) -> bool {
+    // a loaded manifest knows where the target keeps its by-name links
+    return backupMgr.startLinux(parts, gRestore.isLoaded() ? gRestore.target().by_name_base : String());
+  };
+  gCmdCtx.backupStartGpt = [](const String& parts) -> bool { return backupMgr.startGpt(parts); };
+  gCmdCtx.backupGptList = []() -> String { return backupMgr.gpt().listText(); };
+  gCmdCtx.backupResume = []() -> bool { return backupMgr.startResume(); };
+  gCmdCtx.backupDiscard = []() -> bool { return backupMgr.discardPartial(); };
+  gCmdCtx.backupStartScan = []() -> bool { return backupMgr.startScan(); };
+  gCmdCtx.backupScanDiff = [](bool againstBackup) -> bool { return backupMgr.startScanDiff(againstBackup); };
+  gCmdCtx.backupScanShow = []() -> String {
+    if (!SdCache::mounted()) return "SD not mounted";
+    return ScanMap::runsText(CFG_PATH_SCAN_FILE, 40);
+  };
+  gCmdCtx.backupSetProfileId = [](const String& pid) { backupMgr.setProfileId(pid); };
+  gCmdCtx.backupEstimate = [](const String& pid, bool linuxShell) -> String {
+    return backupMgr.estimateText(pid.length() ? pid : backupMgr.getProfileId(), linuxShell);
+  };
+  gCmdCtx.backupSetCustomRange = [](uint32_t start, uint32_t count) {
+    backupMgr.setCustomRange(start, count);
+  };
+
   // ===========================
   // Restore Manifest (NEW)
   // ===========================
@@ -583,7 +618,7 @@ static void setupCommandContext() {
 
   gCmdCtx.restorePlan = []() -> String {
     if (gRestore.isLoaded()) return gRestore.planText();
-    if (restoreMgr.isLoaded()) return String("[restore] legacy restoreMgr loaded (no manifest planText available)\n");
+    if (restoreMgr.isLoaded()) return restoreMgr.getSummaryJson() + "\n";
     return String("(no restore plan loaded)\n");
   };
 
@@ -592,8 +627,51 @@ static void setupCommandContext() {
     return String("restore verify: FAIL (manifest not loaded)\n");
   };
 
+  // .k2bak restore source: the cached SD backup or the flash partition, read in place
+  gCmdCtx.restoreLoad = [](const String& from) -> String {
+    bool flash = from.equalsIgnoreCase("flash");
+    if (!from.length()) flash = !SdCache::exists(SdItem::Backup) && FlashBackup::exists();
+    else if (!flash && !from.equalsIgnoreCase("sd")) return String("restore load: unknown source ") + from;
+
+    if (flash) {
+      if (!restoreMgr.loadBackupFromFlash()) return String("restore load: FAIL (") + restoreMgr.lastError() + ")";
+      return String("restore load: OK (flash partition ") + CFG_FLASH_BACKUP_PARTITION + ")";
+    }
+    if (!restoreMgr.loadBackupFromSd()) return String("restore load: FAIL (") + restoreMgr.lastError() + ")";
+    return String("restore load: checking ") + SdCache::path(SdItem::Backup) + " (see !restore status)";
+  };
+
+  gCmdCtx.restoreUnload = []() { restoreMgr.unload(); };
+
+  gCmdCtx.restoreCheck = [](const String& mode) -> String {
+    RestoreManager::VerifyMode m = RestoreManager::VerifyMode::Auto;
+    if (mode.equalsIgnoreCase("crc")) m = RestoreManager::VerifyMode::Crc32;
+    else if (mode.equalsIgnoreCase("md")) m = RestoreManager::VerifyMode::MdDump;
+    else if (mode.length() && !mode.equalsIgnoreCase("auto")) return String("restore check: unknown mode ") + mode;
+    if (restoreMgr.checking()) return String("restore check: FAIL (file check still running)");
+    if (!restoreMgr.startVerify(m)) return String("restore check: FAIL (") + restoreMgr.verifyStatus() + ")";
+    return String("restore check: started");
+  };
+
+  gCmdCtx.restoreStatus = []() -> String {
+    if (restoreMgr.checking()) {
+      return String("restore: checking file ") + String(restoreMgr.checkProgress() * 100.0f, 1) + "%";
+    }
+    if (!restoreMgr.isLoaded()) {
+      const String e = restoreMgr.lastError();
+      return String("restore: no file loaded") + (e.length() ? String(" (") + e + ")" : String(""));
+    }
+    String s = String("restore: ") + restoreMgr.getBoardId() + " " + restoreMgr.getProfileId() +
+               " loaded; verify " + restoreMgr.verifyStatus();
+    if (restoreMgr.verifying()) s += String(" ") + String(restoreMgr.verifyProgress() * 100.0f, 1) + "%";
+    s += String("; write ") + restoreMgr.writeStatus();
+    if (restoreMgr.writing()) s += String(" ") + String(restoreMgr.writeProgress() * 100.0f, 1) + "%";
+    return s;
+  };
+
   gCmdCtx.restoreArm = [](const String& token, bool overrideBoardId) -> String {
     restoreArmed = true;
+    restoreArmedAtMs = millis();
     restoreBoardOverride = overrideBoardId;
     restoreAckToken = token.length() ? token : makeAckToken();
 
@@ -610,11 +688,40 @@ static void setupCommandContext() {
     gRestore.disarm();
   };
 
+  // Manifest: prints the Linux-side commands. Loaded .k2bak: writes it back
+  // through U-Boot (loady + mmc write), one arm per write.
   gCmdCtx.restoreApply = []() -> String {
     if (gRestore.isLoaded()) return gRestore.applyText();
-    return String("restore apply: FAIL (manifest not loaded)\n");
+    if (!restoreMgr.isLoaded()) return String("restore apply: FAIL (no manifest or .k2bak loaded)\n");
+    if (!restoreArmed) return String("restore apply: FAIL (not armed) - run !restore arm\n");
+    if (millis() - restoreArmedAtMs > RESTORE_ARM_TIMEOUT_MS) {
+      restoreArmed = false;
+      return String("restore apply: FAIL (armed expired, re-arm required)\n");
+    }
+    String why;
+    if (!restoreBoardOverride && !restoreMgr.checkBoardIdMatches(lastEnvBoardId, &why)) {
+      return String("restore apply: FAIL (") + why + ")\n";
+    }
+    if (!restoreMgr.startWrite()) return String("restore apply: FAIL (") + restoreMgr.writeStatus() + ")\n";
+    restoreArmed = false;
+    return String("restore apply: writing ") + restoreMgr.getBoardId() + " via loady + mmc write (see !restore status)\n";
   };
 
+  gCmdCtx.zmSend = [](const String& path, bool resume) -> String {
+    if (targetUartBusy()) return String("zm send: FAIL (target console busy)");
+    String err;
+    if (!zmodem.startSend(path, resume, &err)) return String("zm send: FAIL (") + err + ")";
+    return String("zm send: started (see !zm status)");
+  };
+  gCmdCtx.zmRecv = [](const String& remote, bool resume) -> String {
+    if (targetUartBusy()) return String("zm recv: FAIL (target console busy)");
+    String err;
+    if (!zmodem.startReceive(remote, resume, &err)) return String("zm recv: FAIL (") + err + ")";
+    return String("zm recv: started, saving to SD ") + CFG_ZMODEM_RX_DIR + " (see !zm status)";
+  };
+  gCmdCtx.zmStatus = []() -> String { return zmodem.statusLine(); };
+  gCmdCtx.zmCancel = []() { zmodem.cancel(); };
+
   // actions
   gCmdCtx.rebootNow = []() { ESP.restart(); };
 
@@ -1473,6 +1580,9 @@ static void pumpTargetToOutputs() {
   }
   if (!n) return;
 
+  // a ZMODEM session owns the line: its bytes aren't console output
+  if (zmodem.onTargetBytes(buf, n, !targetUartBusy())) return;
+
   BlueprintRuntime::feedBytes(buf, n);
   K2BUI::onUartRx(buf, n);
 
@@ -1569,6 +1679,8 @@ void setup() {
   loadUartConfig();
   loadApResetConfig();
 
+  TargetSerial.setRxBufferSize(CFG_UART_RX_BUFFER_BYTES); // must precede begin()
+  TargetSerial.setTxBufferSize(CFG_UART_TX_BUFFER_BYTES);
   TargetSerial.begin(currentBaud, SERIAL_8N1, PIN_UART_RX, PIN_UART_TX);
 
   BlueprintRuntime::begin(TargetSerial, &Serial);
@@ -1586,9 +1698,11 @@ void setup() {
 
   backupMgr.begin(&TargetSerial, &prefs);
   restoreMgr.begin(&TargetSerial);
+  zmodem.begin(&TargetSerial);
 
   if (SdCache::begin()) DBG_PRINTF("[SD] mounted\n");
   else DBG_PRINTF("[SD] not mounted\n");
+  FlashBackup::begin();
 
   // NEW: Mount LittleFS for CK2 storage
   if (LittleFS.begin(true)) {
@@ -1665,6 +1779,7 @@ void loop() {
 
   backupMgr.tick();
   restoreMgr.tick();
+  zmodem.tick();
 
   ws.cleanupClients();
 
@@ -1,6 +1,7 @@
 #include "OTA.h"
 #include "Debug.h"
 #include "SdCache.h"
+#include "Crc32.h"
 #include <LittleFS.h>
 #include <FS.h>
 #include <memory>
@@ -141,6 +142,8 @@ static bool     g_active   = false;
 static uint32_t g_written  = 0;
 static uint32_t g_total    = 0;
 static String   g_lastErr;
+static uint32_t g_crc      = Crc32::INIT;  // of the image being flashed; logged so it can be
+                                           // checked against make_update_zip.py's output
 
 // ============================================================
 // Online update (GitHub Releases)
@@ -398,6 +401,7 @@ static bool zipBeginFromHeader() {
     zipFail("Update.begin firmware failed");
     return false;
   }
+  g_crc = Crc32::INIT;
   g_zipStage = 1;
   return true;
 }
@@ -424,6 +428,7 @@ static bool zipWrite(const uint8_t* data, size_t len) {
       const uint32_t remain = g_zipFwSize - g_zipFwW;
       const size_t take = (uint32_t)(len - off) > remain ? (size_t)remain : (len - off);
       if (take) {
+        g_crc = Crc32::update(g_crc, data + off, take);
         size_t w = Update.write((uint8_t*)(data + off), take);
         g_zipFwW += (uint32_t)w;
         g_written += (uint32_t)w;
@@ -438,11 +443,13 @@ static bool zipWrite(const uint8_t* data, size_t len) {
           zipFail("Update.end firmware failed");
           return false;
         }
+        D_OTA("firmware flashed (%u bytes, crc32=%08lx)", (unsigned)g_zipFwSize, (unsigned long)Crc32::finish(g_crc));
         // Next: filesystem image
         if (!Update.begin((size_t)g_zipFsSize, U_SPIFFS)) {
           zipFail("Update.begin littlefs failed");
           return false;
         }
+        g_crc = Crc32::INIT;
         g_zipStage = 2;
       }
       continue;
@@ -453,6 +460,7 @@ static bool zipWrite(const uint8_t* data, size_t len) {
       const uint32_t remain = g_zipFsSize - g_zipFsW;
       const size_t take = (uint32_t)(len - off) > remain ? (size_t)remain : (len - off);
       if (take) {
+        g_crc = Crc32::update(g_crc, data + off, take);
         size_t w = Update.write((uint8_t*)(data + off), take);
         g_zipFsW += (uint32_t)w;
         g_written += (uint32_t)w;
@@ -467,6 +475,7 @@ static bool zipWrite(const uint8_t* data, size_t len) {
           zipFail("Update.end littlefs failed");
           return false;
         }
+        D_OTA("littlefs flashed (%u bytes, crc32=%08lx)", (unsigned)g_zipFsSize, (unsigned long)Crc32::finish(g_crc));
         // Finished
         g_zipStage = 3;
       }
@@ -957,10 +966,12 @@ void OTA::attach(AsyncWebServer& server) {
           g_active = false;
           return;
         }
+        g_crc = Crc32::INIT;
       }
 
       // Data chunk
       if (len) {
+        g_crc = Crc32::update(g_crc, data, len);
         size_t w = Update.write(data, len);
         g_written += (uint32_t)w;
 
@@ -975,7 +986,7 @@ void OTA::attach(AsyncWebServer& server) {
       // Finalize
       if (final) {
         if (Update.end(true)) {
-          D_OTA("OTA success (%u bytes)", (unsigned)g_written);
+          D_OTA("OTA success (%u bytes, crc32=%08lx)", (unsigned)g_written, (unsigned long)Crc32::finish(g_crc));
 
           // SD firmware cache becomes stale once we flash
           if (SdCache::mounted()) {
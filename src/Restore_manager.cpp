@@ -1,15 +1,20 @@
 // ============================================================
 // restore_manager.cpp (FULL COPY/PASTE)
 // Fixes:
-// 1) K2Bak::Parsed uses "entries" (not ranges)
-// 2) K2Bak::RangeEntry payload is NOT stored as .data vector
+// 1) Restore walks K2Bak::extents() of the parsed file (v1/v2 entries or
+//    v3 chunks, adjacent ones merged), not the raw tables
+// 2) Payload is NOT stored as .data vector
 //    It is referenced by (data_off, data_len) into the original file buffer
-// 3) Verify engine uses the original file buffer for expected CRC slices
+// 3) Verify engine uses the original file buffer for expected CRC slices,
+//    or reads them from the SD file (loadBackupFromSd) through K2Bak::FileReader;
+//    a backup in the flash partition is used through a mapped view
+// 4) Write engine streams the same slices to `loady` over YMODEM-1K
 // ============================================================
 
 #include "Restore_manager.h"
 #include "Env_parse.h"
 #include "Debug.h"
+#include "SdCache.h"
 
 #include <ArduinoJson.h>
 #include <math.h>
@@ -21,8 +26,9 @@ DBG_REGISTER_MODULE(__FILE__);
 // Helpers
 // ------------------------------------------------------------
 
-static inline bool hasPayload(const K2Bak::RangeEntry& e) {
-  return (e.data_len > 0);
+// Fill runs carry no bytes but their content is known, so they verify too.
+static inline bool hasPayload(const K2Bak::ChunkEntry& e) {
+  return (e.data_len > 0) || K2Bak::isFill(e);
 }
 
 // ------------------------------------------------------------
@@ -35,9 +41,38 @@ void RestoreManager::begin(HardwareSerial* target){
 }
 
 bool RestoreManager::loadBackupFile(const uint8_t* buf, size_t len){
-  _loaded = false;
-  _lastErr = "";
+  if (_verifying) { _lastErr = "Verify running"; return false; }
+  if (_writing) { _lastErr = "Write running"; return false; }
+  unload();
+  return adoptBuffer(buf, len);
+}
 
+bool RestoreManager::loadBackupFromFlash(){
+  if (_verifying) { _lastErr = "Verify running"; return false; }
+  if (_writing) { _lastErr = "Write running"; return false; }
+  unload();
+
+  size_t len = 0;
+  String err;
+  const uint8_t* p = FlashBackup::map(len, &err);
+  if (!p) {
+    _lastErr = err;
+    DBG_PRINTF("[RESTORE] flash backup: %s\n", _lastErr.c_str());
+    return false;
+  }
+  _flashMapped = true;
+  if (!adoptBuffer(p, len)) {
+    err = _lastErr;
+    unload();
+    _lastErr = err;
+    return false;
+  }
+  DBG_PRINTF("[RESTORE] using flash backup in place (%lu bytes)\n", (unsigned long)len);
+  return true;
+}
+
+// Parses and checks a .k2bak that stays at buf for as long as it is loaded.
+bool RestoreManager::adoptBuffer(const uint8_t* buf, size_t len){
   // Keep reference to the raw uploaded file buffer (so verify can read payload slices)
   _filePtr = buf;
   _fileLen = len;
@@ -57,39 +92,147 @@ bool RestoreManager::loadBackupFile(const uint8_t* buf, size_t len){
   }
 
   _p = std::move(p);
+  _spans = K2Bak::extents(_p);
   _loaded = true;
 
-  DBG_PRINTF("[RESTORE] loaded ok (ver=%u entries=%u)\n",
-             (unsigned)_p.version, (unsigned)_p.entries.size());
+  DBG_PRINTF("[RESTORE] loaded ok (ver=%u chunks=%u spans=%u)\n",
+             (unsigned)_p.version, (unsigned)_p.chunks.size(), (unsigned)_spans.size());
   return true;
 }
 
+bool RestoreManager::loadBackupFromSd(){
+  if (_verifying) { _lastErr = "Verify running"; return false; }
+  if (_writing) { _lastErr = "Write running"; return false; }
+  unload();
+
+  if (!SdCache::mounted() || !SdCache::exists(SdItem::Backup)) {
+    _lastErr = "No backup on SD";
+    return false;
+  }
+  _file = SdCache::openRead(SdItem::Backup);
+  String err;
+  if (!_file || !_reader.open(_file, &err)) {
+    _lastErr = _file ? err : String("Cannot open SD backup");
+    if (_file) _file.close();
+    DBG_PRINTF("[RESTORE] SD open failed: %s\n", _lastErr.c_str());
+    return false;
+  }
+
+  _checking = true;
+  DBG_PRINTF("[RESTORE] SD backup %s: ver=%u chunks=%u, checking %llu bytes\n",
+             SdCache::path(SdItem::Backup), (unsigned)_reader.parsed().version,
+             (unsigned)_reader.parsed().chunks.size(), (unsigned long long)_reader.checkTotalBytes());
+  return true;
+}
+
+void RestoreManager::unload(){
+  if (_verifying) {
+    _turbo.revertNow();
+    _verifying = false;
+    _vs = VState::Idle;
+    _vStatus = "idle";
+  }
+  if (_writing) {
+    _ymodem.cancel("unloaded");
+    _turbo.revertNow();
+    _writing = false;
+    _ws = WState::Idle;
+    _wStatus = "idle";
+  }
+  _loaded = false;
+  _checking = false;
+  _lastErr = "";
+  _reader.close();
+  if (_file) _file.close();
+  _p = K2Bak::Parsed{};
+  _spans.clear();
+  _spans.shrink_to_fit();
+  _filePtr = nullptr;
+  _fileLen = 0;
+  if (_flashMapped) FlashBackup::unmap();
+  _flashMapped = false;
+}
+
+float RestoreManager::checkProgress() const {
+  if (_loaded) return 1.0f;
+  if (!_checking) return 0.0f;
+  const uint64_t total = _reader.checkTotalBytes();
+  return total ? (float)((double)_reader.checkedBytes() / (double)total) : 0.0f;
+}
+
+// Whole-file digests, then every chunk CRC, a slice per tick.
+void RestoreManager::checkTick(){
+  bool done = false;
+  String err;
+  if (!_reader.checkStep(CFG_RESTORE_CHECK_BYTES_PER_TICK, done, &err)) {
+    unload();
+    _lastErr = err;
+    DBG_PRINTF("[RESTORE] SD backup check failed: %s\n", _lastErr.c_str());
+    return;
+  }
+  if (!done) return;
+
+  _checking = false;
+  _spans = K2Bak::extents(meta());
+  _loaded = true;
+  DBG_PRINTF("[RESTORE] loaded ok from SD (ver=%u chunks=%u spans=%u)\n",
+             (unsigned)meta().version, (unsigned)meta().chunks.size(), (unsigned)_spans.size());
+}
+
 String RestoreManager::getEnvText() const{
   if (!_loaded) return "";
-  return _p.envText;
+  return meta().envText;
 }
 
 String RestoreManager::getSummaryJson() const {
-  if (!_loaded) return String("{\"loaded\":false,\"error\":\"") + _lastErr + "\"}";
-
+  const K2Bak::Parsed& p = meta();
   JsonDocument d;
+  if (!_loaded) {
+    d["loaded"] = false;
+    if (_checking) {
+      d["checking"] = true;
+      d["progress"] = checkProgress();
+    } else {
+      d["error"] = _lastErr;
+    }
+    String out;
+    serializeJson(d, out);
+    return out;
+  }
+
   d["loaded"] = true;
-  d["version"] = _p.version;
-  d["timestamp_unix"] = (uint64_t)_p.timestamp_unix;
-  d["board_id"] = _p.boardId;
-  d["profile_id"] = _p.profileId;
-  d["range_count"] = (uint32_t)_p.entries.size();
+  d["source"] = _reader.isOpen() ? "sd" : (_flashMapped ? "flash" : "ram");
+  d["version"] = p.version;
+  d["timestamp_unix"] = (uint64_t)p.timestamp_unix;
+  d["board_id"] = p.boardId;
+  d["profile_id"] = p.profileId;
+  d["chunk_count"] = (uint32_t)p.chunks.size();
 
   JsonArray a = d["ranges"].to<JsonArray>();
-  for (size_t i = 0; i < _p.entries.size(); i++) {
-    const auto& e = _p.entries[i];
-    JsonObject r = a.add<JsonObject>();
-    r["index"]     = (uint32_t)i;
-    r["lba_start"] = e.lba_start;
-    r["lba_count"] = e.lba_count;
-    r["data_len"]  = e.data_len;
-    r["data_off"]  = e.data_off;
-    r["flags"]     = e.flags;
+  if (p.version >= CFG_K2BAK_VERSION_V3) {
+    // profile ranges; their payload lives in the chunk index
+    d["range_count"] = (uint32_t)p.ranges.size();
+    for (size_t i = 0; i < p.ranges.size(); i++) {
+      const auto& e = p.ranges[i];
+      JsonObject r = a.add<JsonObject>();
+      r["index"]       = (uint32_t)i;
+      r["lba_start"]   = e.lba_start;
+      r["lba_count"]   = e.lba_count;
+      r["chunk_count"] = e.chunk_count;
+      r["flags"]       = e.flags;
+    }
+  } else {
+    d["range_count"] = (uint32_t)p.entries.size();
+    for (size_t i = 0; i < p.entries.size(); i++) {
+      const auto& e = p.entries[i];
+      JsonObject r = a.add<JsonObject>();
+      r["index"]     = (uint32_t)i;
+      r["lba_start"] = e.lba_start;
+      r["lba_count"] = e.lba_count;
+      r["data_len"]  = e.data_len;
+      r["data_off"]  = e.data_off;
+      r["flags"]     = e.flags;
+    }
   }
 
   String out;
@@ -99,7 +242,7 @@ String RestoreManager::getSummaryJson() const {
 
 bool RestoreManager::fileRequiresFullConfirm() const {
   if (!_loaded) return false;
-  return _p.profileId.equalsIgnoreCase("FULL");
+  return meta().profileId.equalsIgnoreCase("FULL");
 }
 
 bool RestoreManager::checkBoardIdMatches(const String& currentBoardId, String* whyNot) const {
@@ -107,7 +250,7 @@ bool RestoreManager::checkBoardIdMatches(const String& currentBoardId, String* w
     if (whyNot) *whyNot = "No restore file loaded";
     return false;
   }
-  if (_p.boardId.length() == 0 || _p.boardId.startsWith("unknown_")) {
+  if (meta().boardId.length() == 0 || meta().boardId.startsWith("unknown_")) {
     if (whyNot) *whyNot = "Backup file board_id is unknown; cannot safely match";
     return false;
   }
@@ -115,8 +258,8 @@ bool RestoreManager::checkBoardIdMatches(const String& currentBoardId, String* w
     if (whyNot) *whyNot = "Current board_id unknown";
     return false;
   }
-  if (_p.boardId != currentBoardId) {
-    if (whyNot) *whyNot = String("board_id mismatch: file=") + _p.boardId + " current=" + currentBoardId;
+  if (meta().boardId != currentBoardId) {
+    if (whyNot) *whyNot = String("board_id mismatch: file=") + meta().boardId + " current=" + currentBoardId;
     return false;
   }
   return true;
@@ -125,86 +268,74 @@ bool RestoreManager::checkBoardIdMatches(const String& currentBoardId, String* w
 uint64_t RestoreManager::getTotalRangeBytes() const {
   if (!_loaded) return 0;
   uint64_t bytes = 0;
-  for (auto &e : _p.entries) {
-    bytes += (uint64_t)e.lba_count * 512ULL;
+  if (meta().version >= CFG_K2BAK_VERSION_V3) {
+    for (auto &r : meta().ranges) bytes += (uint64_t)r.lba_count * 512ULL;
+  } else {
+    for (auto &e : meta().entries) bytes += (uint64_t)e.lba_count * 512ULL;
   }
   return bytes;
 }
 
 String RestoreManager::getLayoutHintJson() const {
   if (!_loaded) return "{}";
-  return EnvParse::layoutHintJson(_p.envText);
+  return EnvParse::layoutHintJson(meta().envText);
 }
 
 // ============================================================
 // Task D: Verify engine (read device ranges over UART and compare CRC)
 // ============================================================
 
-static uint32_t g_crc_table[256];
-static bool g_crc_init = false;
-static void init_crc_tbl() {
-  if (g_crc_init) return;
-  for (uint32_t i = 0; i < 256; i++) {
-    uint32_t c = i;
-    for (int j = 0; j < 8; j++) {
-      if (c & 1) c = 0xEDB88320u ^ (c >> 1);
-      else       c = c >> 1;
-    }
-    g_crc_table[i] = c;
-  }
-  g_crc_init = true;
-}
-
-uint32_t RestoreManager::crc32_update(uint32_t crc, const uint8_t* data, size_t len) {
-  init_crc_tbl();
-  uint32_t c = crc;
-  for (size_t i = 0; i < len; i++) {
-    c = g_crc_table[(c ^ data[i]) & 0xFFu] ^ (c >> 8);
-  }
-  return c;
-}
-
+// The prompt starts a line: an "=>" in md's ASCII column or crc32's
+// " ==> " is not one.
 void RestoreManager::sniffPrompt(uint8_t c){
-  _last2 = _last1;
-  _last1 = c;
-  if (_last2 == '=' && _last1 == '>') {
+  if (c == '>' && _last1 == '=' && (_last2 == '\n' || _last2 == '\r')) {
     _promptSeen = true;
     _promptLastMs = millis();
     _promptCount++;
   }
+  _last2 = _last1;
+  _last1 = c;
 }
 
 void RestoreManager::onTargetBytes(const uint8_t* data, size_t len){
-  if(!_verifying) return;
+  if(!_verifying && !_writing) return;
+  if (len) _lastRxMs = millis();
   for(size_t i=0;i<len;i++){
-    uint8_t c = data[i];
-    sniffPrompt(c);
-
-    if (_vs == VState::WaitMdData || _vs == VState::WaitMdPrompt) {
-      _hex.feed(&c, 1);
-      if (_hex.popBytes(_hexOut)) {
-        size_t take = _hexOut.size();
-        if (_chunkGot + take > _chunkBytes) {
-          take = (_chunkBytes > _chunkGot) ? (_chunkBytes - _chunkGot) : 0;
-        }
-        if (take) {
-          _crc = crc32_update(_crc, _hexOut.data(), take);
-          _chunkGot += take;
-        }
-        _hexOut.clear();
-      }
-    }
+    sniffPrompt(data[i]);
+  }
+  if (_writing) { writeFeed(data, len); return; }
+
+  if (_vs == VState::WaitChain || _vs == VState::WaitCrc || _vs == VState::WaitMdData ||
+      _vs == VState::WaitMdPrompt || _vs == VState::WaitRefetch) {
+    const size_t n = _chain.feed(data, len);
+    if (_chain.inMd() && n < len) _chunkGot += _hex.feed(data + n, len - n, _chunkBuf.data(), _chunkBytes);
+  } else if (_vs == VState::ProbeMd) {
+    _mdProbe.feed(data, len);
+  } else if (_vs == VState::TurboUp || _vs == VState::TurboDown) {
+    _turbo.feed(data, len);
   }
 }
 
-bool RestoreManager::startVerify(){
+void RestoreManager::sendCommand(const char* cmd, uint8_t chainParts){
+  _chain.begin(chainParts);
+  _cmdPromptMark = _promptCount;
+  _t->print(cmd); _t->print("\n");
+}
+
+// The prompt that ends the last command, not the one before it.
+bool RestoreManager::commandDone() const {
+  return _promptCount != _cmdPromptMark;
+}
+
+bool RestoreManager::startVerify(VerifyMode mode){
   if(!_loaded) { _vStatus="No restore file loaded"; return false; }
-  if(_p.entries.empty()) { _vStatus="No ranges in file"; return false; }
-  if(!_filePtr || _fileLen == 0) { _vStatus="No file buffer available"; return false; }
+  if(_writing) { _vStatus="Write running"; return false; }
+  if(_spans.empty()) { _vStatus="No ranges in file"; return false; }
+  if(!_reader.isOpen() && (!_filePtr || _fileLen == 0)) { _vStatus="No file buffer available"; return false; }
 
   // Must have payload for meaningful verify
   bool anyPayload=false;
-  for(auto &e:_p.entries) { if(hasPayload(e)){ anyPayload=true; break; } }
+  for(auto &e:_spans) { if(hasPayload(e)){ anyPayload=true; break; } }
   if(!anyPayload) { _vStatus="Verify requires payload ranges (.k2bak meta-only)"; return false; }
 
   _verifying = true;
@@ -216,18 +347,154 @@ bool RestoreManager::startVerify(){
   _promptSeen = false;
   _promptLastMs = 0;
   _promptCount = 0;
-  _last1 = _last2 = 0;
+  _last1 = '\n';   // the stream starts at a line start
+  _last2 = 0;
+
+  _hex.setWordWidth(1);
+  _chain.begin(0);
+  _mdProbed = false;
+  _turboTried = false;
+  _loadAddr = UBootHexParser::BASE_FROM_FIRST_LINE;
 
-  _hex.reset();
-  _hexOut.clear();
+  _vMode = mode;
+  _useCrc = (mode != VerifyMode::MdDump);
+  _chunkBlocks = _useCrc ? CFG_VERIFY_CRC_BLOCKS_PER_CHUNK : CFG_BACKUP_DEFAULT_BLOCKS_PER_CHUNK;
 
   _rangeIdx = 0;
   _doneBlocks = 0;
+  _vRate.begin(JobRate::Model());
 
   return true;
 }
 
+String RestoreManager::verifyStatus() const {
+  if (!_verifying || !_vRate.chunks()) return _vStatus;
+  return _vStatus + " [" + _vRate.text(verifyBytesLeft(), (size_t)_chunkBlocks * 512u) + "]";
+}
+
+uint64_t RestoreManager::verifyBytesLeft() const {
+  uint64_t blocks = 0;
+  for (size_t i = _rangeIdx; i < _spans.size(); i++) {
+    if (hasPayload(_spans[i])) blocks += _spans[i].lba_count;
+  }
+  blocks = blocks > _doneBlocks ? blocks - _doneBlocks : 0;
+  return blocks * 512ULL;
+}
+
+// CRC32 of the .k2bak payload slice (or fill run) matching the current chunk.
+bool RestoreManager::expectedChunkCrc(const K2Bak::ChunkEntry& R, uint32_t& out, String* err){
+  return expectedCrc(R, (uint64_t)_doneBlocks * 512ULL, _chunkBytes, out, err);
+}
+
+// CRC32 of bytes [byteOff, byteOff + len) of span R as the file has them.
+bool RestoreManager::expectedCrc(const K2Bak::ChunkEntry& R, uint64_t byteOff, size_t len, uint32_t& out, String* err){
+  if (K2Bak::isFill(R)) {
+    out = _fillCrc.get(K2Bak::fillByte(R), len);
+    return true;
+  }
+
+  // Raw slice, or compressed frames expanded on the fly
+  return _reader.isOpen() ? _reader.chunkCrc(R, byteOff, len, out, err)
+                          : K2Bak::chunkCrc(_p, R, byteOff, len, out, err);
+}
+
+// Compares one chunk and moves the cursor (next chunk / next range / done).
+void RestoreManager::chunkVerified(const K2Bak::ChunkEntry& R, uint32_t gotCrc){
+  uint32_t blocks = (uint32_t)(_chunkBytes / 512u);
+
+  uint32_t exp = 0;
+  String err;
+  if (!expectedChunkCrc(R, exp, &err)) {
+    _vStatus = String("verify failed: ") + err;
+    _vs = VState::Error;
+    return;
+  }
+
+  if (gotCrc != exp) {
+    char buf[180];
+    snprintf(buf, sizeof(buf),
+             "verify mismatch @range%u lba=0x%lX blocks=0x%lX",
+             (unsigned)_rangeIdx,
+             (unsigned long)(R.lba_start + _doneBlocks),
+             (unsigned long)blocks);
+    _vStatus = String("verify failed: ") + buf;
+    _vs = VState::Error;
+    return;
+  }
+
+  // crc32 mode moves no data: its chunks are all command time
+  const uint32_t now = millis();
+  _vRate.chunk(_chunkBytes, now - _vChunkMs, _useCrc ? 0 : now - _vXferMs, !_useCrc);
+  _doneBlocks += blocks;
+
+  if(_doneBlocks >= R.lba_count){
+    _rangeIdx++;
+    _doneBlocks = 0;
+
+    if(_rangeIdx >= _spans.size()){
+      verifyFinished();
+    } else {
+      _vStatus = "verifying next range";
+      _vs = VState::WaitPrompt;
+      _deadlineMs = millis() + 7000;
+    }
+  } else {
+    _vs = VState::SendMmcRead;
+    _deadlineMs = millis() + 2500;
+    _vStatus = "verifying: next chunk";
+  }
+}
+
+// All ranges matched; drop back to the console baud first if it was raised.
+void RestoreManager::verifyFinished(){
+  _vProgress = 1.0f;
+  if (_turbo.raised()) {
+    _turbo.beginDown();
+    _vs = VState::TurboDown;
+    _deadlineMs = millis() + 10000;
+    _vStatus = "verify OK, restoring console baud";
+    return;
+  }
+  _vStatus = "verify OK";
+  _vs = VState::Done;
+  _verifying = false;
+}
+
+// md mode: re-dumps lines the decoder saw missing, then checks the chunk.
+void RestoreManager::refetchOrFinish(const K2Bak::ChunkEntry& R){
+  UBootHexParser::Gap g;
+  if (_hex.gapsOverflowed() || (!_hex.gapCount() && !_hex.streamDone())) {
+    _vStatus = "verify failed: md dump lost too many lines";
+    _vs = VState::Error;
+    return;
+  }
+  if (!_hex.takeGap(g)) {
+    const uint32_t got = _hex.crcInOrder()
+        ? _hex.crcValue()
+        : Crc32::of(_chunkBuf.data(), _chunkBytes);
+    chunkVerified(R, got);
+    return;
+  }
+  if (++_refetches > CFG_BACKUP_CHUNK_MAX_REFETCH) {
+    _vStatus = "verify failed: md dump lost too many lines";
+    _vs = VState::Error;
+    return;
+  }
+
+  _hex.expectRange(g.addr, g.len);
+  const uint8_t w = _hex.wordWidth();
+  char cmd[128];
+  snprintf(cmd, sizeof(cmd), "md.%c 0x%llX 0x%lX", UBootHexParser::mdSuffix(w),
+           (unsigned long long)g.addr, (unsigned long)(g.len / w));
+  sendCommand(cmd, UBootChainReply::PART_MD);
+  _vs = VState::WaitRefetch;
+  _deadlineMs = millis() + 5000;
+  _vStatus = "verifying: re-fetching lost lines";
+}
+
 void RestoreManager::tick(){
+  if (_checking) { checkTick(); return; }
+  if (_writing) { writeTick(); return; }
   if(!_verifying) return;
 
   if ((int32_t)(millis() - _deadlineMs) > 0) {
@@ -235,16 +502,31 @@ void RestoreManager::tick(){
     _vs = VState::Error;
   }
 
-  // Guard
-  if (_rangeIdx >= _p.entries.size()) {
-    _vStatus = "verify OK";
-    _vProgress = 1.0f;
+  if (_vs == VState::Error) {
+    DBG_PRINTF("[RESTORE] VERIFY ERROR: %s\n", _vStatus.c_str());
+    _turbo.revertNow();
     _verifying = false;
-    _vs = VState::Done;
+    _vs = VState::Idle;
+    return;
+  }
+
+  if (_vs == VState::TurboDown) {
+    if (_turbo.tick()) {
+      if (_turbo.lost()) DBG_PRINTF("[RESTORE] could not confirm console baud restore\n");
+      _vStatus = "verify OK";
+      _vs = VState::Done;
+      _verifying = false;
+    }
     return;
   }
 
-  auto &R = _p.entries[_rangeIdx];
+  // Guard
+  if (_rangeIdx >= _spans.size()) {
+    verifyFinished();
+    return;
+  }
+
+  auto &R = _spans[_rangeIdx];
 
   // If this entry has no payload, skip it (verify only makes sense for payload entries)
   if (!hasPayload(R)) {
@@ -261,20 +543,58 @@ void RestoreManager::tick(){
     uint32_t blocks = remaining > _chunkBlocks ? _chunkBlocks : remaining;
     _chunkBytes = (size_t)blocks * 512u;
     _chunkGot = 0;
-    _crc = 0xFFFFFFFFu;
     _hex.reset();
+    _hex.crcBegin();
     return blocks;
   };
 
   switch(_vs){
     case VState::WaitPrompt: {
       if(_promptSeen && (millis()-_promptLastMs) < 1500){
+        if (!_useCrc && !_turboTried) {
+          _turboTried = true;
+          _turbo.beginUp(_t, CFG_UART_TURBO_BAUD);
+          _vs = VState::TurboUp;
+          _deadlineMs = millis() + 30000;
+          _vStatus = "verifying: raising console baud";
+          break;
+        }
+        if (!_useCrc && !_mdProbed) {
+          // probe clobbers ${loadaddr}, so it runs before the next mmc read
+          _mdProbe.start(_t);
+          _vs = VState::ProbeMd;
+          _deadlineMs = millis() + 15000;
+          _vStatus = "verifying: probing md widths";
+          break;
+        }
         _vs = VState::SendMmcRead;
         _deadlineMs = millis() + 2500;
         _vStatus = "verifying: mmc read";
       }
     } break;
 
+    case VState::TurboUp: {
+      if (_turbo.tick()) {
+        if (_turbo.lost()) {
+          _vStatus = "verify failed: lost the console while changing baud";
+          _vs = VState::Error;
+          break;
+        }
+        _vs = VState::WaitPrompt;
+        _deadlineMs = millis() + 7000;
+      }
+    } break;
+
+    case VState::ProbeMd: {
+      if (_mdProbe.tick()) {
+        _hex.setWordWidth(_mdProbe.width(), _mdProbe.bigEndian());
+        if (_mdProbe.hasLoadAddr()) _loadAddr = _mdProbe.loadAddr();
+        _mdProbed = true;
+        _vs = VState::WaitPrompt;
+        _deadlineMs = millis() + 7000;
+      }
+    } break;
+
     case VState::SendMmcRead: {
       if(!_promptSeen || (millis()-_promptLastMs) > 1500){
         _vs = VState::WaitPrompt;
@@ -284,43 +604,90 @@ void RestoreManager::tick(){
       }
       uint32_t blocks = startNextChunk();
       uint32_t lba = R.lba_start + _doneBlocks;
-      char cmd[128];
-      snprintf(cmd, sizeof(cmd), "mmc read ${loadaddr} 0x%lX 0x%lX",
-               (unsigned long)lba, (unsigned long)blocks);
-      _t->print(cmd); _t->print("\n");
-      _vs = VState::WaitReadPrompt;
+      char cmd[192];
+      int n = snprintf(cmd, sizeof(cmd), "mmc read ${loadaddr} 0x%lX 0x%lX",
+                       (unsigned long)lba, (unsigned long)blocks);
+      // one line per chunk: the check runs right behind the read
+      uint8_t parts = UBootChainReply::PART_MMC;
+      if (_useCrc) {
+        parts |= UBootChainReply::PART_CRC;
+        snprintf(cmd + n, sizeof(cmd) - n, "; crc32 ${loadaddr} 0x%lX", (unsigned long)_chunkBytes);
+      } else {
+        parts |= UBootChainReply::PART_MD;
+        if (_chunkBuf.size() < _chunkBytes) _chunkBuf.resize(_chunkBytes);
+        _hex.beginWindow(_loadAddr, _chunkBytes);
+        _hex.crcBegin();
+        _refetches = 0;
+        const uint8_t w = _hex.wordWidth();
+        snprintf(cmd + n, sizeof(cmd) - n, "; md.%c ${loadaddr} 0x%lX",
+                 UBootHexParser::mdSuffix(w), (unsigned long)(_chunkBytes / w));
+      }
+      sendCommand(cmd, parts);
+      _vChunkMs = millis();
+      _vs = VState::WaitChain;
       _deadlineMs = millis() + 7000;
-      _vStatus = "verifying: wait read prompt";
+      _vStatus = "verifying: mmc read";
     } break;
 
-    case VState::WaitReadPrompt: {
-      if(_promptSeen && (millis()-_promptLastMs) < 1500){
-        _vs = VState::SendMd;
-        _deadlineMs = millis() + 2000;
-        _vStatus = "verifying: md.b";
+    case VState::WaitChain: {
+      if (!_chain.headerDone()) break;
+      if (_chain.mmcFailed()) {
+        char buf[96];
+        snprintf(buf, sizeof(buf), "verify failed: mmc read error @lba 0x%lX",
+                 (unsigned long)(R.lba_start + _doneBlocks));
+        _vStatus = buf;
+        _vs = VState::Error;
+        break;
+      }
+      if (_useCrc) {
+        _vs = VState::WaitCrc;
+        _deadlineMs = millis() + 7000;
+        _vStatus = "verifying: crc32";
+      } else {
+        _vs = VState::WaitMdData;
+        _vXferMs = millis();
+        _deadlineMs = millis() + 14000;
+        _vStatus = "verifying: parsing hex";
       }
     } break;
 
-    case VState::SendMd: {
-      char cmd[128];
-      snprintf(cmd, sizeof(cmd), "md.b ${loadaddr} 0x%lX", (unsigned long)_chunkBytes);
-      _t->print(cmd); _t->print("\n");
-      _vs = VState::WaitMdData;
-      _deadlineMs = millis() + 14000;
-      _vStatus = "verifying: parsing hex";
+    case VState::WaitCrc: {
+      if (!commandDone()) break;
+      if (_chain.crc().unsupported()) {
+        if (_vMode == VerifyMode::Crc32) {
+          _vStatus = "verify failed: U-Boot has no crc32 command";
+          _vs = VState::Error;
+          break;
+        }
+        // Re-read this chunk in md.b-sized pieces.
+        DBG_PRINTF("[RESTORE] crc32 unsupported, falling back to md.b\n");
+        _useCrc = false;
+        _chunkBlocks = CFG_BACKUP_DEFAULT_BLOCKS_PER_CHUNK;
+        _vs = VState::WaitPrompt;
+        _deadlineMs = millis() + 7000;
+        _vStatus = "crc32 unsupported: falling back to md.b";
+        break;
+      }
+      if (_chain.crc().haveResult()) {
+        chunkVerified(R, _chain.crc().result());
+      }
     } break;
 
     case VState::WaitMdData: {
-      if(_chunkGot >= _chunkBytes){
+      if(_hex.streamDone() && !_hex.gapCount()){
         _vs = VState::WaitMdPrompt;
         _deadlineMs = millis() + 7000;
         _vStatus = "verifying: wait prompt";
+      } else if (commandDone() && (millis() - _lastRxMs) > 300) {
+        // md finished (prompt + quiet line) with lines missing
+        _hex.closeStream();
+        refetchOrFinish(R);
       } else {
         // progress by blocks (all entries)
         uint64_t totalBlocks=0, doneBlocks=0;
-        for(size_t i=0;i<_p.entries.size();i++){
-          totalBlocks += _p.entries[i].lba_count;
-          if(i<_rangeIdx) doneBlocks += _p.entries[i].lba_count;
+        for(size_t i=0;i<_spans.size();i++){
+          totalBlocks += _spans[i].lba_count;
+          if(i<_rangeIdx) doneBlocks += _spans[i].lba_count;
         }
         doneBlocks += _doneBlocks;
         _vProgress = totalBlocks ? (float)((double)doneBlocks / (double)totalBlocks) : 0.0f;
@@ -328,80 +695,406 @@ void RestoreManager::tick(){
     } break;
 
     case VState::WaitMdPrompt: {
-      if(_promptSeen && (millis()-_promptLastMs) < 1500){
-        uint32_t chunkCrc = (_crc ^ 0xFFFFFFFFu);
+      if(commandDone()){
+        refetchOrFinish(R);
+      }
+    } break;
+
+    case VState::WaitRefetch: {
+      if (commandDone() && (millis() - _lastRxMs) > 300) {
+        _hex.closeStream();
+        refetchOrFinish(R);
+      }
+    } break;
 
-        // Expected CRC from file payload slice
-        uint32_t blocks = (uint32_t)(_chunkBytes / 512u);
+    case VState::Done: {
+      _verifying = false;
+    } break;
 
-        // Chunk offset within this entry's payload:
-        size_t chunkOff = (size_t)_doneBlocks * 512u;
-        if (chunkOff + _chunkBytes > (size_t)R.data_len) {
-          _vStatus = "verify failed: chunk beyond entry payload length";
-          _vs = VState::Error;
+    default: break;
+  }
+}
+// ============================================================
+// Task E: Write engine (loady + mmc write, read-back crc32 per chunk)
+// ============================================================
+
+bool RestoreManager::startWrite(){
+  if(!_loaded) { _wStatus="No restore file loaded"; return false; }
+  if(_verifying) { _wStatus="Verify running"; return false; }
+  if(_writing) { _wStatus="Write already running"; return false; }
+  if(_spans.empty()) { _wStatus="No ranges in file"; return false; }
+  if(!_reader.isOpen() && (!_filePtr || _fileLen == 0)) { _wStatus="No file buffer available"; return false; }
+
+  bool anyPayload=false;
+  for(auto &e:_spans) { if(hasPayload(e)){ anyPayload=true; break; } }
+  if(!anyPayload) { _wStatus="Write requires payload ranges (.k2bak meta-only)"; return false; }
+
+  _writing = true;
+  _wProgress = 0;
+  _wStatus = "waiting for U-Boot prompt (=>)";
+  _ws = WState::WaitPrompt;
+  _deadlineMs = millis() + 7000;
+
+  _promptSeen = false;
+  _promptLastMs = 0;
+  _promptCount = 0;
+  _last1 = '\n';   // the stream starts at a line start
+  _last2 = 0;
+
+  _chain.begin(0);
+  _turboTried = false;
+  _chunkBlocks = CFG_RESTORE_WRITE_BLOCKS_PER_CHUNK;
+  _rangeIdx = 0;
+  _doneBlocks = 0;
+  _wTries = 0;
+  _wLoaded = false;
+  _wDiff = CFG_RESTORE_WRITE_DIFF;
+  _runBlocks = 0;
+  _wSkipAfter = 0;
+  _wWritten = 0;
+  _wSkipped = 0;
+
+  DBG_PRINTF("[RESTORE] write start: %u spans, %lu blocks per chunk%s\n",
+             (unsigned)_spans.size(), (unsigned long)_chunkBlocks, _wDiff ? ", changed chunks only" : "");
+  return true;
+}
+
+void RestoreManager::writeFeed(const uint8_t* data, size_t len){
+  switch (_ws) {
+    case WState::Ymodem:     _ymodem.feed(data, len); break;
+    case WState::WaitProbe:
+    case WState::WaitChain:
+    case WState::WaitCrc:    _chain.feed(data, len); break;
+    case WState::TurboUp:
+    case WState::TurboDown:  _turbo.feed(data, len); break;
+    default: break;
+  }
+}
+
+// YMODEM source: bytes [off, off + len) of the current chunk, from the SD
+// file or the in-memory / mapped backup. len is whole blocks.
+bool RestoreManager::readSlice(void* ctx, uint64_t off, uint8_t* out, size_t len){
+  RestoreManager* self = (RestoreManager*)ctx;
+  const K2Bak::ChunkEntry& R = self->_spans[self->_rangeIdx];
+  const uint64_t byteOff = (uint64_t)self->_doneBlocks * 512ULL + off;
+  String err;
+  const bool ok = self->_reader.isOpen()
+      ? self->_reader.readBlocks(R.lba_start + (uint32_t)(byteOff / 512u), (uint32_t)(len / 512u), out, &err)
+      : K2Bak::chunkRead(self->_p, R, byteOff, len, out, &err);
+  if (!ok) DBG_PRINTF("[RESTORE] write source read failed: %s\n", err.c_str());
+  return ok;
+}
+
+void RestoreManager::updateWriteProgress(){
+  uint64_t totalBlocks = 0, doneBlocks = 0;
+  for (size_t i = 0; i < _spans.size(); i++) {
+    if (!hasPayload(_spans[i])) continue;
+    totalBlocks += _spans[i].lba_count;
+    if (i < _rangeIdx) doneBlocks += _spans[i].lba_count;
+  }
+  double done = (double)(doneBlocks + _doneBlocks) * 512.0;
+  if (_ws == WState::Ymodem) done += (double)_ymodem.ackedBytes();
+  _wProgress = totalBlocks ? (float)(done / ((double)totalBlocks * 512.0)) : 0.0f;
+}
+
+// Sends the current chunk again from the top (loady), or gives up.
+void RestoreManager::retryChunk(const char* why){
+  const uint32_t lba = _spans[_rangeIdx].lba_start + _doneBlocks;
+  if (++_wTries >= CFG_RESTORE_WRITE_MAX_TRIES) {
+    char buf[160];
+    snprintf(buf, sizeof(buf), "write failed @lba 0x%lX: %s", (unsigned long)lba, why);
+    _wStatus = buf;
+    _ws = WState::Error;
+    return;
+  }
+  DBG_PRINTF("[RESTORE] chunk @lba 0x%lX: %s, retry %u\n", (unsigned long)lba, why, (unsigned)_wTries);
+  _wLoaded = false;
+  _ws = WState::WaitLoadPrompt;
+  _deadlineMs = millis() + 7000;
+  _wStatus = String("writing: retrying chunk (") + why + ")";
+}
+
+// Read-back CRC of one written chunk; moves the cursor on a match.
+void RestoreManager::chunkWritten(const K2Bak::ChunkEntry& R, uint32_t gotCrc){
+  uint32_t exp = 0;
+  String err;
+  if (!expectedChunkCrc(R, exp, &err)) {
+    _wStatus = String("write failed: ") + err;
+    _ws = WState::Error;
+    return;
+  }
+  if (gotCrc != exp) {
+    retryChunk("read-back crc32 mismatch");
+    return;
+  }
+
+  const uint32_t written = (uint32_t)(_chunkBytes / 512u);
+  _wWritten += written;
+  _wSkipped += _wSkipAfter;
+  _wTries = 0;
+  _wLoaded = false;
+  advanceWrite(written + _wSkipAfter);
+  _runBlocks = 0;
+  _wSkipAfter = 0;
+  updateWriteProgress();
+  // the chain's prompt is in, so the next command can go straight out
+  _ws = WState::NextChunk;
+  _deadlineMs = millis() + 2500;
+  _wStatus = "writing: next chunk";
+}
+
+// Moves the write cursor; past the end of a span it starts the next one.
+void RestoreManager::advanceWrite(uint32_t blocks){
+  _doneBlocks += blocks;
+  if (_doneBlocks >= _spans[_rangeIdx].lba_count) {
+    _rangeIdx++;
+    _doneBlocks = 0;
+  }
+}
+
+// Device fingerprint of one unit is in: skip it, or grow the run to write.
+void RestoreManager::probeDone(const K2Bak::ChunkEntry& R){
+  const uint64_t at = (uint64_t)(_doneBlocks + _runBlocks) * 512ULL;
+  bool same = false;
+  if (_chain.mmcOk() && _chain.crc().haveResult()) {
+    uint32_t exp = 0;
+    String err;
+    if (!expectedCrc(R, at, (size_t)_probeBlocks * 512u, exp, &err)) {
+      _wStatus = String("write failed: ") + err;
+      _ws = WState::Error;
+      return;
+    }
+    same = (exp == _chain.crc().result());
+  }
+  // an unreadable unit counts as different: writing it is the repair
+
+  _deadlineMs = millis() + 2500;
+  if (same && !_runBlocks) {
+    _wSkipped += _probeBlocks;
+    advanceWrite(_probeBlocks);
+    updateWriteProgress();
+    _ws = WState::NextChunk;
+    return;
+  }
+  if (same) {
+    _wSkipAfter = _probeBlocks;
+  } else {
+    _runBlocks += _probeBlocks;
+    const uint32_t unit = CFG_RESTORE_DIFF_BLOCKS < _chunkBlocks ? CFG_RESTORE_DIFF_BLOCKS : _chunkBlocks;
+    if (_doneBlocks + _runBlocks < R.lba_count && _runBlocks + unit <= _chunkBlocks) {
+      _ws = WState::SendProbe;
+      return;
+    }
+  }
+  _chunkBytes = (size_t)_runBlocks * 512u;
+  _ws = WState::SendLoad;
+}
+
+void RestoreManager::writeFinished(){
+  _wProgress = 1.0f;
+  uint64_t blocks = 0;
+  for (auto& e : _spans) if (hasPayload(e)) blocks += e.lba_count;
+  char buf[96];
+  if (_wDiff) {
+    snprintf(buf, sizeof(buf), "write OK (%llu blocks: %llu written, %llu unchanged)",
+             (unsigned long long)blocks, (unsigned long long)_wWritten, (unsigned long long)_wSkipped);
+  } else {
+    snprintf(buf, sizeof(buf), "write OK (%llu blocks)", (unsigned long long)blocks);
+  }
+  DBG_PRINTF("[RESTORE] %s\n", buf);
+  _wStatus = buf;
+  if (_turbo.raised()) {
+    _turbo.beginDown();
+    _ws = WState::TurboDown;
+    _deadlineMs = millis() + 10000;
+    return;
+  }
+  _ws = WState::Idle;
+  _writing = false;
+}
+
+void RestoreManager::writeTick(){
+  if ((int32_t)(millis() - _deadlineMs) > 0) {
+    _wStatus = "timeout: " + _wStatus;
+    _ws = WState::Error;
+  }
+
+  if (_ws == WState::Error) {
+    DBG_PRINTF("[RESTORE] WRITE ERROR: %s\n", _wStatus.c_str());
+    if (_ymodem.running()) _ymodem.cancel();
+    _turbo.revertNow();
+    _writing = false;
+    _ws = WState::Idle;
+    return;
+  }
+
+  if (_ws == WState::TurboDown) {
+    if (_turbo.tick()) {
+      if (_turbo.lost()) DBG_PRINTF("[RESTORE] could not confirm console baud restore\n");
+      _ws = WState::Idle;
+      _writing = false;
+    }
+    return;
+  }
+
+  // meta-only spans were never captured: nothing to write there
+  while (_rangeIdx < _spans.size() && !hasPayload(_spans[_rangeIdx])) {
+    _rangeIdx++;
+    _doneBlocks = 0;
+  }
+  if (_rangeIdx >= _spans.size()) {
+    writeFinished();
+    return;
+  }
+
+  auto &R = _spans[_rangeIdx];
+
+  switch (_ws) {
+    case WState::WaitPrompt: {
+      if (_promptSeen && (millis() - _promptLastMs) < 1500) {
+        if (!_turboTried) {
+          _turboTried = true;
+          _turbo.beginUp(_t, CFG_UART_TURBO_BAUD);
+          _ws = WState::TurboUp;
+          _deadlineMs = millis() + 30000;
+          _wStatus = "writing: raising console baud";
           break;
         }
+        _ws = WState::NextChunk;
+        _deadlineMs = millis() + 2500;
+      }
+    } break;
 
-        // Location in the .k2bak file buffer:
-        size_t fileOff = (size_t)R.data_off + chunkOff;
-        if (fileOff + _chunkBytes > _fileLen) {
-          _vStatus = "verify failed: payload beyond file buffer";
-          _vs = VState::Error;
+    case WState::TurboUp: {
+      if (_turbo.tick()) {
+        if (_turbo.lost()) {
+          _wStatus = "write failed: lost the console while changing baud";
+          _ws = WState::Error;
           break;
         }
+        _ws = WState::WaitPrompt;
+        _deadlineMs = millis() + 7000;
+      }
+    } break;
 
-        const uint8_t* expPtr = _filePtr + fileOff;
+    case WState::NextChunk: {
+      if (_wDiff) {
+        _runBlocks = 0;
+        _wSkipAfter = 0;
+        _ws = WState::SendProbe;
+        break;
+      }
+      const uint32_t remaining = R.lba_count - _doneBlocks;
+      const uint32_t blocks = remaining > _chunkBlocks ? _chunkBlocks : remaining;
+      _chunkBytes = (size_t)blocks * 512u;
+      _ws = WState::SendLoad;
+    } break;
 
-        uint32_t exp = 0xFFFFFFFFu;
-        exp = crc32_update(exp, expPtr, _chunkBytes);
-        exp ^= 0xFFFFFFFFu;
+    case WState::SendProbe: {
+      const uint32_t unit = CFG_RESTORE_DIFF_BLOCKS < _chunkBlocks ? CFG_RESTORE_DIFF_BLOCKS : _chunkBlocks;
+      const uint32_t at = _doneBlocks + _runBlocks;
+      const uint32_t left = R.lba_count - at;
+      _probeBlocks = left > unit ? unit : left;
+      char cmd[160];
+      snprintf(cmd, sizeof(cmd), "mmc read ${loadaddr} 0x%lX 0x%lX; crc32 ${loadaddr} 0x%lX",
+               (unsigned long)(R.lba_start + at), (unsigned long)_probeBlocks,
+               (unsigned long)_probeBlocks * 512UL);
+      sendCommand(cmd, UBootChainReply::PART_MMC | UBootChainReply::PART_CRC);
+      _ws = WState::WaitProbe;
+      _deadlineMs = millis() + 7000;
+      _wStatus = "writing: comparing with device";
+    } break;
 
-        if (chunkCrc != exp) {
-          char buf[180];
-          snprintf(buf, sizeof(buf),
-                   "verify mismatch @range%u lba=0x%lX blocks=0x%lX",
-                   (unsigned)_rangeIdx,
-                   (unsigned long)(R.lba_start + _doneBlocks),
-                   (unsigned long)blocks);
-          _vStatus = String("verify failed: ") + buf;
-          _vs = VState::Error;
-          break;
-        }
+    case WState::WaitProbe: {
+      if (!_chain.headerDone() || !commandDone()) break;
+      if (_chain.crc().unsupported()) {
+        _wStatus = "write failed: U-Boot has no crc32 command (writes can't be checked)";
+        _ws = WState::Error;
+        break;
+      }
+      probeDone(R);
+    } break;
 
-        _doneBlocks += blocks;
-
-        if(_doneBlocks >= R.lba_count){
-          _rangeIdx++;
-          _doneBlocks = 0;
-
-          if(_rangeIdx >= _p.entries.size()){
-            _vStatus = "verify OK";
-            _vProgress = 1.0f;
-            _vs = VState::Done;
-            _verifying = false;
-          } else {
-            _vStatus = "verifying next range";
-            _vs = VState::WaitPrompt;
-            _deadlineMs = millis() + 7000;
-          }
-        } else {
-          _vs = VState::SendMmcRead;
-          _deadlineMs = millis() + 2500;
-          _vStatus = "verifying: next chunk";
-        }
+    case WState::SendLoad: {
+      if (K2Bak::isFill(R)) {
+        // mw.b fills ${loadaddr} on the target; nothing to transfer
+        _ws = WState::SendWrite;
+        break;
       }
+      sendCommand("loady ${loadaddr}", 0);
+      _ymodem.begin(_t, "k2restore.bin", _chunkBytes, &RestoreManager::readSlice, this);
+      _ws = WState::Ymodem;
+      // 10 bits per byte plus ACK turnarounds; the sender has its own per-packet timeouts
+      const uint32_t baud = _t->baudRate() ? _t->baudRate() : 115200;
+      _deadlineMs = millis() + 30000 + (uint32_t)((uint64_t)_chunkBytes * 20000ULL / baud);
+      _wStatus = "writing: sending chunk (ymodem)";
     } break;
 
-    case VState::Done: {
-      _verifying = false;
+    case WState::Ymodem: {
+      if (!_ymodem.tick()) {
+        updateWriteProgress();
+        break;
+      }
+      if (_ymodem.ok()) {
+        _wLoaded = true;
+        _ws = WState::WaitLoadPrompt;
+        _deadlineMs = millis() + 7000;
+        _wStatus = "writing: chunk loaded";
+        break;
+      }
+      if (!_ymodem.started()) {
+        _wStatus = String("write failed: ") + _ymodem.error();
+        _ws = WState::Error;
+        break;
+      }
+      retryChunk((String("ymodem: ") + _ymodem.error()).c_str());
     } break;
 
-    case VState::Error: {
-      DBG_PRINTF("[RESTORE] VERIFY ERROR: %s\n", _vStatus.c_str());
-      _verifying = false;
-      _vs = VState::Idle;
+    case WState::WaitLoadPrompt: {
+      if (!commandDone()) break;
+      _ws = _wLoaded ? WState::SendWrite : WState::SendLoad;
+      _deadlineMs = millis() + 2500;
+    } break;
+
+    case WState::SendWrite: {
+      const uint32_t lba = R.lba_start + _doneBlocks;
+      const unsigned long blocks = (unsigned long)(_chunkBytes / 512u);
+      char cmd[224];
+      int n = 0;
+      if (K2Bak::isFill(R)) {
+        n = snprintf(cmd, sizeof(cmd), "mw.b ${loadaddr} 0x%02X 0x%lX; ",
+                     (unsigned)K2Bak::fillByte(R), (unsigned long)_chunkBytes);
+      }
+      // read back what landed on the device, not what sits in RAM
+      snprintf(cmd + n, sizeof(cmd) - n,
+               "mmc write ${loadaddr} 0x%lX 0x%lX; mmc read ${loadaddr} 0x%lX 0x%lX; crc32 ${loadaddr} 0x%lX",
+               (unsigned long)lba, blocks, (unsigned long)lba, blocks, (unsigned long)_chunkBytes);
+      sendCommand(cmd, UBootChainReply::PART_MMC_WRITE | UBootChainReply::PART_MMC | UBootChainReply::PART_CRC);
+      _ws = WState::WaitChain;
+      _deadlineMs = millis() + 30000;
+      _wStatus = "writing: mmc write";
+    } break;
+
+    case WState::WaitChain: {
+      // U-Boot runs the whole chain even after a failed part: let it finish
+      if (!_chain.headerDone()) break;
+      _ws = WState::WaitCrc;
+      _deadlineMs = millis() + 7000;
+      _wStatus = "writing: crc32";
+    } break;
+
+    case WState::WaitCrc: {
+      if (!commandDone()) break;
+      if (_chain.mmcWriteFailed()) { retryChunk("mmc write error"); break; }
+      if (_chain.mmcFailed()) { retryChunk("mmc read-back error"); break; }
+      if (_chain.crc().unsupported()) {
+        _wStatus = "write failed: U-Boot has no crc32 command (writes can't be checked)";
+        _ws = WState::Error;
+        break;
+      }
+      if (_chain.crc().haveResult()) chunkWritten(R, _chain.crc().result());
     } break;
 
     default: break;
   }
-}
\ No newline at end of file
+}
@@ -97,9 +97,34 @@ bool SafeGuard::allow(const String& head, const String& sub, const String& arg,
   if (head.equalsIgnoreCase("backup") && sub.equalsIgnoreCase("start")) {
     if (arg.equalsIgnoreCase("uart")) return !blockedBy(CFG_SG_BLOCK_BACKUP_START_UART, "backup start uart", whyBlocked);
     if (arg.equalsIgnoreCase("meta")) return !blockedBy(CFG_SG_BLOCK_BACKUP_START_META, "backup start meta", whyBlocked);
-    return true;
+    // a raw dump too, just driven from the Linux shell ("linux [parts]"),
+    // of GPT partitions ("uart <parts>") or against the SD backup ("incr")
+    String mode = arg;
+    mode.toLowerCase();
+    if (mode == "incr")
+      return !blockedBy(CFG_SG_BLOCK_BACKUP_START_UART, "backup start incr", whyBlocked);
+    if (mode == "linux" || mode.startsWith("linux "))
+      return !blockedBy(CFG_SG_BLOCK_BACKUP_START_UART, "backup start linux", whyBlocked);
+    // anything else may be a raw dump a newer Command.cpp knows
+    return !blockedBy(CFG_SG_BLOCK_BACKUP_START_UART, "backup start uart", whyBlocked);
   }
 
+  // reads LBA 0-33 like a raw dump; "list" only shows the result
+  if (head.equalsIgnoreCase("backup") && sub.equalsIgnoreCase("gpt") && !arg.equalsIgnoreCase("list"))
+    return !blockedBy(CFG_SG_BLOCK_BACKUP_START_UART, "backup gpt", whyBlocked);
+
+  // carries on an interrupted raw dump
+  if (head.equalsIgnoreCase("backup") && sub.equalsIgnoreCase("resume"))
+    return !blockedBy(CFG_SG_BLOCK_BACKUP_START_UART, "backup resume", whyBlocked);
+
+  // deletes the partial file that resume needs
+  if (head.equalsIgnoreCase("backup") && sub.equalsIgnoreCase("discard"))
+    return !blockedBy(CFG_SG_BLOCK_BACKUP_START_UART, "backup discard", whyBlocked);
+
+  // mmc read + crc32 over the whole range; diff/show only read SD
+  if (head.equalsIgnoreCase("backup") && sub.equalsIgnoreCase("scan") && !arg.length())
+    return !blockedBy(CFG_SG_BLOCK_BACKUP_START_UART, "backup scan", whyBlocked);
+
   if (head.equalsIgnoreCase("backup") && sub.equalsIgnoreCase("status"))
     return !blockedBy(CFG_SG_BLOCK_BACKUP_STATUS, "backup status", whyBlocked);
 
@@ -125,6 +150,17 @@ bool SafeGuard::allow(const String& head, const String& sub, const String& arg,
   if (head.equalsIgnoreCase("restore") && sub.equalsIgnoreCase("verify"))
     return !blockedBy(CFG_SG_BLOCK_RESTORE_VERIFY, "restore verify", whyBlocked);
 
+  // reads the target through its console, like verify
+  if (head.equalsIgnoreCase("restore") && sub.equalsIgnoreCase("check"))
+    return !blockedBy(CFG_SG_BLOCK_RESTORE_VERIFY, "restore check", whyBlocked);
+
+  // ---- zmodem ----
+  if (head.equalsIgnoreCase("zm") && sub.equalsIgnoreCase("send"))
+    return !blockedBy(CFG_SG_BLOCK_ZM_SEND, "zm send", whyBlocked);
+
+  if (head.equalsIgnoreCase("zm") && sub.equalsIgnoreCase("recv"))
+    return !blockedBy(CFG_SG_BLOCK_ZM_RECV, "zm recv", whyBlocked);
+
   // ---- sd rm ----
   if (head.equalsIgnoreCase("sd") && sub.equalsIgnoreCase("rm"))
     return !blockedBy(CFG_SG_BLOCK_SD_RM, "sd rm", whyBlocked);
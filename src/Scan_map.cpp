@@ -0,0 +1,280 @@
+#include "Scan_map.h"
+#include "Debug.h"
+#include <SD.h>
+#include <cstdio>
+#include <cstdlib>
+
+DBG_REGISTER_MODULE(__FILE__);
+
+namespace ScanMap {
+
+static String tempPath() {
+  return String(CFG_PATH_SCAN_FILE) + ".tmp";
+}
+
+static String fmtBlocks(uint64_t blocks) {
+  const uint64_t kib = blocks / 2ULL;
+  if (kib >= 10ULL * 1024ULL) return String((unsigned long)(kib / 1024ULL)) + " MiB";
+  return String((unsigned long)kib) + " KiB";
+}
+
+static const char* kindName(char k) {
+  switch (k) {
+    case KIND_ZERO:   return "zero";
+    case KIND_ERASED: return "erased";
+    default:          return "data";
+  }
+}
+
+Kind kindOf(uint32_t crc, uint32_t zeroCrc, uint32_t erasedCrc) {
+  if (crc == zeroCrc) return KIND_ZERO;
+  if (crc == erasedCrc) return KIND_ERASED;
+  return KIND_DATA;
+}
+
+// ------------------------------------------------------------
+// Summary
+// ------------------------------------------------------------
+
+void Summary::add(const Entry& e) {
+  chunks++;
+  if (e.kind == KIND_ZERO) zeroBlocks += e.count;
+  else if (e.kind == KIND_ERASED) erasedBlocks += e.count;
+  else dataBlocks += e.count;
+}
+
+String Summary::text() const {
+  return String((unsigned long)chunks) + " chunks: " + fmtBlocks(dataBlocks) + " data, " +
+         fmtBlocks(zeroBlocks) + " zero, " + fmtBlocks(erasedBlocks) + " erased (0xFF)";
+}
+
+// ------------------------------------------------------------
+// Writer
+// ------------------------------------------------------------
+
+bool Writer::begin(const String& boardId, uint32_t chunkBlocks, String* err) {
+  discard();
+  const String tmp = tempPath();
+  _f = SD.open(tmp.c_str(), FILE_WRITE);
+  if (!_f) {
+    if (err) *err = String("cannot create ") + tmp;
+    return false;
+  }
+  _open = true;
+  char pre[32];
+  snprintf(pre, sizeof(pre), "K2SCAN 1 %lx ", (unsigned long)chunkBlocks);
+  const String head = String(pre) + (boardId.length() ? boardId : String("unknown")) + "\n";
+  if (_f.print(head) != head.length()) {
+    if (err) *err = "SD write failed";
+    discard();
+    return false;
+  }
+  return true;
+}
+
+bool Writer::add(const Entry& e, String* err) {
+  char line[48];
+  const int n = snprintf(line, sizeof(line), "%lx %lx %08lx %c\n", (unsigned long)e.lba,
+                         (unsigned long)e.count, (unsigned long)e.crc, e.kind);
+  if (!_open || _f.write((const uint8_t*)line, (size_t)n) != (size_t)n) {
+    if (err) *err = "SD write failed";
+    return false;
+  }
+  return true;
+}
+
+bool Writer::commit(String* err) {
+  if (!_open) {
+    if (err) *err = "no scan in progress";
+    return false;
+  }
+  _f.flush();
+  _f.close();
+  _open = false;
+
+  if (SD.exists(CFG_PATH_SCAN_PREV_FILE)) SD.remove(CFG_PATH_SCAN_PREV_FILE);
+  if (SD.exists(CFG_PATH_SCAN_FILE)) SD.rename(CFG_PATH_SCAN_FILE, CFG_PATH_SCAN_PREV_FILE);
+  if (!SD.rename(tempPath().c_str(), CFG_PATH_SCAN_FILE)) {
+    if (err) *err = String("cannot rename scan map to ") + CFG_PATH_SCAN_FILE;
+    return false;
+  }
+  return true;
+}
+
+void Writer::discard() {
+  if (!_open) return;
+  _f.close();
+  _open = false;
+  SD.remove(tempPath().c_str());
+}
+
+// ------------------------------------------------------------
+// Reader
+// ------------------------------------------------------------
+
+bool Reader::open(const char* path, String* err) {
+  close();
+  _f = SD.open(path, FILE_READ);
+  if (!_f) {
+    if (err) *err = String("no scan map at ") + path;
+    return false;
+  }
+  _open = true;
+  _bad = false;
+  _read = 0;
+  _len = _pos = 0;
+
+  char line[160];
+  unsigned long chunk = 0;
+  int boardAt = 0;
+  if (!readLine(line, sizeof(line)) || sscanf(line, "K2SCAN 1 %lx %n", &chunk, &boardAt) != 1 || !boardAt) {
+    if (err) *err = String(path) + " is not a scan map";
+    close();
+    return false;
+  }
+  _chunkBlocks = (uint32_t)chunk;
+  _boardId = String(line + boardAt);
+  return true;
+}
+
+void Reader::close() {
+  if (_open) _f.close();
+  _open = false;
+}
+
+float Reader::progress() const {
+  if (!_open || !_f.size()) return 0.0f;
+  return (float)((double)_read / (double)_f.size());
+}
+
+bool Reader::readLine(char* out, size_t outLen) {
+  size_t n = 0;
+  for (;;) {
+    if (_pos == _len) {
+      _len = _f.read((uint8_t*)_buf, sizeof(_buf));
+      _pos = 0;
+      if (!_len) {
+        out[n] = 0;
+        return n > 0;
+      }
+    }
+    const char c = _buf[_pos++];
+    _read++;
+    if (c == '\n') {
+      out[n] = 0;
+      return true;
+    }
+    if (c != '\r' && n + 1 < outLen) out[n++] = c;
+  }
+}
+
+bool Reader::next(Entry& e) {
+  if (!_open || _bad) return false;
+  char line[64];
+  if (!readLine(line, sizeof(line))) return false;
+
+  unsigned long lba = 0, count = 0, crc = 0;
+  char kind = 0;
+  if (sscanf(line, "%lx %lx %lx %c", &lba, &count, &crc, &kind) != 4 || !count) {
+    DBG_PRINTF("[SCAN] bad map line: %s\n", line);
+    _bad = true;
+    return false;
+  }
+  e.lba = (uint32_t)lba;
+  e.count = (uint32_t)count;
+  e.crc = (uint32_t)crc;
+  e.kind = kind;
+  return true;
+}
+
+// ------------------------------------------------------------
+// Diff
+// ------------------------------------------------------------
+
+void Diff::reset() {
+  _chunks = _changed = _missing = 0;
+  _changedBlocks = _missingBlocks = 0;
+  _spanCount = 0;
+  _moreSpans = false;
+}
+
+void Diff::same(const Entry&) {
+  _chunks++;
+}
+
+void Diff::changed(const Entry& e) {
+  _chunks++;
+  _changed++;
+  _changedBlocks += e.count;
+  if (_spanCount && _spans[_spanCount - 1].lba + _spans[_spanCount - 1].count == e.lba) {
+    _spans[_spanCount - 1].count += e.count;
+  } else if (_spanCount < CFG_BACKUP_SCAN_DIFF_SPANS) {
+    _spans[_spanCount++] = Span{e.lba, e.count};
+  } else {
+    _moreSpans = true;
+  }
+}
+
+void Diff::missing(const Entry& e) {
+  _chunks++;
+  _missing++;
+  _missingBlocks += e.count;
+}
+
+String Diff::summary(const char* against) const {
+  String s = String("scan vs ") + against + ": " + String((unsigned long)_chunks) + " chunks, ";
+  if (!_changed) {
+    s += "none changed";
+  } else {
+    s += String((unsigned long)_changed) + " changed (" + fmtBlocks(_changedBlocks) + "):";
+    char buf[40];
+    for (size_t i = 0; i < _spanCount; i++) {
+      snprintf(buf, sizeof(buf), " 0x%lX+0x%lX", (unsigned long)_spans[i].lba, (unsigned long)_spans[i].count);
+      s += buf;
+    }
+    if (_moreSpans) s += " ...";
+  }
+  if (_missing) s += String("; ") + String((unsigned long)_missing) + " not in " + against + " (" + fmtBlocks(_missingBlocks) + ")";
+  return s;
+}
+
+// ------------------------------------------------------------
+// Runs
+// ------------------------------------------------------------
+
+String runsText(const char* path, size_t maxLines) {
+  Reader r;
+  String err;
+  if (!r.open(path, &err)) return err;
+
+  String out;
+  size_t lines = 0;
+  Entry run, e;
+  bool have = false;
+  auto flush = [&]() {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "0x%lX +0x%lX %s (", (unsigned long)run.lba, (unsigned long)run.count,
+             kindName(run.kind));
+    out += String(buf) + fmtBlocks(run.count) + ")\n";
+    lines++;
+  };
+  while (r.next(e)) {
+    if (have && e.kind == run.kind && run.lba + run.count == e.lba) {
+      run.count += e.count;
+      continue;
+    }
+    if (have) {
+      if (lines >= maxLines) { out += "...\n"; have = false; break; }
+      flush();
+    }
+    run = e;
+    have = true;
+  }
+  if (have) flush();
+  if (r.failed()) out += "(map is damaged past this point)\n";
+  if (!out.length()) return "scan map is empty";
+  out.remove(out.length() - 1);
+  return String("board ") + r.boardId() + "\n" + out;
+}
+
+} // namespace ScanMap
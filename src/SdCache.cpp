@@ -5,6 +5,7 @@
 #include <SPI.h>
 #include <SD.h>
 #include <ArduinoJson.h>
+#include <unistd.h>
 
 DBG_REGISTER_MODULE(__FILE__);
 
@@ -12,8 +13,15 @@ DBG_REGISTER_MODULE(__FILE__);
 
 static bool g_mounted = false;
 
+// SD.begin()'s default VFS mount point, for the POSIX calls FS lacks
+static const char* SD_MOUNT = "/sd";
+
 static const char* pathFor(SdItem item) {
-  return (item == SdItem::Backup) ? CFG_PATH_FW_FILE : CFG_PATH_FW_DIR;
+  return (item == SdItem::Backup) ? CFG_PATH_BACKUP_FILE : CFG_PATH_FW_FILE;
+}
+
+static String tempPathFor(SdItem item) {
+  return String(pathFor(item)) + ".tmp";
 }
 
 bool SdCache::begin() {
@@ -90,6 +98,70 @@ File SdCache::openRead(SdItem item) {
   return SD.open(pathFor(item), FILE_READ);
 }
 
+File SdCache::openTemp(SdItem item) {
+  if (!g_mounted) return File();
+  const String tmp = tempPathFor(item);
+  if (SD.exists(tmp.c_str())) SD.remove(tmp.c_str());
+  // "w+" so streaming writers can seek back, patch and re-read.
+  return SD.open(tmp.c_str(), "w+");
+}
+
+bool SdCache::commitTemp(SdItem item) {
+  if (!g_mounted) return false;
+  const char* finalPath = pathFor(item);
+  const String tmp = tempPathFor(item);
+  if (!SD.exists(tmp.c_str())) return false;
+
+  // Unlike writeAtomic's small files, neither side can be made again
+  // cheaply: the old one moves aside until the new one is in place, and a
+  // failed rename keeps both.
+  const String old = String(finalPath) + ".old";
+  if (SD.exists(old.c_str())) SD.remove(old.c_str());
+  const bool hadOld = SD.exists(finalPath);
+  if (hadOld && !SD.rename(finalPath, old.c_str())) return false;
+  if (!SD.rename(tmp.c_str(), finalPath)) {
+    if (hadOld) SD.rename(old.c_str(), finalPath);
+    return false;
+  }
+  if (hadOld) SD.remove(old.c_str());
+  return true;
+}
+
+void SdCache::discardTemp(SdItem item) {
+  if (!g_mounted) return;
+  const String tmp = tempPathFor(item);
+  if (SD.exists(tmp.c_str())) SD.remove(tmp.c_str());
+}
+
+File SdCache::reopenTemp(SdItem item, uint64_t size) {
+  if (!g_mounted) return File();
+  const String tmp = tempPathFor(item);
+  File f = SD.open(tmp.c_str(), "r+");
+  if (!f) return File();
+  const uint64_t have = f.size();
+  if (have == size) return f;
+  f.close();
+  if (have < size) return File();
+
+  // bytes written after the caller's last consistent point
+  if (truncate((String(SD_MOUNT) + tmp).c_str(), (off_t)size) != 0) {
+    DBG_PRINTF("[SD] cannot truncate %s to %llu bytes\n", tmp.c_str(), (unsigned long long)size);
+    return File();
+  }
+  return SD.open(tmp.c_str(), "r+");
+}
+
+uint64_t SdCache::freeBytes() {
+  if (!g_mounted) return 0;
+  const uint64_t total = SD.totalBytes();
+  const uint64_t used  = SD.usedBytes();
+  return (total > used) ? (total - used) : 0;
+}
+
+const char* SdCache::path(SdItem item) {
+  return pathFor(item);
+}
+
 String SdCache::statusJson() {
   JsonDocument d;
   d["mounted"] = g_mounted;
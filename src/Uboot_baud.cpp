@@ -0,0 +1,162 @@
+#include "Uboot_baud.h"
+#include "Debug.h"
+
+DBG_REGISTER_MODULE(__FILE__);
+
+// Fastest first; all are exact divisors of the ESP32 80 MHz APB clock or
+// close enough (< 1 %) for 8N1.
+static const uint32_t kTurboBauds[] = { 1500000, 1000000, 921600, 460800, 230400 };
+static const char* kEchoMarker = "K2_TURBO_OK";
+
+void UBootBaudTurbo::beginUp(HardwareSerial* target, uint32_t maxBaud){
+  _t = target;
+  _orig = _cur = _t ? _t->baudRate() : 0;
+  _maxBaud = maxBaud;
+  _candIdx = 0;
+  _lost = false;
+  _searching = true;
+  _st = St::Done;
+  if (!_t || !_orig) return;
+  if (nextCandidate()) startSwitch(_want, false);
+}
+
+void UBootBaudTurbo::beginDown(){
+  _searching = false;
+  if (!_t || !raised()) { _st = St::Done; return; }
+  startSwitch(_orig, true);
+}
+
+// Picks the next untried baud above the original one; false when none left.
+bool UBootBaudTurbo::nextCandidate(){
+  while (_candIdx < sizeof(kTurboBauds) / sizeof(kTurboBauds[0])) {
+    const uint32_t b = kTurboBauds[_candIdx++];
+    if (b <= _maxBaud && b > _orig) { _want = b; return true; }
+  }
+  return false;
+}
+
+void UBootBaudTurbo::startSwitch(uint32_t baud, bool down){
+  _want = baud;
+  _down = down;
+  _echoTries = 0;
+  _st = St::SendSetenv;
+}
+
+// One switch finished; ok = echo came back at the new baud.
+void UBootBaudTurbo::switchDone(bool ok){
+  if (!_down) {
+    if (ok) { finish(); return; }
+    DBG_PRINTF("[TURBO] %lu baud failed echo probe\n", (unsigned long)_cur);
+    startSwitch(_orig, true);  // undo, then try the next candidate
+    return;
+  }
+  if (!ok) { _lost = true; finish(); return; }
+  if (_searching && nextCandidate()) { startSwitch(_want, false); return; }
+  finish();
+}
+
+void UBootBaudTurbo::finish(){
+  _st = St::Done;
+  DBG_PRINTF("[TURBO] link at %lu baud%s\n", (unsigned long)_cur, _lost ? " (unconfirmed)" : "");
+}
+
+void UBootBaudTurbo::feed(const uint8_t* data, size_t len){
+  if (!running() || !data) return;
+  for (size_t i = 0; i < len; i++){
+    char c = (char)data[i];
+    if (c == '\r') continue;
+    if (c == '\n') {
+      _line[_len] = 0;
+      if (_len) parseLine();
+      _len = 0;
+      continue;
+    }
+    if (_len < LINE_MAX - 1) _line[_len++] = c;
+  }
+}
+
+void UBootBaudTurbo::parseLine(){
+  if (strstr(_line, "## Switch baudrate")) _switchSeen = true;
+  else if (strstr(_line, "not supported")) _unsupported = true;
+  // the typed command is echoed as "=> echo K2_TURBO_OK"; only the output
+  // line is the bare marker
+  else if (strcmp(_line, kEchoMarker) == 0) _echoSeen = true;
+}
+
+bool UBootBaudTurbo::tick(){
+  if (_st == St::Idle) return false;
+  if (_st == St::Done) return true;
+
+  const uint32_t now = millis();
+  const bool timedOut = (int32_t)(now - _deadlineMs) > 0;
+
+  switch (_st) {
+    case St::SendSetenv: {
+      _switchSeen = _unsupported = false;
+      _len = 0;
+      char cmd[48];
+      snprintf(cmd, sizeof(cmd), "setenv baudrate %lu", (unsigned long)_want);
+      _t->print(cmd); _t->print("\n");
+      _deadlineMs = now + 1500;
+      _st = St::WaitSwitch;
+    } break;
+
+    case St::WaitSwitch: {
+      if (_unsupported && !_down) {
+        // U-Boot refused this rate and stayed where it was
+        if (nextCandidate()) startSwitch(_want, false);
+        else finish();
+      } else if (_switchSeen || timedOut) {
+        // without the banner we can't tell whether U-Boot switched, so
+        // switch anyway and let the echo probe decide
+        _switchMs = now;
+        _st = St::Switch;
+      }
+    } break;
+
+    case St::Switch: {
+      // U-Boot: udelay(50000); serial_setbrg(); udelay(50000); then waits for CR
+      if (now - _switchMs < 120) break;
+      _t->flush();
+      _t->updateBaudRate(_want);
+      _cur = _want;
+      delay(2);
+      _t->print("\r");
+      _switchMs = now;
+      _st = St::SendEcho;
+    } break;
+
+    case St::SendEcho: {
+      if (now - _switchMs < 50) break;
+      _echoSeen = false;
+      _len = 0;
+      _t->print("echo "); _t->print(kEchoMarker); _t->print("\n");
+      _deadlineMs = now + 800;
+      _st = St::WaitEcho;
+    } break;
+
+    case St::WaitEcho: {
+      if (_echoSeen) { switchDone(true); break; }
+      if (!timedOut) break;
+      if (++_echoTries < 2) { _switchMs = now - 50; _st = St::SendEcho; break; }
+      switchDone(false);
+    } break;
+
+    default: break;
+  }
+  return _st == St::Done;
+}
+
+void UBootBaudTurbo::revertNow(){
+  if (!_t || !raised()) return;
+  char cmd[48];
+  snprintf(cmd, sizeof(cmd), "setenv baudrate %lu", (unsigned long)_orig);
+  _t->print(cmd); _t->print("\n");
+  _t->flush();
+  delay(150);
+  _t->updateBaudRate(_orig);
+  _cur = _orig;
+  delay(2);
+  _t->print("\r");
+  _st = St::Done;
+}
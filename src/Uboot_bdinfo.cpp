@@ -0,0 +1,90 @@
+#include "Uboot_bdinfo.h"
+#include "Debug.h"
+
+DBG_REGISTER_MODULE(__FILE__);
+
+void UBootRamInfo::reset(){
+  _len = 0;
+  _bankCount = 0;
+  _bankOpen = false;
+  _relocAddr = 0;
+  _spStart = 0;
+}
+
+void UBootRamInfo::feed(const uint8_t* data, size_t len){
+  if (!data || !len) return;
+
+  for (size_t i = 0; i < len; i++){
+    char c = (char)data[i];
+    if (c == '\r') continue;
+
+    if (c == '\n'){
+      _line[_len] = 0;
+      if (_len) parseLine();
+      _len = 0;
+      continue;
+    }
+
+    if (_len < LINE_MAX - 1) _line[_len++] = c;
+  }
+}
+
+// "key   = 0x1234" -> key (trimmed) and value; false for anything else.
+static bool splitKeyHex(char* line, const char*& key, uint64_t& val){
+  char* eq = strchr(line, '=');
+  if (!eq) return false;
+
+  char* end = eq;
+  while (end > line && end[-1] == ' ') end--;
+  *end = 0;
+  key = line;
+
+  const char* p = eq + 1;
+  while (*p == ' ') p++;
+  if (p[0] != '0' || (p[1] != 'x' && p[1] != 'X')) return false;
+  char* stop = nullptr;
+  val = strtoull(p + 2, &stop, 16);
+  return stop != p + 2;
+}
+
+void UBootRamInfo::parseLine(){
+  const char* key = nullptr;
+  uint64_t v = 0;
+  if (!splitKeyHex(_line, key, v)) return;
+
+  if (!strcmp(key, "-> start") || !strcmp(key, "memstart")) {
+    if (_bankCount < MAX_BANKS) {
+      _banks[_bankCount].start = v;
+      _bankOpen = true;
+    }
+  } else if ((!strcmp(key, "-> size") || !strcmp(key, "memsize")) && _bankOpen) {
+    _banks[_bankCount].size = v;
+    _bankCount++;
+    _bankOpen = false;
+  } else if (!strcmp(key, "relocaddr")) {
+    _relocAddr = v;
+  } else if (!strcmp(key, "sp start")) {
+    _spStart = v;
+  }
+}
+
+uint64_t UBootRamInfo::roomAbove(uint64_t addr) const {
+  // U-Boot relocates itself to the top of RAM with heap and stack below it,
+  // so without one of these guards the bank end is not a safe limit.
+  uint64_t end = 0;
+  const uint64_t guards[2] = { _spStart, _relocAddr };
+  for (uint64_t g : guards) {
+    if (g <= addr + STACK_MARGIN) continue;
+    if (!end || g - STACK_MARGIN < end) end = g - STACK_MARGIN;
+  }
+  if (!end) return 0;
+
+  for (size_t i = 0; i < _bankCount; i++) {
+    const Bank& b = _banks[i];
+    if (b.size && addr >= b.start && addr - b.start < b.size) {
+      if (b.start + b.size < end) end = b.start + b.size;
+      break;
+    }
+  }
+  return end - addr;
+}
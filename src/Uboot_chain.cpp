@@ -0,0 +1,63 @@
+#include "Uboot_chain.h"
+#include "Debug.h"
+
+DBG_REGISTER_MODULE(__FILE__);
+
+void UBootChainReply::begin(uint8_t parts){
+  _parts = parts;
+  _len = 0;
+  _mmcDone = false;
+  _mmcOk = false;
+  _mmcWriteDone = false;
+  _mmcWriteOk = false;
+  _crc.reset();
+}
+
+bool UBootChainReply::headerDone() const {
+  if ((_parts & PART_MMC_WRITE) && !_mmcWriteDone) return false;
+  if ((_parts & PART_MMC) && !_mmcDone) return false;
+  if ((_parts & PART_CRC) && !_crc.haveResult() && !_crc.unsupported()) return false;
+  return true;
+}
+
+size_t UBootChainReply::feed(const uint8_t* data, size_t len){
+  if (!data || !len) return 0;
+  if (headerDone()) return (_parts & PART_MD) ? 0 : len;
+
+  for (size_t i = 0; i < len; i++){
+    char c = (char)data[i];
+    if (c == '\r') continue;
+
+    if (c == '\n'){
+      _line[_len] = 0;
+      if (_len) parseLine();
+      _len = 0;
+      if (headerDone()) return (_parts & PART_MD) ? i + 1 : len;
+      continue;
+    }
+
+    if (_len < LINE_MAX - 1) _line[_len++] = c;
+  }
+  return len;
+}
+
+void UBootChainReply::parseLine(){
+  // MMC write: dev # 0, block # 2048, count 64 ... 64 blocks written: OK
+  const char* w = strstr(_line, "blocks written:");
+  if (w && (_parts & PART_MMC_WRITE)) {
+    _mmcWriteDone = true;
+    _mmcWriteOk = strstr(w, "OK") != nullptr;
+    return;
+  }
+  // MMC read: dev # 0, block # 2048, count 64 ... 64 blocks read: OK
+  const char* p = strstr(_line, "blocks read:");
+  if (p && (_parts & PART_MMC)) {
+    _mmcDone = true;
+    _mmcOk = strstr(p, "OK") != nullptr;
+    return;
+  }
+  if (_parts & PART_CRC) {
+    _crc.feed((const uint8_t*)_line, _len);
+    _crc.feed((const uint8_t*)"\n", 1);
+  }
+}
@@ -0,0 +1,61 @@
+#include "Uboot_crc.h"
+#include "Debug.h"
+
+DBG_REGISTER_MODULE(__FILE__);
+
+static int hexval(char c){
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return 10 + (c - 'a');
+  if (c >= 'A' && c <= 'F') return 10 + (c - 'A');
+  return -1;
+}
+
+void UBootCrcReply::reset(){
+  _len = 0;
+  _have = false;
+  _crc = 0;
+  _unsupported = false;
+}
+
+void UBootCrcReply::feed(const uint8_t* data, size_t len){
+  if (!data || !len) return;
+
+  for (size_t i = 0; i < len; i++){
+    char c = (char)data[i];
+    if (c == '\r') continue;
+
+    if (c == '\n'){
+      _line[_len] = 0;
+      if (_len) parseLine();
+      _len = 0;
+      continue;
+    }
+
+    // Long lines (md output, banners) are irrelevant; keep the head only.
+    if (_len < LINE_MAX - 1) _line[_len++] = c;
+  }
+}
+
+void UBootCrcReply::parseLine(){
+  if (strstr(_line, "Unknown command")) {
+    _unsupported = true;
+    return;
+  }
+
+  const char* p = strstr(_line, "==>");
+  if (!p) return;
+  p += 3;
+  while (*p == ' ') p++;
+
+  uint32_t v = 0;
+  int n = 0;
+  for (; n < 8; n++) {
+    int h = hexval(p[n]);
+    if (h < 0) break;
+    v = (v << 4) | (uint32_t)h;
+  }
+  if (n != 8) return;
+
+  _crc = v;
+  _have = true;
+}
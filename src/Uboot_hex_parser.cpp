@@ -1,79 +1,206 @@
 #include "Uboot_hex_parser.h"
-#include "Debug.h"
+#include "Crc32.h"
 
+#ifdef ARDUINO
+#include "Debug.h"
 DBG_REGISTER_MODULE(__FILE__);
-
-static int hexval(char c){
-  if (c >= '0' && c <= '9') return c - '0';
-  if (c >= 'a' && c <= 'f') return 10 + (c - 'a');
-  if (c >= 'A' && c <= 'F') return 10 + (c - 'A');
-  return -1;
-}
+#endif
+
+// -1 = not a hex digit
+static const int8_t kNibble[256] = {
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+   0, 1, 2, 3, 4, 5, 6, 7, 8, 9,-1,-1,-1,-1,-1,-1,
+  -1,10,11,12,13,14,15,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,10,11,12,13,14,15,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+};
 
 void UBootHexParser::reset(){
-  _lineBuf = "";
-  _pending.clear();
-  _pending.shrink_to_fit(); // optional: remove if you want to keep capacity
+  _st = St::Addr;
+  _nibbles = 0;
+  _lineAddr = 0;
+  _lineBytes = 0;
+  _lineLead = false;
 }
 
-void UBootHexParser::feed(const uint8_t* data, size_t len){
-  if (!data || !len) return;
+void UBootHexParser::beginWindow(uint64_t base, size_t len){
+  reset();
+  _windowed = true;
+  _baseKnown = (base != BASE_FROM_FIRST_LINE);
+  _base = _baseKnown ? base : 0;
+  _winLen = len;
+  _next = _base;
+  _end = _base + len;
+  _gapCount = 0;
+  _gapOverflow = false;
+}
 
-  for (size_t i = 0; i < len; i++){
-    char c = (char)data[i];
-    if (c == '\r') continue;
+void UBootHexParser::expectRange(uint64_t addr, size_t len){
+  reset();
+  _next = addr;
+  _end = addr + len;
+  _inOrder = false;
+}
 
-    if (c == '\n'){
-      if (_lineBuf.length() > 0) {
-        parseLine(_lineBuf);
-      }
-      _lineBuf = "";
-      continue;
-    }
+void UBootHexParser::closeStream(){
+  if (_windowed && _baseKnown && _next < _end) addGap(_next, _end);
+  _next = _end;
+}
 
-    // Use project-wide limit from appconfig.h
-    if (_lineBuf.length() < CMD_LINEBUF_MAX) {
-      _lineBuf += c;
-    }
+void UBootHexParser::addGap(uint64_t addr, uint64_t end){
+  _inOrder = false;
+  if (end <= addr) return;
+  if (_gapCount && _gaps[_gapCount - 1].addr + _gaps[_gapCount - 1].len == addr) {
+    _gaps[_gapCount - 1].len += (uint32_t)(end - addr);
+    return;
   }
+  if (_gapCount >= MAX_GAPS) { _gapOverflow = true; return; }
+  _gaps[_gapCount].addr = addr;
+  _gaps[_gapCount].len = (uint32_t)(end - addr);
+  _gapCount++;
 }
 
-bool UBootHexParser::parseLine(const String& line){
-  // Find "ADDR:" prefix
-  int colon = line.indexOf(':');
-  if (colon < 0) return false;
+bool UBootHexParser::takeGap(Gap& g){
+  if (!_gapCount) return false;
+  g = _gaps[0];
+  for (size_t i = 1; i < _gapCount; i++) _gaps[i - 1] = _gaps[i];
+  _gapCount--;
+  return true;
+}
 
-  // After colon, parse hex byte pairs separated by spaces
-  int i = colon + 1;
+// Called at "ADDR:"; false = ignore this line.
+bool UBootHexParser::lineStart(){
+  _lastLineAddr = _lineAddr;
+  _lineBytes = 0;
+  _lineLead = true;
+  if (!_windowed) return true;
+
+  if (!_baseKnown) {
+    _base = _lineAddr;
+    _next = _base;
+    _end = _base + _winLen;
+    _baseKnown = true;
+  }
+  if (_lineAddr < _base || _lineAddr >= _base + _winLen) return false;
 
-  while (i < (int)line.length()){
-    // skip spaces
-    while (i < (int)line.length() && line[i] == ' ') i++;
-    if (i + 1 >= (int)line.length()) break;
+  if (_lineAddr > _next && _next < _end) {
+    addGap(_next, _lineAddr < _end ? _lineAddr : _end);
+  }
+  if (_lineAddr >= _next) _next = _lineAddr;
+  else { _lineLead = false; _inOrder = false; }  // fills an earlier hole
+  return true;
+}
 
-    int h1 = hexval(line[i]);
-    int h2 = hexval(line[i + 1]);
+void UBootHexParser::setWordWidth(uint8_t width, bool bigEndian){
+  if (width != 1 && width != 2 && width != 4 && width != 8) width = 1;
+  _width = width;
+  _bigEndian = bigEndian;
+  reset();
+}
 
-    if (h1 < 0 || h2 < 0) {
-      // Stop at ASCII region (or any non-hex)
-      break;
-    }
+char UBootHexParser::mdSuffix(uint8_t width){
+  switch (width) {
+    case 2: return 'w';
+    case 4: return 'l';
+    case 8: return 'q';
+    default: return 'b';
+  }
+}
 
-    uint8_t b = (uint8_t)((h1 << 4) | h2);
-    _pending.push_back(b);
+// _word[] holds the printed value most-significant byte first.
+// seqPos: where the next byte goes when no window is set.
+size_t UBootHexParser::emitWord(uint8_t* out, size_t outCap, size_t seqPos){
+  const uint64_t pos = _windowed ? (_lineAddr - _base + _lineBytes) : seqPos;
+  _lineBytes += _width;
+  if (_windowed && _lineLead) _next = _lineAddr + _lineBytes;
+
+  if (pos >= outCap) return 0;
+  size_t n = (outCap - pos) < _width ? (size_t)(outCap - pos) : _width;
+  for (size_t k = 0; k < n; k++) {
+    uint8_t b = _bigEndian ? _word[k] : _word[_width - 1 - k];
+    if (out) out[pos + k] = b;
+    if (_crcOn && _inOrder) _crc = Crc32::step(_crc, b);
+  }
+  return n;
+}
 
-    i += 2;
+// print_buffer() emits "%08lx:", then " %0*x" per word, then "    " + ASCII.
+// So a word is exactly one space + 2*width hex digits; a wider gap or a
+// token of another length means the ASCII column (or junk) has started and
+// the rest of the line is ignored.
+size_t UBootHexParser::feed(const uint8_t* data, size_t len, uint8_t* out, size_t outCap){
+  if (!data || !len) return 0;
 
-    // Skip until next space or end (handles "01", "01 " and also weird separators)
-    while (i < (int)line.length() && line[i] != ' ') i++;
-  }
+  const uint8_t digits = (uint8_t)(2 * _width);
+  size_t got = 0;
 
-  return true;
-}
+  for (size_t i = 0; i < len; i++){
+    const uint8_t c = data[i];
 
-bool UBootHexParser::popBytes(std::vector<uint8_t>& out){
-  if (_pending.empty()) return false;
-  out = std::move(_pending);
-  _pending.clear();
-  return true;
+    if (c == '\n') {
+      // a word ending the line (no ASCII column) still counts
+      if (_st == St::Digit && _nibbles == digits) {
+        got += emitWord(out, outCap, got);
+      }
+      _st = St::Addr;
+      _nibbles = 0;
+      _lineAddr = 0;
+      continue;
+    }
+    if (c == '\r') continue;
+
+    switch (_st) {
+      case St::Addr:
+        // only "<hex address>:" lines are dump lines
+        if (c == ':' && _nibbles) _st = lineStart() ? St::Sep : St::Skip;
+        else if (kNibble[c] >= 0 && _nibbles < 16) { _lineAddr = (_lineAddr << 4) | (uint64_t)kNibble[c]; _nibbles++; }
+        else _st = St::Skip;
+        break;
+
+      case St::Sep:
+        _nibbles = 0;
+        _st = (c == ' ') ? St::Digit : St::Skip;
+        break;
+
+      case St::AfterWord:
+        // one space already consumed; a second one is the ASCII gap
+        if (c == ' ') { _st = St::Skip; break; }
+        _nibbles = 0;
+        _st = St::Digit;
+        // c is the first digit of the next word
+        // fall through
+      case St::Digit: {
+        if (c == ' ') {
+          if (_nibbles == digits) {
+            got += emitWord(out, outCap, got);
+            _st = St::AfterWord;
+          } else {
+            _st = St::Skip;  // "  " gap or short token
+          }
+          break;
+        }
+        const int8_t v = kNibble[c];
+        if (v < 0 || _nibbles >= digits) { _st = St::Skip; break; }
+        if (_nibbles & 1) _word[_nibbles >> 1] = (uint8_t)(_word[_nibbles >> 1] | (uint8_t)v);
+        else _word[_nibbles >> 1] = (uint8_t)(v << 4);
+        _nibbles++;
+      } break;
+
+      case St::Skip:
+      default:
+        break;
+    }
+  }
+  return got;
 }
@@ -0,0 +1,137 @@
+#include "Uboot_md_probe.h"
+#include "Debug.h"
+
+DBG_REGISTER_MODULE(__FILE__);
+
+static const uint8_t kTryWidths[] = { 8, 4, 2 };
+
+void UBootMdProbe::start(HardwareSerial* target){
+  _t = target;
+  _last1 = '\n';
+  _last2 = 0;
+  _promptCount = 0;
+  _cmdPromptMark = 0;
+  _gotLen = 0;
+  _width = 1;
+  _bigEndian = false;
+  _haveLoadAddr = false;
+  _loadAddr = 0;
+  _tryIdx = 0;
+  _hiWritten = false;
+  _st = St::SendMw;
+}
+
+void UBootMdProbe::feed(const uint8_t* data, size_t len){
+  if (!running()) return;
+  for (size_t i = 0; i < len; i++){
+    // prompts start a line; md's ASCII column may hold "=>" too
+    if (data[i] == '>' && _last1 == '=' && (_last2 == '\n' || _last2 == '\r')) _promptCount++;
+    _last2 = _last1;
+    _last1 = data[i];
+  }
+
+  if (_st == St::WaitMdB || _st == St::WaitMdW) {
+    _gotLen += _hex.feed(data, len, _got + _gotLen, PROBE_BYTES - _gotLen);
+  }
+}
+
+void UBootMdProbe::send(const char* cmd, St next){
+  _gotLen = 0;
+  _cmdPromptMark = _promptCount;
+  if (_t) { _t->print(cmd); _t->print("\n"); }
+  _st = next;
+  _deadlineMs = millis() + 3000;
+}
+
+void UBootMdProbe::finish(uint8_t width){
+  _width = width;
+  _st = St::Done;
+  DBG_PRINTF("[MDPROBE] using md.%c (%s-endian)\n",
+             UBootHexParser::mdSuffix(_width), _bigEndian ? "big" : "little");
+}
+
+bool UBootMdProbe::tick(){
+  if (_st == St::Idle) return false;
+  if (_st == St::Done) return true;
+
+  const bool replied = (_promptCount != _cmdPromptMark);
+  const bool timedOut = (int32_t)(millis() - _deadlineMs) > 0;
+
+  switch (_st) {
+    case St::SendMw:
+      send("mw.l ${loadaddr} 0x04030201 4", St::WaitMw);
+      break;
+
+    case St::WaitMw:
+      if (timedOut) { finish(1); break; }
+      if (replied) _st = St::SendMdB;
+      break;
+
+    case St::SendMdB:
+      _hex.reset();
+      _hex.setWordWidth(1);
+      send("md.b ${loadaddr} 0x10", St::WaitMdB);
+      break;
+
+    case St::WaitMdB: {
+      if (timedOut) { finish(1); break; }
+      if (!replied) break;
+
+      static const uint8_t le[8] = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08 };
+      static const uint8_t be[8] = { 0x04, 0x03, 0x02, 0x01, 0x08, 0x07, 0x06, 0x05 };
+      if (_gotLen < PROBE_BYTES) { finish(1); break; }
+      if (_hiWritten) {
+        // both longs as written, else a swapped md.q half would go unseen
+        if (memcmp(_got, _bigEndian ? be : le, 8) != 0) { finish(1); break; }
+        memcpy(_ref, _got, PROBE_BYTES);
+        _st = St::SendMdW;
+        break;
+      }
+      _loadAddr = _hex.lastLineAddr();
+      _haveLoadAddr = true;
+      if (memcmp(_got, le, 4) == 0) _bigEndian = false;
+      else if (memcmp(_got, be, 4) == 0) _bigEndian = true;
+      else { finish(1); break; }  // mw failed: stay on md.b
+      _st = St::SendMwHi;
+    } break;
+
+    case St::SendMwHi: {
+      char cmd[48];
+      snprintf(cmd, sizeof(cmd), "mw.l 0x%llX 0x08070605 1", (unsigned long long)(_loadAddr + 4));
+      send(cmd, St::WaitMwHi);
+    } break;
+
+    case St::WaitMwHi:
+      if (timedOut) { finish(1); break; }
+      if (replied) {
+        _hiWritten = true;
+        _st = St::SendMdB;
+      }
+      break;
+
+    case St::SendMdW: {
+      if (_tryIdx >= sizeof(kTryWidths)) { finish(1); break; }
+      const uint8_t w = kTryWidths[_tryIdx];
+      _hex.reset();
+      _hex.setWordWidth(w, _bigEndian);
+      char cmd[48];
+      snprintf(cmd, sizeof(cmd), "md.%c ${loadaddr} 0x%X",
+               UBootHexParser::mdSuffix(w), (unsigned)(PROBE_BYTES / w));
+      send(cmd, St::WaitMdW);
+    } break;
+
+    case St::WaitMdW: {
+      // unsupported widths print usage (no hex) or nothing at all
+      if (!replied && !timedOut) break;
+      if (_gotLen >= PROBE_BYTES && memcmp(_got, _ref, PROBE_BYTES) == 0) {
+        finish(kTryWidths[_tryIdx]);
+        break;
+      }
+      _tryIdx++;
+      _st = St::SendMdW;
+    } break;
+
+    default: break;
+  }
+  return _st == St::Done;
+}
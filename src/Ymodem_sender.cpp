@@ -0,0 +1,277 @@
+#include "Ymodem_sender.h"
+#include "AppConfig.h"
+#include "Debug.h"
+
+DBG_REGISTER_MODULE(__FILE__);
+
+static constexpr uint8_t SOH = 0x01;
+static constexpr uint8_t STX = 0x02;
+static constexpr uint8_t EOT = 0x04;
+static constexpr uint8_t ACK = 0x06;
+static constexpr uint8_t NAK = 0x15;
+static constexpr uint8_t CAN = 0x18;
+static constexpr uint8_t PAD = 0x1A;
+
+static constexpr uint32_t START_MS = 15000;   // loady prints its banner, then polls 'C'
+static constexpr uint32_t ACK_MS = 3000;
+static constexpr uint32_t NEXT_C_MS = 1000;   // 'C' after block 0 / EOT is optional
+static constexpr uint8_t MAX_TRIES = 10;
+// U-Boot's xyzModem gives up after 3 CANs in a row
+static constexpr uint8_t CAN_SENT = 5;
+
+static_assert(CFG_YMODEM_STAGE_BYTES % 1024 == 0, "YMODEM stages hold whole 1K blocks");
+
+struct Crc16Table { uint16_t t[256]; };
+
+static constexpr Crc16Table makeCrc16() {
+  Crc16Table r{};
+  for (uint32_t i = 0; i < 256; i++) {
+    uint16_t c = (uint16_t)(i << 8);
+    for (int k = 0; k < 8; k++) c = (c & 0x8000u) ? (uint16_t)((c << 1) ^ 0x1021u) : (uint16_t)(c << 1);
+    r.t[i] = c;
+  }
+  return r;
+}
+
+static constexpr Crc16Table CRC16 = makeCrc16();
+
+uint16_t YmodemSender::crc16(const uint8_t* data, size_t len, uint16_t crc){
+  uint16_t c = crc;
+  for (size_t i = 0; i < len; i++) c = (uint16_t)((c << 8) ^ CRC16.t[((c >> 8) ^ data[i]) & 0xFFu]);
+  return c;
+}
+
+void YmodemSender::begin(HardwareSerial* target, const char* name, uint64_t size, ReadFn read, void* ctx){
+  _t = target;
+  _name = name ? name : "";
+  _size = size;
+  _read = read;
+  _ctx = ctx;
+  _acked = 0;
+  _seq = 0;
+  _started = false;
+  _err = "";
+  _prev = 0;
+  _nextFill = 0;
+  for (int s = 0; s < 2; s++) {
+    _stage[s].resize(CFG_YMODEM_STAGE_BYTES);
+    _stageOff[s] = 0;
+    _stageLen[s] = 0;
+  }
+  expect(St::WaitC, START_MS);
+}
+
+void YmodemSender::expect(St st, uint32_t ms){
+  _st = st;
+  _deadlineMs = millis() + ms;
+}
+
+void YmodemSender::fail(const String& why){
+  if (_st == St::Done || _st == St::Failed) return;
+  if (_started && _t) {
+    uint8_t can[CAN_SENT];
+    memset(can, CAN, sizeof(can));
+    _t->write(can, sizeof(can));
+  }
+  _err = why;
+  _st = St::Failed;
+  DBG_PRINTF("[YMODEM] %s (%llu/%llu bytes)\n", _err.c_str(),
+             (unsigned long long)_acked, (unsigned long long)_size);
+}
+
+void YmodemSender::cancel(const char* why){
+  fail(why);
+}
+
+// ------------------------------------------------------------
+// Staging (double buffer)
+// ------------------------------------------------------------
+
+// Stage k (CFG_YMODEM_STAGE_BYTES each) always lives in slot k & 1.
+bool YmodemSender::fillSlot(int s){
+  const uint64_t off = _nextFill;
+  const uint64_t left = _size - off;
+  const size_t n = left < CFG_YMODEM_STAGE_BYTES ? (size_t)left : (size_t)CFG_YMODEM_STAGE_BYTES;
+  if (!_read || !_read(_ctx, off, _stage[s].data(), n)) {
+    _stageLen[s] = 0;
+    return false;
+  }
+  _stageOff[s] = off;
+  _stageLen[s] = n;
+  _nextFill = off + n;
+  return true;
+}
+
+// The stage after the one in flight, read while the receiver works.
+void YmodemSender::prefetch(){
+  if (_nextFill >= _size || _nextFill > _acked + CFG_YMODEM_STAGE_BYTES) return;
+  const int s = (int)((_nextFill / CFG_YMODEM_STAGE_BYTES) & 1u);
+  if (_stageLen[s] && _stageOff[s] + _stageLen[s] > _acked) return;  // still in use
+  if (!fillSlot(s)) fail("payload read failed");
+}
+
+const uint8_t* YmodemSender::payloadAt(uint64_t off){
+  const int s = (int)((off / CFG_YMODEM_STAGE_BYTES) & 1u);
+  if (!_stageLen[s] || off < _stageOff[s] || off >= _stageOff[s] + _stageLen[s]) {
+    // prefetch hasn't caught up (or the first stage): read it now
+    _nextFill = off - (off % CFG_YMODEM_STAGE_BYTES);
+    if (!fillSlot(s)) return nullptr;
+  }
+  return _stage[s].data() + (size_t)(off - _stageOff[s]);
+}
+
+// ------------------------------------------------------------
+// Packets
+// ------------------------------------------------------------
+
+// Block 0: "name\0size\0" opens the file; all zeros ends the batch.
+void YmodemSender::sendHeader(bool last){
+  memset(_pkt, 0, 3 + 128 + 2);
+  _pkt[0] = SOH;
+  _pkt[1] = 0x00;
+  _pkt[2] = 0xFF;
+  if (!last) {
+    char* p = (char*)_pkt + 3;
+    const size_t nameLen = _name.length() < 100 ? _name.length() : 100;
+    memcpy(p, _name.c_str(), nameLen);
+    snprintf(p + nameLen + 1, 128 - nameLen - 1, "%llu", (unsigned long long)_size);
+  }
+  const uint16_t crc = crc16(_pkt + 3, 128);
+  _pkt[3 + 128] = (uint8_t)(crc >> 8);
+  _pkt[3 + 128 + 1] = (uint8_t)crc;
+  _pktLen = 3 + 128 + 2;
+  _tries = 1;
+  _t->write(_pkt, _pktLen);
+  expect(last ? St::WaitEndAck : St::WaitHdrAck, last ? NEXT_C_MS : ACK_MS);
+}
+
+bool YmodemSender::sendData(){
+  const uint8_t* src = payloadAt(_acked);
+  if (!src) {
+    fail("payload read failed");
+    return false;
+  }
+  const uint64_t left = _size - _acked;
+  const size_t n = left < BLOCK ? (size_t)left : BLOCK;
+  _pkt[0] = STX;
+  _pkt[1] = _seq;
+  _pkt[2] = (uint8_t)~_seq;
+  memcpy(_pkt + 3, src, n);
+  if (n < BLOCK) memset(_pkt + 3 + n, PAD, BLOCK - n);
+  const uint16_t crc = crc16(_pkt + 3, BLOCK);
+  _pkt[3 + BLOCK] = (uint8_t)(crc >> 8);
+  _pkt[3 + BLOCK + 1] = (uint8_t)crc;
+  _pktLen = sizeof(_pkt);
+  _tries = 1;
+  _t->write(_pkt, _pktLen);
+  expect(St::WaitDataAck, ACK_MS);
+  return true;
+}
+
+void YmodemSender::sendEot(){
+  _pkt[0] = EOT;
+  _pktLen = 1;
+  _tries = 1;
+  _t->write(_pkt, _pktLen);
+  expect(St::WaitEotAck, ACK_MS);
+}
+
+void YmodemSender::resend(){
+  if (++_tries > MAX_TRIES) {
+    char why[64];
+    snprintf(why, sizeof(why), "no ACK after %u tries at byte %llu", (unsigned)MAX_TRIES,
+             (unsigned long long)_acked);
+    fail(why);
+    return;
+  }
+  _t->write(_pkt, _pktLen);
+  _deadlineMs = millis() + ACK_MS;
+}
+
+// ------------------------------------------------------------
+// Receiver replies
+// ------------------------------------------------------------
+
+void YmodemSender::feed(const uint8_t* data, size_t len){
+  for (size_t i = 0; i < len && running(); i++) onByte(data[i]);
+}
+
+void YmodemSender::onByte(uint8_t c){
+  const uint8_t prev = _prev;
+  _prev = c;
+
+  // CAN CAN from the receiver aborts (a lone CAN may be line noise)
+  if (c == CAN && prev == CAN && _started) {
+    _err = "receiver cancelled";
+    _st = St::Failed;
+    return;
+  }
+
+  switch (_st) {
+    case St::WaitC:
+      // loady's banner is text; its 'C' polls stand alone
+      if (c == 'C' && !isalnum(prev)) {
+        _started = true;
+        sendHeader(false);
+      }
+      break;
+
+    case St::WaitHdrAck:
+      if (c == ACK) {
+        _seq = 1;
+        if (!_size) sendEot();
+        else expect(St::WaitDataC, NEXT_C_MS);
+      } else if (c == NAK) {
+        resend();
+      }
+      break;
+
+    case St::WaitDataC:
+      if (c == 'C' || c == NAK) sendData();
+      break;
+
+    case St::WaitDataAck:
+      if (c == ACK) {
+        const uint64_t left = _size - _acked;
+        _acked += left < BLOCK ? left : BLOCK;
+        _seq++;
+        if (_acked >= _size) sendEot();
+        else sendData();
+      } else if (c == NAK) {
+        resend();
+      }
+      break;
+
+    case St::WaitEotAck:
+      if (c == ACK) expect(St::WaitEndC, NEXT_C_MS);
+      else if (c == NAK) resend();
+      break;
+
+    case St::WaitEndC:
+      if (c == 'C') sendHeader(true);
+      break;
+
+    case St::WaitEndAck:
+      if (c == ACK) _st = St::Done;
+      break;
+
+    default: break;
+  }
+}
+
+bool YmodemSender::tick(){
+  if (!running()) return _st != St::Idle;
+
+  if ((int32_t)(millis() - _deadlineMs) > 0) {
+    switch (_st) {
+      case St::WaitC:       fail("no 'C' from the receiver (loady not running?)"); break;
+      case St::WaitDataC:   sendData(); break;  // receiver that doesn't repeat 'C'
+      case St::WaitEndC:
+      case St::WaitEndAck:  _st = St::Done; break;  // the file is in; end of batch is courtesy
+      default:              resend(); break;
+    }
+  } else if (_st == St::WaitDataAck || _st == St::WaitDataC) {
+    prefetch();
+  }
+  return !running();
+}
@@ -0,0 +1,881 @@
+#include "Zmodem.h"
+#include "AppConfig.h"
+#include "Crc32.h"
+#include "Debug.h"
+#include "Ymodem_sender.h"
+
+DBG_REGISTER_MODULE(__FILE__);
+
+// Framing
+static constexpr uint8_t ZPAD = '*';
+static constexpr uint8_t ZDLE = 0x18;   // also CAN
+static constexpr uint8_t ZBIN = 'A';
+static constexpr uint8_t ZHEX = 'B';
+static constexpr uint8_t ZBIN32 = 'C';
+static constexpr uint8_t XON = 0x11;
+static constexpr uint8_t XOFF = 0x13;
+
+// Subpacket ends (after ZDLE)
+static constexpr uint8_t ZCRCE = 'h';   // frame ends, header follows
+static constexpr uint8_t ZCRCG = 'i';   // frame continues
+static constexpr uint8_t ZCRCQ = 'j';   // frame continues, ZACK expected
+static constexpr uint8_t ZCRCW = 'k';   // frame ends, ZACK expected
+static constexpr uint8_t ZRUB0 = 'l';   // 0x7F
+static constexpr uint8_t ZRUB1 = 'm';   // 0xFF
+
+// Frame types
+static constexpr uint8_t ZRQINIT = 0;
+static constexpr uint8_t ZRINIT = 1;
+static constexpr uint8_t ZSINIT = 2;
+static constexpr uint8_t ZACK = 3;
+static constexpr uint8_t ZFILE = 4;
+static constexpr uint8_t ZSKIP = 5;
+static constexpr uint8_t ZNAK = 6;
+static constexpr uint8_t ZABORT = 7;
+static constexpr uint8_t ZFIN = 8;
+static constexpr uint8_t ZRPOS = 9;
+static constexpr uint8_t ZDATA = 10;
+static constexpr uint8_t ZEOF = 11;
+static constexpr uint8_t ZFERR = 12;
+static constexpr uint8_t ZCRC = 13;
+static constexpr uint8_t ZCHALLENGE = 14;
+static constexpr uint8_t ZCAN = 16;
+static constexpr uint8_t ZFREECNT = 17;
+static constexpr uint8_t ZCOMMAND = 18;
+
+// ZRINIT flags (ZF0)
+static constexpr uint8_t CANFDX = 0x01;
+static constexpr uint8_t CANOVIO = 0x02;
+static constexpr uint8_t CANFC32 = 0x20;
+static constexpr uint8_t ESCCTL = 0x40;
+// ZFILE conversion (ZF0)
+static constexpr uint8_t ZCBIN = 1;
+static constexpr uint8_t ZCRESUM = 3;
+
+static constexpr uint32_t START_MS = 20000;   // shell echo, then sz / rz loads
+static constexpr uint32_t HDR_MS = 5000;
+static constexpr uint32_t DATA_MS = 10000;
+static constexpr uint32_t OO_MS = 1000;
+static constexpr uint8_t MAX_TRIES = 10;
+static constexpr uint8_t CAN_ABORT = 5;       // CANs in a row from the peer
+static constexpr size_t SUBPACKET = 1024;     // what we send
+static constexpr size_t TX_LOW = 2048;        // refill the queue below this
+
+static_assert(CFG_ZMODEM_WINDOW_BYTES >= 4 * SUBPACKET, "ZMODEM window holds a few subpackets");
+
+static inline uint32_t getLe32(const uint8_t p[4]) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void putLe32(uint8_t p[4], uint32_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+static int8_t hexValue(uint8_t c) {
+  if (c >= '0' && c <= '9') return (int8_t)(c - '0');
+  if (c >= 'a' && c <= 'f') return (int8_t)(c - 'a' + 10);
+  if (c >= 'A' && c <= 'F') return (int8_t)(c - 'A' + 10);
+  return -1;
+}
+
+// ------------------------------------------------------------
+// Auto-start detection: "**" ZDLE "B0" then '0' (ZRQINIT) or '1' (ZRINIT)
+// ------------------------------------------------------------
+
+Zmodem::Detector::Seen Zmodem::Detector::feed(uint8_t c){
+  static const uint8_t PATTERN[] = { ZPAD, ZPAD, ZDLE, ZHEX, '0' };
+  if (_matched == sizeof(PATTERN)) {
+    _matched = 0;
+    if (c == '0') return Seen::Sender;
+    if (c == '1') return Seen::Receiver;
+  }
+  if (c == PATTERN[_matched]) _matched++;
+  else if (_matched == 2 && c == ZPAD) {}   // "***" still ends in "**"
+  else _matched = (c == ZPAD) ? 1 : 0;
+  return Seen::None;
+}
+
+// ------------------------------------------------------------
+// Session
+// ------------------------------------------------------------
+
+void Zmodem::reset(HardwareSerial* target, void* ctx){
+  _t = target;
+  _ctx = ctx;
+  _err = "";
+  _tries = 0;
+  _errors = 0;
+  _name = "";
+  _size = 0;
+  _mtime = 0;
+  _resume = false;
+  _resumedAt = 0;
+  _files = 0;
+  _txPos = _ackPos = _lastQ = 0;
+  _inFrame = false;
+  _peerCrc32 = false;
+  _peerEscCtl = false;
+  _ovio = true;
+  _rxBuf = 0;
+  _window = CFG_ZMODEM_WINDOW_BYTES;
+  _subMax = SUBPACKET;
+  _closing = false;
+  _pos = 0;
+  _subFor = 0;
+  _subFlags = 0;
+  _fileOpen = false;
+  _oo = 0;
+  _rx = Rx::Hunt;
+  _esc = false;
+  _can = 0;
+  _tx.clear();
+  _txSent = 0;
+  _lastOut = 0;
+}
+
+void Zmodem::beginSend(HardwareSerial* target, const char* name, uint64_t size, uint32_t mtime,
+                       bool resume, ReadFn read, void* ctx){
+  reset(target, ctx);
+  _send = true;
+  _name = name ? name : "";
+  _size = size;
+  _mtime = mtime;
+  _resume = resume;
+  _read = read;
+  _io.resize(SUBPACKET);
+  if (size > MAX_FILE_BYTES) {
+    // not running yet, so not through fail(): nothing to abort on the line
+    _err = "file too large for ZMODEM (32-bit offsets)";
+    _st = St::Failed;
+    return;
+  }
+  // rz announces itself with ZRINIT; ZRQINIT only if it stays quiet, so
+  // nothing lands on the shell before rz has the line
+  expect(St::SWaitRinit, HDR_MS);
+}
+
+void Zmodem::beginReceive(HardwareSerial* target, bool waitForSender,
+                          OpenFn open, WriteFn write, CloseFn close, void* ctx){
+  reset(target, ctx);
+  _send = false;
+  _open = open;
+  _write = write;
+  _close = close;
+  _waitSender = waitForSender;
+  _sub.resize(CFG_ZMODEM_MAX_SUBPACKET);
+  if (waitForSender) {
+    expect(St::RWaitFile, START_MS);
+  } else {
+    sendZrinit();
+    expect(St::RWaitFile, HDR_MS);
+  }
+}
+
+void Zmodem::expect(St st, uint32_t ms){
+  _st = st;
+  _deadlineMs = millis() + ms;
+}
+
+bool Zmodem::timedOut() const {
+  return (int32_t)(millis() - _deadlineMs) > 0;
+}
+
+void Zmodem::fail(const String& why){
+  if (!running()) return;
+  if (_fileOpen && _close) _close(_ctx, false);
+  _fileOpen = false;
+  if (_t) {
+    // drop what's queued; eight CANs then backspaces, as lrzsz does
+    static const uint8_t ABORT[] = { ZDLE, ZDLE, ZDLE, ZDLE, ZDLE, ZDLE, ZDLE, ZDLE,
+                                     8, 8, 8, 8, 8, 8, 8, 8, 8, 8 };
+    _t->write(ABORT, sizeof(ABORT));
+  }
+  _tx.clear();
+  _txSent = 0;
+  _err = why;
+  _st = St::Failed;
+  DBG_PRINTF("[ZMODEM] %s: %s (%llu/%llu bytes)\n", _name.c_str(), _err.c_str(),
+             (unsigned long long)bytes(), (unsigned long long)_size);
+}
+
+void Zmodem::cancel(const char* why){
+  fail(why);
+}
+
+// Counts a timeout; false once the session gave up.
+bool Zmodem::retry(const char* what){
+  _errors++;
+  if (++_tries > MAX_TRIES) {
+    char why[80];
+    snprintf(why, sizeof(why), "%s after %u tries at byte %llu", what, (unsigned)MAX_TRIES,
+             (unsigned long long)bytes());
+    fail(why);
+    return false;
+  }
+  return true;
+}
+
+bool Zmodem::tick(){
+  if (!running()) return _st != St::Idle;
+  pump();
+
+  if (_st == St::SData && !_closing) {
+    while (_st == St::SData && _tx.size() - _txSent < TX_LOW && sendData()) {}
+    pump();
+  }
+  if (_closing && txIdle()) {
+    _st = St::Done;
+    return true;
+  }
+  if (!timedOut()) return !running();
+
+  switch (_st) {
+    case St::SWaitRinit:
+      if (retry("no ZRINIT (rz not running?)")) {
+        sendHexHeader(ZRQINIT, 0u);
+        _deadlineMs = millis() + HDR_MS;
+      }
+      break;
+    case St::SWaitRpos:
+      if (retry("no ZRPOS for ZFILE")) sendZfile();
+      break;
+    case St::SData:
+    case St::SWaitAck:
+      // the ZACKs stopped: start over from the last confirmed byte; a
+      // receiver that is further on answers ZRPOS
+      if (retry("no ZACK")) {
+        if (_inFrame) sendSubpacket(nullptr, 0, ZCRCE);
+        _inFrame = false;
+        _txPos = _lastQ = _ackPos;
+        expect(St::SData, DATA_MS);
+      }
+      break;
+    case St::SWaitEof:
+      if (retry("no ZRINIT after ZEOF")) {
+        sendBinHeader(ZEOF, (uint32_t)_size);
+        _deadlineMs = millis() + HDR_MS;
+      }
+      break;
+    case St::SWaitFin:
+      // the file is in; the closing ZFIN exchange is courtesy
+      _st = St::Done;
+      break;
+    case St::RWaitFile:
+      if (_waitSender && !_files) {
+        fail("no ZRQINIT (sz not running?)");
+        break;
+      }
+      if (retry("no ZFILE")) {
+        sendZrinit();
+        _deadlineMs = millis() + HDR_MS;
+      }
+      break;
+    case St::RData:
+      if (retry("data stalled")) {
+        _rx = Rx::Hunt;
+        sendHexHeader(ZRPOS, (uint32_t)_pos);
+        _deadlineMs = millis() + DATA_MS;
+      }
+      break;
+    case St::RWaitOO:
+      _st = St::Done;
+      break;
+    default: break;
+  }
+  pump();
+  return !running();
+}
+
+// ------------------------------------------------------------
+// Output
+// ------------------------------------------------------------
+
+void Zmodem::pump(){
+  if (!_t || txIdle()) return;
+  const int room = _t->availableForWrite();
+  if (room <= 0) return;
+  size_t n = _tx.size() - _txSent;
+  if (n > (size_t)room) n = (size_t)room;
+  _t->write(_tx.data() + _txSent, n);
+  _txSent += n;
+  if (txIdle()) {
+    _tx.clear();
+    _txSent = 0;
+  }
+}
+
+void Zmodem::put(uint8_t c){
+  _tx.push_back(c);
+  _lastOut = c;
+}
+
+// lrzsz's zsendline(): ZDLE, DLE, XON, XOFF (either parity) always; CR
+// after '@' (telnet "CR @" escape); every control character with ESCCTL.
+void Zmodem::putEscaped(uint8_t c){
+  bool esc;
+  switch (c) {
+    case ZDLE: case 0x10: case XON: case XOFF:
+    case ZDLE | 0x80: case 0x90: case XON | 0x80: case XOFF | 0x80:
+      esc = true;
+      break;
+    case '\r': case '\r' | 0x80:
+      esc = _peerEscCtl || (_lastOut & 0x7F) == '@';
+      break;
+    default:
+      esc = _peerEscCtl && (c & 0x60) == 0;
+      break;
+  }
+  if (esc) {
+    put(ZDLE);
+    c ^= 0x40;
+  }
+  put(c);
+}
+
+void Zmodem::sendHexHeader(uint8_t type, uint32_t arg){
+  uint8_t p[4];
+  putLe32(p, arg);
+  sendHexHeader(type, p);
+}
+
+void Zmodem::sendHexHeader(uint8_t type, const uint8_t p[4]){
+  static const char HEX[] = "0123456789abcdef";
+  uint8_t h[5] = { type, p[0], p[1], p[2], p[3] };
+  const uint16_t crc = YmodemSender::crc16(h, sizeof(h));
+  const uint8_t c[2] = { (uint8_t)(crc >> 8), (uint8_t)crc };
+  put(ZPAD); put(ZPAD); put(ZDLE); put(ZHEX);
+  for (uint8_t b : h) { put(HEX[b >> 4]); put(HEX[b & 15]); }
+  for (uint8_t b : c) { put(HEX[b >> 4]); put(HEX[b & 15]); }
+  put('\r');
+  put('\n' | 0x80);
+  if (type != ZFIN && type != ZACK) put(XON);
+  pump();
+}
+
+// Buffer size 0 (stream), full duplex, overlapped I/O, CRC-32.
+void Zmodem::sendZrinit(){
+  const uint8_t f[4] = { 0, 0, 0, CANFDX | CANOVIO | CANFC32 };
+  sendHexHeader(ZRINIT, f);
+}
+
+void Zmodem::sendBinHeader(uint8_t type, uint32_t arg){
+  uint8_t p[4];
+  putLe32(p, arg);
+  sendBinHeader(type, p);
+}
+
+void Zmodem::sendBinHeader(uint8_t type, const uint8_t p[4]){
+  const uint8_t h[5] = { type, p[0], p[1], p[2], p[3] };
+  put(ZPAD);
+  put(ZDLE);
+  put(_peerCrc32 ? ZBIN32 : ZBIN);
+  for (uint8_t b : h) putEscaped(b);
+  if (_peerCrc32) {
+    uint8_t c[4];
+    putLe32(c, Crc32::finish(Crc32::update(Crc32::INIT, h, sizeof(h))));
+    for (uint8_t b : c) putEscaped(b);
+  } else {
+    const uint16_t crc = YmodemSender::crc16(h, sizeof(h));
+    putEscaped((uint8_t)(crc >> 8));
+    putEscaped((uint8_t)crc);
+  }
+}
+
+void Zmodem::sendSubpacket(const uint8_t* data, size_t len, uint8_t end){
+  for (size_t i = 0; i < len; i++) putEscaped(data[i]);
+  put(ZDLE);
+  put(end);
+  if (_peerCrc32) {
+    uint32_t crc = Crc32::update(Crc32::INIT, data, len);
+    crc = Crc32::finish(Crc32::step(crc, end));
+    uint8_t c[4];
+    putLe32(c, crc);
+    for (uint8_t b : c) putEscaped(b);
+  } else {
+    const uint16_t crc = YmodemSender::crc16(&end, 1, YmodemSender::crc16(data, len));
+    putEscaped((uint8_t)(crc >> 8));
+    putEscaped((uint8_t)crc);
+  }
+  if (end == ZCRCW) put(XON);
+}
+
+// ------------------------------------------------------------
+// Sender
+// ------------------------------------------------------------
+
+// "name\0size mtime mode serial files-left bytes-left\0" (mtime and mode
+// in octal, as sz writes them).
+void Zmodem::sendZfile(){
+  const uint8_t flags[4] = { 0, 0, 0, _resume ? ZCRESUM : ZCBIN };
+  char info[160];
+  const size_t nameLen = _name.length() < 100 ? _name.length() : 100;
+  memcpy(info, _name.c_str(), nameLen);
+  info[nameLen] = 0;
+  const int n = snprintf(info + nameLen + 1, sizeof(info) - nameLen - 1, "%llu %lo 100644 0 1 %llu",
+                         (unsigned long long)_size, (unsigned long)_mtime, (unsigned long long)_size);
+  sendBinHeader(ZFILE, flags);
+  sendSubpacket((const uint8_t*)info, nameLen + 1 + (size_t)n + 1, ZCRCW);
+  pump();
+  expect(St::SWaitRpos, HDR_MS);
+}
+
+// Queues the next subpacket; false when the window (or the file) says stop.
+bool Zmodem::sendData(){
+  if (_txPos >= _size) {
+    if (_inFrame) sendSubpacket(nullptr, 0, ZCRCE);
+    _inFrame = false;
+    sendBinHeader(ZEOF, (uint32_t)_size);
+    pump();
+    _tries = 0;
+    expect(St::SWaitEof, HDR_MS);
+    return false;
+  }
+  if (_txPos - _ackPos >= _window) return false;
+
+  if (!_inFrame) {
+    sendBinHeader(ZDATA, (uint32_t)_txPos);
+    _inFrame = true;
+  }
+  const uint64_t left = _size - _txPos;
+  const size_t n = left < _subMax ? (size_t)left : _subMax;
+  if (!_read || !_read(_ctx, _txPos, _io.data(), n)) {
+    fail("file read failed");
+    return false;
+  }
+  _txPos += n;
+
+  uint8_t end;
+  if (!_ovio || (_rxBuf && _txPos - _ackPos + _subMax > _window)) {
+    end = ZCRCW;
+  } else if (_txPos - _lastQ >= _window / 4) {
+    end = ZCRCQ;
+    _lastQ = _txPos;
+  } else {
+    end = ZCRCG;
+  }
+  sendSubpacket(_io.data(), n, end);
+  if (end == ZCRCW) {
+    _inFrame = false;
+    _lastQ = _txPos;
+    expect(St::SWaitAck, DATA_MS);
+    return false;
+  }
+  return true;
+}
+
+// ZCRC: CRC-32 of the first len bytes (0: all), so rz can tell whether
+// its partial copy matches before resuming.
+void Zmodem::sendCrcReply(uint32_t len){
+  uint64_t total = len ? len : _size;
+  if (total > _size) total = _size;
+  uint32_t crc = Crc32::INIT;
+  for (uint64_t off = 0; off < total;) {
+    const size_t n = total - off < SUBPACKET ? (size_t)(total - off) : SUBPACKET;
+    if (!_read || !_read(_ctx, off, _io.data(), n)) {
+      fail("file read failed");
+      return;
+    }
+    crc = Crc32::update(crc, _io.data(), n);
+    off += n;
+  }
+  sendHexHeader(ZCRC, Crc32::finish(crc));
+}
+
+void Zmodem::onSenderHeader(uint8_t type, uint32_t pos, const uint8_t p[4]){
+  switch (type) {
+    case ZRINIT:
+      if (_st == St::SWaitRinit || _st == St::SWaitRpos) {
+        const uint8_t f = p[3];
+        const uint32_t buf = (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+        _peerCrc32 = (f & CANFC32) != 0;
+        _peerEscCtl = (f & ESCCTL) != 0;
+        _ovio = (f & CANOVIO) && (f & CANFDX);
+        _rxBuf = buf;
+        _window = buf && buf < CFG_ZMODEM_WINDOW_BYTES ? buf : (uint32_t)CFG_ZMODEM_WINDOW_BYTES;
+        _subMax = _window < SUBPACKET ? _window : SUBPACKET;
+        _tries = 0;
+        sendZfile();
+      } else if (_st == St::SWaitEof) {
+        _files++;
+        _tries = 0;
+        sendHexHeader(ZFIN, 0u);
+        expect(St::SWaitFin, HDR_MS);
+      }
+      break;
+
+    case ZRPOS:
+      if (_st == St::SWaitRinit || _st == St::SWaitFin) break;
+      if (pos > _size) {
+        fail("ZRPOS past the end of the file");
+        break;
+      }
+      if (_st == St::SWaitRpos) {
+        _resumedAt = pos;
+      } else {
+        _errors++;
+        // what's still queued is from before the error
+        _tx.resize(_txSent);
+      }
+      _txPos = _ackPos = _lastQ = pos;
+      _inFrame = false;
+      expect(St::SData, DATA_MS);
+      break;
+
+    case ZACK:
+      if (pos <= _txPos && pos >= _ackPos) {
+        _ackPos = pos;
+        _tries = 0;
+        // a late ZACK for a ZCRCQ doesn't answer the ZCRCW
+        if (_st == St::SWaitAck && pos == _txPos) expect(St::SData, DATA_MS);
+        else if (_st == St::SData || _st == St::SWaitAck) _deadlineMs = millis() + DATA_MS;
+      }
+      break;
+
+    case ZNAK:
+      if (_st == St::SWaitRpos) sendZfile();
+      else if (_st == St::SWaitEof) sendBinHeader(ZEOF, (uint32_t)_size);
+      break;
+
+    case ZSKIP:
+      fail("receiver skipped the file");
+      break;
+
+    case ZCRC:
+      sendCrcReply(pos);
+      break;
+
+    case ZFIN:
+      if (_st == St::SWaitFin) {
+        put('O');
+        put('O');
+        pump();
+        _closing = true;
+      }
+      break;
+
+    case ZABORT:
+    case ZFERR:
+    case ZCAN:
+      fail("receiver aborted");
+      break;
+
+    default: break;
+  }
+}
+
+// ------------------------------------------------------------
+// Receiver
+// ------------------------------------------------------------
+
+void Zmodem::expectSubpacket(uint8_t forType){
+  _subFor = forType;
+  _subLen = 0;
+  _crcLen = 0;
+  _rx = Rx::Data;
+}
+
+void Zmodem::onReceiverHeader(uint8_t type, uint32_t pos, const uint8_t p[4]){
+  switch (type) {
+    case ZRQINIT:
+      if (_st == St::RWaitFile) {
+        sendZrinit();
+        expect(St::RWaitFile, HDR_MS);
+      }
+      break;
+
+    case ZSINIT:
+    case ZFILE:
+    case ZCOMMAND:
+      _subFlags = p[3];
+      expectSubpacket(type);
+      break;
+
+    case ZDATA:
+      if (_st != St::RData) break;
+      if (pos != _pos) {
+        _errors++;
+        sendHexHeader(ZRPOS, (uint32_t)_pos);
+        _deadlineMs = millis() + DATA_MS;
+        break;
+      }
+      expectSubpacket(ZDATA);
+      _deadlineMs = millis() + DATA_MS;
+      break;
+
+    case ZEOF:
+      if (_st != St::RData || pos != _pos) break;   // data still to come
+      if (_close) _close(_ctx, true);
+      _fileOpen = false;
+      _files++;
+      _tries = 0;
+      sendZrinit();
+      expect(St::RWaitFile, HDR_MS);
+      break;
+
+    case ZFIN:
+      sendHexHeader(ZFIN, 0u);
+      _oo = 0;
+      expect(St::RWaitOO, OO_MS);
+      break;
+
+    case ZFREECNT:
+      sendHexHeader(ZACK, 0xFFFFFFFFu);
+      break;
+
+    case ZCHALLENGE:
+      sendHexHeader(ZACK, p);
+      break;
+
+    case ZABORT:
+    case ZFERR:
+    case ZCAN:
+      fail("sender aborted");
+      break;
+
+    default: break;
+  }
+}
+
+void Zmodem::onSubpacket(bool good){
+  const uint8_t forType = _subFor;
+  _rx = Rx::Hunt;
+  if (!good) {
+    _errors++;
+    if (forType == ZDATA) {
+      sendHexHeader(ZRPOS, (uint32_t)_pos);
+      _deadlineMs = millis() + DATA_MS;
+    } else {
+      sendHexHeader(ZNAK, 0u);
+    }
+    return;
+  }
+
+  switch (forType) {
+    case ZSINIT:
+      // the sender's attention string isn't used: we never interrupt it
+      sendHexHeader(ZACK, 1u);
+      break;
+
+    case ZCOMMAND:
+      fail("refused ZCOMMAND from the sender");
+      break;
+
+    case ZFILE: {
+      if (_st != St::RWaitFile) break;
+      const char* info = (const char*)_sub.data();
+      const size_t nameLen = strnlen(info, _subLen);
+      if (!nameLen || nameLen >= _subLen) {
+        sendHexHeader(ZNAK, 0u);
+        break;
+      }
+      if (_subLen < _sub.size()) _sub[_subLen] = 0;
+      else _sub[_subLen - 1] = 0;
+      _name = String(info);
+      _size = strtoull(info + nameLen + 1, nullptr, 10);
+      _mtime = 0;
+      _resumedAt = 0;
+      uint64_t at = 0;
+      const bool resume = _subFlags == ZCRESUM;
+      if (!_open || !_open(_ctx, _name.c_str(), _size, resume, at)) {
+        sendHexHeader(ZSKIP, 0u);
+        break;
+      }
+      if (!resume || at > _size || at > 0xFFFFFFFFull) at = 0;
+      _fileOpen = true;
+      _pos = _resumedAt = at;
+      _tries = 0;
+      sendHexHeader(ZRPOS, (uint32_t)_pos);
+      expect(St::RData, DATA_MS);
+      break;
+    }
+
+    case ZDATA:
+      if (_subLen) {
+        if (!_write || !_write(_ctx, _pos, _sub.data(), _subLen)) {
+          fail("write failed");
+          return;
+        }
+        _pos += _subLen;
+      }
+      _tries = 0;
+      _deadlineMs = millis() + DATA_MS;
+      if (_subEnd == ZCRCQ || _subEnd == ZCRCW) sendHexHeader(ZACK, (uint32_t)_pos);
+      if (_subEnd == ZCRCG || _subEnd == ZCRCQ) expectSubpacket(ZDATA);
+      break;
+
+    default: break;
+  }
+}
+
+// ------------------------------------------------------------
+// Parser
+// ------------------------------------------------------------
+
+void Zmodem::feed(const uint8_t* data, size_t len){
+  for (size_t i = 0; i < len && running(); i++) onByte(data[i]);
+  pump();
+}
+
+// Decoded byte, -1 for nothing (ZDLE, flow control), -2 for a bad escape.
+// frameEnd: the byte is a subpacket end (ZCRCE..ZCRCW).
+int Zmodem::unescape(uint8_t c, bool& frameEnd){
+  frameEnd = false;
+  if (!_esc) {
+    if (c == ZDLE) {
+      _esc = true;
+      return -1;
+    }
+    // flow control is always escaped in the data, so raw ones are the line's
+    if ((c & 0x7F) == XON || (c & 0x7F) == XOFF) return -1;
+    return c;
+  }
+  if (c == ZDLE) return -1;   // part of a CAN run
+  _esc = false;
+  switch (c) {
+    case ZCRCE: case ZCRCG: case ZCRCQ: case ZCRCW:
+      frameEnd = true;
+      return c;
+    case ZRUB0: return 0x7F;
+    case ZRUB1: return 0xFF;
+    default:
+      if ((c & 0x60) == 0x40) return c ^ 0x40;
+      return -2;
+  }
+}
+
+void Zmodem::onByte(uint8_t c){
+  if (c == ZDLE) {
+    if (++_can >= CAN_ABORT) {
+      fail(_send ? "receiver cancelled" : "sender cancelled");
+      return;
+    }
+  } else {
+    _can = 0;
+  }
+
+  switch (_rx) {
+    case Rx::Hunt:
+      if (_st == St::RWaitOO) {
+        if (c == 'O' && ++_oo == 2) _st = St::Done;
+        return;
+      }
+      if (c == ZPAD) _rx = Rx::Pad;
+      return;
+
+    case Rx::Pad:
+      if (c == ZDLE) {
+        _rx = Rx::Format;
+        _esc = false;
+      } else if (c != ZPAD) {
+        _rx = Rx::Hunt;
+      }
+      return;
+
+    case Rx::Format:
+      _hdrLen = 0;
+      _hexLen = 0;
+      if (c == ZHEX) _rx = Rx::HexHdr;
+      else if (c == ZBIN || c == ZBIN32) { _rx = Rx::BinHdr; _rxCrc32 = c == ZBIN32; }
+      else _rx = Rx::Hunt;
+      return;
+
+    case Rx::HexHdr: {
+      const int8_t v = hexValue(c);
+      if (v < 0) {
+        _errors++;
+        _rx = Rx::Hunt;
+        return;
+      }
+      _hex[_hexLen++] = (uint8_t)v;
+      if (_hexLen < 14) return;
+      uint8_t h[7];
+      for (int i = 0; i < 7; i++) h[i] = (uint8_t)((_hex[2 * i] << 4) | _hex[2 * i + 1]);
+      _rx = Rx::Hunt;
+      if (YmodemSender::crc16(h, 5) != (uint16_t)((h[5] << 8) | h[6])) {
+        _errors++;
+        return;
+      }
+      _rxCrc32 = false;
+      onHeader(h[0], h + 1);
+      return;
+    }
+
+    case Rx::BinHdr: {
+      bool end;
+      const int v = unescape(c, end);
+      if (v == -1) return;
+      if (v == -2 || end) {
+        _errors++;
+        _rx = Rx::Hunt;
+        return;
+      }
+      _hdr[_hdrLen++] = (uint8_t)v;
+      if (_hdrLen < (_rxCrc32 ? 9 : 7)) return;
+      _rx = Rx::Hunt;
+      bool good;
+      if (_rxCrc32) good = Crc32::finish(Crc32::update(Crc32::INIT, _hdr, 5)) == getLe32(_hdr + 5);
+      else good = YmodemSender::crc16(_hdr, 5) == (uint16_t)((_hdr[5] << 8) | _hdr[6]);
+      if (!good) {
+        _errors++;
+        return;
+      }
+      uint8_t h[5];
+      memcpy(h, _hdr, sizeof(h));
+      onHeader(h[0], h + 1);
+      return;
+    }
+
+    case Rx::Data: {
+      bool end;
+      const int v = unescape(c, end);
+      if (v == -1) return;
+      if (v == -2) {
+        onSubpacket(false);
+        return;
+      }
+      if (end) {
+        _subEnd = (uint8_t)v;
+        _crcLen = 0;
+        _rx = Rx::DataCrc;
+        return;
+      }
+      if (_subLen >= _sub.size()) {
+        onSubpacket(false);
+        return;
+      }
+      _sub[_subLen++] = (uint8_t)v;
+      return;
+    }
+
+    case Rx::DataCrc: {
+      bool end;
+      const int v = unescape(c, end);
+      if (v == -1) return;
+      if (v == -2 || end) {
+        onSubpacket(false);
+        return;
+      }
+      _crcBytes[_crcLen++] = (uint8_t)v;
+      if (_crcLen < (_rxCrc32 ? 4 : 2)) return;
+      bool good;
+      if (_rxCrc32) {
+        const uint32_t crc = Crc32::step(Crc32::update(Crc32::INIT, _sub.data(), _subLen), _subEnd);
+        good = Crc32::finish(crc) == getLe32(_crcBytes);
+      } else {
+        const uint16_t crc = YmodemSender::crc16(&_subEnd, 1, YmodemSender::crc16(_sub.data(), _subLen));
+        good = crc == (uint16_t)((_crcBytes[0] << 8) | _crcBytes[1]);
+      }
+      onSubpacket(good);
+      return;
+    }
+  }
+}
+
+void Zmodem::onHeader(uint8_t type, const uint8_t p[4]){
+  const uint32_t pos = getLe32(p);
+  if (_send) onSenderHeader(type, pos, p);
+  else onReceiverHeader(type, pos, p);
+}
@@ -0,0 +1,257 @@
+#include "Zmodem_transfer.h"
+#include "AppConfig.h"
+#include "BlueprintRuntime.h"
+#include "Debug.h"
+#include "SdCache.h"
+#include <LittleFS.h>
+#include <SD.h>
+
+DBG_REGISTER_MODULE(__FILE__);
+
+// rz's ZRINIT counts as "rz is waiting" for this long
+static constexpr uint32_t RZ_SEEN_MS = 30000;
+
+static String baseName(const String& path) {
+  const int slash = path.lastIndexOf('/');
+  return slash >= 0 ? path.substring((unsigned)slash + 1) : path;
+}
+
+// A name from the sender, made safe as a file name in the receive dir.
+static String safeName(const char* name) {
+  String s = baseName(String(name ? name : ""));
+  for (unsigned i = 0; i < s.length(); i++) {
+    const char c = s[i];
+    if ((uint8_t)c < 0x20 || strchr("\\:*?\"<>|", c)) s[i] = '_';
+  }
+  if (!s.length() || s == "." || s == "..") return String();
+  return s;
+}
+
+static String fmtBytes(uint64_t n) {
+  return String((unsigned long)(n / 1024ULL)) + " KiB";
+}
+
+void ZmodemTransfer::begin(HardwareSerial* target){
+  _t = target;
+}
+
+// ------------------------------------------------------------
+// Commands
+// ------------------------------------------------------------
+
+// "sd:/path", "fs:/path" or "/path" (SD).
+bool ZmodemTransfer::startSend(const String& path, bool resume, String* err){
+  if (running()) { if (err) *err = "a transfer is running"; return false; }
+
+  String p = path;
+  p.trim();
+  const bool lfs = p.startsWith("fs:");
+  if (lfs || p.startsWith("sd:")) p.remove(0, 3);
+  if (!p.length()) { if (err) *err = "no file given"; return false; }
+  if (!lfs && !SdCache::mounted()) { if (err) *err = "SD not mounted"; return false; }
+
+  // rz started by hand is waiting already; otherwise start it ourselves
+  const bool rzWaiting = _rzSeenMs && (millis() - _rzSeenMs) < RZ_SEEN_MS;
+  if (!rzWaiting && BlueprintRuntime::mode() != BlueprintRuntime::Mode::LinuxShell) {
+    if (err) *err = "target is not at a Linux shell prompt";
+    return false;
+  }
+
+  _file = lfs ? LittleFS.open(p.c_str(), "r") : SD.open(p.c_str(), FILE_READ);
+  if (!_file || _file.isDirectory()) {
+    if (_file) _file.close();
+    if (err) *err = String("can't open ") + (lfs ? "fs:" : "sd:") + p;
+    return false;
+  }
+  if ((uint64_t)_file.size() > Zmodem::MAX_FILE_BYTES) {
+    _file.close();
+    if (err) *err = "file too large for ZMODEM (32-bit offsets)";
+    return false;
+  }
+  _path = String(lfs ? "fs:" : "sd:") + p;
+  _partPath = "";
+
+  if (!rzWaiting) {
+    _t->print(resume ? "rz -r" : "rz -y");
+    _t->print("\n");
+  }
+  _rzSeenMs = 0;
+  _zm.beginSend(_t, baseName(p).c_str(), _file.size(), (uint32_t)_file.getLastWrite(), resume, readCb, this);
+  _active = true;
+  DBG_PRINTF("[ZMODEM] send %s (%llu bytes)%s\n", _path.c_str(),
+             (unsigned long long)_file.size(), resume ? " resume" : "");
+  return true;
+}
+
+bool ZmodemTransfer::startReceive(const String& remote, bool resume, String* err){
+  if (running()) { if (err) *err = "a transfer is running"; return false; }
+
+  String r = remote;
+  r.trim();
+  if (!r.length()) { if (err) *err = "no remote file given"; return false; }
+  if (r.indexOf('\'') >= 0) { if (err) *err = "remote path can't contain a quote"; return false; }
+  if (!SdCache::mounted()) { if (err) *err = "SD not mounted"; return false; }
+  if (BlueprintRuntime::mode() != BlueprintRuntime::Mode::LinuxShell) {
+    if (err) *err = "target is not at a Linux shell prompt";
+    return false;
+  }
+
+  _t->print(String(resume ? "sz -r '" : "sz '") + r + "'\n");
+  beginReceive(true);
+  DBG_PRINTF("[ZMODEM] recv %s%s\n", r.c_str(), resume ? " resume" : "");
+  return true;
+}
+
+void ZmodemTransfer::beginReceive(bool waitForSender){
+  _path = "";
+  _partPath = "";
+  _zm.beginReceive(_t, waitForSender, openCb, writeCb, closeCb, this);
+  _active = true;
+}
+
+void ZmodemTransfer::cancel(){
+  if (running()) _zm.cancel("cancelled");
+}
+
+// ------------------------------------------------------------
+// Stream
+// ------------------------------------------------------------
+
+bool ZmodemTransfer::onTargetBytes(const uint8_t* data, size_t len, bool allowAutostart){
+  if (running()) {
+    _zm.feed(data, len);
+    return true;
+  }
+  for (size_t i = 0; i < len; i++) {
+    const Zmodem::Detector::Seen seen = _detect.feed(data[i]);
+    if (seen == Zmodem::Detector::Seen::Receiver) {
+      _rzSeenMs = millis();
+      if (!_rzSeenMs) _rzSeenMs = 1;
+    } else if (seen == Zmodem::Detector::Seen::Sender && CFG_ZMODEM_AUTOSTART &&
+               allowAutostart && SdCache::mounted()) {
+      // sz started by hand: its ZRQINIT gets our ZRINIT right away
+      DBG_PRINTF("[ZMODEM] sz detected, receiving\n");
+      beginReceive(false);
+      _zm.feed(data + i + 1, len - i - 1);
+      return false;
+    }
+  }
+  return false;
+}
+
+void ZmodemTransfer::tick(){
+  if (!_active) return;
+  if (_zm.tick()) finish();
+}
+
+void ZmodemTransfer::finish(){
+  _active = false;
+  if (_file) _file.close();
+  const String name = _zm.fileName().length() ? _zm.fileName() : String("(no file)");
+  if (_zm.ok()) {
+    if (_zm.sending()) {
+      _last = String("zm: sent ") + _path + " (" + fmtBytes(_zm.size()) + ")";
+    } else {
+      _last = String("zm: received ") + _zm.files() + " file(s), last " + _path + " (" + fmtBytes(_zm.size()) + ")";
+    }
+    if (_zm.resumedAt()) _last += String(", resumed at ") + fmtBytes(_zm.resumedAt());
+  } else {
+    _last = String("zm: ") + (_zm.sending() ? "send " : "recv ") + name + " FAILED: " + _zm.error() +
+            " at " + fmtBytes(_zm.bytes());
+    if (!_zm.sending() && _partPath.length()) _last += String(" (kept ") + _partPath + ", !zm recv -r resumes)";
+  }
+  if (_zm.errors()) _last += String(", ") + _zm.errors() + " retries";
+  DBG_PRINTF("[ZMODEM] %s\n", _last.c_str());
+}
+
+String ZmodemTransfer::statusLine() const {
+  if (!running()) return _last;
+  String s = String("zm: ") + (_zm.sending() ? "sending " : "receiving ");
+  if (!_zm.fileName().length()) return s + "(waiting for the peer)";
+  s += _zm.fileName() + " " + fmtBytes(_zm.bytes()) + "/" + fmtBytes(_zm.size());
+  if (_zm.size()) s += String(" (") + String((float)_zm.bytes() * 100.0f / (float)_zm.size(), 1) + "%)";
+  if (_zm.resumedAt()) s += String(", resumed at ") + fmtBytes(_zm.resumedAt());
+  if (_zm.errors()) s += String(", ") + _zm.errors() + " retries";
+  return s;
+}
+
+// ------------------------------------------------------------
+// Files
+// ------------------------------------------------------------
+
+bool ZmodemTransfer::readCb(void* ctx, uint64_t off, uint8_t* out, size_t len){
+  ZmodemTransfer* self = (ZmodemTransfer*)ctx;
+  if (!self->_file) return false;
+  if (self->_file.position() != off && !self->_file.seek(off)) return false;
+  return self->_file.read(out, len) == len;
+}
+
+bool ZmodemTransfer::openCb(void* ctx, const char* name, uint64_t size, bool resume, uint64_t& resumeAt){
+  return ((ZmodemTransfer*)ctx)->openRx(name, size, resume, resumeAt);
+}
+
+bool ZmodemTransfer::writeCb(void* ctx, uint64_t off, const uint8_t* data, size_t len){
+  ZmodemTransfer* self = (ZmodemTransfer*)ctx;
+  // the engine only writes in order, from where open() said
+  if (!self->_file || off != self->_rxAt) return false;
+  if (self->_file.write(data, len) != len) return false;
+  self->_rxAt += len;
+  return true;
+}
+
+void ZmodemTransfer::closeCb(void* ctx, bool complete){
+  ((ZmodemTransfer*)ctx)->closeRx(complete);
+}
+
+bool ZmodemTransfer::openRx(const char* name, uint64_t size, bool resume, uint64_t& resumeAt){
+  const String safe = safeName(name);
+  if (!safe.length() || !SdCache::mounted()) return false;
+  if (!SD.exists(CFG_ZMODEM_RX_DIR)) SD.mkdir(CFG_ZMODEM_RX_DIR);
+  _path = String(CFG_ZMODEM_RX_DIR) + "/" + safe;
+  const String part = _path + ".part";
+
+  resumeAt = 0;
+  if (resume && SD.exists(part.c_str())) {
+    _file = SD.open(part.c_str(), FILE_APPEND);
+    if (_file) resumeAt = _file.size();
+  } else {
+    _file = SD.open(part.c_str(), FILE_WRITE);
+  }
+  if (!_file) {
+    DBG_PRINTF("[ZMODEM] can't create %s, skipping\n", part.c_str());
+    return false;
+  }
+  if (resumeAt > size) {
+    // not the same file: start over
+    _file.close();
+    _file = SD.open(part.c_str(), FILE_WRITE);
+    resumeAt = 0;
+    if (!_file) return false;
+  }
+  if (size - resumeAt > SdCache::freeBytes()) {
+    DBG_PRINTF("[ZMODEM] %s: %llu bytes won't fit on SD, skipping\n", safe.c_str(),
+               (unsigned long long)(size - resumeAt));
+    _file.close();
+    if (!resumeAt) SD.remove(part.c_str());
+    return false;
+  }
+  _partPath = part;
+  _rxAt = resumeAt;
+  DBG_PRINTF("[ZMODEM] receiving %s -> %s (%llu bytes, from %llu)\n", name, _path.c_str(),
+             (unsigned long long)size, (unsigned long long)resumeAt);
+  return true;
+}
+
+void ZmodemTransfer::closeRx(bool complete){
+  if (_file) {
+    _file.flush();
+    _file.close();
+  }
+  if (!complete || !_partPath.length()) return;
+  if (SD.exists(_path.c_str())) SD.remove(_path.c_str());
+  if (!SD.rename(_partPath.c_str(), _path.c_str())) {
+    DBG_PRINTF("[ZMODEM] rename %s failed, left as .part\n", _partPath.c_str());
+    return;
+  }
+  _partPath = "";
+}
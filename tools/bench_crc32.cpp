@@ -0,0 +1,90 @@
+// Host benchmark for the CRC32 kernels in src/Crc32.cpp.
+//
+// Checks every kernel against the bit-at-a-time reference (whole buffer,
+// odd lengths, unaligned starts, split updates), then prints the rate of
+// each next to what verify/backup feed it: a 1.5 / 3 Mbaud UART and a
+// 20 MB/s SD card.
+//
+// Build + run from the repo root:
+//   g++ -O2 -std=c++17 -Iinclude tools/bench_crc32.cpp src/Crc32.cpp -o bench_crc32
+//   ./bench_crc32 [MiB of data, default 64] [span bytes, default 4096]
+//
+// The ROM kernel (CFG_CRC32_USE_ROM) only exists on the ESP32; time it
+// there against updateSlice8 before switching. As with bench_hex_decode,
+// host MB/s is not ESP32 MB/s: compare the kernels' ratio, not the
+// absolute numbers.
+
+#include "Crc32.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static uint32_t crc32Ref(const uint8_t* p, size_t n) {
+  uint32_t c = 0xFFFFFFFFu;
+  for (size_t i = 0; i < n; i++) {
+    c ^= p[i];
+    for (int k = 0; k < 8; k++) c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+  }
+  return c ^ 0xFFFFFFFFu;
+}
+
+typedef uint32_t (*Kernel)(uint32_t, const uint8_t*, size_t);
+
+static bool check(const char* name, Kernel k, const std::vector<uint8_t>& mem) {
+  // "123456789" is the standard check value
+  const uint8_t nine[] = { '1','2','3','4','5','6','7','8','9' };
+  bool ok = Crc32::finish(k(Crc32::INIT, nine, sizeof(nine))) == 0xCBF43926u;
+
+  for (size_t start = 0; ok && start < 9; start++) {
+    for (size_t len = 0; ok && len < 300; len += 1 + len / 7) {
+      const uint8_t* p = mem.data() + start;
+      const size_t cut = len / 3;
+      const uint32_t split = Crc32::finish(k(k(Crc32::INIT, p, cut), p + cut, len - cut));
+      ok = Crc32::finish(k(Crc32::INIT, p, len)) == crc32Ref(p, len) && split == crc32Ref(p, len);
+    }
+  }
+  if (!ok) printf("%-10s MISMATCH\n", name);
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  const size_t mib  = (argc > 1) ? (size_t)atoi(argv[1]) : 64;
+  const size_t span = (argc > 2) ? (size_t)atoi(argv[2]) : 4096;
+
+  std::vector<uint8_t> mem(mib * 1024 * 1024 + 16);
+  uint32_t x = 0x12345678u;
+  for (auto& b : mem) { x = x * 1664525u + 1013904223u; b = (uint8_t)(x >> 24); }
+
+  struct { const char* name; Kernel k; } kernels[] = {
+    { "bytewise", Crc32::updateBytewise },
+    { "slice8",   Crc32::updateSlice8 },
+  };
+
+  printf("data %zu MiB in %zu-byte spans\n", mib, span);
+  printf("kernel        MB/s  x1.5Mbaud  x3Mbaud  xSD20MB/s\n");
+
+  int rc = 0;
+  double base = 0;
+  for (const auto& e : kernels) {
+    if (!check(e.name, e.k, mem)) { rc = 1; continue; }
+
+    const size_t total = mib * 1024 * 1024;
+    uint32_t c = Crc32::INIT;
+    const auto t0 = std::chrono::steady_clock::now();
+    for (size_t off = 0; off < total; off += span) {
+      const size_t n = (total - off < span) ? total - off : span;
+      c = e.k(c, mem.data() + off, n);
+    }
+    const auto t1 = std::chrono::steady_clock::now();
+    if (Crc32::finish(c) != crc32Ref(mem.data(), total)) { printf("%-10s MISMATCH\n", e.name); rc = 1; continue; }
+
+    const double mbs = (double)total / std::chrono::duration<double>(t1 - t0).count() / 1e6;
+    if (base == 0) base = mbs;
+    // 8N1 raw bytes, i.e. the best case (md text costs ~3-5x more)
+    printf("%-10s %7.1f  %9.0f  %7.0f  %9.1f   (%.1fx bytewise)\n", e.name, mbs,
+           mbs / 0.15, mbs / 0.30, mbs / 20.0, mbs / base);
+  }
+  return rc;
+}
@@ -0,0 +1,106 @@
+// Host benchmark for UBootHexParser (src/Uboot_hex_parser.cpp).
+//
+// Generates U-Boot md.b / md.w / md.l / md.q output for random data, feeds it
+// to the decoder in UART-sized batches, checks the decoded bytes and fused
+// CRC32, and prints the decode rate next to what a given baud rate delivers.
+//
+// Build + run from the repo root:
+//   g++ -O2 -std=c++17 -Iinclude tools/bench_hex_decode.cpp src/Uboot_hex_parser.cpp src/Crc32.cpp -o bench_hex_decode
+//   ./bench_hex_decode [MiB of payload, default 16] [batch bytes, default 128]
+//
+// Host MB/s is not ESP32 MB/s; the useful number is the headroom factor.
+// The S3 at 240 MHz is roughly 10-20x slower than a desktop core for this
+// kind of loop, so keep the reported headroom well above that.
+
+#include "Uboot_hex_parser.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static uint32_t crc32Ref(const uint8_t* p, size_t n) {
+  uint32_t c = 0xFFFFFFFFu;
+  for (size_t i = 0; i < n; i++) {
+    c ^= p[i];
+    for (int k = 0; k < 8; k++) c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+  }
+  return c ^ 0xFFFFFFFFu;
+}
+
+// Same layout as U-Boot print_buffer(): 16 bytes per line, little-endian target.
+static std::string mdText(const std::vector<uint8_t>& mem, unsigned width) {
+  std::string s;
+  s.reserve(mem.size() * 5);
+  char buf[32];
+  for (size_t off = 0; off < mem.size(); off += 16) {
+    snprintf(buf, sizeof(buf), "%08zx:", (size_t)0x40000000u + off);
+    s += buf;
+    for (size_t w = 0; w < 16; w += width) {
+      uint64_t v = 0;
+      for (unsigned k = 0; k < width; k++) v |= (uint64_t)mem[off + w + k] << (8 * k);
+      snprintf(buf, sizeof(buf), " %0*llx", (int)(width * 2), (unsigned long long)v);
+      s += buf;
+    }
+    s += "    ";
+    for (size_t k = 0; k < 16; k++) {
+      uint8_t c = mem[off + k];
+      s += (c >= 0x20 && c < 0x7f) ? (char)c : '.';
+    }
+    s += "\r\n";
+  }
+  return s;
+}
+
+int main(int argc, char** argv) {
+  const size_t mib   = (argc > 1) ? (size_t)atoi(argv[1]) : 16;
+  const size_t batch = (argc > 2) ? (size_t)atoi(argv[2]) : 128;
+
+  std::vector<uint8_t> mem(mib * 1024 * 1024);
+  uint32_t x = 0x12345678u;
+  for (auto& b : mem) { x = x * 1664525u + 1013904223u; b = (uint8_t)(x >> 24); }
+  const uint32_t refCrc = crc32Ref(mem.data(), mem.size());
+
+  std::vector<uint8_t> out(mem.size());
+  const unsigned widths[] = { 1, 2, 4, 8 };
+  int rc = 0;
+
+  printf("payload %zu MiB, batch %zu bytes\n", mib, batch);
+  printf("width  text/byte  text MB/s  payload MB/s  x1.5Mbaud  x3Mbaud  check\n");
+
+  for (unsigned w : widths) {
+    const std::string text = mdText(mem, w);
+
+    UBootHexParser p;
+    p.setWordWidth((uint8_t)w);
+    p.crcBegin();
+
+    size_t got = 0;
+    const auto t0 = std::chrono::steady_clock::now();
+    for (size_t off = 0; off < text.size(); off += batch) {
+      const size_t n = (text.size() - off < batch) ? text.size() - off : batch;
+      got += p.feed((const uint8_t*)text.data() + off, n, out.data() + got, out.size() - got);
+    }
+    const auto t1 = std::chrono::steady_clock::now();
+
+    const double sec = std::chrono::duration<double>(t1 - t0).count();
+    const double textMBs = (double)text.size() / sec / 1e6;
+    const double payMBs  = (double)got / sec / 1e6;
+    // 8N1: 10 bits per character on the wire
+    const double wire15 = 1500000.0 / 10.0 / 1e6;
+    const double wire30 = 3000000.0 / 10.0 / 1e6;
+
+    const bool ok = got == mem.size() &&
+                    memcmp(out.data(), mem.data(), mem.size()) == 0 &&
+                    p.crcValue() == refCrc;
+    if (!ok) rc = 1;
+
+    printf("md.%c   %9.2f  %9.1f  %12.1f  %9.0f  %7.0f  %s\n",
+           UBootHexParser::mdSuffix((uint8_t)w),
+           (double)text.size() / (double)mem.size(), textMBs, payMBs,
+           textMBs / wire15, textMBs / wire30, ok ? "ok" : "MISMATCH");
+  }
+  return rc;
+}
@@ -0,0 +1,334 @@
+#!/usr/bin/env python3
+"""Inspect, verify and unpack .k2bak backups on a PC.
+
+Reads v1, v2 and v3 files (see include/K2bak.h for the layout), including
+v3 chunks stored as LZ4 frames. Standard library only.
+
+Usage:
+  python tools/k2bak.py info    backup.k2bak
+  python tools/k2bak.py verify  backup.k2bak
+  python tools/k2bak.py extract backup.k2bak disk.img [--base-lba N]
+
+extract writes every backed-up block at (lba - base) * 512 of the output,
+so with the default base of 0 the image lines up with the eMMC. Fill runs
+of 0x00 are left as holes (sparse on most filesystems).
+"""
+
+from __future__ import annotations
+
+import argparse
+import hashlib
+import struct
+import sys
+import zlib
+
+MAGIC5 = b"K2BAK"
+MAGIC_V1 = b"K2BAK\0\0\x01"
+END_MAGIC = b"K2END"
+
+RANGE_RAW = 1 << 0
+RANGE_COMPRESSED = 1 << 1
+RANGE_FILL_00 = 1 << 2
+RANGE_FILL_FF = 1 << 3
+
+FRAME_STORED = 0x80000000
+FRAME_LEN_MASK = 0x7FFFFFFF
+FRAME_BYTES = 32 * 512  # CFG_K2BAK_LZ_FRAME_BLOCKS
+
+HDR_V1 = struct.Struct("<8sB3xIIIIIIII")
+HDR_V2 = struct.Struct("<5sB2xIIQIIIIIIII")
+HDR_V3 = struct.Struct("<5sB2xIIIQIIIIIIQQQQII")
+RANGE_V12 = struct.Struct("<IIIIII")
+RANGE_V3 = struct.Struct("<IIIIII")
+CHUNK = struct.Struct("<IIQIIII")
+FOOTER = struct.Struct("<5s3x32s")
+
+
+class K2BakError(Exception):
+    pass
+
+
+class Chunk:
+    def __init__(self, lba_start, lba_count, data_off, data_len, crc32, flags):
+        self.lba_start = lba_start
+        self.lba_count = lba_count
+        self.data_off = data_off
+        self.data_len = data_len
+        self.crc32 = crc32
+        self.flags = flags
+
+    def kind(self) -> str:
+        if self.flags & RANGE_FILL_FF:
+            return "fill-ff"
+        if self.flags & RANGE_FILL_00:
+            return "fill-00"
+        if self.flags & RANGE_COMPRESSED:
+            return "lz4"
+        return "raw"
+
+
+def lz4_block_decompress(src: bytes, raw_len: int) -> bytes:
+    out = bytearray()
+    ip, n = 0, len(src)
+    while ip < n:
+        token = src[ip]
+        ip += 1
+        lit = token >> 4
+        if lit == 15:
+            while True:
+                if ip >= n:
+                    raise K2BakError("lz4: truncated literal length")
+                b = src[ip]
+                ip += 1
+                lit += b
+                if b != 255:
+                    break
+        if ip + lit > n:
+            raise K2BakError("lz4: literals past end")
+        out += src[ip:ip + lit]
+        ip += lit
+        if ip == n:
+            break
+        if ip + 2 > n:
+            raise K2BakError("lz4: truncated offset")
+        offset = src[ip] | (src[ip + 1] << 8)
+        ip += 2
+        if offset == 0 or offset > len(out):
+            raise K2BakError("lz4: bad match offset")
+        ml = token & 15
+        if ml == 15:
+            while True:
+                if ip >= n:
+                    raise K2BakError("lz4: truncated match length")
+                b = src[ip]
+                ip += 1
+                ml += b
+                if b != 255:
+                    break
+        ml += 4
+        start = len(out) - offset
+        if offset >= ml:
+            out += out[start:start + ml]
+        else:
+            for i in range(ml):
+                out.append(out[start + i])
+        if len(out) > raw_len:
+            break
+    if len(out) != raw_len:
+        raise K2BakError("lz4: frame expands to %d bytes, expected %d" % (len(out), raw_len))
+    return bytes(out)
+
+
+class Backup:
+    def __init__(self, data: bytes):
+        self.data = data
+        self.ranges: list[tuple[int, int]] = []
+        self.chunks: list[Chunk] = []
+        self.board_id = ""
+        self.profile_id = ""
+        self.env = ""
+        self.timestamp = 0
+        if data[:8] == MAGIC_V1:
+            self.version = 1
+            self._parse_v1()
+        elif data[:5] == MAGIC5 and len(data) > 5:
+            self.version = data[5]
+            if self.version == 2:
+                self._parse_v2()
+            elif self.version == 3:
+                self._parse_v3()
+            else:
+                raise K2BakError("unsupported .k2bak version %d" % self.version)
+        else:
+            raise K2BakError("not a .k2bak file")
+
+    # ---- headers ----
+    def _text(self, off: int, n: int) -> tuple[str, int]:
+        if off + n > len(self.data):
+            raise K2BakError("string field out of bounds")
+        return self.data[off:off + n].decode("utf-8", "replace"), off + n
+
+    def _entries(self, off: int, count: int) -> None:
+        end = off + count * RANGE_V12.size
+        if end > len(self.data):
+            raise K2BakError("range table out of bounds")
+        for lba, cnt, doff, dlen, crc, flags in RANGE_V12.iter_unpack(self.data[off:end]):
+            self.ranges.append((lba, cnt))
+            if dlen or flags & (RANGE_FILL_00 | RANGE_FILL_FF):
+                self.chunks.append(Chunk(lba, cnt, doff, dlen, crc, flags))
+
+    def _parse_v1(self) -> None:
+        (_, _, hsize, _, bid_len, env_len, count, table_off, _, self.file_crc) = HDR_V1.unpack_from(self.data)
+        if hsize != HDR_V1.size:
+            raise K2BakError("header size mismatch")
+        self.board_id, off = self._text(HDR_V1.size, bid_len)
+        self.env, _ = self._text(off, env_len)
+        self._entries(table_off, count)
+        self.crc_off, self.sha_off = 40, None
+
+    def _parse_v2(self) -> None:
+        (_, _, hsize, _, self.timestamp, bid_len, pid_len, env_len, count,
+         table_off, _, self.footer_off, self.file_crc) = HDR_V2.unpack_from(self.data)
+        if hsize != HDR_V2.size:
+            raise K2BakError("header size mismatch")
+        self.board_id, off = self._text(HDR_V2.size, bid_len)
+        self.profile_id, off = self._text(off, pid_len)
+        self.env, _ = self._text(off, env_len)
+        self._entries(table_off, count)
+        self.crc_off, self.sha_off = 52, self.footer_off + 8
+
+    def _parse_v3(self) -> None:
+        (_, _, hsize, _, _, self.timestamp, bid_len, pid_len, env_len, range_count,
+         chunk_count, _, _, range_off, chunk_off, self.footer_off,
+         self.file_crc, _) = HDR_V3.unpack_from(self.data)
+        if hsize != HDR_V3.size:
+            raise K2BakError("header size mismatch")
+        if self.footer_off + FOOTER.size != len(self.data):
+            raise K2BakError("footer not at end of file")
+        self.board_id, off = self._text(HDR_V3.size, bid_len)
+        self.profile_id, off = self._text(off, pid_len)
+        self.env, _ = self._text(off, env_len)
+        for lba, cnt, _, _, _, _ in RANGE_V3.iter_unpack(self.data[range_off:range_off + range_count * RANGE_V3.size]):
+            self.ranges.append((lba, cnt))
+        for entry in CHUNK.iter_unpack(self.data[chunk_off:chunk_off + chunk_count * CHUNK.size]):
+            lba, cnt, doff, dlen, crc, flags, _ = entry
+            self.chunks.append(Chunk(lba, cnt, doff, dlen, crc, flags))
+        if len(self.ranges) != range_count or len(self.chunks) != chunk_count:
+            raise K2BakError("tables out of bounds")
+        self.crc_off, self.sha_off = 84, self.footer_off + 8
+
+    # ---- payload ----
+    def frames(self, c: Chunk):
+        """Yields the raw content of a chunk in pieces."""
+        total = c.lba_count * 512
+        if c.flags & (RANGE_FILL_00 | RANGE_FILL_FF):
+            fill = b"\xff" if c.flags & RANGE_FILL_FF else b"\x00"
+            for pos in range(0, total, FRAME_BYTES):
+                yield fill * min(FRAME_BYTES, total - pos)
+            return
+        if c.data_off + c.data_len > len(self.data):
+            raise K2BakError("chunk payload out of bounds")
+        if not c.flags & RANGE_COMPRESSED:
+            yield self.data[c.data_off:c.data_off + c.data_len]
+            return
+        pos, end, raw = c.data_off, c.data_off + c.data_len, 0
+        while raw < total:
+            if pos + 4 > end:
+                raise K2BakError("compressed chunk truncated")
+            (hdr,) = struct.unpack_from("<I", self.data, pos)
+            pos += 4
+            body_len = hdr & FRAME_LEN_MASK
+            if pos + body_len > end:
+                raise K2BakError("compressed chunk truncated")
+            raw_len = min(FRAME_BYTES, total - raw)
+            body = self.data[pos:pos + body_len]
+            if hdr & FRAME_STORED:
+                if body_len != raw_len:
+                    raise K2BakError("stored frame length mismatch")
+                yield body
+            else:
+                yield lz4_block_decompress(body, raw_len)
+            pos += body_len
+            raw += raw_len
+        if pos != end:
+            raise K2BakError("trailing bytes in compressed chunk")
+
+    def verify(self) -> list[str]:
+        problems = []
+        z = bytearray(self.data)
+        z[self.crc_off:self.crc_off + 4] = b"\0" * 4
+        if self.sha_off is not None:
+            footer_magic, sha = FOOTER.unpack_from(self.data, self.footer_off)
+            if footer_magic != END_MAGIC:
+                problems.append("bad footer magic")
+            z[self.sha_off:self.sha_off + 32] = b"\0" * 32
+            if hashlib.sha256(z).digest() != sha:
+                problems.append("file SHA-256 mismatch")
+        if zlib.crc32(z) != self.file_crc:
+            problems.append("file CRC32 mismatch")
+        for i, c in enumerate(self.chunks):
+            if c.flags & (RANGE_FILL_00 | RANGE_FILL_FF):
+                continue
+            crc = 0
+            try:
+                for piece in self.frames(c):
+                    crc = zlib.crc32(piece, crc)
+            except K2BakError as e:
+                problems.append("chunk %d: %s" % (i, e))
+                continue
+            if crc != c.crc32:
+                problems.append("chunk %d (lba 0x%x): CRC mismatch" % (i, c.lba_start))
+        return problems
+
+
+def cmd_info(b: Backup) -> int:
+    print("version    %d" % b.version)
+    print("board_id   %s" % b.board_id)
+    print("profile_id %s" % b.profile_id)
+    print("timestamp  %d" % b.timestamp)
+    print("env        %d bytes" % len(b.env))
+    for lba, cnt in b.ranges:
+        print("range      lba 0x%08x +0x%x (%d KiB)" % (lba, cnt, cnt // 2))
+    raw = sum(c.lba_count * 512 for c in b.chunks if c.data_len)
+    stored = sum(c.data_len for c in b.chunks)
+    kinds: dict[str, int] = {}
+    for c in b.chunks:
+        kinds[c.kind()] = kinds.get(c.kind(), 0) + 1
+    print("chunks     %d (%s)" % (len(b.chunks), ", ".join("%s %d" % kv for kv in sorted(kinds.items()))))
+    print("payload    %d -> %d bytes" % (raw, stored))
+    return 0
+
+
+def cmd_verify(b: Backup) -> int:
+    problems = b.verify()
+    for p in problems:
+        print("FAIL: " + p)
+    if not problems:
+        print("OK")
+    return 1 if problems else 0
+
+
+def cmd_extract(b: Backup, out_path: str, base_lba: int) -> int:
+    with open(out_path, "wb") as f:
+        end = 0
+        for c in b.chunks:
+            if c.lba_start < base_lba:
+                raise SystemExit("chunk at lba 0x%x is below --base-lba" % c.lba_start)
+            off = (c.lba_start - base_lba) * 512
+            end = max(end, off + c.lba_count * 512)
+            if c.flags & RANGE_FILL_00:
+                continue
+            f.seek(off)
+            for piece in b.frames(c):
+                f.write(piece)
+        f.truncate(end)
+    print("Wrote %s (%d bytes)" % (out_path, end))
+    return 0
+
+
+def main() -> int:
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("command", choices=("info", "verify", "extract"))
+    ap.add_argument("backup", help=".k2bak file")
+    ap.add_argument("output", nargs="?", help="Output image (extract)")
+    ap.add_argument("--base-lba", type=lambda s: int(s, 0), default=0, help="LBA written at offset 0 (extract)")
+    args = ap.parse_args()
+
+    with open(args.backup, "rb") as f:
+        data = f.read()
+    try:
+        b = Backup(data)
+        if args.command == "info":
+            return cmd_info(b)
+        if args.command == "verify":
+            return cmd_verify(b)
+        if not args.output:
+            raise SystemExit("extract needs an output path")
+        return cmd_extract(b, args.output, args.base_lba)
+    except K2BakError as e:
+        print("error: %s" % e, file=sys.stderr)
+        return 1
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
@@ -24,6 +24,7 @@ from __future__ import annotations
 import argparse
 import os
 import struct
+import zlib
 
 MAGIC = b"K2UPD1\0\0"
 
@@ -64,8 +65,9 @@ def main() -> int:
         f.write(fs)
 
     print(f"Wrote {out_path}")
-    print(f"  firmware: {len(fw)} bytes")
-    print(f"  littlefs: {len(fs)} bytes")
+    # the device logs the same CRC32 per image after flashing it
+    print(f"  firmware: {len(fw)} bytes, crc32={zlib.crc32(fw):08x}")
+    print(f"  littlefs: {len(fs)} bytes, crc32={zlib.crc32(fs):08x}")
     print("Upload this file from the OTA page as update.zip")
     return 0
 